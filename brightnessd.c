@@ -20,21 +20,63 @@
  *
  */
 
+#define _GNU_SOURCE // accept4(), dl_iterate_phdr()
+#define _DEFAULT_SOURCE // syscall(), MAP_POPULATE
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
+#include <math.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <linux/netlink.h>
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#endif
+#elif defined(USE_IO_URING)
+#error "USE_IO_URING requires USE_SYSFS_BACKLIGHT_CONTROL"
+#endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+#define HAVE_SPAWN_CLOSEFROM 1 // posix_spawn_file_actions_addclosefrom_np()
+#endif
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2) // <linux/close_range.h>, Linux 5.11
+#endif
+#ifdef ALLOC_AUDIT
+#include <link.h>
+#include <stdatomic.h>
+#endif
 #include <xcb/xcb.h>
 #include <xcb/xcb_event.h>
 #include <xcb/screensaver.h>
 #include <xcb/dpms.h>
 #include <xcb/randr.h>
+#include <xcb/sync.h>
+#include <xcb/present.h>
+#include "brightnessd_status.h"
 
 
 #ifdef DEBUGLOG
@@ -67,7 +109,15 @@
 } while (0)
 
 
-#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+#ifdef ALLOC_AUDIT
+    #define ALLOC_AUDIT_STATE(STATE) do { gs_allocaudit.state = (STATE); } while (0)
+    #define ALLOC_AUDIT_CHECKPOINT() alloc_audit_checkpoint()
+#else
+    #define ALLOC_AUDIT_STATE(STATE) do {} while (0)
+    #define ALLOC_AUDIT_CHECKPOINT() do {} while (0)
+#endif
+
+
 #define CC_IGNORE_WARNING_CAST_ALIGN                     \
     _Pragma("clang diagnostic push"                    ) \
     _Pragma("clang diagnostic ignored \"-Wcast-align\"") \
@@ -77,18 +127,83 @@
 #define CC_RESTORE_WARNINGS          \
     _Pragma("clang diagnostic push") \
     _Pragma("GCC diagnostic push"  )
-#endif
 
 
 #define NO_BRIGHTNESS -1
 #define BRN_PRIORSCRSVR_UNDEFINED 0xff
 #define RET_OK 0
+#define MAX_OUTPUTS 8
+#define MAX_PROBED_OUTPUTS 32
+#define EDID_BLOCK_LENGTH 128
+#define STATE_CACHE_MAGIC UINT32_C(0x62726e64)
+#define STATE_CACHE_VERSION 2
+#define STATE_CACHE_PANELS 16
+#define GAMMA_LEVEL_MAX 1000
+#define GAMMA_VECTOR_LANES 8
+#define FADE_MS_ADAPTIVE 800
+#define FADE_STEP_MS 20
+#define TIMER_SLACK_NS (FADE_STEP_MS * 1000000UL / 4)
+#define ADAPTIVE_BUCKETS 128
+#define ADAPTIVE_BUCKET_SECONDS 2
+#define ADAPTIVE_CANCEL_WINDOW 10
+#define ADAPTIVE_CANCEL_TARGET_PERCENT 20
+#define ADAPTIVE_MIN_SAMPLES 8
+#define ADAPTIVE_DECAY_SAMPLES 1024
+#define MAX_STAGES 8
+#define MAX_SUBSCRIBERS 8
+#define STATUS_LINE_MAX 256
+#define LISTEN_FDS_START 3
+#define METRICS_STATES (STATE_UNKNOWN + 1)
+#define METRICS_LATENCY_BUCKETS 11
+#define METRICS_TEXT_MAX 8192
+#define METRICS_INTERVAL_MS 1000
+#define CONFIRM_TIMEOUT_MS 250
+#define CONFIRM_TOLERANCE_PERCENT 2
+#define CONFIRM_ATTEMPTS 3
+#define RESTORE_TARGET_US 1000
+#define PLAN_MAX_ENTRIES MAX_OUTPUTS
+#define NSEC_PER_SEC 1000000000L
+#define RECONNECT_BACKOFF_MIN_MS 50
+#define RECONNECT_BACKOFF_MAX_MS 2000
+#define UEVENT_BUFFER_SIZE 8192
+#ifndef POWER_SUPPLY_PATH
+#define POWER_SUPPLY_PATH "/sys/class/power_supply/"
+#endif
+#define MAX_ADAPTERS 8
+#define ADAPTER_NAME_MAX 32
+#define MAX_HOOKS 4
+#define HOOK_SHELL "/bin/sh"
+#define MAX_LEDS 3
+#define LED_NAME_MAX 64
+#ifndef LEDS_PATH
+#define LEDS_PATH "/sys/class/leds/"
+#endif
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+#define WORKER_MAILBOX_EMPTY 0
+#define WORKER_MAILBOX_FULL  (UINT64_C(1) << 32)
+#define URING_MAX_FILES (1 + MAX_LEDS)
+#define URING_READ 0x100
+#define LOGIND_MAX_INFLIGHT 2
+#define LOGIND_MESSAGE_MAX 768
+#define LOGIND_RECEIVE_MAX 4096
+#define LOGIND_SERIAL_HELLO 1
+#define LOGIND_AUTH_TIMEOUT_MS 500
+#ifndef LOGIND_BUS_PATH
+#define LOGIND_BUS_PATH "/run/dbus/system_bus_socket"
+#endif
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // configuration
 ///////////////////////////////////////////////////////////////////////////////
 static uint8_t DIM_PERCENT_INTERVAL = 20;
 static uint8_t DIM_PERCENT_TIMEOUT = 40;
+static bool    FULLSCREEN_INHIBIT  = true;
+static bool    GAMMA_DIMMING       = false;
+static uint8_t ADAPTIVE_DELAY_MAX  = 0;
+static uint16_t FADE_MS            = 0;
+static uint16_t RECONNECT_S        = 60;
+static uint16_t HOOK_TIMEOUT_MS    = 5000;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -106,6 +221,9 @@ typedef enum {
     STATE_UNKNOWN,
 } state_t;
 
+// the status page publishes state_t as is
+_Static_assert((int)BRIGHTNESSD_STATE_UNKNOWN == (int)STATE_UNKNOWN, "status page states differ from state_t");
+
 static struct Tcolor {
     char* yellow;
     char* red;
@@ -144,13 +262,279 @@ static struct Teventstate {
     uint8_t  brn_old_perc;
     uint8_t  brn_priorscrsvr_perc;
     bool     brn_interval_set;
+    uint8_t  scrsvr_state;
 } gs_eventstate = {
     .brn_cur_perc         = 0,
     .brn_old_perc         = 0,
     .brn_priorscrsvr_perc = BRN_PRIORSCRSVR_UNDEFINED,
     .brn_interval_set     = false,
+    .scrsvr_state         = XCB_SCREENSAVER_STATE_OFF,
+};
+
+// what woke up the event loop from poll(), a timeout being a fade step or a confirmation deadline
+typedef enum {
+    WAKEUP_X,
+    WAKEUP_TIMER,
+    WAKEUP_WORKER,
+    WAKEUP_UEVENT,
+    WAKEUP_HOOK,
+    WAKEUP_SOCKET,
+    WAKEUP_SIGNAL,
+    WAKEUP_TIMEOUT,
+    WAKEUP_SOURCE_COUNT
+} wakeup_source_t;
+
+static struct Tstats {
+    uint64_t wakeups;
+    uint64_t wakeups_by_source[WAKEUP_SOURCE_COUNT];
+    uint64_t events_received;
+    uint64_t events_screensaver;
+    uint64_t bursts;
+    uint64_t transitions_handled;
+    uint64_t transitions_elided;
+    uint64_t events_dpms;
+    uint64_t backend_ops_suppressed;
+    uint64_t plan_restores;
+    uint64_t dims_inhibited;
+    uint64_t reconnects;
+    uint64_t reconnect_attempts;
+    uint64_t reconnect_topology_reused;
+    uint64_t recovery_us_last;
+    uint64_t recovery_us_max;
+} gs_stats;
+
+// upper bounds of the restore latency histogram's buckets in microseconds
+static const uint32_t gs_metrics_latency_bounds_us[METRICS_LATENCY_BUCKETS] = {
+    250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000
+};
+
+// a device's last brightness write until the device reports it, see confirm_expect()
+struct Tconfirmdevice {
+    uint64_t   issued_us;
+    uint64_t   completed_us;
+    uint64_t   deadline_us;
+    uint64_t   latency_us_sum;
+    uint64_t   latency_us_max;
+    uint64_t   confirmed;
+    uint64_t   reissued;
+    uint64_t   failed;
+    uint32_t   output;
+    xcb_atom_t backlight_atom;
+    int32_t    target_abs;
+    int32_t    from_abs;
+    uint16_t   sequence;
+    uint8_t    attempts;
+    bool       pending;
+    bool       completed;
+    char       _padding[3];
+};
+
+static struct Tconfirm {
+    struct Tconfirmdevice devices[MAX_OUTPUTS];
+    uint8_t               num_devices;
+    uint8_t               num_pending;
+    char                  _padding[6];
+} gs_confirm;
+
+// counters exported in the Prometheus text format, see metrics_write()
+static struct Tmetrics {
+    const char *path;
+    uint64_t    transitions[METRICS_STATES];
+    uint64_t    transition_round_trips[METRICS_STATES];
+    uint64_t    transition_writes[METRICS_STATES];
+    uint64_t    round_trips;
+    uint64_t    writes;
+    uint64_t    backend_errors;
+    uint64_t    restore_started_us;
+    uint64_t    restore_latency_us_sum;
+    uint64_t    restore_latency[METRICS_LATENCY_BUCKETS + 1];
+    uint64_t    restores;
+    uint64_t    issue_latency[METRICS_LATENCY_BUCKETS + 1];
+    uint64_t    issue_latency_us_sum;
+    uint64_t    issue_latency_us_max;
+    uint64_t    issues_over_target;
+    uint64_t    restores_fast;
+    uint64_t    written;
+    uint64_t    write_errors;
+    uint64_t    written_at_ms;
+    bool        dirty;
+    char        _padding[7];
+} gs_metrics;
+
+static struct Tinhibit {
+    xcb_atom_t   net_active_window_atom;
+    xcb_atom_t   net_wm_state_atom;
+    xcb_atom_t   net_wm_state_fullscreen_atom;
+    xcb_window_t active_window;
+    bool         fullscreen;
+    char         _padding[3];
+} gs_inhibit;
+
+struct Tplanentry {
+    struct Tpanelstate *ppanel;
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    xcb_randr_output_t  output;
+    xcb_atom_t          backlight_atom;
+#endif
+    int32_t             value_abs;
+    char                _padding[4];
+};
+
+// absolute per-output brightness values to write back in one batch when undimming
+static struct Tplan {
+    struct Tplanentry entries[PLAN_MAX_ENTRIES];
+    uint8_t           num_entries;
+    bool              valid;
+    bool              deferred;
+    bool              pending;
+    char              _padding[4];
+} gs_restoreplan;
+
+// dimming schedule of --stage SECONDS:PERCENT, replacing the timeout and
+// cycle stages; each stage's per-output targets are computed on the ON event
+struct Tstage {
+    uint16_t seconds;
+    uint8_t  perc;
+    char     _padding[1];
+};
+
+static struct Tstages {
+    struct Tstage stages[MAX_STAGES];
+    struct Tplan  plans[MAX_STAGES];
+    uint64_t      started_at_ms;
+    uint8_t       num_stages;
+    uint8_t       next;
+    char          _padding[6];
+} gs_stages;
+
+// dim levels per power source by --battery-brightness TIMEOUT:INTERVAL, the
+// kernel's power_supply uevents tell when a mains adapter comes and goes;
+// the machine is on ac while any of the adapters known by name is online
+typedef enum {
+    POWER_SOURCE_AC,
+    POWER_SOURCE_BATTERY,
+    POWER_SOURCE_COUNT
+} power_source_t;
+
+static struct Tpower {
+    uint64_t uevents;
+    uint64_t switches;
+    char     adapters[MAX_ADAPTERS][ADAPTER_NAME_MAX];
+    bool     online[MAX_ADAPTERS];
+    uint8_t  num_adapters;
+    uint8_t  percent_timeout[POWER_SOURCE_COUNT];
+    uint8_t  percent_interval[POWER_SOURCE_COUNT];
+    uint8_t  source;
+    bool     enabled;
+    char     _padding[1];
+} gs_power;
+
+// commands run by --hook STATE:COMMAND when a transition enters STATE, each
+// spawned after the transition's brightness writes are flushed, and reaped by
+// its pidfd in the event loop, so a slow hook never holds up the next event
+typedef enum {
+    HOOK_TIMEOUT,
+    HOOK_INTERVAL,
+    HOOK_OFF,
+    HOOK_EVENT_COUNT
+} hook_event_t;
+
+static const uint8_t gs_hook_states[HOOK_EVENT_COUNT] = {
+    [HOOK_TIMEOUT]  = STATE_SCREENSAVER_ON_TIMEOUT,
+    [HOOK_INTERVAL] = STATE_SCREENSAVER_ON_INTERVAL,
+    [HOOK_OFF]      = STATE_SCREENSAVER_OFF,
+};
+
+struct Thookprocess {
+    uint64_t deadline_ms;
+    pid_t    pid;
+    uint8_t  event;
+    bool     killed;
+    char     _padding[2];
+};
+
+static struct Thooks {
+    char               *commands[HOOK_EVENT_COUNT];
+    struct Thookprocess running[MAX_HOOKS];
+    uint64_t            spawned;
+    uint64_t            exited;
+    uint64_t            failed;
+    uint64_t            killed;
+    uint64_t            dropped;
+    uint64_t            spawn_us_max;
+    uint8_t             queue[MAX_HOOKS];
+    uint8_t             num_queued;
+    uint8_t             num_running;
+    bool                enabled;
+    char                _padding[1];
+} gs_hooks;
+
+// LED class devices, e.g., keyboard backlights, dimmed by --led NAME:TIMEOUT:INTERVAL
+// along with the screen: the event loop commits them in the same pass as the
+// screen's writes, by the same io_uring or writer thread if there is one, and
+// restores each to the brightness it had before; that one is read by the
+// writer as well, taken by the event loop in a later pass
+typedef enum {
+    LED_READ_IDLE,
+    LED_READ_PENDING,
+    LED_READ_FAILED
+} led_read_t;
+
+struct Tledpolicy {
+    char    *name;
+    uint8_t  percent_timeout;
+    uint8_t  percent_interval;
+    char     _padding[6];
+};
+
+struct Tled {
+    char     name[LED_NAME_MAX];
+    int      fd;
+    int32_t  max_abs;
+    int32_t  cur_abs;
+    int32_t  restore_abs;
+    int32_t  from_abs;
+    uint8_t  percent_timeout;
+    uint8_t  percent_interval;
+    uint8_t  file;
+    uint8_t  read;
 };
 
+static struct Tleds {
+    uint64_t          fade_started_at_ms;
+    uint64_t          dims;
+    uint64_t          restores;
+    uint64_t          writes;
+    struct Tledpolicy policies[MAX_LEDS];
+    struct Tled       leds[MAX_LEDS];
+    uint8_t           num_policies;
+    uint8_t           num_leds;
+    char              _padding[6];
+} gs_leds;
+
+// idle detection by --idle-alarms TIMEOUT:INTERVAL, replacing the screensaver
+// notifications by SYNC alarms on the server's IDLETIME counter: the idle time
+// rising across TIMEOUT and TIMEOUT+INTERVAL stands for the ON and cycle
+// notifications, falling back below TIMEOUT on user input for OFF
+typedef enum {
+    IDLE_ALARM_RESET,
+    IDLE_ALARM_TIMEOUT,
+    IDLE_ALARM_INTERVAL,
+    IDLE_ALARM_COUNT
+} idle_alarm_t;
+
+static struct Tidle {
+    xcb_sync_alarm_t   alarms[IDLE_ALARM_COUNT];
+    xcb_sync_counter_t counter;
+    uint32_t           idle_ms;
+    uint16_t           timeout;
+    uint16_t           interval;
+    uint8_t            first_event;
+    uint8_t            fired;
+    bool               enabled;
+    char               _padding[1];
+} gs_idle;
+
 static struct Txcb {
     xcb_connection_t        *connection;
     xcb_screen_t            *screen;
@@ -162,7 +546,10 @@ static struct Txcb {
     int                      screen_nr;
     xcb_intern_atom_reply_t *screensaver_id_atom;
     uint8_t                  screensaver_id;
-    char                     _padding[7];
+    uint8_t                  randr_first_event;
+    uint8_t                  dpms_opcode;
+    bool                     dpms_events;
+    xcb_atom_t               edid_atom;
 } gs_xcb = {
     .connection            = NULL,
     .screen                = NULL,
@@ -171,9 +558,406 @@ static struct Txcb {
     .pixmap                = 0,
     .screensaver_id_atom   = NULL,
     .screensaver_id        = 0,
+    .randr_first_event     = 0,
+    .dpms_opcode           = 0,
+    .dpms_events           = false,
     .backlight_atom        = 0,
     .backlight_new_atom    = 0,
-    .backlight_legacy_atom = 0
+    .backlight_legacy_atom = 0,
+    .edid_atom             = XCB_ATOM_NONE
+};
+
+// file descriptors the event loop waits on, unused ones are set to -1
+typedef enum {
+    POLL_SOURCE_X,
+    POLL_SOURCE_WORKER,
+    POLL_SOURCE_LEDS,
+    POLL_SOURCE_TIMER,
+    POLL_SOURCE_UEVENT,
+    POLL_SOURCE_SIGNAL,
+    POLL_SOURCE_HOOKS,
+    POLL_SOURCE_SUBSCRIBE = POLL_SOURCE_HOOKS + MAX_HOOKS,
+    POLL_SOURCE_SUBSCRIBERS,
+    POLL_SOURCE_COUNT = POLL_SOURCE_SUBSCRIBERS + MAX_SUBSCRIBERS
+} poll_source_t;
+
+static struct pollfd gs_pollfds[POLL_SOURCE_COUNT];
+
+// what is pushed to subscribers, compared as a whole to detect changes
+struct Tstatus {
+    int32_t brn_abs[MAX_OUTPUTS];
+    uint8_t brn_perc[MAX_OUTPUTS];
+    uint8_t state;
+    uint8_t brn_cur_perc;
+    uint8_t num_outputs;
+    bool    dimmed;
+};
+
+// a subscriber's unsent rest of a status line; while a line is pending, a
+// newer status merely marks the subscriber dirty, i.e., slow readers get
+// the latest status once they catch up instead of every intermediate one
+struct Tsubscriber {
+    char     pending[STATUS_LINE_MAX];
+    uint16_t pending_offset;
+    uint16_t pending_length;
+    bool     dirty;
+    char     _padding[3];
+};
+
+// the shared-memory status page, see brightnessd_status.h
+static struct brightnessd_status *gs_statuspage;
+_Static_assert(BRIGHTNESSD_STATUS_OUTPUTS == MAX_OUTPUTS, "status page outputs differ from MAX_OUTPUTS");
+
+static struct Tsubscription {
+    struct Tsubscriber subscribers[MAX_SUBSCRIBERS];
+    uint64_t           pushed;
+    uint64_t           coalesced;
+    struct Tstatus     status;
+    struct sockaddr_un address;
+    uint8_t            num_subscribers;
+    bool               valid;
+    bool               created;
+    char               _padding[3];
+} gs_subscription;
+
+// the dimming timer either delays the timeout stage's dimming or fires the
+// next stage of a dimming schedule, it is never periodic; a fade is paced by
+// the event loop's poll() timeout, or by Present, and merely marked as the
+// timer's action, so that disarming the timer cancels it all the same
+typedef enum {
+    TIMER_IDLE,
+    TIMER_DIM_DELAY,
+    TIMER_FADE,
+    TIMER_STAGE
+} timer_action_t;
+
+static struct Ttimer {
+    int            fd;
+    timer_action_t action;
+} gs_timer = {
+    .fd     = -1,
+    .action = TIMER_IDLE,
+};
+
+// a fade steps the brightness along (step/steps)^exponent, once its first
+// step is written the levels are the ones written and are not read back
+static struct Tfade {
+    uint64_t started_at_ms;
+    double   exponent;
+    uint16_t step;
+    uint16_t steps;
+    uint8_t  from_perc;
+    uint8_t  to_perc;
+    bool     written;
+    char     _padding[1];
+} gs_fade;
+
+// with the Present extension, a fade is paced by the refresh of the crtc the
+// first output is shown on instead of by the timer: every MSC notification
+// on a window placed there writes the step due at that time, so there is at
+// most one write per refresh, and none while the previous one is unconfirmed
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static struct Tpresent {
+    uint64_t            frames;
+    uint64_t            frames_written;
+    uint64_t            frames_busy;
+    xcb_window_t        window;
+    xcb_present_event_t eid;
+    xcb_randr_output_t  placed_output;
+    uint32_t            serial;
+    uint8_t             opcode;
+    bool                enabled;
+    bool                pending;
+    bool                pacing;
+    char                _padding[4];
+} gs_present;
+#endif
+
+// a lost X server is reconnected to by the event loop, whose poll() timeout
+// paces the attempts with an exponential backoff, so that signals, the
+// socket, hooks and the backlight writer are still served in the meantime
+static struct Treconnect {
+    uint64_t   lost_at_us;
+    uint64_t   next_at_us;
+    uint32_t   backoff_ms;
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    xcb_atom_t backlight_new_atom;
+    xcb_atom_t backlight_legacy_atom;
+    #endif
+    bool       active;
+    char       _padding[3];
+} gs_reconnect;
+
+// online histogram of the time from the timeout stage until the user returns,
+// halved every ADAPTIVE_DECAY_SAMPLES samples so that it follows the user
+static struct Tadaptive {
+    uint32_t returns[ADAPTIVE_BUCKETS];
+    uint32_t samples;
+    uint32_t delay_s;
+    double   curve;
+    double   cancel_probability;
+    uint64_t timeout_at_ms;
+    uint64_t dimmed_at_ms;
+    uint64_t decisions;
+    uint64_t dims_avoided;
+    uint64_t dims_cancelled;
+    uint64_t dims_stuck;
+    bool     timeout_seen;
+    bool     dimmed;
+    char     _padding[6];
+} gs_adaptive = {
+    .curve = 1.0,
+};
+
+// backlight writer thread: the event loop posts the latest target into a
+// single-slot mailbox, the worker reports completed writes via eventfd; each
+// LED has a mailbox of its own, and a bit in led_reading asking for its value
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static struct Tworker {
+    pthread_t        thread;
+    _Atomic uint64_t mailbox;
+    _Atomic uint64_t led_mailboxes[MAX_LEDS];
+    _Atomic uint64_t led_errors;
+    _Atomic int32_t  led_values[MAX_LEDS];
+    _Atomic uint32_t led_reading;
+    _Atomic uint64_t written;
+    _Atomic uint64_t errors;
+    _Atomic uint64_t latency_ns_total;
+    _Atomic uint64_t latency_ns_max;
+    uint64_t         submitted;
+    uint64_t         superseded;
+    uint64_t         errors_reported;
+    uint64_t         depth_max;
+    uint64_t         led_errors_reported;
+    _Atomic int      last_errno;
+    int              wakeup_fd;
+    int              completion_fd;
+    int              brightness_fd;
+    int              led_fds[MAX_LEDS];
+    int32_t          last_target;
+    _Atomic bool     stop;
+    bool             running;
+    uint8_t          num_leds;
+    char             _padding[5];
+} gs_worker = {
+    .mailbox       = WORKER_MAILBOX_EMPTY,
+    .running       = false,
+    .wakeup_fd     = -1,
+    .completion_fd = -1,
+    .brightness_fd = -1,
+};
+#endif
+
+// what is known about a panel across restarts, keyed by a hash of its EDID
+// (xrandr) or of its backlight directory (sysfs); key 0 marks a free slot
+struct Tpanelstate {
+    uint64_t key;
+    int32_t  brn_min_abs;
+    int32_t  brn_max_abs;
+    int32_t  brn_restore_abs;
+    int32_t  gamma_level;
+    bool     legacy_atom;
+    bool     gamma;
+    char     _padding[6];
+};
+
+// layout of the memory-mapped state file
+struct Tstatefile {
+    uint32_t           magic;
+    uint32_t           version;
+    uint32_t           next_slot;
+    uint32_t           _reserved;
+    struct Tpanelstate panels[STATE_CACHE_PANELS];
+};
+
+static struct Tstatefile *gs_statefile = NULL;
+
+// outputs with a usable backlight property, probed once and kept until the
+// randr configuration changes; outputs dimmed by their crtc's gamma ramps
+// instead have no backlight atom but the original ramps followed by a
+// scratch buffer of the same size for the scaled ramps
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+struct Toutput {
+    xcb_randr_output_t  output;
+    xcb_atom_t          backlight_atom;
+    int32_t             brn_min_abs;
+    int32_t             brn_max_abs;
+    struct Tpanelstate *ppanel;
+    xcb_randr_crtc_t    crtc;
+    int32_t             gamma_level;
+    uint16_t           *gamma_ramps;
+    uint16_t           *gamma_scratch;
+    int32_t             brn_cur_abs;
+    uint16_t            gamma_size;
+    char                _padding[2];
+};
+
+// the gamma ramps are scaled in chunks of GAMMA_VECTOR_LANES entries
+typedef uint16_t Tramp16 __attribute__((vector_size(GAMMA_VECTOR_LANES * sizeof(uint16_t))));
+typedef uint32_t Tramp32 __attribute__((vector_size(GAMMA_VECTOR_LANES * sizeof(uint32_t))));
+
+static struct Toutputs {
+    struct Toutput outputs[MAX_OUTPUTS];
+    uint8_t        num_outputs;
+    bool           valid;
+    char           _padding[6];
+} gs_outputs;
+#endif
+
+// how brightness values reach the sysfs file, see --writer: submitted to an
+// io_uring and reaped by the event loop, handed to the writer thread,
+// written by the event loop itself, or passed to logind, which needs no
+// write access to the file
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+typedef enum {
+    WRITER_SYNC,
+    WRITER_THREAD,
+    WRITER_URING,
+    WRITER_LOGIND
+} writer_t;
+
+#ifdef USE_IO_URING
+static writer_t SYSFS_WRITER = WRITER_URING;
+#else
+static writer_t SYSFS_WRITER = WRITER_THREAD;
+#endif
+#endif
+
+// one persistent system bus connection calling logind's Session.SetBrightness
+// without waiting for the replies: up to LOGIND_MAX_INFLIGHT calls are in
+// flight, a value written meanwhile is kept and superseded by later ones until
+// a reply makes room, or the socket takes more, so a fade does not queue up
+// calls; the call is built once, only its serial and value are filled in per
+// write; a lost connection is made again by the event loop, see logind_lost()
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static struct Tlogind {
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t superseded;
+    uint64_t errors;
+    uint64_t reconnects;
+    uint64_t latency_ns_total;
+    uint64_t latency_ns_max;
+    uint64_t issued_ns[LOGIND_MAX_INFLIGHT];
+    uint32_t serials[LOGIND_MAX_INFLIGHT];
+    size_t   message_length;
+    size_t   value_offset;
+    size_t   received;
+    size_t   discard;
+    uint32_t serial;
+    int      fd;
+    int32_t  pending;
+    int32_t  last_target;
+    uint8_t  head;
+    uint8_t  inflight;
+    bool     running;
+    bool     lost;
+    char     _padding[4];
+    char     message[LOGIND_MESSAGE_MAX];
+    char     receive[LOGIND_RECEIVE_MAX];
+} gs_logind = {
+    .fd          = -1,
+    .pending     = NO_BRIGHTNESS,
+    .last_target = NO_BRIGHTNESS,
+};
+#endif
+
+// io_uring of registered files, one write in flight per file: a value
+// written while the previous one is in flight is kept until its completion
+// and superseded by later ones, as with the writer thread's mailbox; the
+// LEDs' reads are told apart by URING_READ in their user_data
+#ifdef USE_IO_URING
+static struct Turing {
+    uint64_t             submitted;
+    uint64_t             completed;
+    uint64_t             enters;
+    uint64_t             superseded;
+    uint64_t             errors;
+    uint64_t             latency_ns_total;
+    uint64_t             latency_ns_max;
+    uint64_t             issued_ns[URING_MAX_FILES];
+    char                 values[URING_MAX_FILES][16];
+    char                 reads[URING_MAX_FILES][16];
+    int32_t              pending[URING_MAX_FILES];
+    int32_t              read_abs[URING_MAX_FILES];
+    int32_t              last_target[URING_MAX_FILES];
+    void                *sq_ring;
+    void                *cq_ring;
+    struct io_uring_sqe *sqes;
+    uint32_t            *sq_head;
+    uint32_t            *sq_tail;
+    uint32_t            *sq_mask;
+    uint32_t            *sq_array;
+    uint32_t            *cq_head;
+    uint32_t            *cq_tail;
+    uint32_t            *cq_mask;
+    struct io_uring_cqe *cqes;
+    size_t               sq_ring_size;
+    size_t               cq_ring_size;
+    size_t               sqes_size;
+    int                  fd;
+    int                  event_fd;
+    int                  last_errno;
+    uint32_t             queued;
+    bool                 inflight[URING_MAX_FILES];
+    bool                 reading[URING_MAX_FILES];
+    uint8_t              num_files;
+    bool                 running;
+    char                 _padding[6];
+} gs_uring = {
+    .fd       = -1,
+    .event_fd = -1,
+};
+#endif
+
+// the brightness file is kept open, the maximal brightness is read only once
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static struct Tsysfs {
+    int                 brightness_fd;
+    int32_t             brn_max_abs;
+    struct Tpanelstate *ppanel;
+    int32_t             brn_cur_abs;
+    int                 actual_brightness_fd;
+} gs_sysfs = {
+    .brightness_fd = -1,
+    .actual_brightness_fd = -1,
+    .brn_max_abs   = NO_BRIGHTNESS,
+    .ppanel        = NULL,
+    .brn_cur_abs   = NO_BRIGHTNESS,
+};
+#endif
+
+// allocation accounting of the audit build, allocations are attributed to
+// libxcb by the return address of the allocator call
+#ifdef ALLOC_AUDIT
+#define ALLOC_AUDIT_MAX_RANGES 16
+static struct Tallocaudit {
+    uintptr_t        xcb_start[ALLOC_AUDIT_MAX_RANGES];
+    uintptr_t        xcb_end[ALLOC_AUDIT_MAX_RANGES];
+    _Atomic uint64_t allocs;
+    _Atomic uint64_t allocs_xcb;
+    uint64_t         allocs_last;
+    uint64_t         allocs_xcb_last;
+    uint64_t         iterations;
+    uint64_t         iterations_allocating;
+    uint64_t         max_per_iteration;
+    uint64_t         own_warmup;
+    uint32_t         warm;
+    uint8_t          num_ranges;
+    uint8_t          state;
+    char             _padding[2];
+} gs_allocaudit;
+#endif
+
+// what a drained burst of events boils down to
+struct Tburst {
+    uint32_t screensaver_events;
+    uint8_t  net_state;
+    bool     saw_off;
+    bool     active_window_changed;
+    bool     wm_state_changed;
+    bool     present_complete;
+    char     _padding[3];
 };
 
 typedef enum {
@@ -185,7 +969,8 @@ typedef enum {
 
 typedef enum {
     OPERATION_SHUTDOWN_CONN,
-    OPERATION_SHUTDOWN_DEREGEVENT
+    OPERATION_SHUTDOWN_DEREGEVENT,
+    OPERATION_SHUTDOWN_GAMMA
 } setup_operations_t;
 
 
@@ -193,25 +978,179 @@ typedef enum {
 // forward declarations
 ///////////////////////////////////////////////////////////////////////////////
 static void print_usage(void);
-static void signal_handler(const int sig) __attribute__((noreturn));
+static void signal_handler(const int sig);
+static void print_stats(void);
+#ifdef ALLOC_AUDIT
+static bool alloc_audit_is_xcb(const uintptr_t address);
+static int alloc_audit_phdr_callback(struct dl_phdr_info *info, size_t size, void *data);
+static void alloc_audit_init(void);
+static void alloc_audit_checkpoint(void);
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+#endif
+#ifdef FAKE_X
+int fakex_start(void); // fakex.c
+int fakex_uevents(void); // fakex.c
+void fakex_stop(void); // fakex.c
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+int fakex_bus(void); // fakex.c
+#endif
+#endif
 static inline bool operation_handler(const operations_t operation, struct Txcb *pxcb, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc) __attribute__((always_inline));
-void shutdown(const setup_operations_t operation);
+void shutdown_operation(const setup_operations_t operation);
 bool query_state(struct Tglobalstate *state, const struct Txcb *pxcb);
 bool query_state_screensaver(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb);
 bool query_state_dpms(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb);
-static int parse_uint8_t(char* input, uint8_t* output);
+bool query_state_idle(struct Tglobalstate *pglobalstate, const struct Tidle *pidle);
+static bool idle_alarms_init(const struct Txcb *pxcb, struct Tidle *pidle);
+static xcb_void_cookie_t idle_alarm_create(const struct Txcb *pxcb, struct Tidle *pidle, const idle_alarm_t alarm, const uint32_t value_ms, const uint32_t test_type);
+bool query_active_window(struct Tinhibit *pinhibit, const struct Txcb *pxcb);
+bool query_fullscreen(struct Tinhibit *pinhibit, const struct Txcb *pxcb);
+static int parse_uint(char* input, const uint16_t min, const uint16_t max, uint16_t* output);
+static uint64_t monotonic_ms(void);
+static void timer_arm(const timer_action_t action, const uint32_t delay_ms, const uint32_t interval_ms);
+static void timer_disarm(void);
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static bool present_init(const struct Txcb *pxcb, struct Tpresent *ppresent);
+static bool present_place(const struct Txcb *pxcb, struct Tpresent *ppresent);
+static void present_request(const struct Txcb *pxcb, struct Tpresent *ppresent);
+#endif
+static uint8_t dim_to(struct Txcb *pxcb, struct Teventstate *peventstate, const uint8_t brn_target_perc);
+static void adaptive_decide(void);
+static void adaptive_record_return(void);
+static int parse_stage(char* input, struct Tstages *pstages);
+static int parse_idle_alarms(char* input, struct Tidle *pidle);
+static int parse_battery_brightness(char* input, struct Tpower *ppower);
+static int parse_hook(char* input, struct Thooks *phooks);
+static int parse_led(char* input, struct Tleds *pleds);
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static int parse_writer(char* input, writer_t *pwriter);
+#endif
+static bool plan_capture(struct Txcb *pxcb, struct Tplan *pplan);
+static void plan_scale(const struct Tplan *pprior, const uint8_t brn_percent, struct Tplan *pplan);
+static const char *state_name(const uint8_t state);
+static bool subscription_open(void);
+static void subscription_close(void);
+static void subscription_remove(const uint8_t s);
+static void subscription_send(const uint8_t s);
+static int subscription_format(char *line, const size_t size);
+static void subscription_publish(const struct Tglobalstate *pglobalstate, const struct Teventstate *peventstate);
+static void _event_loop_subscription(void);
+static void _event_loop_signal(void);
+static bool status_page_open(void);
+static void status_page_publish(const struct Tstatus *pstatus);
+static bool power_open(struct Tpower *ppower);
+#ifndef FAKE_X
+static bool power_read(const char *path, char *value, const size_t size);
+static int power_scan(struct Tpower *ppower);
+#endif
+static bool power_adapter(struct Tpower *ppower, const char *name, const int online);
+static void power_apply(struct Tpower *ppower, const uint8_t source);
+static void power_uevent(struct Tpower *ppower, const char *message, const size_t length);
+static void power_receive(struct Tpower *ppower);
+static uint8_t _event_loop_power(struct Txcb *pxcb, struct Teventstate *peventstate);
+#ifndef HAVE_SPAWN_CLOSEFROM
+static void fds_cloexec(void);
+#endif
+static bool hooks_open(struct Thooks *phooks);
+static void hook_queue(struct Thooks *phooks, const uint8_t state);
+static void hooks_spawn(struct Thooks *phooks, const uint8_t brn_cur_perc);
+static void hooks_reap(struct Thooks *phooks);
+static int hook_timeout_ms(const struct Thooks *phooks);
+static void hooks_kill(void);
+static uint8_t leds_open(struct Tleds *pleds);
+static void led_write(struct Tleds *pleds, struct Tled *pled, const int32_t value_abs);
+static int32_t led_read(struct Tleds *pleds, struct Tled *pled);
+static void leds_commit(struct Tleds *pleds, const uint8_t state, const bool dimmed, const uint8_t brn_cur_perc);
+static void leds_restore(void);
+static int listen_fds(void);
+static void notify_ready(void);
+static uint64_t monotonic_us(void);
+static void metrics_transition(const uint8_t state, const uint64_t round_trips, const uint64_t writes);
+static void metrics_restore_done(void);
+static void metrics_restore_issued(const uint64_t received_us);
+static void metrics_write(void);
+static int metrics_timeout_ms(void);
+static struct Tconfirmdevice *confirm_device(const uint32_t output, const xcb_atom_t backlight_atom);
+static void confirm_expect(const uint32_t output, const xcb_atom_t backlight_atom, const int32_t target_abs, const unsigned int sequence);
+static void confirm_done(struct Tconfirmdevice *pdevice, const uint64_t done_us);
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static bool confirm_reached(const struct Tconfirmdevice *pdevice, const int32_t actual_abs);
+#endif
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static void confirm_echo(const uint32_t output, const xcb_atom_t backlight_atom, const uint16_t sequence);
+static void confirm_error(const xcb_generic_error_t *error);
+#endif
+static void confirm_check(const struct Txcb *pxcb);
+static int confirm_timeout_ms(void);
+static int fade_timeout_ms(void);
+static inline void restore_plan_record(struct Tplan *pplan, const struct Tplanentry *pentry) __attribute__((always_inline));
+static inline void restore_plan_reset(struct Tplan *pplan) __attribute__((always_inline));
+static bool apply_plan(const struct Txcb *pxcb, const struct Tplan *pplan);
+static uint64_t fnv1a_64(const uint8_t *data, const size_t length);
+static bool state_cache_open(void);
+static struct Tpanelstate *state_cache_panel(const uint64_t key);
+static void state_cache_clear_restore(const struct Tplan *pplan);
+static void state_cache_restore(struct Txcb *pxcb);
 static int parse_args(int len, char** args);
+static uint8_t setup_connection(struct Tglobalstate *pglobalstate, struct Txcb *pxcb);
+static void disconnect(struct Txcb *pxcb);
+static bool reconnect_start(struct Txcb *pxcb);
+static int reconnect_timeout_ms(void);
+static uint8_t reconnect(struct Tglobalstate *pglobalstate, struct Txcb *pxcb, struct Teventstate *peventstate);
 #ifndef USE_SYSFS_BACKLIGHT_CONTROL
 bool _operation_handler_randr(const operations_t operation, struct Txcb *pxcb, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc);
 int32_t _get_brightness_randr(struct Txcb *pxcb, const xcb_randr_output_t output, const xcb_atom_t *backlight_atom);
 int32_t get_brightness_randr(struct Txcb *pxcb, const xcb_randr_output_t output);
 int8_t set_brightness_randr(const struct Txcb *pxcb, xcb_randr_output_t output, int32_t value);
+bool query_outputs(struct Txcb *pxcb, struct Toutputs *poutputs);
+static struct Tpanelstate *query_panel(const struct Txcb *pxcb, const xcb_randr_get_output_property_cookie_t edid_cookie);
+static bool query_gamma(const struct Txcb *pxcb, const xcb_randr_output_t output, struct Toutput *poutput, struct Toutputs *pprevious);
+static void gamma_scale(uint16_t *restrict scaled, const uint16_t *restrict ramps, const size_t length, const uint32_t factor);
+static void gamma_apply(const struct Txcb *pxcb, struct Toutput *poutput, const int32_t level);
+static struct Toutput *find_output(const xcb_randr_output_t output);
+static bool outputs_unchanged(const struct Txcb *pxcb, const xcb_atom_t backlight_new_atom, const xcb_atom_t backlight_legacy_atom);
 #endif
+int32_t get_brightness_file(const int fd);
+int8_t set_brightness_file(const int fd, const int32_t value_abs);
 #ifdef USE_SYSFS_BACKLIGHT_CONTROL
 bool _operation_handler_file(const operations_t operation, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc);
-int32_t get_brightness_file(const char* filename);
-int8_t set_brightness_file(const char* filename, const int32_t value_abs);
 static inline bool is_file_accessible(const char* filename, const int mode) __attribute__((always_inline));
+bool backlight_worker_start(struct Tworker *pworker, const int fd);
+void backlight_worker_submit(struct Tworker *pworker, const int32_t value_abs);
+void backlight_worker_complete(struct Tworker *pworker);
+static void backlight_worker_led(struct Tworker *pworker, const uint8_t led, const int32_t value_abs);
+static void backlight_worker_led_read(struct Tworker *pworker, const uint8_t led);
+static inline uint64_t backlight_worker_outstanding(const struct Tworker *pworker) __attribute__((always_inline));
+static void backlight_worker_stop(void);
+static int8_t backlight_write(const int32_t value_abs);
+static void backlight_flush(void);
+static bool backlight_lagging(void);
+static int32_t backlight_current(void);
+#endif
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static size_t dbus_pad(char *buffer, size_t offset, const size_t alignment);
+static size_t dbus_put_string(char *buffer, size_t offset, const char *value);
+static size_t dbus_put_field(char *buffer, size_t offset, const uint8_t code, const char type, const char *value);
+static size_t dbus_call(char *buffer, const uint32_t serial, const char *destination, const char *path, const char *interface, const char *member, const char *signature);
+static bool logind_start(struct Tlogind *plogind);
+static void logind_send(struct Tlogind *plogind, const int32_t value_abs);
+static void logind_write(struct Tlogind *plogind, const int32_t value_abs);
+static void logind_reply(struct Tlogind *plogind, const char *message, const size_t length);
+static void logind_complete(struct Tlogind *plogind);
+static void logind_lost(struct Tlogind *plogind);
+static bool logind_reconnect(struct Tlogind *plogind);
+static void logind_stop(void);
+#endif
+#ifdef USE_IO_URING
+static bool uring_start(struct Turing *puring, const int *fds, const uint8_t num_files);
+static void uring_write(struct Turing *puring, const uint8_t file, const int32_t value_abs);
+static void uring_read(struct Turing *puring, const uint8_t file);
+static void uring_submit(struct Turing *puring);
+static void uring_complete(struct Turing *puring);
+static void uring_stop(void);
+static void uring_fallback(void);
 #endif
 
 
@@ -238,7 +1177,7 @@ static inline bool is_file_accessible(const char* filename, const int mode) {
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// shutdown()
+// shutdown_operation()
 ///////////////////////////////////////////////////////////////////////////////
 /** Perform cleanup and shutdown operations.
 
@@ -246,18 +1185,26 @@ static inline bool is_file_accessible(const char* filename, const int mode) {
 
     @see setup_operations_t
 */
-void shutdown(const setup_operations_t operation) {
+void shutdown_operation(const setup_operations_t operation) {
     switch(operation) {
         case OPERATION_SHUTDOWN_CONN:
+            if (!gs_xcb.connection) {
+                return;
+            }
             if (xcb_connection_has_error(gs_xcb.connection) > 0) {
                 ERROR("Error: xcb connection error while releasing xcb connection\n");
                 return;
             }
             DEBUG("[shutdown] releasing xcb connection\n");
-            (void)xcb_screensaver_unset_attributes(gs_xcb.connection, gs_xcb.screen->root);
             if (gs_xcb.pixmap != 0) {
+                (void)xcb_screensaver_unset_attributes(gs_xcb.connection, gs_xcb.screen->root);
                 (void)xcb_free_pixmap(gs_xcb.connection, gs_xcb.pixmap);
             }
+            for (uint8_t a = 0; a < IDLE_ALARM_COUNT; a++) {
+                if (gs_idle.alarms[a] != 0) {
+                    (void)xcb_sync_destroy_alarm(gs_xcb.connection, gs_idle.alarms[a]);
+                }
+            }
             if (gs_xcb.screensaver_id_atom) {
                 xcb_delete_property(gs_xcb.connection, gs_xcb.screen->root, gs_xcb.screensaver_id_atom->atom);
                 free(gs_xcb.screensaver_id_atom);
@@ -268,6 +1215,9 @@ void shutdown(const setup_operations_t operation) {
             (void)unsetenv("XSCREENSAVER_WINDOW");
             return;
         case OPERATION_SHUTDOWN_DEREGEVENT:
+            if (!gs_xcb.connection) {
+                return;
+            }
             if (xcb_connection_has_error(gs_xcb.connection) > 0) {
                 ERROR("Error: xcb connection error while de-registering from screensaver events\n");
                 return;
@@ -275,11 +1225,35 @@ void shutdown(const setup_operations_t operation) {
             DEBUG("[shutdown] unsubscribing from screensaver events\n");
             (void)xcb_screensaver_select_input(gs_xcb.connection, gs_xcb.screen->root, 0);
             return;
+        case OPERATION_SHUTDOWN_GAMMA:
+            #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+            if (!gs_xcb.connection) {
+                return;
+            }
+            if (xcb_connection_has_error(gs_xcb.connection) > 0) {
+                ERROR("Error: xcb connection error while restoring gamma ramps\n");
+                return;
+            }
+            DEBUG("[shutdown] restoring original gamma ramps\n");
+            for (uint8_t o = 0; o < gs_outputs.num_outputs; o++) {
+                const struct Toutput *poutput = &gs_outputs.outputs[o];
+                if (poutput->gamma_ramps && poutput->gamma_level != GAMMA_LEVEL_MAX) {
+                    (void)xcb_randr_set_crtc_gamma(gs_xcb.connection, poutput->crtc, poutput->gamma_size,
+                        poutput->gamma_ramps, poutput->gamma_ramps + poutput->gamma_size, poutput->gamma_ramps + 2 * poutput->gamma_size);
+                    if (poutput->ppanel) { poutput->ppanel->gamma_level = GAMMA_LEVEL_MAX; }
+                }
+            }
+            (void)xcb_flush(gs_xcb.connection);
+            #endif
+            return;
     }
 }
-// callables for atexit() registration wrapping shutdown() with the appropriate operation arguments
-static void shutdown_connection()        { shutdown(OPERATION_SHUTDOWN_CONN);       }
-static void shutdown_deregister_events() { shutdown(OPERATION_SHUTDOWN_DEREGEVENT); }
+// callables for atexit() registration wrapping shutdown_operation() with the appropriate operation arguments
+static void shutdown_connection()        { shutdown_operation(OPERATION_SHUTDOWN_CONN);       }
+static void shutdown_deregister_events() { shutdown_operation(OPERATION_SHUTDOWN_DEREGEVENT); }
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static void shutdown_restore_gamma()     { shutdown_operation(OPERATION_SHUTDOWN_GAMMA);      }
+#endif
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -299,6 +1273,7 @@ bool query_state_screensaver(struct Tglobalstate *pglobalstate, const struct Txc
     xcb_screensaver_query_info_reply_t  *screensaver_query_info_reply;
     screensaver_query_info_cookie = xcb_screensaver_query_info(pxcb->connection, pxcb->screen->root);
     screensaver_query_info_reply  = xcb_screensaver_query_info_reply(pxcb->connection, screensaver_query_info_cookie, NULL);
+    gs_metrics.round_trips++;
     if (!screensaver_query_info_reply) { return false; }
 
     pglobalstate->screensaver_idlesecuser   = screensaver_query_info_reply->ms_since_user_input / 1000;
@@ -312,6 +1287,7 @@ bool query_state_screensaver(struct Tglobalstate *pglobalstate, const struct Txc
     xcb_get_screen_saver_cookie_t    get_screen_saver_cookie;
     get_screen_saver_cookie = xcb_get_screen_saver(pxcb->connection);
     get_screensaver_reply   = xcb_get_screen_saver_reply(pxcb->connection, get_screen_saver_cookie, NULL);
+    gs_metrics.round_trips++;
     if (!get_screensaver_reply) { return false; }
 
     pglobalstate->screensaver_timeout         = get_screensaver_reply->timeout;
@@ -340,6 +1316,140 @@ bool query_state_screensaver(struct Tglobalstate *pglobalstate, const struct Txc
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// query_state_idle()
+///////////////////////////////////////////////////////////////////////////////
+/** Derive the screensaver state from the last idle alarm.
+
+    The alarm's idle time tells the cycle stage from the timeout stage just
+    like the screensaver's idle time does, but without a round trip.
+
+    @param pglobalstate     state container struct
+    @param pidle            idle alarms container struct
+    @return                 true
+
+    @see Tglobalstate
+    @see Tidle
+    @see query_state_screensaver
+*/
+bool query_state_idle(struct Tglobalstate *pglobalstate, const struct Tidle *pidle) {
+    pglobalstate->screensaver_state       = pidle->fired == IDLE_ALARM_RESET ? XCB_SCREENSAVER_STATE_OFF : XCB_SCREENSAVER_STATE_ON;
+    pglobalstate->screensaver_idlesecuser = pidle->fired == IDLE_ALARM_TIMEOUT ? pidle->timeout : pidle->idle_ms / 1000;
+    pglobalstate->screensaver_timeout     = pidle->timeout;
+    pglobalstate->screensaver_interval    = pidle->interval;
+    pglobalstate->screensaver_blanking    = 1;
+
+    TRACE("[query_state] idle   :: timeout=%us interval=%us idlems=%u alarm=%u\n",
+        pidle->timeout,
+        pidle->interval,
+        pidle->idle_ms,
+        pidle->fired
+    );
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// idle_alarm_create()
+///////////////////////////////////////////////////////////////////////////////
+/** Create an alarm on the IDLETIME counter reporting each trigger by an event.
+
+    Transition tests stay armed after triggering, i.e., the alarm fires
+    again the next time the idle time crosses the value.
+
+    @param pxcb             xcb container struct
+    @param pidle            idle alarms container struct
+    @param alarm            which of the idle alarms to create
+    @param value_ms         the idle time to compare with
+    @param test_type        XCB_SYNC_TESTTYPE_POSITIVE_TRANSITION or XCB_SYNC_TESTTYPE_NEGATIVE_TRANSITION
+    @return                 the cookie to check the creation with
+
+    @see idle_alarms_init
+*/
+static xcb_void_cookie_t idle_alarm_create(const struct Txcb *pxcb, struct Tidle *pidle, const idle_alarm_t alarm, const uint32_t value_ms, const uint32_t test_type) {
+    // counter, value type, value (hi, lo), test type, delta (hi, lo), events
+    const uint32_t values[] = { pidle->counter, XCB_SYNC_VALUETYPE_ABSOLUTE, 0, value_ms, test_type, 0, 0, 1 };
+    pidle->alarms[alarm] = xcb_generate_id(pxcb->connection);
+    return xcb_sync_create_alarm_checked(pxcb->connection, pidle->alarms[alarm],
+        XCB_SYNC_CA_COUNTER | XCB_SYNC_CA_VALUE_TYPE | XCB_SYNC_CA_VALUE | XCB_SYNC_CA_TEST_TYPE | XCB_SYNC_CA_DELTA | XCB_SYNC_CA_EVENTS,
+        values
+    );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// idle_alarms_init()
+///////////////////////////////////////////////////////////////////////////////
+/** Arm the idle alarms on the SYNC extension's IDLETIME system counter.
+
+    The server wakes up the event loop exactly when the idle time crosses a
+    threshold, there is no polling and no need to own the screensaver, so
+    other screensavers and lockers keep working alongside.
+
+    @param pxcb             xcb container struct
+    @param pidle            idle alarms container struct
+    @return                 true if all alarms are armed, false otherwise
+
+    @see Tidle
+    @see idle_alarm_create
+*/
+static bool idle_alarms_init(const struct Txcb *pxcb, struct Tidle *pidle) {
+    const xcb_query_extension_reply_t *query_ext_reply = xcb_get_extension_data(pxcb->connection, &xcb_sync_id);
+    if (!query_ext_reply || query_ext_reply->present == 0) {
+        ERROR("Error: cannot query sync extension\n");
+        return false;
+    }
+    pidle->first_event = query_ext_reply->first_event;
+
+    xcb_sync_initialize_cookie_t            initialize_cookie = xcb_sync_initialize(pxcb->connection, 3, 1);
+    xcb_sync_list_system_counters_cookie_t  counters_cookie   = xcb_sync_list_system_counters(pxcb->connection);
+    xcb_sync_initialize_reply_t            *initialize_reply  = xcb_sync_initialize_reply(pxcb->connection, initialize_cookie, NULL);
+    xcb_sync_list_system_counters_reply_t  *counters_reply    = xcb_sync_list_system_counters_reply(pxcb->connection, counters_cookie, NULL);
+    gs_metrics.round_trips++;
+    if (!initialize_reply || !counters_reply) {
+        free(initialize_reply);
+        free(counters_reply);
+        ERROR("Error: cannot list sync system counters\n");
+        return false;
+    }
+    TRACE("[idle] sync version %u.%u\n", initialize_reply->major_version, initialize_reply->minor_version);
+    free(initialize_reply);
+    xcb_sync_systemcounter_iterator_t counter_iterator = xcb_sync_list_system_counters_counters_iterator(counters_reply);
+    for (; counter_iterator.rem; xcb_sync_systemcounter_next(&counter_iterator)) {
+        if (counter_iterator.data->name_len == strlen("IDLETIME") &&
+            memcmp(xcb_sync_systemcounter_name(counter_iterator.data), "IDLETIME", strlen("IDLETIME")) == 0) {
+            pidle->counter = counter_iterator.data->counter;
+        }
+    }
+    free(counters_reply);
+    if (pidle->counter == 0) {
+        ERROR("Error: the X server has no IDLETIME counter\n");
+        return false;
+    }
+
+    const uint32_t timeout_ms = pidle->timeout * 1000U;
+    xcb_void_cookie_t cookies[IDLE_ALARM_COUNT];
+    uint8_t num_cookies = 0;
+    cookies[num_cookies++] = idle_alarm_create(pxcb, pidle, IDLE_ALARM_TIMEOUT, timeout_ms, XCB_SYNC_TESTTYPE_POSITIVE_TRANSITION);
+    cookies[num_cookies++] = idle_alarm_create(pxcb, pidle, IDLE_ALARM_RESET, timeout_ms, XCB_SYNC_TESTTYPE_NEGATIVE_TRANSITION);
+    // the dimming schedule does without cycle events
+    if (pidle->interval > 0 && gs_stages.num_stages == 0) {
+        cookies[num_cookies++] = idle_alarm_create(pxcb, pidle, IDLE_ALARM_INTERVAL, timeout_ms + pidle->interval * 1000U, XCB_SYNC_TESTTYPE_POSITIVE_TRANSITION);
+    }
+    bool armed = true;
+    for (uint8_t c = 0; c < num_cookies; c++) {
+        xcb_generic_error_t *error = xcb_request_check(pxcb->connection, cookies[c]);
+        if (error) {
+            ERROR("Error: cannot create idle alarm (error %d)\n", error->error_code);
+            free(error);
+            armed = false;
+        }
+    }
+    DEBUG("[idle] armed %u alarms on counter 0x%x at %us idle\n", num_cookies, pidle->counter, pidle->timeout);
+    return armed;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // query_state_dpms()
 ///////////////////////////////////////////////////////////////////////////////
@@ -359,6 +1469,7 @@ bool query_state_dpms(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb
 
     dpms_get_timeouts_cookie = xcb_dpms_get_timeouts_unchecked(pxcb->connection);
     dpms_get_timeouts_reply  = xcb_dpms_get_timeouts_reply(pxcb->connection, dpms_get_timeouts_cookie, &error);
+    gs_metrics.round_trips++;
     if (!dpms_get_timeouts_reply) { return false; }
 
     pglobalstate->dpms_standby_timeout = dpms_get_timeouts_reply->standby_timeout;
@@ -370,6 +1481,7 @@ bool query_state_dpms(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb
     xcb_dpms_info_reply_t  *dpms_info_reply;
     dpms_info_cookie = xcb_dpms_info(pxcb->connection);
     dpms_info_reply  = xcb_dpms_info_reply(pxcb->connection, dpms_info_cookie, &error);
+    gs_metrics.round_trips++;
     if (!dpms_info_reply) { return false; }
 
     pglobalstate->dpms_state       = dpms_info_reply->state;
@@ -401,6 +1513,10 @@ bool query_state_dpms(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb
 ///////////////////////////////////////////////////////////////////////////////
 /** Aggregate the current screensaver and dpms state.
 
+    If the server supports DPMS 1.2, the dpms power level is tracked by
+    DPMS Info events instead of being queried here. With idle alarms, the
+    screensaver state is derived from the last alarm instead.
+
     @param pglobalstate     state container struct
     @param pxcb             xcb container struct
     @return                 true on successful query aggregation, false otherwise
@@ -409,6 +1525,7 @@ bool query_state_dpms(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb
     @see Txcb
     @see query_state_dpms
     @see query_state_screensaver
+    @see query_state_idle
 */
 bool query_state(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb) {
     if (xcb_connection_has_error(pxcb->connection) > 0) {
@@ -416,8 +1533,8 @@ bool query_state(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb) {
         return false;
     }
 
-    if (!query_state_dpms(pglobalstate, pxcb)       ) { return false; }
-    if (!query_state_screensaver(pglobalstate, pxcb)) { return false; }
+    if (!pxcb->dpms_events && !query_state_dpms(pglobalstate, pxcb)) { return false; }
+    if (gs_idle.enabled ? !query_state_idle(pglobalstate, &gs_idle) : !query_state_screensaver(pglobalstate, pxcb)) { return false; }
 
     #define SET_STATE(STATE)                             \
         do {                                             \
@@ -461,6 +1578,100 @@ bool query_state(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb) {
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// query_active_window()
+///////////////////////////////////////////////////////////////////////////////
+/** Query the window manager's active window and follow its property changes.
+
+    The previously active window is no longer listened to, the newly active
+    one is selected for PropertyNotify events so that `_NET_WM_STATE` changes
+    arrive as events rather than having to be queried.
+
+    @param pinhibit         fullscreen inhibit container struct
+    @param pxcb             xcb container struct
+    @return                 true if the active window changed, false otherwise
+
+    @see Tinhibit
+    @see query_fullscreen
+*/
+bool query_active_window(struct Tinhibit *pinhibit, const struct Txcb *pxcb) {
+    xcb_get_property_cookie_t  property_cookie;
+    xcb_get_property_reply_t  *property_reply;
+    xcb_window_t               active_window = XCB_WINDOW_NONE;
+
+    property_cookie = xcb_get_property(pxcb->connection, 0, pxcb->screen->root, pinhibit->net_active_window_atom, XCB_ATOM_WINDOW, 0, 1);
+    property_reply  = xcb_get_property_reply(pxcb->connection, property_cookie, NULL);
+    gs_metrics.round_trips++;
+    if (property_reply) {
+        if (property_reply->type == XCB_ATOM_WINDOW && property_reply->format == 32 && xcb_get_property_value_length(property_reply) == sizeof(xcb_window_t)) {
+            CC_IGNORE_WARNING_CAST_ALIGN
+            active_window = *((xcb_window_t *) xcb_get_property_value(property_reply));
+            CC_RESTORE_WARNINGS
+        }
+        free(property_reply);
+    }
+    if (active_window == pinhibit->active_window) {
+        return false;
+    }
+
+    // the windows may be gone already, errors are dropped by the event loop
+    const uint32_t no_events[]       = { XCB_EVENT_MASK_NO_EVENT };
+    const uint32_t property_events[] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
+    if (pinhibit->active_window != XCB_WINDOW_NONE) {
+        (void)xcb_change_window_attributes(pxcb->connection, pinhibit->active_window, XCB_CW_EVENT_MASK, no_events);
+    }
+    if (active_window != XCB_WINDOW_NONE) {
+        (void)xcb_change_window_attributes(pxcb->connection, active_window, XCB_CW_EVENT_MASK, property_events);
+    }
+    TRACE("[query_active_window] active window 0x%x -> 0x%x\n", pinhibit->active_window, active_window);
+    pinhibit->active_window = active_window;
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// query_fullscreen()
+///////////////////////////////////////////////////////////////////////////////
+/** Query whether the active window is in fullscreen state.
+
+    @param pinhibit         fullscreen inhibit container struct
+    @param pxcb             xcb container struct
+    @return                 true if the fullscreen state changed, false otherwise
+
+    @see Tinhibit
+    @see query_active_window
+*/
+bool query_fullscreen(struct Tinhibit *pinhibit, const struct Txcb *pxcb) {
+    xcb_get_property_cookie_t  property_cookie;
+    xcb_get_property_reply_t  *property_reply;
+    bool                       fullscreen = false;
+
+    if (pinhibit->active_window != XCB_WINDOW_NONE) {
+        property_cookie = xcb_get_property(pxcb->connection, 0, pinhibit->active_window, pinhibit->net_wm_state_atom, XCB_ATOM_ATOM, 0, 32);
+        property_reply  = xcb_get_property_reply(pxcb->connection, property_cookie, NULL);
+        gs_metrics.round_trips++;
+        if (property_reply) {
+            if (property_reply->type == XCB_ATOM_ATOM && property_reply->format == 32) {
+                CC_IGNORE_WARNING_CAST_ALIGN
+                const xcb_atom_t *states = (const xcb_atom_t *) xcb_get_property_value(property_reply);
+                CC_RESTORE_WARNINGS
+                int num_states = xcb_get_property_value_length(property_reply) / (int)sizeof(xcb_atom_t);
+                for (int i = 0; i < num_states; i++) {
+                    fullscreen |= states[i] == pinhibit->net_wm_state_fullscreen_atom;
+                }
+            }
+            free(property_reply);
+        }
+    }
+    if (fullscreen == pinhibit->fullscreen) {
+        return false;
+    }
+    TRACE("[query_fullscreen] window 0x%x fullscreen=%s\n", pinhibit->active_window, fullscreen ? "yes" : "no");
+    pinhibit->fullscreen = fullscreen;
+    return true;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // _get_brightness_randr()
 ///////////////////////////////////////////////////////////////////////////////
@@ -485,6 +1696,7 @@ int32_t _get_brightness_randr(struct Txcb *pxcb, const xcb_randr_output_t output
     if (pxcb->backlight_atom != XCB_ATOM_NONE) {
         output_poperty_cookie = xcb_randr_get_output_property(pxcb->connection, output, pxcb->backlight_atom, XCB_ATOM_NONE, 0, 4, 0, 0);
         output_poperty_reply  = xcb_randr_get_output_property_reply(pxcb->connection, output_poperty_cookie, &error);
+        gs_metrics.round_trips++;
         if (error != NULL || output_poperty_reply == NULL) {
             TRACE("[get_brightness_randr] error %u while querying brightness of output %d on backlight %d\n", error->error_code, output, pxcb->backlight_atom);
             return NO_BRIGHTNESS;
@@ -535,25 +1747,32 @@ int32_t get_brightness_randr(struct Txcb *pxcb, const xcb_randr_output_t output)
 ///////////////////////////////////////////////////////////////////////////////
 /** Set the brightness of a given output to a device-specific absolute value.
 
+    The write is not checked by a round trip, but confirmed once the server
+    echoes the property change; an X error for the request comes in as an
+    event and fails the confirmation, see `confirm_expect()`.
+
     @param pxcb             xcb container struct
     @param output           the output to set the brightness for
     @param value_abs        the *absolute* brightness value in the output's device-specific range
-    @return                 RET_OK, or NO_BRIGHTNESS on error
+    @return                 RET_OK, or NO_BRIGHTNESS if the request could not be sent
 
     @see Txcb
     @see NO_BRIGHTNESS
     @see RET_OK
+    @see confirm_echo
+    @see confirm_error
 */
 #ifndef USE_SYSFS_BACKLIGHT_CONTROL
 int8_t set_brightness_randr(const struct Txcb *pxcb, const xcb_randr_output_t output, int32_t value_abs) {
-    xcb_void_cookie_t    xcb_void_cookie;
-    xcb_generic_error_t *xcb_generic_error;
     TRACE("[set_brightness_randr] setting brightness_abs to %d [output: %d]\n", value_abs, output);
-    xcb_void_cookie = xcb_randr_change_output_property(pxcb->connection, output, pxcb->backlight_atom, XCB_ATOM_INTEGER, 32, XCB_PROP_MODE_REPLACE, 1, (unsigned char *)&value_abs);
-    if ( (xcb_generic_error = xcb_request_check(pxcb->connection, xcb_void_cookie)) ) {
-        ERROR("Error: cannot set brightness. Exiting.\n");
+    xcb_void_cookie_t cookie = xcb_randr_change_output_property(pxcb->connection, output, pxcb->backlight_atom, XCB_ATOM_INTEGER, 32, XCB_PROP_MODE_REPLACE, 1, (unsigned char *)&value_abs);
+    gs_metrics.writes++;
+    if (xcb_connection_has_error(pxcb->connection)) {
+        gs_metrics.backend_errors++;
+        ERROR("Error: cannot set brightness of output %d\n", output);
         return NO_BRIGHTNESS;
     }
+    confirm_expect(output, pxcb->backlight_atom, value_abs, cookie.sequence);
     return RET_OK;
 }
 #endif
@@ -564,31 +1783,32 @@ int8_t set_brightness_randr(const struct Txcb *pxcb, const xcb_randr_output_t ou
 ///////////////////////////////////////////////////////////////////////////////
 /** Get the brightness of an output from a file as device-specific absolute value.
 
-    @param filename         the absolute path to the file the brightness value is read from
+    Reads from the start of an already opened file, i.e., without allocating
+    a stdio stream per reading.
+
+    @param fd               the file descriptor of the file the brightness value is read from
     @return                 the *absolute* brightness value in the output's device-specific range, or NO_BRIGHTNESS on error
 
     @see NO_BRIGHTNESS
 */
-#ifdef USE_SYSFS_BACKLIGHT_CONTROL
-int32_t get_brightness_file(const char* filename) {
-	FILE *file;
-	int32_t brightness;
-	if ((file = fopen(filename, "r"))) {
-		if (EOF == fscanf(file, "%u", &brightness)) {
-            ERROR("Error: cannot read file %s (%s)\n", filename, strerror(errno));
-            return NO_BRIGHTNESS;
-        }
-		if (fclose(file) != 0) {
-            ERROR("Error: cannot close file %s (%s)\n", filename, strerror(errno));
-            return NO_BRIGHTNESS;
-        }
-        TRACE("[get_brightness_file] brightness_abs=%d\n", brightness);
-		return brightness;
-	}
-	ERROR("Error: cannot open file %s for reading (%s)\n", filename, strerror(errno));
-	return NO_BRIGHTNESS;
+int32_t get_brightness_file(const int fd) {
+    char value[16];
+    ssize_t length = pread(fd, value, sizeof(value) - 1, 0);
+    if (length <= 0) {
+        gs_metrics.backend_errors++;
+        ERROR("Error: cannot read brightness file (%s)\n", length < 0 ? strerror(errno) : "empty");
+        return NO_BRIGHTNESS;
+    }
+    value[length] = '\0';
+    char *end = NULL;
+    long brightness = strtol(value, &end, 10);
+    if (end == value || brightness < 0 || brightness > INT32_MAX) {
+        ERROR("Error: cannot parse brightness value %s\n", value);
+        return NO_BRIGHTNESS;
+    }
+    TRACE("[get_brightness_file] brightness_abs=%ld\n", brightness);
+    return (int32_t)brightness;
 }
-#endif
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -596,354 +1816,5803 @@ int32_t get_brightness_file(const char* filename) {
 ///////////////////////////////////////////////////////////////////////////////
 /** Set the brightness of an output by a file to a device-specific absolute value.
 
-    @param filename         the absolute path to the file the brightness value is read from
+    @param fd               the file descriptor of the file the brightness value is written to
     @param value_abs        the *absolute* brightness value in the output's device-specific range
     @return                 RET_OK, or NO_BRIGHTNESS on error
 
     @see NO_BRIGHTNESS
     @see RET_OK
 */
-#ifdef USE_SYSFS_BACKLIGHT_CONTROL
-int8_t set_brightness_file(const char* filename, const int32_t value_abs) {
-	FILE *file;
-	if ((file = fopen(filename, "w"))) {
-        int8_t retcode = RET_OK;
-		if (fprintf(file, "%u", value_abs) < 0) {
-            ERROR("Error: cannot write file %s (%s)\n", filename, strerror(errno));
-            retcode = NO_BRIGHTNESS;
-        }
-		if (fclose(file) != 0) {
-            ERROR("Error: cannot close file %s (%s)\n", filename, strerror(errno));
-            retcode = NO_BRIGHTNESS;
-        }
-        return retcode;
-	}
-	ERROR("Error: cannot open file %s for writing (%s)", filename, strerror(errno));
-    return NO_BRIGHTNESS;
+int8_t set_brightness_file(const int fd, const int32_t value_abs) {
+    char value[16];
+    int length = snprintf(value, sizeof(value), "%d", value_abs);
+    gs_metrics.writes++;
+    if (pwrite(fd, value, (size_t)length, 0) != length) {
+        gs_metrics.backend_errors++;
+        ERROR("Error: cannot write brightness file (%s)\n", strerror(errno));
+        return NO_BRIGHTNESS;
+    }
+    return RET_OK;
 }
-#endif
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// _operation_handler_randr()
+// backlight_worker()
 ///////////////////////////////////////////////////////////////////////////////
-/** Provides set/get/increase/decrease brightness operations using xrandr.
-
-    @param operation        the brightness operation to perform
-    @param pxcb             the global xcb container struct
-    @param brn_percent      brightness percentage to set/increase/decrease depending on `operation`
-    @param brn_cur_perc     the current brightness as percentage
-    @param brn_new_perc     the new brightness as percentage
-    @return                 true if operation could be performed, false on an unrecoverable error
-
-    @see operations_t
-    @see Txcb
-*/
-#ifndef USE_SYSFS_BACKLIGHT_CONTROL
-bool _operation_handler_randr(const operations_t operation, struct Txcb *pxcb, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc) {
-    bool output_found = false;
-    xcb_generic_error_t *error;
-    xcb_randr_output_t  *outputs;
-    xcb_randr_get_screen_resources_reply_t *resources_reply;
-    xcb_randr_get_screen_resources_cookie_t resources_cookie;
-
-    resources_cookie = xcb_randr_get_screen_resources(pxcb->connection, pxcb->screen->root);
-    resources_reply  = xcb_randr_get_screen_resources_reply(pxcb->connection, resources_cookie, &error);
-    if (error != NULL || resources_reply == NULL) {
-        ERROR("Error: randr Get Screen Resources returned error %d\n", error ? error->error_code : -1);
-        return false;
-    }
+/** Thread body writing brightness values posted to the worker's mailbox.
 
-    outputs = xcb_randr_get_screen_resources_outputs(resources_reply);
-    for (uint16_t o = 0; o < resources_reply->num_outputs; o++) {
-        int32_t brn_cur_abs = get_brightness_randr(pxcb, outputs[o]);
-        if (brn_cur_abs != NO_BRIGHTNESS) {
-            output_found = true;
+    Some backlight drivers block in write() while they ramp the PWM, so the
+    writes happen here rather than in the event loop. Only the most recent
+    target is ever written, targets posted meanwhile supersede each other.
+    The same goes for the LEDs, whose values asked for are read after their
+    writes, i.e., a read sees the LED's last value posted before it.
 
-            xcb_randr_query_output_property_cookie_t prop_cookie;
-            xcb_randr_query_output_property_reply_t *prop_reply;
+    @param arg              the worker container struct
+    @return                 always NULL
 
-            prop_cookie = xcb_randr_query_output_property(pxcb->connection, outputs[o], pxcb->backlight_atom);
-            prop_reply  = xcb_randr_query_output_property_reply(pxcb->connection, prop_cookie, &error);
+    @see Tworker
+    @see backlight_worker_submit
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void *backlight_worker(void *arg) {
+    struct Tworker *pworker = arg;
+    uint64_t counter;
+    while (!atomic_load(&pworker->stop)) {
+        if (read(pworker->wakeup_fd, &counter, sizeof(counter)) < 0 && errno != EINTR) {
+            atomic_store(&pworker->last_errno, errno);
+            break;
+        }
+        uint64_t mailbox;
+        while ( (mailbox = atomic_exchange(&pworker->mailbox, WORKER_MAILBOX_EMPTY)) != WORKER_MAILBOX_EMPTY ) {
+            char value[16];
+            struct timespec start, end;
+            int length = snprintf(value, sizeof(value), "%d", (int32_t)(uint32_t)mailbox);
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            if (pwrite(pworker->brightness_fd, value, (size_t)length, 0) != length) {
+                atomic_store(&pworker->last_errno, errno);
+                atomic_fetch_add(&pworker->errors, 1);
+            } else {
+                (void)clock_gettime(CLOCK_MONOTONIC, &end);
+                uint64_t latency_ns = (uint64_t)((end.tv_sec - start.tv_sec) * NSEC_PER_SEC + (end.tv_nsec - start.tv_nsec));
+                atomic_fetch_add(&pworker->latency_ns_total, latency_ns);
+                if (latency_ns > atomic_load(&pworker->latency_ns_max)) {
+                    atomic_store(&pworker->latency_ns_max, latency_ns);
+                }
+                atomic_fetch_add(&pworker->written, 1);
+            }
+            counter = 1;
+            (void)write(pworker->completion_fd, &counter, sizeof(counter));
+        }
+        bool completed = false;
+        for (uint8_t l = 0; l < pworker->num_leds; l++) {
+            if ( (mailbox = atomic_exchange(&pworker->led_mailboxes[l], WORKER_MAILBOX_EMPTY)) == WORKER_MAILBOX_EMPTY ) {
+                continue;
+            }
+            char value[16];
+            int length = snprintf(value, sizeof(value), "%d", (int32_t)(uint32_t)mailbox);
+            if (pwrite(pworker->led_fds[l], value, (size_t)length, 0) != length) {
+                atomic_store(&pworker->last_errno, errno);
+                atomic_fetch_add(&pworker->led_errors, 1);
+                completed = true;
+            }
+        }
+        const uint32_t reading = atomic_load(&pworker->led_reading);
+        for (uint8_t l = 0; l < pworker->num_leds; l++) {
+            if (!(reading & (1U << l))) {
+                continue;
+            }
+            char value[16];
+            char *end = NULL;
+            long brightness = NO_BRIGHTNESS;
+            const ssize_t length = pread(pworker->led_fds[l], value, sizeof(value) - 1, 0);
+            if (length > 0) {
+                value[length] = '\0';
+                brightness = strtol(value, &end, 10);
+            }
+            if (end == value || brightness < 0 || brightness > INT32_MAX) {
+                atomic_store(&pworker->last_errno, length < 0 ? errno : EINVAL);
+                atomic_fetch_add(&pworker->led_errors, 1);
+                brightness = NO_BRIGHTNESS;
+            }
+            atomic_store(&pworker->led_values[l], (int32_t)brightness);
+            atomic_fetch_and(&pworker->led_reading, ~(1U << l));
+            completed = true;
+        }
+        if (completed) {
+            counter = 1;
+            (void)write(pworker->completion_fd, &counter, sizeof(counter));
+        }
+    }
+    return NULL;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_worker_start()
+///////////////////////////////////////////////////////////////////////////////
+/** Spawn the backlight writer thread, writing the LEDs opened by then as well.
+
+    @param pworker          the worker container struct
+    @param fd               the file descriptor of the file the brightness value is written to, -1 for the LEDs only
+    @return                 true on success, false otherwise
+
+    @see Tworker
+    @see backlight_worker
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+bool backlight_worker_start(struct Tworker *pworker, const int fd) {
+    pworker->brightness_fd = fd;
+    for (uint8_t l = 0; l < gs_leds.num_leds; l++) {
+        pworker->led_fds[l] = gs_leds.leds[l].fd;
+        atomic_store(&pworker->led_mailboxes[l], WORKER_MAILBOX_EMPTY);
+    }
+    atomic_store(&pworker->led_reading, 0);
+    pworker->num_leds = gs_leds.num_leds;
+    pworker->wakeup_fd     = eventfd(0, EFD_CLOEXEC);
+    pworker->completion_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (pworker->wakeup_fd < 0 || pworker->completion_fd < 0) {
+        ERROR("Error: cannot create backlight worker eventfds (%s)\n", strerror(errno));
+    } else {
+        // the thread inherits the signal mask, this leaves all signals to the event loop's thread
+        sigset_t signals, previous;
+        (void)sigfillset(&signals);
+        (void)pthread_sigmask(SIG_BLOCK, &signals, &previous);
+        const int err = pthread_create(&pworker->thread, NULL, backlight_worker, pworker);
+        (void)pthread_sigmask(SIG_SETMASK, &previous, NULL);
+        if (err == 0) {
+            pworker->running = true;
+            return true;
+        }
+        ERROR("Error: cannot start backlight worker thread (%s)\n", strerror(err));
+    }
+    if (pworker->wakeup_fd >= 0)     { (void)close(pworker->wakeup_fd);     }
+    if (pworker->completion_fd >= 0) { (void)close(pworker->completion_fd); }
+    pworker->wakeup_fd     = -1;
+    pworker->completion_fd = -1;
+    return false;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_worker_outstanding()
+///////////////////////////////////////////////////////////////////////////////
+/** Number of posted targets neither written, failed, nor superseded yet.
+
+    @param pworker          the worker container struct
+    @return                 the worker's queue depth
+
+    @see Tworker
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static inline uint64_t backlight_worker_outstanding(const struct Tworker *pworker) {
+    return pworker->submitted - pworker->superseded - atomic_load(&pworker->written) - atomic_load(&pworker->errors);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_worker_submit()
+///////////////////////////////////////////////////////////////////////////////
+/** Post a new brightness target to the backlight writer thread.
+
+    Never blocks: A target the worker has not picked up yet is replaced.
+
+    @param pworker          the worker container struct
+    @param value_abs        the *absolute* brightness value in the output's device-specific range
+
+    @see Tworker
+    @see backlight_worker
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+void backlight_worker_submit(struct Tworker *pworker, const int32_t value_abs) {
+    uint64_t previous = atomic_exchange(&pworker->mailbox, WORKER_MAILBOX_FULL | (uint32_t)value_abs);
+    pworker->submitted++;
+    gs_metrics.writes++;
+    pworker->last_target = value_abs;
+    if (previous != WORKER_MAILBOX_EMPTY) {
+        pworker->superseded++;
+    } else {
+        uint64_t counter = 1;
+        (void)write(pworker->wakeup_fd, &counter, sizeof(counter));
+    }
+    uint64_t depth = backlight_worker_outstanding(pworker);
+    if (depth > pworker->depth_max) {
+        pworker->depth_max = depth;
+    }
+    TRACE("[backlight_worker_submit] brightness_abs=%d [queue depth: %lu]\n", value_abs, (unsigned long)depth);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_worker_led()
+///////////////////////////////////////////////////////////////////////////////
+/** Post a new brightness value of an LED to the backlight writer thread.
+
+    Never blocks: A value the worker has not picked up yet is replaced.
+
+    @param pworker          the worker container struct
+    @param led              the index of the LED in `gs_leds`
+    @param value_abs        the *absolute* brightness value in the LED's range
+
+    @see backlight_worker
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void backlight_worker_led(struct Tworker *pworker, const uint8_t led, const int32_t value_abs) {
+    gs_metrics.writes++;
+    if (atomic_exchange(&pworker->led_mailboxes[led], WORKER_MAILBOX_FULL | (uint32_t)value_abs) == WORKER_MAILBOX_EMPTY) {
+        uint64_t counter = 1;
+        (void)write(pworker->wakeup_fd, &counter, sizeof(counter));
+    }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_worker_led_read()
+///////////////////////////////////////////////////////////////////////////////
+/** Ask the backlight writer thread for the brightness of an LED.
+
+    The value is in `led_values` once the LED's bit in `led_reading` is
+    cleared, which the worker reports like a completed write.
+
+    @param pworker          the worker container struct
+    @param led              the index of the LED in `gs_leds`
+
+    @see backlight_worker
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void backlight_worker_led_read(struct Tworker *pworker, const uint8_t led) {
+    uint64_t counter = 1;
+    atomic_fetch_or(&pworker->led_reading, 1U << led);
+    (void)write(pworker->wakeup_fd, &counter, sizeof(counter));
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_worker_complete()
+///////////////////////////////////////////////////////////////////////////////
+/** Acknowledge write completions reported by the backlight writer thread.
+
+    @param pworker          the worker container struct
+
+    @see Tworker
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+void backlight_worker_complete(struct Tworker *pworker) {
+    uint64_t counter;
+    if (read(pworker->completion_fd, &counter, sizeof(counter)) < 0) {
+        return;
+    }
+    uint64_t errors = atomic_load(&pworker->errors);
+    if (errors != pworker->errors_reported) {
+        ERROR("Error: cannot write brightness file (%s)\n", strerror(atomic_load(&pworker->last_errno)));
+        pworker->errors_reported = errors;
+    }
+    uint64_t led_errors = atomic_load(&pworker->led_errors);
+    if (led_errors != pworker->led_errors_reported) {
+        ERROR("Error: cannot access LED brightness file (%s)\n", strerror(atomic_load(&pworker->last_errno)));
+        pworker->led_errors_reported = led_errors;
+    }
+    TRACE("[backlight_worker_complete] %lu writes completed [queue depth: %lu]\n", (unsigned long)counter, (unsigned long)backlight_worker_outstanding(pworker));
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_worker_stop()
+///////////////////////////////////////////////////////////////////////////////
+/** Let the backlight writer thread finish its pending write and join it.
+
+    @see Tworker
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void backlight_worker_stop(void) {
+    if (!gs_worker.running) {
+        return;
+    }
+    DEBUG("[shutdown] stopping backlight worker\n");
+    uint64_t counter = 1;
+    atomic_store(&gs_worker.stop, true);
+    (void)write(gs_worker.wakeup_fd, &counter, sizeof(counter));
+    (void)pthread_join(gs_worker.thread, NULL);
+    gs_worker.running = false;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// uring_start()
+///////////////////////////////////////////////////////////////////////////////
+/** Set up an io_uring for writing brightness values to registered files.
+
+    Done by the raw system calls, there is no need for liburing. The ring
+    reports completions by an eventfd the event loop waits on. Requires
+    IORING_OP_WRITE and IORING_OP_READ, i.e., Linux 5.6, as told by
+    IORING_REGISTER_PROBE; on older kernels, with io_uring disabled, or on
+    any other failure, the writer thread is used instead.
+
+    @param puring           the io_uring container struct
+    @param fds              the files to register, written to by their index
+    @param num_files        the number of files, at most URING_MAX_FILES
+    @return                 true on success, false otherwise
+
+    @see Turing
+    @see uring_write
+*/
+#ifdef USE_IO_URING
+static bool uring_start(struct Turing *puring, const int *fds, const uint8_t num_files) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // room for a write and a read per file
+    if ( (puring->fd = (int)syscall(__NR_io_uring_setup, 2 * URING_MAX_FILES, &params)) < 0 ) {
+        WARN("Warning: cannot set up io_uring (%s)\n", strerror(errno));
+        return false;
+    }
+    // IORING_REGISTER_PROBE came along with IORING_OP_WRITE and IORING_OP_READ, it fails on older kernels
+    const size_t probe_size = sizeof(struct io_uring_probe) + (IORING_OP_WRITE + 1) * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    const bool writes = probe &&
+        syscall(__NR_io_uring_register, puring->fd, IORING_REGISTER_PROBE, probe, IORING_OP_WRITE + 1) == 0 &&
+        probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) &&
+        (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!writes) {
+        WARN("Warning: io_uring lacks IORING_OP_WRITE or IORING_OP_READ\n");
+        uring_stop();
+        return false;
+    }
+    puring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    puring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    puring->sqes_size    = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        puring->sq_ring_size = puring->sq_ring_size > puring->cq_ring_size ? puring->sq_ring_size : puring->cq_ring_size;
+        puring->cq_ring_size = 0;
+    }
+    puring->sq_ring = mmap(NULL, puring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, puring->fd, IORING_OFF_SQ_RING);
+    puring->cq_ring = puring->cq_ring_size == 0 ? puring->sq_ring :
+                      mmap(NULL, puring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, puring->fd, IORING_OFF_CQ_RING);
+    void *sqes      = mmap(NULL, puring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, puring->fd, IORING_OFF_SQES);
+    if (puring->sq_ring == MAP_FAILED || puring->cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+        WARN("Warning: cannot map io_uring (%s)\n", strerror(errno));
+        if (puring->sq_ring == MAP_FAILED) { puring->sq_ring = NULL; }
+        if (puring->cq_ring == MAP_FAILED) { puring->cq_ring = NULL; }
+        if (sqes != MAP_FAILED) { (void)munmap(sqes, puring->sqes_size); }
+        uring_stop();
+        return false;
+    }
+    CC_IGNORE_WARNING_CAST_ALIGN
+    puring->sqes     = sqes;
+    puring->sq_head  = (uint32_t *)((char *)puring->sq_ring + params.sq_off.head);
+    puring->sq_tail  = (uint32_t *)((char *)puring->sq_ring + params.sq_off.tail);
+    puring->sq_mask  = (uint32_t *)((char *)puring->sq_ring + params.sq_off.ring_mask);
+    puring->sq_array = (uint32_t *)((char *)puring->sq_ring + params.sq_off.array);
+    puring->cq_head  = (uint32_t *)((char *)puring->cq_ring + params.cq_off.head);
+    puring->cq_tail  = (uint32_t *)((char *)puring->cq_ring + params.cq_off.tail);
+    puring->cq_mask  = (uint32_t *)((char *)puring->cq_ring + params.cq_off.ring_mask);
+    puring->cqes     = (struct io_uring_cqe *)((char *)puring->cq_ring + params.cq_off.cqes);
+    CC_RESTORE_WARNINGS
+
+    puring->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (puring->event_fd < 0 ||
+        syscall(__NR_io_uring_register, puring->fd, IORING_REGISTER_FILES, fds, num_files) < 0 ||
+        syscall(__NR_io_uring_register, puring->fd, IORING_REGISTER_EVENTFD, &puring->event_fd, 1) < 0) {
+        WARN("Warning: cannot register files with io_uring (%s)\n", strerror(errno));
+        uring_stop();
+        return false;
+    }
+    for (uint8_t f = 0; f < num_files; f++) {
+        puring->pending[f]     = NO_BRIGHTNESS;
+        puring->last_target[f] = NO_BRIGHTNESS;
+    }
+    puring->num_files = num_files;
+    puring->running   = true;
+    return true;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// uring_write()
+///////////////////////////////////////////////////////////////////////////////
+/** Queue a brightness write to a registered file, submitted by `uring_submit()`.
+
+    Never blocks: While a write to the file is in flight, the value is kept
+    until its completion, replacing a value kept before.
+
+    @param puring           the io_uring container struct
+    @param file             the index of the registered file
+    @param value_abs        the *absolute* brightness value in the output's device-specific range
+
+    @see Turing
+    @see uring_complete
+*/
+#ifdef USE_IO_URING
+static void uring_write(struct Turing *puring, const uint8_t file, const int32_t value_abs) {
+    puring->last_target[file] = value_abs;
+    if (puring->inflight[file]) {
+        if (puring->pending[file] != NO_BRIGHTNESS) {
+            puring->superseded++;
+        }
+        puring->pending[file] = value_abs;
+        return;
+    }
+    const int length = snprintf(puring->values[file], sizeof(puring->values[file]), "%d", value_abs);
+    const uint32_t tail  = *puring->sq_tail;
+    const uint32_t index = tail & *puring->sq_mask;
+    struct io_uring_sqe *sqe = &puring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_WRITE;
+    sqe->flags     = IOSQE_FIXED_FILE;
+    sqe->fd        = file;
+    sqe->off       = 0;
+    sqe->addr      = (uint64_t)(uintptr_t)puring->values[file];
+    sqe->len       = (uint32_t)length;
+    sqe->user_data = file;
+    puring->sq_array[index] = index;
+    __atomic_store_n(puring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    puring->issued_ns[file] = monotonic_us() * 1000;
+    puring->inflight[file]  = true;
+    puring->queued++;
+    puring->submitted++;
+    gs_metrics.writes++;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// uring_read()
+///////////////////////////////////////////////////////////////////////////////
+/** Queue a read of a registered file, submitted by `uring_submit()`.
+
+    The value is in `read_abs` once `reading` is cleared by `uring_complete()`.
+
+    @param puring           the io_uring container struct
+    @param file             the index of the registered file
+
+    @see Turing
+*/
+#ifdef USE_IO_URING
+static void uring_read(struct Turing *puring, const uint8_t file) {
+    const uint32_t tail  = *puring->sq_tail;
+    const uint32_t index = tail & *puring->sq_mask;
+    struct io_uring_sqe *sqe = &puring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_READ;
+    sqe->flags     = IOSQE_FIXED_FILE;
+    sqe->fd        = file;
+    sqe->off       = 0;
+    sqe->addr      = (uint64_t)(uintptr_t)puring->reads[file];
+    sqe->len       = sizeof(puring->reads[file]) - 1;
+    sqe->user_data = URING_READ | file;
+    puring->sq_array[index] = index;
+    __atomic_store_n(puring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    puring->reading[file] = true;
+    puring->queued++;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// uring_submit()
+///////////////////////////////////////////////////////////////////////////////
+/** Submit all queued writes by a single io_uring_enter() without waiting for them.
+
+    A tail the kernel did not take is submitted again at once, or, if it is
+    short of resources, along with the next writes or completions. On any
+    other error the io_uring is given up on, see `uring_fallback()`.
+
+    @param puring           the io_uring container struct
+
+    @see uring_write
+*/
+#ifdef USE_IO_URING
+static void uring_submit(struct Turing *puring) {
+    while (puring->queued > 0) {
+        const long submitted = syscall(__NR_io_uring_enter, puring->fd, puring->queued, 0, 0, NULL, 0);
+        puring->enters++;
+        if (submitted < 0 && errno == EINTR) {
+            continue;
+        }
+        if (submitted == 0 || (submitted < 0 && (errno == EAGAIN || errno == EBUSY))) {
+            TRACE("[uring_submit] %u writes left queued\n", puring->queued);
+            return;
+        }
+        if (submitted < 0) {
+            ERROR("Error: cannot submit to io_uring (%s)\n", strerror(errno));
+            uring_fallback();
+            return;
+        }
+        TRACE("[uring_submit] %ld writes submitted\n", submitted);
+        puring->queued -= (uint32_t)submitted;
+    }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// uring_complete()
+///////////////////////////////////////////////////////////////////////////////
+/** Reap the completed writes and reads, then submit the values kept meanwhile.
+
+    @param puring           the io_uring container struct
+
+    @see uring_write
+*/
+#ifdef USE_IO_URING
+static void uring_complete(struct Turing *puring) {
+    uint64_t counter;
+    (void)read(puring->event_fd, &counter, sizeof(counter));
+    const uint64_t now_ns = monotonic_us() * 1000;
+    uint32_t head = *puring->cq_head;
+    while (head != __atomic_load_n(puring->cq_tail, __ATOMIC_ACQUIRE)) {
+        const struct io_uring_cqe *cqe = &puring->cqes[head & *puring->cq_mask];
+        const uint8_t file = (uint8_t)cqe->user_data;
+        if (cqe->user_data & URING_READ) {
+            char *end = NULL;
+            long brightness = NO_BRIGHTNESS;
+            if (cqe->res > 0) {
+                puring->reads[file][cqe->res] = '\0';
+                brightness = strtol(puring->reads[file], &end, 10);
+            }
+            if (end == puring->reads[file] || brightness < 0 || brightness > INT32_MAX) {
+                gs_metrics.backend_errors++;
+                ERROR("Error: cannot read LED brightness file (%s)\n", cqe->res < 0 ? strerror(-cqe->res) : "no value");
+                brightness = NO_BRIGHTNESS;
+            }
+            puring->read_abs[file] = (int32_t)brightness;
+            puring->reading[file]  = false;
+            head++;
+            continue;
+        }
+        if (cqe->res < 0 || (size_t)cqe->res != strlen(puring->values[file])) {
+            puring->errors++;
+            puring->last_errno = cqe->res < 0 ? -cqe->res : EIO;
+            gs_metrics.backend_errors++;
+            ERROR("Error: cannot write brightness file (%s)\n", strerror(puring->last_errno));
+        } else {
+            const uint64_t latency_ns = now_ns - puring->issued_ns[file];
+            puring->latency_ns_total += latency_ns;
+            puring->latency_ns_max    = latency_ns > puring->latency_ns_max ? latency_ns : puring->latency_ns_max;
+        }
+        puring->inflight[file] = false;
+        puring->completed++;
+        head++;
+    }
+    __atomic_store_n(puring->cq_head, head, __ATOMIC_RELEASE);
+    for (uint8_t f = 0; f < puring->num_files; f++) {
+        if (!puring->inflight[f] && puring->pending[f] != NO_BRIGHTNESS) {
+            const int32_t value_abs = puring->pending[f];
+            puring->pending[f] = NO_BRIGHTNESS;
+            uring_write(puring, f, value_abs);
+        }
+    }
+    uring_submit(puring);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// uring_stop()
+///////////////////////////////////////////////////////////////////////////////
+/** Tear down the io_uring, writes in flight are completed by the kernel regardless.
+
+    @see Turing
+*/
+#ifdef USE_IO_URING
+static void uring_stop(void) {
+    if (gs_uring.sqes)                                       { (void)munmap(gs_uring.sqes, gs_uring.sqes_size); }
+    if (gs_uring.cq_ring && gs_uring.cq_ring != gs_uring.sq_ring) { (void)munmap(gs_uring.cq_ring, gs_uring.cq_ring_size); }
+    if (gs_uring.sq_ring)                                    { (void)munmap(gs_uring.sq_ring, gs_uring.sq_ring_size); }
+    if (gs_uring.event_fd >= 0)                              { (void)close(gs_uring.event_fd); }
+    if (gs_uring.fd >= 0)                                    { (void)close(gs_uring.fd); }
+    gs_uring.sqes     = NULL;
+    gs_uring.cq_ring  = NULL;
+    gs_uring.sq_ring  = NULL;
+    gs_uring.event_fd = -1;
+    gs_uring.fd       = -1;
+    gs_uring.running  = false;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// dbus_pad()
+///////////////////////////////////////////////////////////////////////////////
+/** Zero-pad a D-Bus message to the alignment of the next value.
+
+    The D-Bus helpers write in the host's byte order, which the message's
+    endianness flag announces, to a buffer of LOGIND_MESSAGE_MAX bytes.
+
+    @param buffer           the message
+    @param offset           the current end of the message
+    @param alignment        the next value's alignment, 1, 4, or 8
+    @return                 the aligned end of the message
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static size_t dbus_pad(char *buffer, size_t offset, const size_t alignment) {
+    while (offset % alignment != 0) {
+        buffer[offset++] = '\0';
+    }
+    return offset;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// dbus_put_string()
+///////////////////////////////////////////////////////////////////////////////
+/** Append a D-Bus string or object path, i.e., its length, itself, and a NUL.
+
+    @param buffer           the message
+    @param offset           the current end of the message
+    @param value            the string
+    @return                 the new end of the message
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static size_t dbus_put_string(char *buffer, size_t offset, const char *value) {
+    const uint32_t length = (uint32_t)strlen(value);
+    offset = dbus_pad(buffer, offset, 4);
+    memcpy(buffer + offset, &length, sizeof(length));
+    memcpy(buffer + offset + sizeof(length), value, length + 1);
+    return offset + sizeof(length) + length + 1;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// dbus_put_field()
+///////////////////////////////////////////////////////////////////////////////
+/** Append a header field holding a string, an object path, or a signature.
+
+    @param buffer           the message
+    @param offset           the current end of the message
+    @param code             the header field code
+    @param type             the value's type, i.e., 's', 'o', or 'g'
+    @param value            the value
+    @return                 the new end of the message
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static size_t dbus_put_field(char *buffer, size_t offset, const uint8_t code, const char type, const char *value) {
+    offset = dbus_pad(buffer, offset, 8);
+    buffer[offset++] = (char)code;
+    buffer[offset++] = 1;
+    buffer[offset++] = type;
+    buffer[offset++] = '\0';
+    if (type != 'g') {
+        return dbus_put_string(buffer, offset, value);
+    }
+    const size_t length = strlen(value);
+    buffer[offset++] = (char)length;
+    memcpy(buffer + offset, value, length + 1);
+    return offset + length + 1;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// dbus_call()
+///////////////////////////////////////////////////////////////////////////////
+/** Write the header of a method call, its body is to follow.
+
+    The body's length is left 0, to be filled in once the body is appended.
+
+    @param buffer           the message
+    @param serial           the call's serial
+    @param destination      the bus name called
+    @param path             the object path called
+    @param interface        the interface of the method
+    @param member           the method
+    @param signature        the body's signature, NULL for none
+    @return                 the length of the header, i.e., where the body starts
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static size_t dbus_call(char *buffer, const uint32_t serial, const char *destination, const char *path, const char *interface, const char *member, const char *signature) {
+    const uint32_t zero = 0;
+    #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    buffer[0] = 'l';
+    #else
+    buffer[0] = 'B';
+    #endif
+    buffer[1] = 1; // METHOD_CALL
+    buffer[2] = 0;
+    buffer[3] = 1; // protocol version
+    memcpy(buffer + 4, &zero, sizeof(zero));
+    memcpy(buffer + 8, &serial, sizeof(serial));
+    size_t offset = 16;
+    offset = dbus_put_field(buffer, offset, 1, 'o', path);
+    offset = dbus_put_field(buffer, offset, 2, 's', interface);
+    offset = dbus_put_field(buffer, offset, 3, 's', member);
+    offset = dbus_put_field(buffer, offset, 6, 's', destination);
+    if (signature) {
+        offset = dbus_put_field(buffer, offset, 8, 'g', signature);
+    }
+    const uint32_t fields_length = (uint32_t)(offset - 16);
+    memcpy(buffer + 12, &fields_length, sizeof(fields_length));
+    return dbus_pad(buffer, offset, 8);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// logind_start()
+///////////////////////////////////////////////////////////////////////////////
+/** Connect to the system bus and build the SetBrightness call.
+
+    The bus is `$DBUS_SYSTEM_BUS_ADDRESS` if it is a `unix:path=` address, or
+    LOGIND_BUS_PATH; with FAKE_X, the fake X server's mock bus. Authenticating
+    by the peer credentials (`EXTERNAL`) is the only blocking exchange, given
+    up after LOGIND_AUTH_TIMEOUT_MS, the reply to `Hello` is read in the
+    event loop like all others. The device is taken from
+    SYSFS_BACKLIGHT_PATH, i.e., `/sys/class/SUBSYSTEM/NAME/`.
+
+    @param plogind          logind connection container struct
+    @return                 true if connected, false otherwise
+
+    @see logind_write
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static bool logind_start(struct Tlogind *plogind) {
+    _Static_assert(sizeof(SYSFS_BACKLIGHT_PATH) < 256, "SYSFS_BACKLIGHT_PATH too long for LOGIND_MESSAGE_MAX");
+    char device[] = SYSFS_BACKLIGHT_PATH;
+    size_t length = strlen(device);
+    while (length > 1 && device[length - 1] == '/') {
+        device[--length] = '\0';
+    }
+    char *name = strrchr(device, '/');
+    if (!name || name == device) {
+        ERROR("Error: cannot tell the subsystem and name of %s\n", SYSFS_BACKLIGHT_PATH);
+        return false;
+    }
+    *name++ = '\0';
+    const char *subsystem = strrchr(device, '/') + 1;
+
+    #ifdef FAKE_X
+    plogind->fd = fakex_bus();
+    #else
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    const char *bus = getenv("DBUS_SYSTEM_BUS_ADDRESS");
+    if (bus && strncmp(bus, "unix:path=", strlen("unix:path=")) == 0) {
+        bus += strlen("unix:path=");
+        const size_t bus_length = strcspn(bus, ",;");
+        memcpy(address.sun_path, bus, bus_length < sizeof(address.sun_path) - 1 ? bus_length : sizeof(address.sun_path) - 1);
+    } else {
+        (void)snprintf(address.sun_path, sizeof(address.sun_path), "%s", LOGIND_BUS_PATH);
+    }
+    plogind->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (plogind->fd >= 0 && connect(plogind->fd, (const struct sockaddr *)&address, sizeof(address)) < 0) {
+        WARN("Warning: cannot connect to the system bus at %s (%s)\n", address.sun_path, strerror(errno));
+        logind_stop();
+        return false;
+    }
+    #endif
+    if (plogind->fd < 0) {
+        return false;
+    }
+
+    char line[128];
+    char uid[16];
+    int line_length = snprintf(line, sizeof(line), "%cAUTH EXTERNAL ", '\0');
+    (void)snprintf(uid, sizeof(uid), "%u", (unsigned int)getuid());
+    for (const char *c = uid; *c; c++) {
+        line_length += snprintf(line + line_length, sizeof(line) - (size_t)line_length, "%02x", (unsigned int)*c);
+    }
+    line_length += snprintf(line + line_length, sizeof(line) - (size_t)line_length, "\r\n");
+    if (send(plogind->fd, line, (size_t)line_length, MSG_NOSIGNAL) != line_length) {
+        WARN("Warning: cannot authenticate to the system bus (%s)\n", strerror(errno));
+        logind_stop();
+        return false;
+    }
+    // the bus sends nothing but the one line before BEGIN
+    const uint64_t deadline_ms = monotonic_ms() + LOGIND_AUTH_TIMEOUT_MS;
+    size_t received = 0;
+    while (received < sizeof(line) - 1 && (received < 2 || memcmp(line + received - 2, "\r\n", 2) != 0)) {
+        const uint64_t now_ms = monotonic_ms();
+        struct pollfd pollfd = { .fd = plogind->fd, .events = POLLIN };
+        const int ready = now_ms < deadline_ms ? poll(&pollfd, 1, (int)(deadline_ms - now_ms)) : 0;
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        const ssize_t count = ready > 0 ? recv(plogind->fd, line + received, sizeof(line) - 1 - received, MSG_DONTWAIT) : 0;
+        if (count <= 0) {
+            if (count < 0 && (errno == EINTR || errno == EAGAIN)) { continue; }
+            break;
+        }
+        received += (size_t)count;
+    }
+    line[received] = '\0';
+    if (strncmp(line, "OK ", 3) != 0) {
+        WARN("Warning: the system bus refused to authenticate uid %s\n", uid);
+        logind_stop();
+        return false;
+    }
+
+    // BEGIN and Hello go out together, the brightness calls may follow right away
+    char *hello = plogind->message;
+    memcpy(hello, "BEGIN\r\n", strlen("BEGIN\r\n"));
+    const size_t hello_length = strlen("BEGIN\r\n") + dbus_call(hello + strlen("BEGIN\r\n"), LOGIND_SERIAL_HELLO,
+        "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "Hello", NULL);
+    if (send(plogind->fd, hello, hello_length, MSG_NOSIGNAL) != (ssize_t)hello_length) {
+        WARN("Warning: cannot say hello to the system bus (%s)\n", strerror(errno));
+        logind_stop();
+        return false;
+    }
+
+    size_t offset = dbus_call(plogind->message, 0, "org.freedesktop.login1", "/org/freedesktop/login1/session/auto",
+        "org.freedesktop.login1.Session", "SetBrightness", "ssu");
+    const size_t body = offset;
+    offset = dbus_put_string(plogind->message, offset, subsystem);
+    offset = dbus_put_string(plogind->message, offset, name);
+    plogind->value_offset   = dbus_pad(plogind->message, offset, 4);
+    plogind->message_length = plogind->value_offset + sizeof(int32_t);
+    const uint32_t body_length = (uint32_t)(plogind->message_length - body);
+    memcpy(plogind->message + 4, &body_length, sizeof(body_length));
+
+    (void)fcntl(plogind->fd, F_SETFL, O_NONBLOCK);
+    plogind->serial  = LOGIND_SERIAL_HELLO;
+    plogind->running = true;
+    plogind->lost    = false;
+    DEBUG("[logind] connected, setting the brightness of %s %s\n", subsystem, name);
+    return true;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// logind_send()
+///////////////////////////////////////////////////////////////////////////////
+/** Send a SetBrightness call without waiting for its reply.
+
+    If the socket's buffer is full, the value is kept until the socket takes
+    more, which the event loop waits for by POLLOUT. Any other failure, a
+    partly sent call included, breaks the connection, see `logind_lost()`.
+
+    @param plogind          logind connection container struct
+    @param value_abs        the *absolute* brightness value in the device's range
+
+    @see logind_complete
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void logind_send(struct Tlogind *plogind, const int32_t value_abs) {
+    const uint32_t serial = ++plogind->serial == 0 ? ++plogind->serial : plogind->serial;
+    const uint32_t value  = (uint32_t)value_abs;
+    memcpy(plogind->message + 8, &serial, sizeof(serial));
+    memcpy(plogind->message + plogind->value_offset, &value, sizeof(value));
+    ssize_t sent;
+    do {
+        sent = send(plogind->fd, plogind->message, plogind->message_length, MSG_NOSIGNAL | MSG_DONTWAIT);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        TRACE("[logind_send] the bus is busy, keeping brightness_abs=%d\n", value_abs);
+        plogind->pending = value_abs;
+        gs_pollfds[POLL_SOURCE_WORKER].events = POLLIN | POLLOUT;
+        return;
+    }
+    if (sent != (ssize_t)plogind->message_length) {
+        plogind->errors++;
+        gs_metrics.backend_errors++;
+        ERROR("Error: cannot call logind (%s)\n", sent < 0 ? strerror(errno) : "short write");
+        logind_lost(plogind);
+        return;
+    }
+    gs_pollfds[POLL_SOURCE_WORKER].events = POLLIN;
+    const uint8_t slot = (uint8_t)((plogind->head + plogind->inflight) % LOGIND_MAX_INFLIGHT);
+    plogind->serials[slot]   = serial;
+    plogind->issued_ns[slot] = monotonic_us() * 1000;
+    plogind->inflight++;
+    plogind->submitted++;
+    gs_metrics.writes++;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// logind_write()
+///////////////////////////////////////////////////////////////////////////////
+/** Call SetBrightness, or keep the value until a call in flight is answered or the socket takes more.
+
+    Never blocks and never waits for a reply.
+
+    @param plogind          logind connection container struct
+    @param value_abs        the *absolute* brightness value in the device's range
+
+    @see logind_complete
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void logind_write(struct Tlogind *plogind, const int32_t value_abs) {
+    plogind->last_target = value_abs;
+    // a value kept already goes first, i.e., this one takes its place
+    if (plogind->lost || plogind->inflight == LOGIND_MAX_INFLIGHT || plogind->pending != NO_BRIGHTNESS) {
+        if (plogind->pending != NO_BRIGHTNESS) {
+            plogind->superseded++;
+        }
+        plogind->pending = value_abs;
+        return;
+    }
+    logind_send(plogind, value_abs);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// logind_reply()
+///////////////////////////////////////////////////////////////////////////////
+/** Account a message received from the bus if it answers a call in flight.
+
+    The bus delivers the replies in order, hence usually to the oldest call,
+    but any call in flight is looked for: a reply to none is ignored, e.g.,
+    the reply to `Hello` or signals, and must not keep a call in flight.
+
+    @param plogind          logind connection container struct
+    @param message          the message
+    @param length           the message's length
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void logind_reply(struct Tlogind *plogind, const char *message, const size_t length) {
+    const uint8_t type = (uint8_t)message[1];
+    if ((type != 2 && type != 3) || plogind->inflight == 0) { // METHOD_RETURN, ERROR
+        return;
+    }
+    uint32_t fields_length;
+    memcpy(&fields_length, message + 12, sizeof(fields_length));
+    const size_t fields_end = 16 + fields_length;
+    uint32_t reply_serial = 0;
+    const char *error_name = "";
+    size_t offset = 16;
+    while (offset < fields_end && fields_end <= length) {
+        offset = (offset + 7) & ~(size_t)7;
+        if (offset + 4 > fields_end) {
+            break;
+        }
+        const uint8_t code = (uint8_t)message[offset];
+        const char    kind = message[offset + 2];
+        offset += 4;
+        if (kind == 'u') {
+            offset = (offset + 3) & ~(size_t)3;
+            if (code == 5 && offset + 4 <= fields_end) {
+                memcpy(&reply_serial, message + offset, sizeof(reply_serial));
+            }
+            offset += 4;
+        } else if (kind == 's' || kind == 'o') {
+            uint32_t string_length;
+            offset = (offset + 3) & ~(size_t)3;
+            memcpy(&string_length, message + offset, sizeof(string_length));
+            if (code == 4) {
+                error_name = message + offset + 4;
+            }
+            offset += 4 + string_length + 1;
+        } else if (kind == 'g') {
+            offset += 1 + (size_t)(uint8_t)message[offset] + 1;
+        } else {
+            break;
+        }
+    }
+    uint8_t i = 0;
+    while (i < plogind->inflight && plogind->serials[(plogind->head + i) % LOGIND_MAX_INFLIGHT] != reply_serial) {
+        i++;
+    }
+    if (i == plogind->inflight) {
+        return;
+    }
+    const uint8_t slot = (uint8_t)((plogind->head + i) % LOGIND_MAX_INFLIGHT);
+    const uint64_t latency_ns = monotonic_us() * 1000 - plogind->issued_ns[slot];
+    // the oldest call takes the answered one's slot, then the oldest slot is freed
+    plogind->serials[slot]   = plogind->serials[plogind->head];
+    plogind->issued_ns[slot] = plogind->issued_ns[plogind->head];
+    plogind->head = (uint8_t)((plogind->head + 1) % LOGIND_MAX_INFLIGHT);
+    plogind->inflight--;
+    plogind->completed++;
+    if (type == 3) {
+        plogind->errors++;
+        gs_metrics.backend_errors++;
+        ERROR("Error: logind did not set the brightness (%s)\n", error_name);
+        return;
+    }
+    plogind->latency_ns_total += latency_ns;
+    plogind->latency_ns_max    = latency_ns > plogind->latency_ns_max ? latency_ns : plogind->latency_ns_max;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// logind_complete()
+///////////////////////////////////////////////////////////////////////////////
+/** Read the messages the bus sent, then call with the value kept meanwhile.
+
+    Also called once the socket takes more after a call did not fit, i.e.,
+    with nothing to read.
+
+    @param plogind          logind connection container struct
+
+    @see logind_write
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void logind_complete(struct Tlogind *plogind) {
+    while (true) {
+        const ssize_t count = recv(plogind->fd, plogind->receive + plogind->received, sizeof(plogind->receive) - plogind->received, MSG_DONTWAIT);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                ERROR("Error: lost the system bus connection%s%s\n", count < 0 ? ", " : "", count < 0 ? strerror(errno) : "");
+                logind_lost(plogind);
+            }
+            break;
+        }
+        plogind->received += (size_t)count;
+        size_t offset = 0;
+        while (plogind->received - offset > 0) {
+            const char *message = plogind->receive + offset;
+            const size_t available = plogind->received - offset;
+            if (plogind->discard > 0) {
+                const size_t skipped = available < plogind->discard ? available : plogind->discard;
+                plogind->discard -= skipped;
+                offset += skipped;
+                continue;
+            }
+            if (available < 16) {
+                break;
+            }
+            uint32_t body_length, fields_length;
+            memcpy(&body_length,   message + 4,  sizeof(body_length));
+            memcpy(&fields_length, message + 12, sizeof(fields_length));
+            const size_t length = ((16 + (size_t)fields_length + 7) & ~(size_t)7) + body_length;
+            if (length > sizeof(plogind->receive)) {
+                // too large for a reply to SetBrightness, e.g., a signal, skip it
+                plogind->discard = length;
+                continue;
+            }
+            if (available < length) {
+                break;
+            }
+            logind_reply(plogind, message, length);
+            offset += length;
+        }
+        plogind->received -= offset;
+        memmove(plogind->receive, plogind->receive + offset, plogind->received);
+    }
+    if (plogind->running && !plogind->lost && plogind->inflight < LOGIND_MAX_INFLIGHT && plogind->pending != NO_BRIGHTNESS) {
+        const int32_t value_abs = plogind->pending;
+        plogind->pending = NO_BRIGHTNESS;
+        logind_send(plogind, value_abs);
+    }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// logind_lost()
+///////////////////////////////////////////////////////////////////////////////
+/** Close a broken system bus connection, for the event loop to make it again.
+
+    Whether logind took the calls in flight is unknown, so the last value is
+    kept to be called again on the new connection, as are the values written
+    until then. Never reconnects itself, since it is called on the way of a
+    write, see `logind_reconnect()`.
+
+    @param plogind          logind connection container struct
+
+    @see logind_reconnect
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void logind_lost(struct Tlogind *plogind) {
+    if (plogind->fd >= 0) {
+        (void)close(plogind->fd);
+    }
+    plogind->fd       = -1;
+    plogind->inflight = 0;
+    plogind->head     = 0;
+    plogind->received = 0;
+    plogind->discard  = 0;
+    plogind->pending  = plogind->last_target;
+    plogind->lost     = true;
+    gs_pollfds[POLL_SOURCE_WORKER].fd = -1;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// logind_reconnect()
+///////////////////////////////////////////////////////////////////////////////
+/** Connect to the system bus again after `logind_lost()`.
+
+    Called by the event loop. The values kept are called on the new
+    connection by `logind_complete()` once the socket is writable rather
+    than from here. Without a bus, the brightness cannot be set anymore,
+    hence the event loop exits on a failed attempt like a failed start,
+    e.g., for the service manager to restart _brightnessd_.
+
+    @param plogind          logind connection container struct
+    @return                 true if connected again, false otherwise
+
+    @see logind_start
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static bool logind_reconnect(struct Tlogind *plogind) {
+    plogind->reconnects++;
+    if (!logind_start(plogind)) {
+        ERROR("Error: cannot reconnect to the system bus\n");
+        return false;
+    }
+    WARN("Warning: reconnected to the system bus\n");
+    gs_pollfds[POLL_SOURCE_WORKER].fd     = plogind->fd;
+    gs_pollfds[POLL_SOURCE_WORKER].events = plogind->pending != NO_BRIGHTNESS ? POLLIN | POLLOUT : POLLIN;
+    return true;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// logind_stop()
+///////////////////////////////////////////////////////////////////////////////
+/** Close the system bus connection, calls sent are answered by logind regardless.
+
+    @see Tlogind
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void logind_stop(void) {
+    if (gs_logind.fd >= 0) {
+        (void)close(gs_logind.fd);
+    }
+    gs_logind.fd       = -1;
+    gs_logind.running  = false;
+    gs_logind.inflight = 0;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_write()
+///////////////////////////////////////////////////////////////////////////////
+/** Write a brightness value by whichever writer is running, see writer_t.
+
+    Writes queued to the io_uring are submitted by `backlight_flush()`.
+
+    @param value_abs        the *absolute* brightness value in the output's device-specific range
+    @return                 RET_OK, or NO_BRIGHTNESS on error
+
+    @see backlight_flush
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static int8_t backlight_write(const int32_t value_abs) {
+    if (gs_logind.running) {
+        logind_write(&gs_logind, value_abs);
+        return RET_OK;
+    }
+    #ifdef USE_IO_URING
+    if (gs_uring.running) {
+        uring_write(&gs_uring, 0, value_abs);
+        return RET_OK;
+    }
+    #endif
+    if (gs_worker.running) {
+        backlight_worker_submit(&gs_worker, value_abs);
+        return RET_OK;
+    }
+    return set_brightness_file(gs_sysfs.brightness_fd, value_abs);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_flush()
+///////////////////////////////////////////////////////////////////////////////
+/** Submit the writes of a transition queued by `backlight_write()`.
+
+    @see backlight_write
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void backlight_flush(void) {
+    #ifdef USE_IO_URING
+    if (gs_uring.running) {
+        uring_submit(&gs_uring);
+    }
+    #endif
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_lagging()
+///////////////////////////////////////////////////////////////////////////////
+/** Whether the brightness file may not show the last value written yet.
+
+    @return                 true while a write is queued or in flight
+
+    @see backlight_current
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static bool backlight_lagging(void) {
+    if (gs_logind.running) {
+        return gs_logind.inflight > 0 || gs_logind.pending != NO_BRIGHTNESS;
+    }
+    #ifdef USE_IO_URING
+    if (gs_uring.running) {
+        return gs_uring.inflight[0];
+    }
+    #endif
+    return gs_worker.running && backlight_worker_outstanding(&gs_worker) > 0;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// backlight_current()
+///////////////////////////////////////////////////////////////////////////////
+/** Get the current brightness, i.e., the last value written while the file lags behind.
+
+    @return                 the *absolute* brightness value, or NO_BRIGHTNESS on error
+
+    @see backlight_lagging
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static int32_t backlight_current(void) {
+    if (!backlight_lagging()) {
+        return get_brightness_file(gs_sysfs.brightness_fd);
+    }
+    if (gs_logind.running) {
+        return gs_logind.last_target;
+    }
+    #ifdef USE_IO_URING
+    if (gs_uring.running) {
+        return gs_uring.last_target[0];
+    }
+    #endif
+    return gs_worker.last_target;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// uring_fallback()
+///////////////////////////////////////////////////////////////////////////////
+/** Give up on a failing io_uring for the writer thread, or writing at once.
+
+    Writes queued or kept are forgotten with the io_uring, and whether those
+    in flight made it is unknown, so the last value of each file is written
+    again by the new writer.
+
+    @see uring_submit
+*/
+#ifdef USE_IO_URING
+static void uring_fallback(void) {
+    int32_t last_target[URING_MAX_FILES];
+    bool    unsettled[URING_MAX_FILES];
+    for (uint8_t f = 0; f < gs_uring.num_files; f++) {
+        last_target[f] = gs_uring.last_target[f];
+        unsettled[f]   = gs_uring.inflight[f] || gs_uring.pending[f] != NO_BRIGHTNESS;
+        gs_uring.inflight[f] = false;
+        gs_uring.reading[f]  = false;
+        gs_uring.pending[f]  = NO_BRIGHTNESS;
+    }
+    gs_uring.queued = 0;
+    uring_stop();
+    // reads in flight are asked for again from the new writer
+    for (uint8_t l = 0; l < gs_leds.num_leds; l++) {
+        gs_leds.leds[l].file = 0;
+        if (gs_leds.leds[l].read == LED_READ_PENDING) {
+            gs_leds.leds[l].read = LED_READ_IDLE;
+        }
+    }
+
+    WARN("Warning: falling back to the backlight worker\n");
+    gs_pollfds[POLL_SOURCE_WORKER].fd = -1;
+    SYSFS_WRITER = WRITER_THREAD;
+    if (backlight_worker_start(&gs_worker, gs_sysfs.brightness_fd)) {
+        gs_pollfds[POLL_SOURCE_WORKER].fd = gs_worker.completion_fd;
+        atexit(backlight_worker_stop);
+    } else {
+        WARN("Warning: writing brightness from the event loop\n");
+        SYSFS_WRITER = WRITER_SYNC;
+    }
+
+    if (unsettled[0]) {
+        (void)backlight_write(last_target[0]);
+    }
+    for (uint8_t l = 0; l < gs_leds.num_leds; l++) {
+        if (unsettled[l + 1]) {
+            led_write(&gs_leds, &gs_leds.leds[l], last_target[l + 1]);
+        }
+    }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// gamma_scale()
+///////////////////////////////////////////////////////////////////////////////
+/** Scale gamma ramp entries by a 16.16 fixed-point factor.
+
+    Works on GAMMA_VECTOR_LANES entries at once, widened to 32 bits so that
+    the product cannot overflow; only the tail of a ramp size not divisible
+    by GAMMA_VECTOR_LANES is scaled one by one.
+
+    @param scaled           the scaled ramp entries
+    @param ramps            the original ramp entries
+    @param length           the number of ramp entries
+    @param factor           the scale factor, 65536 is 1.0
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static void gamma_scale(uint16_t *restrict scaled, const uint16_t *restrict ramps, const size_t length, const uint32_t factor) {
+    size_t i = 0;
+    for (; i + GAMMA_VECTOR_LANES <= length; i += GAMMA_VECTOR_LANES) {
+        Tramp16 entries;
+        memcpy(&entries, &ramps[i], sizeof(entries));
+        Tramp32 wide = __builtin_convertvector(entries, Tramp32);
+        wide    = (wide * factor) >> 16;
+        entries = __builtin_convertvector(wide, Tramp16);
+        memcpy(&scaled[i], &entries, sizeof(entries));
+    }
+    for (; i < length; i++) {
+        scaled[i] = (uint16_t)((ramps[i] * factor) >> 16);
+    }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// gamma_apply()
+///////////////////////////////////////////////////////////////////////////////
+/** Dim an output by setting its crtc's gamma ramps to the scaled original ramps.
+
+    The request is sent unchecked into the scratch buffer of the output, i.e.,
+    without allocating or waiting for the server.
+
+    @param pxcb             the global xcb container struct
+    @param poutput          the gamma-dimmed output
+    @param level            the brightness level, GAMMA_LEVEL_MAX restores the original ramps
+
+    @see gamma_scale
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static void gamma_apply(const struct Txcb *pxcb, struct Toutput *poutput, const int32_t level) {
+    const size_t size = poutput->gamma_size;
+    gamma_scale(poutput->gamma_scratch, poutput->gamma_ramps, 3 * size, (uint32_t)level * 65536U / GAMMA_LEVEL_MAX);
+    gs_metrics.writes++;
+    (void)xcb_randr_set_crtc_gamma(pxcb->connection, poutput->crtc, poutput->gamma_size,
+        poutput->gamma_scratch, poutput->gamma_scratch + size, poutput->gamma_scratch + 2 * size);
+    poutput->gamma_level = level;
+    poutput->brn_cur_abs = level;
+    if (poutput->ppanel) {
+        poutput->ppanel->gamma_level = level;
+    }
+    TRACE("[gamma_apply] level=%d [output: %d][crtc: %d]\n", level, poutput->output, poutput->crtc);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// find_output()
+///////////////////////////////////////////////////////////////////////////////
+/** Look up an output among the cached outputs.
+
+    @param output           the output to look up
+    @return                 the cached output, or NULL if it is not cached
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static struct Toutput *find_output(const xcb_randr_output_t output) {
+    for (uint8_t o = 0; o < gs_outputs.num_outputs; o++) {
+        if (gs_outputs.outputs[o].output == output) {
+            return &gs_outputs.outputs[o];
+        }
+    }
+    return NULL;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// outputs_unchanged()
+///////////////////////////////////////////////////////////////////////////////
+/** Tell whether the cached outputs are still valid on a new connection.
+
+    After reconnecting, a server that kept its outputs and backlight atoms
+    spares probing them all over again, which would cost several round trips
+    per output. A single Get Screen Resources Current tells.
+
+    @param pxcb                     xcb container struct of the new connection
+    @param backlight_new_atom       the `Backlight` atom on the previous connection
+    @param backlight_legacy_atom    the `BACKLIGHT` atom on the previous connection
+    @return                         true if every cached output is still there, false otherwise
+
+    @see reconnect
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static bool outputs_unchanged(const struct Txcb *pxcb, const xcb_atom_t backlight_new_atom, const xcb_atom_t backlight_legacy_atom) {
+    if (pxcb->backlight_new_atom != backlight_new_atom || pxcb->backlight_legacy_atom != backlight_legacy_atom) {
+        return false;
+    }
+    xcb_randr_get_screen_resources_current_reply_t *resources_reply = xcb_randr_get_screen_resources_current_reply(pxcb->connection,
+        xcb_randr_get_screen_resources_current(pxcb->connection, pxcb->screen->root), NULL);
+    gs_metrics.round_trips++;
+    if (!resources_reply) {
+        return false;
+    }
+    const xcb_randr_output_t *outputs = xcb_randr_get_screen_resources_current_outputs(resources_reply);
+    const int num_outputs = xcb_randr_get_screen_resources_current_outputs_length(resources_reply);
+    uint8_t found = 0;
+    for (uint8_t o = 0; o < gs_outputs.num_outputs; o++) {
+        for (int r = 0; r < num_outputs; r++) {
+            if (outputs[r] == gs_outputs.outputs[o].output) {
+                found++;
+                break;
+            }
+        }
+    }
+    free(resources_reply);
+    return found == gs_outputs.num_outputs;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// query_gamma()
+///////////////////////////////////////////////////////////////////////////////
+/** Set up gamma dimming for a connected output without backlight property.
+
+    Captures the crtc's original gamma ramps. An output that has been cached
+    before keeps its ramps, as the crtc's current ramps may already be dimmed.
+    For the same reason, ramps left dimmed by a previous instance according to
+    the panel's state record are scaled back up.
+
+    @param pxcb             the global xcb container struct
+    @param output           the output to set up
+    @param poutput          the cache entry to fill in, with `ppanel` already set
+    @param pprevious        the outputs cached before, whose ramps are taken over
+    @return                 true if the output can be dimmed by gamma, false otherwise
+
+    @see gamma_apply
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static bool query_gamma(const struct Txcb *pxcb, const xcb_randr_output_t output, struct Toutput *poutput, struct Toutputs *pprevious) {
+    xcb_randr_get_output_info_reply_t *info_reply = xcb_randr_get_output_info_reply(pxcb->connection,
+        xcb_randr_get_output_info(pxcb->connection, output, XCB_CURRENT_TIME), NULL);
+    gs_metrics.round_trips++;
+    if (info_reply == NULL || info_reply->connection != XCB_RANDR_CONNECTION_CONNECTED || info_reply->crtc == XCB_NONE) {
+        free(info_reply);
+        return false;
+    }
+    poutput->crtc = info_reply->crtc;
+    free(info_reply);
+
+    for (uint8_t p = 0; p < pprevious->num_outputs; p++) {
+        struct Toutput *pprior = &pprevious->outputs[p];
+        if (pprior->output == output && pprior->crtc == poutput->crtc && pprior->gamma_ramps) {
+            poutput->gamma_ramps   = pprior->gamma_ramps;
+            poutput->gamma_scratch = pprior->gamma_scratch;
+            poutput->gamma_size    = pprior->gamma_size;
+            poutput->gamma_level   = pprior->gamma_level;
+            pprior->gamma_ramps    = NULL;
+            return true;
+        }
+    }
+
+    xcb_randr_get_crtc_gamma_size_reply_t *size_reply = xcb_randr_get_crtc_gamma_size_reply(pxcb->connection,
+        xcb_randr_get_crtc_gamma_size(pxcb->connection, poutput->crtc), NULL);
+    xcb_randr_get_crtc_gamma_reply_t *gamma_reply = xcb_randr_get_crtc_gamma_reply(pxcb->connection,
+        xcb_randr_get_crtc_gamma(pxcb->connection, poutput->crtc), NULL);
+    gs_metrics.round_trips += 2;
+    if (size_reply == NULL || gamma_reply == NULL || size_reply->size == 0 || gamma_reply->size != size_reply->size) {
+        free(size_reply);
+        free(gamma_reply);
+        return false;
+    }
+    const size_t size = gamma_reply->size;
+    free(size_reply);
+
+    if ( !(poutput->gamma_ramps = malloc(6 * size * sizeof(uint16_t))) ) {
+        free(gamma_reply);
+        return false;
+    }
+    poutput->gamma_scratch = poutput->gamma_ramps + 3 * size;
+    poutput->gamma_size    = (uint16_t)size;
+    poutput->gamma_level   = GAMMA_LEVEL_MAX;
+    memcpy(poutput->gamma_ramps,            xcb_randr_get_crtc_gamma_red(gamma_reply),   size * sizeof(uint16_t));
+    memcpy(poutput->gamma_ramps + size,     xcb_randr_get_crtc_gamma_green(gamma_reply), size * sizeof(uint16_t));
+    memcpy(poutput->gamma_ramps + 2 * size, xcb_randr_get_crtc_gamma_blue(gamma_reply),  size * sizeof(uint16_t));
+    free(gamma_reply);
+
+    if (poutput->ppanel && poutput->ppanel->gamma && poutput->ppanel->gamma_level > 0 && poutput->ppanel->gamma_level < GAMMA_LEVEL_MAX) {
+        DEBUG("[query_gamma] output %d was left at gamma level %d, recovering original ramps\n", output, poutput->ppanel->gamma_level);
+        poutput->gamma_level = poutput->ppanel->gamma_level;
+        for (size_t i = 0; i < 3 * size; i++) {
+            uint32_t entry = (uint32_t)poutput->gamma_ramps[i] * GAMMA_LEVEL_MAX / (uint32_t)poutput->gamma_level;
+            poutput->gamma_ramps[i] = (uint16_t)(entry > UINT16_MAX ? UINT16_MAX : entry);
+        }
+    }
+    TRACE("[query_gamma] output %d: crtc %d, gamma size %zu\n", output, poutput->crtc, size);
+    return true;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// query_panel()
+///////////////////////////////////////////////////////////////////////////////
+/** Identify the panel attached to an output by its EDID.
+
+    @param pxcb             the global xcb container struct
+    @param edid_cookie      the cookie of the pending EDID property request
+    @return                 the panel's state record, or NULL if the output has no EDID
+
+    @see state_cache_panel
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static struct Tpanelstate *query_panel(const struct Txcb *pxcb, const xcb_randr_get_output_property_cookie_t edid_cookie) {
+    xcb_randr_get_output_property_reply_t *edid_reply = xcb_randr_get_output_property_reply(pxcb->connection, edid_cookie, NULL);
+    if (edid_reply == NULL) {
+        return NULL;
+    }
+    struct Tpanelstate *ppanel = NULL;
+    int length = xcb_randr_get_output_property_data_length(edid_reply);
+    if (edid_reply->format == 8 && length > 0) {
+        ppanel = state_cache_panel(fnv1a_64(xcb_randr_get_output_property_data(edid_reply), (size_t)length));
+    }
+    free(edid_reply);
+    return ppanel;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// query_outputs()
+///////////////////////////////////////////////////////////////////////////////
+/** Probe all outputs for a backlight property and its valid range.
+
+    The result is cached in `poutputs` until the randr configuration changes,
+    so brightness operations do not have to enumerate the screen resources
+    and query the property ranges again. Panels known from the state file by
+    their EDID are not probed at all. With gamma dimming enabled, connected
+    outputs without backlight property are dimmed by their crtc's gamma ramps.
+
+    @param pxcb             the global xcb container struct
+    @param poutputs         output cache container struct
+    @return                 true if any output has a usable backlight property, false otherwise
+
+    @see Toutputs
+    @see Txcb
+    @see query_panel
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+bool query_outputs(struct Txcb *pxcb, struct Toutputs *poutputs) {
+    xcb_generic_error_t *error = NULL;
+    xcb_randr_output_t  *outputs;
+    xcb_randr_get_screen_resources_reply_t *resources_reply;
+    xcb_randr_get_screen_resources_cookie_t resources_cookie;
+    xcb_randr_get_output_property_cookie_t  edid_cookies[MAX_PROBED_OUTPUTS];
+    struct Toutputs previous = *poutputs;
+
+    poutputs->num_outputs = 0;
+    poutputs->valid       = false;
+
+    resources_cookie = xcb_randr_get_screen_resources(pxcb->connection, pxcb->screen->root);
+    resources_reply  = xcb_randr_get_screen_resources_reply(pxcb->connection, resources_cookie, &error);
+    gs_metrics.round_trips++;
+    if (error != NULL || resources_reply == NULL) {
+        ERROR("Error: randr Get Screen Resources returned error %d\n", error ? error->error_code : -1);
+        free(error);
+        *poutputs = previous;
+        return false;
+    }
+
+    outputs = xcb_randr_get_screen_resources_outputs(resources_reply);
+    uint16_t num_edids = 0;
+    if (gs_statefile && pxcb->edid_atom != XCB_ATOM_NONE) {
+        // ask for all EDIDs at once, the replies are collected while walking the outputs
+        num_edids = resources_reply->num_outputs < MAX_PROBED_OUTPUTS ? resources_reply->num_outputs : MAX_PROBED_OUTPUTS;
+        for (uint16_t o = 0; o < num_edids; o++) {
+            edid_cookies[o] = xcb_randr_get_output_property(pxcb->connection, outputs[o], pxcb->edid_atom, XCB_ATOM_NONE, 0, EDID_BLOCK_LENGTH / 4, 0, 0);
+        }
+    }
+    uint16_t o = 0;
+    for (; o < resources_reply->num_outputs && poutputs->num_outputs < MAX_OUTPUTS; o++) {
+        struct Tpanelstate *ppanel = o < num_edids ? query_panel(pxcb, edid_cookies[o]) : NULL;
+        struct Toutput     *poutput = &poutputs->outputs[poutputs->num_outputs];
+
+        memset(poutput, 0, sizeof(*poutput));
+        if (ppanel && !ppanel->gamma && ppanel->brn_max_abs > ppanel->brn_min_abs) {
+            poutput->output         = outputs[o];
+            poutput->backlight_atom = ppanel->legacy_atom ? pxcb->backlight_legacy_atom : pxcb->backlight_new_atom;
+            poutput->brn_min_abs    = ppanel->brn_min_abs;
+            poutput->brn_max_abs    = ppanel->brn_max_abs;
+            poutput->brn_cur_abs    = NO_BRIGHTNESS;
+            poutput->ppanel         = ppanel;
+            poutputs->num_outputs++;
+            TRACE("[query_outputs] output %d: known panel, range %d..%d\n", poutput->output, poutput->brn_min_abs, poutput->brn_max_abs);
+            continue;
+        }
+        int32_t brn_cur_abs = get_brightness_randr(pxcb, outputs[o]);
+        if (brn_cur_abs == NO_BRIGHTNESS) {
+            poutput->ppanel = ppanel;
+            if (GAMMA_DIMMING && query_gamma(pxcb, outputs[o], poutput, &previous)) {
+                poutput->output         = outputs[o];
+                poutput->backlight_atom = XCB_ATOM_NONE;
+                poutput->brn_min_abs    = 0;
+                poutput->brn_max_abs    = GAMMA_LEVEL_MAX;
+                poutput->brn_cur_abs    = poutput->gamma_level;
+                poutputs->num_outputs++;
+                if (ppanel) { ppanel->gamma = true; }
+                TRACE("[query_outputs] output %d: gamma dimming at level %d\n", poutput->output, poutput->gamma_level);
+            }
+            continue;
+        }
+
+        xcb_randr_query_output_property_cookie_t prop_cookie;
+        xcb_randr_query_output_property_reply_t *prop_reply;
+
+        prop_cookie = xcb_randr_query_output_property(pxcb->connection, outputs[o], pxcb->backlight_atom);
+        prop_reply  = xcb_randr_query_output_property_reply(pxcb->connection, prop_cookie, &error);
+        gs_metrics.round_trips++;
+        if (error != NULL || prop_reply == NULL) {
+            TRACE("[query_outputs] error %d while querying output property, continuing to next display\n", error ? error->error_code : -1);
+            free(error);
+            error = NULL;
+            continue;
+        }
+
+        if (prop_reply->range && xcb_randr_query_output_property_valid_values_length(prop_reply) == 2) {
+            const int32_t *values   = xcb_randr_query_output_property_valid_values(prop_reply);
+            poutput->output         = outputs[o];
+            poutput->backlight_atom = pxcb->backlight_atom;
+            poutput->brn_min_abs    = values[0];
+            poutput->brn_max_abs    = values[1];
+            poutput->brn_cur_abs    = brn_cur_abs;
+            poutput->ppanel         = ppanel;
+            poutputs->num_outputs++;
+            if (ppanel) {
+                ppanel->brn_min_abs = values[0];
+                ppanel->brn_max_abs = values[1];
+                ppanel->legacy_atom = pxcb->backlight_atom == pxcb->backlight_legacy_atom;
+                ppanel->gamma       = false;
+            }
+            TRACE("[query_outputs] output %d: backlight %d, range %d..%d\n", poutput->output, poutput->backlight_atom, poutput->brn_min_abs, poutput->brn_max_abs);
+        }
+        free(prop_reply);
+    }
+    for (; o < num_edids; o++) {
+        xcb_discard_reply(pxcb->connection, edid_cookies[o].sequence);
+    }
+    for (uint8_t p = 0; p < previous.num_outputs; p++) {
+        // ramps of gamma-dimmed outputs that are gone for good
+        free(previous.outputs[p].gamma_ramps);
+    }
+    free(resources_reply);
+    poutputs->valid = true;
+    return poutputs->num_outputs > 0;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _operation_handler_randr()
+///////////////////////////////////////////////////////////////////////////////
+/** Provides set/get/increase/decrease brightness operations using xrandr.
+
+    Works on the cached backlight outputs, see `query_outputs()`, so the only
+    round trips are the brightness readings; writes are confirmed by their
+    property echo later on. The level of gamma-dimmed outputs is known without
+    asking the server.
+
+    @param operation        the brightness operation to perform
+    @param pxcb             the global xcb container struct
+    @param brn_percent      brightness percentage to set/increase/decrease depending on `operation`
+    @param brn_cur_perc     the current brightness as percentage
+    @param brn_new_perc     the new brightness as percentage
+    @return                 true if operation could be performed, false on an unrecoverable error
+
+    @see operations_t
+    @see Txcb
+    @see query_outputs
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+bool _operation_handler_randr(const operations_t operation, struct Txcb *pxcb, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc) {
+    bool output_found = false;
+
+    if (!gs_outputs.valid && !query_outputs(pxcb, &gs_outputs)) {
+        ERROR("Error: Couldn't find any output with a backlight property.\n");
+        return false;
+    }
+
+    if (operation != OPERATION_GETBRIGHTNESS && !gs_restoreplan.valid) {
+        gs_restoreplan.num_entries = 0;
+    }
+
+    for (uint8_t o = 0; o < gs_outputs.num_outputs; o++) {
+        struct Toutput *poutput = &gs_outputs.outputs[o];
+        // a fade's later steps start from the level its previous step wrote, no round trip per refresh
+        const bool fading   = operation == OPERATION_SETBRIGHTNESS && gs_timer.action == TIMER_FADE && gs_fade.written;
+        int32_t brn_cur_abs = poutput->gamma_ramps ? poutput->gamma_level
+                            : fading && poutput->brn_cur_abs != NO_BRIGHTNESS ? poutput->brn_cur_abs
+                            : _get_brightness_randr(pxcb, poutput->output, &poutput->backlight_atom);
+        poutput->brn_cur_abs = brn_cur_abs;
+        if (brn_cur_abs == NO_BRIGHTNESS) {
+            // the output vanished under our feet or the panel's record is stale, probe again next time
+            gs_metrics.backend_errors++;
+            if (poutput->ppanel) { poutput->ppanel->brn_max_abs = poutput->ppanel->brn_min_abs; }
+            gs_outputs.valid = false;
+            continue;
+        }
+        output_found = true;
+
+        int32_t brn_min_abs = poutput->brn_min_abs;
+        int32_t brn_max_abs = poutput->brn_max_abs;
+        int32_t brn_new_abs = brn_percent * (brn_max_abs - brn_min_abs) / 100;
+        *brn_cur_perc = (uint8_t) ((brn_cur_abs - brn_min_abs) * 100 / (brn_max_abs - brn_min_abs));
+        *brn_new_perc = *brn_cur_perc;
+
+        switch (operation) {
+            case OPERATION_GETBRIGHTNESS:
+                TRACE("[operation_handler] OPERATION_GETBRIGHTNESS\n");
+                TRACE("[operation_handler] min_abs:%d <= cur_abs:%d <= max_abs:%d\n", brn_min_abs, brn_cur_abs, brn_max_abs);
+                return true;
+            case OPERATION_SETBRIGHTNESS:
+                brn_new_abs = brn_min_abs + brn_new_abs;
+                TRACE("[operation_handler] OPERATION_SETBRIGHTNESS -> %d (abs)\n", brn_new_abs);
+                break;
+            case OPERATION_INCBRIGHTNESS:
+                brn_new_abs = brn_cur_abs + brn_new_abs;
+                TRACE("[operation_handler] OPERATION_INCBRIGHTNESS -> %d (abs)\n", brn_new_abs);
+                break;
+            case OPERATION_DECBRIGHTNESS:
+                brn_new_abs = brn_cur_abs - brn_new_abs;
+                TRACE("[operation_handler] OPERATION_DECBRIGHTNESS -> %d (abs)\n", brn_new_abs);
+        }
+        if (brn_new_abs > brn_max_abs) { brn_new_abs = brn_max_abs; }
+        if (brn_new_abs < brn_min_abs) { brn_new_abs = brn_min_abs; }
+        *brn_new_perc = (uint8_t) (brn_new_abs * 100 / (brn_max_abs - brn_min_abs));
+
+        TRACE("[operation_handler] min_abs:%d <= cur_abs:%d -> new_abs:%d <= max_abs:%d\n", brn_min_abs, brn_cur_abs, brn_new_abs, brn_max_abs);
+        TRACE("[operation_handler] cur_perc:%d -> new_perc:%d\n", *brn_cur_perc, *brn_new_perc);
+
+        if (!gs_restoreplan.valid && poutput->ppanel) {
+            poutput->ppanel->brn_restore_abs = brn_cur_abs;
+        }
+        const struct Tplanentry entry = { .ppanel = poutput->ppanel, .output = poutput->output, .backlight_atom = poutput->backlight_atom, .value_abs = brn_cur_abs };
+        restore_plan_record(&gs_restoreplan, &entry);
+        if (poutput->gamma_ramps) {
+            gamma_apply(pxcb, poutput, brn_new_abs);
+        } else if (set_brightness_randr(pxcb, poutput->output, brn_new_abs) != RET_OK) {
+            return false;
+        }
+        poutput->brn_cur_abs = brn_new_abs;
+        xcb_flush(pxcb->connection);
+    }
+    if (operation != OPERATION_GETBRIGHTNESS) {
+        gs_restoreplan.valid = gs_restoreplan.num_entries > 0;
+    }
+    if (!output_found) {
+        ERROR("Error: Couldn't get brightness for any output.\n");
+    }
+    return output_found;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _operation_handler_file()
+///////////////////////////////////////////////////////////////////////////////
+/** Provides set/get/increase/decrease brightness operations using sysfs files.
+
+    @param operation        the brightness operation to perform
+    @param brn_percent      brightness percentage to set/increase/decrease depending on `operation`
+    @param brn_cur_perc     the current brightness as percentage
+    @param brn_new_perc     the new brightness as percentage
+    @return                 true if operation could be performed, false on an unrecoverable error
+
+    @see operations_t
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+bool _operation_handler_file(const operations_t operation, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc) {
+    int32_t brn_min_abs = 0;
+    int32_t brn_max_abs = 0;
+    int32_t brn_cur_abs = 0;
+
+    // the file lags behind while a write is still in flight
+    if ( NO_BRIGHTNESS == (brn_cur_abs = backlight_current()) ) {
+        ERROR("Error: Couldn't get current brightness for output.\n");
+        return false;
+    }
+    if ( NO_BRIGHTNESS == (brn_max_abs = gs_sysfs.brn_max_abs) ) {
+        ERROR("Error: Couldn't get maximal brightness for output.\n");
+        return false;
+    }
+    gs_sysfs.brn_cur_abs = brn_cur_abs;
+    int32_t brn_new_abs = brn_percent * (brn_max_abs - brn_min_abs) / 100;
+    *brn_cur_perc = (uint8_t) ((brn_cur_abs - brn_min_abs) * 100 / (brn_max_abs - brn_min_abs));
+    *brn_new_perc = *brn_cur_perc;
+
+    switch (operation) {
+        case OPERATION_GETBRIGHTNESS:
+            TRACE("[operation_handler] OPERATION_GETBRIGHTNESS\n");
+            TRACE("[operation_handler] min_abs:%d <= cur_abs:%d <= max_abs:%d\n", brn_min_abs, brn_cur_abs, brn_max_abs);
+            return true;
+        case OPERATION_SETBRIGHTNESS:
+            brn_new_abs = brn_min_abs + brn_new_abs;
+            TRACE("[operation_handler] OPERATION_SETBRIGHTNESS -> %d (abs)\n", brn_new_abs);
+            break;
+        case OPERATION_INCBRIGHTNESS:
+            brn_new_abs = brn_cur_abs + brn_new_abs;
+            TRACE("[operation_handler] OPERATION_INCBRIGHTNESS -> %d (abs)\n", brn_new_abs);
+            break;
+        case OPERATION_DECBRIGHTNESS:
+            brn_new_abs = brn_cur_abs - brn_new_abs;
+            TRACE("[operation_handler] OPERATION_DECBRIGHTNESS -> %d (abs)\n", brn_new_abs);
+    }
+    if (brn_new_abs > brn_max_abs) { brn_new_abs = brn_max_abs; }
+    if (brn_new_abs < brn_min_abs) { brn_new_abs = brn_min_abs; }
+    *brn_new_perc = (uint8_t) (brn_new_abs * 100 / (brn_max_abs - brn_min_abs));
+
+    TRACE("[operation_handler] min_abs:%d <= cur_abs:%d -> new_abs:%d <= max_abs:%d\n", brn_min_abs, brn_cur_abs, brn_new_abs, brn_max_abs);
+    TRACE("[operation_handler] cur_perc:%d -> new_perc:%d\n", *brn_cur_perc, *brn_new_perc);
+
+    if (!gs_restoreplan.valid) {
+        const struct Tplanentry entry = { .ppanel = gs_sysfs.ppanel, .value_abs = brn_cur_abs };
+        if (gs_sysfs.ppanel) {
+            gs_sysfs.ppanel->brn_restore_abs = brn_cur_abs;
+        }
+        gs_restoreplan.num_entries = 0;
+        restore_plan_record(&gs_restoreplan, &entry);
+        gs_restoreplan.valid = true;
+    }
+    (void)backlight_write(brn_new_abs);
+    backlight_flush();
+    gs_sysfs.brn_cur_abs = brn_new_abs;
+    confirm_expect(0, XCB_ATOM_NONE, brn_new_abs, 0);
+
+    return true;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// restore_plan_record()
+///////////////////////////////////////////////////////////////////////////////
+/** Record an output's brightness from before the first dimming write.
+
+    Entries are only recorded as long as the plan is not valid yet, i.e., the
+    plan holds the brightness values from before the screen got dimmed.
+
+    @param pplan            the restore plan
+    @param pentry           the output and its *absolute* brightness prior to the write
+
+    @see Tplan
+    @see restore_plan_reset
+*/
+static inline void restore_plan_record(struct Tplan *pplan, const struct Tplanentry *pentry) {
+    if (pplan->valid || pplan->num_entries >= PLAN_MAX_ENTRIES) {
+        return;
+    }
+    pplan->entries[pplan->num_entries++] = *pentry;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// restore_plan_reset()
+///////////////////////////////////////////////////////////////////////////////
+/** Invalidate the restore plan once the brightness has been restored.
+
+    The prior brightness values the plan's panels keep in the state file are
+    dropped as well.
+
+    @param pplan            the restore plan
+
+    @see Tplan
+    @see state_cache_clear_restore
+*/
+static inline void restore_plan_reset(struct Tplan *pplan) {
+    state_cache_clear_restore(pplan);
+    pplan->num_entries = 0;
+    pplan->valid       = false;
+    pplan->deferred    = false;
+    pplan->pending     = false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// apply_plan()
+///////////////////////////////////////////////////////////////////////////////
+/** Write all absolute brightness values of a plan in one batch.
+
+    On the xrandr backend, all property changes and gamma ramps are issued
+    unchecked and flushed at once, i.e., without any round trip. The sysfs backend has a
+    single entry only, queued to the io_uring or handed to the backlight writer
+    thread.
+
+    @param pxcb             the global xcb container struct
+    @param pplan            the plan to apply
+    @return                 true if all values could be written, false otherwise
+
+    @see Tplan
+*/
+static bool apply_plan(const struct Txcb *pxcb, const struct Tplan *pplan) {
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    (void)pxcb;
+    for (uint8_t e = 0; e < pplan->num_entries; e++) {
+        TRACE("[apply_plan] brightness_abs=%d\n", pplan->entries[e].value_abs);
+        gs_sysfs.brn_cur_abs = pplan->entries[e].value_abs;
+        if (backlight_write(pplan->entries[e].value_abs) != RET_OK) {
+            return false;
+        }
+        confirm_expect(0, XCB_ATOM_NONE, pplan->entries[e].value_abs, 0);
+    }
+    backlight_flush();
+    return true;
+#else
+    for (uint8_t e = 0; e < pplan->num_entries; e++) {
+        TRACE("[apply_plan] brightness_abs=%d [output: %d][backlight: %d]\n", pplan->entries[e].value_abs, pplan->entries[e].output, pplan->entries[e].backlight_atom);
+        if (pplan->entries[e].backlight_atom == XCB_ATOM_NONE) {
+            struct Toutput *poutput = find_output(pplan->entries[e].output);
+            if (poutput && poutput->gamma_ramps) {
+                gamma_apply(pxcb, poutput, pplan->entries[e].value_abs);
+            }
+            continue;
+        }
+        xcb_void_cookie_t cookie = xcb_randr_change_output_property(pxcb->connection, pplan->entries[e].output, pplan->entries[e].backlight_atom,
+            XCB_ATOM_INTEGER, 32, XCB_PROP_MODE_REPLACE, 1, &pplan->entries[e].value_abs);
+        gs_metrics.writes++;
+        confirm_expect(pplan->entries[e].output, pplan->entries[e].backlight_atom, pplan->entries[e].value_abs, cookie.sequence);
+        struct Toutput *poutput = find_output(pplan->entries[e].output);
+        if (poutput) {
+            poutput->brn_cur_abs = pplan->entries[e].value_abs;
+        }
+    }
+    return xcb_flush(pxcb->connection) > 0;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// plan_capture()
+///////////////////////////////////////////////////////////////////////////////
+/** Record the current absolute brightness of all outputs as a plan.
+
+    Used as restore plan by the dimming schedule, so the values are kept in
+    the state file as well.
+
+    @param pxcb             the global xcb container struct
+    @param pplan            the plan to fill in
+    @return                 true if any output's brightness could be read, false otherwise
+
+    @see plan_scale
+*/
+static bool plan_capture(struct Txcb *pxcb, struct Tplan *pplan) {
+    pplan->num_entries = 0;
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    (void)pxcb;
+    int32_t brn_cur_abs = backlight_current();
+    if (brn_cur_abs != NO_BRIGHTNESS) {
+        pplan->entries[pplan->num_entries++] = (struct Tplanentry){ .ppanel = gs_sysfs.ppanel, .value_abs = brn_cur_abs };
+        if (gs_sysfs.ppanel) { gs_sysfs.ppanel->brn_restore_abs = brn_cur_abs; }
+    }
+#else
+    if (!gs_outputs.valid && !query_outputs(pxcb, &gs_outputs)) {
+        return false;
+    }
+    for (uint8_t o = 0; o < gs_outputs.num_outputs && pplan->num_entries < PLAN_MAX_ENTRIES; o++) {
+        const struct Toutput *poutput = &gs_outputs.outputs[o];
+        int32_t brn_cur_abs = poutput->gamma_ramps ? poutput->gamma_level : _get_brightness_randr(pxcb, poutput->output, &poutput->backlight_atom);
+        if (brn_cur_abs == NO_BRIGHTNESS) {
+            continue;
+        }
+        pplan->entries[pplan->num_entries++] = (struct Tplanentry){
+            .ppanel         = poutput->ppanel,
+            .output         = poutput->output,
+            .backlight_atom = poutput->backlight_atom,
+            .value_abs      = brn_cur_abs
+        };
+        if (poutput->ppanel) { poutput->ppanel->brn_restore_abs = brn_cur_abs; }
+    }
+#endif
+    pplan->valid = pplan->num_entries > 0;
+    return pplan->valid;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// plan_scale()
+///////////////////////////////////////////////////////////////////////////////
+/** Compute a plan setting all outputs of a plan to a brightness percentage.
+
+    An output already darker than the percentage is left as it is.
+
+    @param pprior           the plan with the outputs' current brightness
+    @param brn_percent      the brightness percentage of the new plan
+    @param pplan            the plan to fill in
+
+    @see plan_capture
+*/
+static void plan_scale(const struct Tplan *pprior, const uint8_t brn_percent, struct Tplan *pplan) {
+    *pplan = *pprior;
+    for (uint8_t e = 0; e < pplan->num_entries; e++) {
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+        int32_t brn_min_abs = 0;
+        int32_t brn_max_abs = gs_sysfs.brn_max_abs;
+#else
+        const struct Toutput *poutput = find_output(pplan->entries[e].output);
+        if (!poutput) {
+            continue;
+        }
+        int32_t brn_min_abs = poutput->brn_min_abs;
+        int32_t brn_max_abs = poutput->brn_max_abs;
+#endif
+        int32_t brn_new_abs = brn_min_abs + brn_percent * (brn_max_abs - brn_min_abs) / 100;
+        if (brn_new_abs < pplan->entries[e].value_abs) {
+            pplan->entries[e].value_abs = brn_new_abs;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fnv1a_64()
+///////////////////////////////////////////////////////////////////////////////
+/** Hash a byte sequence with 64-bit FNV-1a.
+
+    @param data             the bytes to hash
+    @param length           the number of bytes
+    @return                 the hash, never 0 so that it can serve as key
+*/
+static uint64_t fnv1a_64(const uint8_t *data, const size_t length) {
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash ? hash : 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// state_cache_open()
+///////////////////////////////////////////////////////////////////////////////
+/** Map the state file `$XDG_CACHE_HOME/brightnessd/state` into memory.
+
+    The file is shared-mapped, so the stores into it reach the page cache
+    immediately and outlive a crash or `kill -9` of the daemon. A file with
+    an unknown layout is reset.
+
+    @return                 true if the state file is mapped, false otherwise
+
+    @see Tstatefile
+*/
+static bool state_cache_open(void) {
+    char path[PATH_MAX];
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home       = getenv("HOME");
+    int length;
+
+    if (cache_home && cache_home[0] == '/') {
+        length = snprintf(path, sizeof(path), "%s", cache_home);
+    } else if (home && home[0] == '/') {
+        length = snprintf(path, sizeof(path), "%s/.cache", home);
+    } else {
+        return false;
+    }
+    if (length < 0 || (size_t)length >= sizeof(path) - sizeof("/"PROGNAME"/state")) {
+        return false;
+    }
+    (void)mkdir(path, 0700);
+    (void)strcat(path, "/"PROGNAME);
+    if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+        WARN("Warning: cannot create directory %s (%s)\n", path, strerror(errno));
+        return false;
+    }
+    (void)strcat(path, "/state");
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(struct Tstatefile)) < 0) {
+        WARN("Warning: cannot open state file %s (%s)\n", path, strerror(errno));
+        if (fd >= 0) { (void)close(fd); }
+        return false;
+    }
+    void *mapping = mmap(NULL, sizeof(struct Tstatefile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (mapping == MAP_FAILED) {
+        WARN("Warning: cannot map state file %s (%s)\n", path, strerror(errno));
+        return false;
+    }
+    gs_statefile = mapping;
+    if (gs_statefile->magic != STATE_CACHE_MAGIC || gs_statefile->version != STATE_CACHE_VERSION) {
+        DEBUG("[state_cache] initializing state file %s\n", path);
+        memset(gs_statefile, 0, sizeof(struct Tstatefile));
+        gs_statefile->magic   = STATE_CACHE_MAGIC;
+        gs_statefile->version = STATE_CACHE_VERSION;
+    }
+    DEBUG("[state_cache] using state file %s\n", path);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// state_cache_panel()
+///////////////////////////////////////////////////////////////////////////////
+/** Look up a panel's state record, claiming a slot for an unknown panel.
+
+    When all slots are taken, the slots are reused round-robin.
+
+    @param key              the panel's hash
+    @return                 the panel's record, or NULL if there is no state file
+
+    @see Tpanelstate
+*/
+static struct Tpanelstate *state_cache_panel(const uint64_t key) {
+    if (!gs_statefile) {
+        return NULL;
+    }
+    struct Tpanelstate *pfree = NULL;
+    for (uint8_t p = 0; p < STATE_CACHE_PANELS; p++) {
+        if (gs_statefile->panels[p].key == key) {
+            return &gs_statefile->panels[p];
+        }
+        if (!pfree && gs_statefile->panels[p].key == 0) {
+            pfree = &gs_statefile->panels[p];
+        }
+    }
+    if (!pfree) {
+        pfree = &gs_statefile->panels[gs_statefile->next_slot++ % STATE_CACHE_PANELS];
+    }
+    pfree->key             = key;
+    pfree->brn_min_abs     = 0;
+    pfree->brn_max_abs     = 0;
+    pfree->brn_restore_abs = NO_BRIGHTNESS;
+    pfree->legacy_atom     = false;
+    return pfree;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// state_cache_clear_restore()
+///////////////////////////////////////////////////////////////////////////////
+/** Forget the persisted brightness values from before dimming of a plan's panels.
+
+    Panels of other outputs keep theirs, e.g., a panel that was unplugged
+    while dimmed and gets restored once it shows up again.
+
+    @param pplan            the plan whose panels to clear
+
+    @see state_cache_restore
+*/
+static void state_cache_clear_restore(const struct Tplan *pplan) {
+    if (!gs_statefile) {
+        return;
+    }
+    for (uint8_t e = 0; e < pplan->num_entries; e++) {
+        if (pplan->entries[e].ppanel) {
+            pplan->entries[e].ppanel->brn_restore_abs = NO_BRIGHTNESS;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// state_cache_restore()
+///////////////////////////////////////////////////////////////////////////////
+/** Restore the brightness a previous instance left dimmed.
+
+    The prior brightness values recorded when dimming are still in the state
+    file if the daemon died before undimming. They are written back as a
+    restore plan.
+
+    @param pxcb             the global xcb container struct
+
+    @see apply_plan
+    @see state_cache_clear_restore
+*/
+static void state_cache_restore(struct Txcb *pxcb) {
+    if (!gs_statefile) {
+        return;
+    }
+    gs_restoreplan.num_entries = 0;
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    if (gs_sysfs.ppanel && gs_sysfs.ppanel->brn_restore_abs != NO_BRIGHTNESS) {
+        gs_restoreplan.entries[gs_restoreplan.num_entries++] = (struct Tplanentry){ .ppanel = gs_sysfs.ppanel, .value_abs = gs_sysfs.ppanel->brn_restore_abs };
+    }
+#else
+    if (!gs_outputs.valid) {
+        (void)query_outputs(pxcb, &gs_outputs);
+    }
+    for (uint8_t o = 0; o < gs_outputs.num_outputs; o++) {
+        const struct Toutput *poutput = &gs_outputs.outputs[o];
+        if (poutput->ppanel && poutput->ppanel->brn_restore_abs != NO_BRIGHTNESS) {
+            gs_restoreplan.entries[gs_restoreplan.num_entries++] = (struct Tplanentry){
+                .ppanel         = poutput->ppanel,
+                .output         = poutput->output,
+                .backlight_atom = poutput->backlight_atom,
+                .value_abs      = poutput->ppanel->brn_restore_abs
+            };
+        }
+    }
+#endif
+    if (gs_restoreplan.num_entries > 0) {
+        WARN("Warning: restoring brightness left dimmed by a previous instance\n");
+        if (!apply_plan(pxcb, &gs_restoreplan)) {
+            ERROR("Error: cannot restore brightness left dimmed by a previous instance\n");
+        }
+    }
+    restore_plan_reset(&gs_restoreplan);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// operation_handler()
+///////////////////////////////////////////////////////////////////////////////
+/** Wrapper function calling the sysfs files backend or the xrandr backend variant.
+
+    @param operation        the brightness operation to perform
+    @param pxcb             the global xcb container struct
+    @param brn_percent      brightness percentage to set/increase/decrease depending on `operation`
+    @param brn_cur_perc     the current brightness as percentage
+    @param brn_new_perc     the new brightness as percentage
+    @return                 true if operation could be performed, false on an unrecoverable error
+
+    @see _operation_handler_file
+    @see _operation_handler_randr
+*/
+static inline bool operation_handler(const operations_t operation, struct Txcb *pxcb, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc){
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    (void)pxcb;
+    return _operation_handler_file(operation, brn_percent, brn_cur_perc, brn_new_perc);
+#else
+    return _operation_handler_randr(operation, pxcb, brn_percent, brn_cur_perc, brn_new_perc);
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// print_stats()
+///////////////////////////////////////////////////////////////////////////////
+/** Print the event loop counters to stderr.
+
+    Called on SIGUSR1 and, in debug builds, on exit.
+
+    @see Tstats
+*/
+static void print_stats(void) {
+    (void)fprintf(stderr, "["PROGNAME"::STATS] wakeups: total=%lu x=%lu timer=%lu worker=%lu uevent=%lu hook=%lu socket=%lu signal=%lu timeout=%lu\n",
+        (unsigned long)gs_stats.wakeups,
+        (unsigned long)gs_stats.wakeups_by_source[WAKEUP_X],
+        (unsigned long)gs_stats.wakeups_by_source[WAKEUP_TIMER],
+        (unsigned long)gs_stats.wakeups_by_source[WAKEUP_WORKER],
+        (unsigned long)gs_stats.wakeups_by_source[WAKEUP_UEVENT],
+        (unsigned long)gs_stats.wakeups_by_source[WAKEUP_HOOK],
+        (unsigned long)gs_stats.wakeups_by_source[WAKEUP_SOCKET],
+        (unsigned long)gs_stats.wakeups_by_source[WAKEUP_SIGNAL],
+        (unsigned long)gs_stats.wakeups_by_source[WAKEUP_TIMEOUT]
+    );
+    (void)fprintf(stderr, "["PROGNAME"::STATS] events: received=%lu screensaver=%lu bursts=%lu\n",
+        (unsigned long)gs_stats.events_received,
+        (unsigned long)gs_stats.events_screensaver,
+        (unsigned long)gs_stats.bursts
+    );
+    (void)fprintf(stderr, "["PROGNAME"::STATS] transitions: handled=%lu elided=%lu\n",
+        (unsigned long)gs_stats.transitions_handled,
+        (unsigned long)gs_stats.transitions_elided
+    );
+    (void)fprintf(stderr, "["PROGNAME"::STATS] dpms: events=%lu suppressed=%lu plan_restores=%lu\n",
+        (unsigned long)gs_stats.events_dpms,
+        (unsigned long)gs_stats.backend_ops_suppressed,
+        (unsigned long)gs_stats.plan_restores
+    );
+    (void)fprintf(stderr, "["PROGNAME"::STATS] fullscreen: dims_inhibited=%lu\n",
+        (unsigned long)gs_stats.dims_inhibited
+    );
+    if (gs_power.enabled) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] power: source=%s uevents=%lu switches=%lu\n",
+            gs_power.source == POWER_SOURCE_BATTERY ? "battery" : "ac",
+            (unsigned long)gs_power.uevents,
+            (unsigned long)gs_power.switches
+        );
+    }
+    if (gs_leds.num_leds > 0) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] leds: devices=%u dims=%lu restores=%lu writes=%lu\n",
+            gs_leds.num_leds,
+            (unsigned long)gs_leds.dims,
+            (unsigned long)gs_leds.restores,
+            (unsigned long)gs_leds.writes
+        );
+    }
+    if (gs_hooks.enabled) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] hooks: spawned=%lu exited=%lu failed=%lu killed=%lu dropped=%lu running=%u spawn_max=%luus\n",
+            (unsigned long)gs_hooks.spawned,
+            (unsigned long)gs_hooks.exited,
+            (unsigned long)gs_hooks.failed,
+            (unsigned long)gs_hooks.killed,
+            (unsigned long)gs_hooks.dropped,
+            gs_hooks.num_running,
+            (unsigned long)gs_hooks.spawn_us_max
+        );
+    }
+    if (gs_stats.reconnects > 0) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] reconnect: reconnects=%lu attempts=%lu topology_reused=%lu recovery_last=%luus recovery_max=%luus\n",
+            (unsigned long)gs_stats.reconnects,
+            (unsigned long)gs_stats.reconnect_attempts,
+            (unsigned long)gs_stats.reconnect_topology_reused,
+            (unsigned long)gs_stats.recovery_us_last,
+            (unsigned long)gs_stats.recovery_us_max
+        );
+    }
+    (void)fprintf(stderr, "["PROGNAME"::STATS] subscription: subscribers=%u pushed=%lu coalesced=%lu\n",
+        gs_subscription.num_subscribers,
+        (unsigned long)gs_subscription.pushed,
+        (unsigned long)gs_subscription.coalesced
+    );
+    (void)fprintf(stderr, "["PROGNAME"::STATS] restore: fast=%lu issue_latency_max=%luus over_%uus=%lu\n",
+        (unsigned long)gs_metrics.restores_fast,
+        (unsigned long)gs_metrics.issue_latency_us_max,
+        RESTORE_TARGET_US,
+        (unsigned long)gs_metrics.issues_over_target
+    );
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    if (gs_present.enabled) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] fade: present frames=%lu written=%lu busy=%lu\n",
+            (unsigned long)gs_present.frames,
+            (unsigned long)gs_present.frames_written,
+            (unsigned long)gs_present.frames_busy
+        );
+    }
+    #endif
+    for (uint8_t d = 0; d < gs_confirm.num_devices; d++) {
+        const struct Tconfirmdevice *pdevice = &gs_confirm.devices[d];
+        (void)fprintf(stderr, "["PROGNAME"::STATS] confirm: device=%u confirmed=%lu reissued=%lu failed=%lu latency_avg=%luus latency_max=%luus\n",
+            pdevice->output,
+            (unsigned long)pdevice->confirmed,
+            (unsigned long)pdevice->reissued,
+            (unsigned long)pdevice->failed,
+            (unsigned long)(pdevice->confirmed ? pdevice->latency_us_sum / pdevice->confirmed : 0),
+            (unsigned long)pdevice->latency_us_max
+        );
+    }
+    if (gs_metrics.path) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] metrics: written=%lu errors=%lu restores=%lu\n",
+            (unsigned long)gs_metrics.written,
+            (unsigned long)gs_metrics.write_errors,
+            (unsigned long)gs_metrics.restores
+        );
+    }
+    if (ADAPTIVE_DELAY_MAX > 0) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] adaptive: samples=%u avoided=%lu cancelled=%lu stuck=%lu\n",
+            gs_adaptive.samples,
+            (unsigned long)gs_adaptive.dims_avoided,
+            (unsigned long)gs_adaptive.dims_cancelled,
+            (unsigned long)gs_adaptive.dims_stuck
+        );
+        (void)fprintf(stderr, "["PROGNAME"::STATS] adaptive: decisions=%lu delay=%us (max %us) curve=%.2f cancel_probability=%.2f\n",
+            (unsigned long)gs_adaptive.decisions,
+            gs_adaptive.delay_s,
+            ADAPTIVE_DELAY_MAX,
+            gs_adaptive.curve,
+            gs_adaptive.cancel_probability
+        );
+    }
+    #ifdef USE_IO_URING
+    if (gs_uring.running) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] uring: submitted=%lu completed=%lu enters=%lu superseded=%lu errors=%lu write_latency_avg=%luus write_latency_max=%luus\n",
+            (unsigned long)gs_uring.submitted,
+            (unsigned long)gs_uring.completed,
+            (unsigned long)gs_uring.enters,
+            (unsigned long)gs_uring.superseded,
+            (unsigned long)gs_uring.errors,
+            (unsigned long)(gs_uring.completed > gs_uring.errors ? gs_uring.latency_ns_total / (gs_uring.completed - gs_uring.errors) / 1000 : 0),
+            (unsigned long)(gs_uring.latency_ns_max / 1000)
+        );
+    }
+    #endif
+    #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    if (SYSFS_WRITER == WRITER_LOGIND) {
+        (void)fprintf(stderr, "["PROGNAME"::STATS] logind: submitted=%lu completed=%lu superseded=%lu errors=%lu reconnects=%lu inflight=%u write_latency_avg=%luus write_latency_max=%luus\n",
+            (unsigned long)gs_logind.submitted,
+            (unsigned long)gs_logind.completed,
+            (unsigned long)gs_logind.superseded,
+            (unsigned long)gs_logind.errors,
+            (unsigned long)gs_logind.reconnects,
+            gs_logind.inflight,
+            (unsigned long)(gs_logind.completed > gs_logind.errors ? gs_logind.latency_ns_total / (gs_logind.completed - gs_logind.errors) / 1000 : 0),
+            (unsigned long)(gs_logind.latency_ns_max / 1000)
+        );
+    }
+    uint64_t written = atomic_load(&gs_worker.written);
+    (void)fprintf(stderr, "["PROGNAME"::STATS] worker: submitted=%lu written=%lu superseded=%lu errors=%lu depth=%lu depth_max=%lu\n",
+        (unsigned long)gs_worker.submitted,
+        (unsigned long)written,
+        (unsigned long)gs_worker.superseded,
+        (unsigned long)atomic_load(&gs_worker.errors),
+        (unsigned long)backlight_worker_outstanding(&gs_worker),
+        (unsigned long)gs_worker.depth_max
+    );
+    (void)fprintf(stderr, "["PROGNAME"::STATS] worker: write_latency_avg=%luus write_latency_max=%luus\n",
+        (unsigned long)(written ? atomic_load(&gs_worker.latency_ns_total) / written / 1000 : 0),
+        (unsigned long)(atomic_load(&gs_worker.latency_ns_max) / 1000)
+    );
+    #endif
+    #ifdef ALLOC_AUDIT
+    (void)fprintf(stderr, "["PROGNAME"::STATS] allocations: total=%lu libxcb=%lu iterations=%lu allocating=%lu max_per_iteration=%lu own_warmup=%lu\n",
+        (unsigned long)atomic_load(&gs_allocaudit.allocs),
+        (unsigned long)atomic_load(&gs_allocaudit.allocs_xcb),
+        (unsigned long)gs_allocaudit.iterations,
+        (unsigned long)gs_allocaudit.iterations_allocating,
+        (unsigned long)gs_allocaudit.max_per_iteration,
+        (unsigned long)gs_allocaudit.own_warmup
+    );
+    #endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// malloc(), calloc(), realloc()
+///////////////////////////////////////////////////////////////////////////////
+/** Counting allocator wrappers of the allocation audit build.
+
+    Forward to glibc's allocator and count every allocation, separately those
+    made from within libxcb, i.e., the replies and events it hands out.
+
+    @see Tallocaudit
+    @see alloc_audit_checkpoint
+*/
+#ifdef ALLOC_AUDIT
+void *malloc(size_t size) {
+    atomic_fetch_add(&gs_allocaudit.allocs, 1);
+    if (alloc_audit_is_xcb((uintptr_t)__builtin_return_address(0))) { atomic_fetch_add(&gs_allocaudit.allocs_xcb, 1); }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    atomic_fetch_add(&gs_allocaudit.allocs, 1);
+    if (alloc_audit_is_xcb((uintptr_t)__builtin_return_address(0))) { atomic_fetch_add(&gs_allocaudit.allocs_xcb, 1); }
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add(&gs_allocaudit.allocs, 1);
+    if (alloc_audit_is_xcb((uintptr_t)__builtin_return_address(0))) { atomic_fetch_add(&gs_allocaudit.allocs_xcb, 1); }
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// alloc_audit_is_xcb()
+///////////////////////////////////////////////////////////////////////////////
+/** Check whether an address lies within the code of one of the libxcb libraries.
+
+    @param address          the return address of an allocator call
+    @return                 true if `address` belongs to libxcb, false otherwise
+*/
+#ifdef ALLOC_AUDIT
+static bool alloc_audit_is_xcb(const uintptr_t address) {
+    for (uint8_t r = 0; r < gs_allocaudit.num_ranges; r++) {
+        if (address >= gs_allocaudit.xcb_start[r] && address < gs_allocaudit.xcb_end[r]) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// alloc_audit_phdr_callback()
+///////////////////////////////////////////////////////////////////////////////
+/** `dl_iterate_phdr()` callback collecting the executable segments of libxcb*.
+
+    @param info             the loaded object's program headers
+    @param size             size of `info`
+    @param data             unused
+    @return                 0 to continue the iteration
+*/
+#ifdef ALLOC_AUDIT
+static int alloc_audit_phdr_callback(struct dl_phdr_info *info, size_t size, void *data) {
+    (void)size;
+    (void)data;
+    if (info->dlpi_name == NULL || strstr(info->dlpi_name, "libxcb") == NULL) {
+        return 0;
+    }
+    for (uint16_t h = 0; h < info->dlpi_phnum && gs_allocaudit.num_ranges < ALLOC_AUDIT_MAX_RANGES; h++) {
+        if (info->dlpi_phdr[h].p_type == PT_LOAD && (info->dlpi_phdr[h].p_flags & PF_X)) {
+            gs_allocaudit.xcb_start[gs_allocaudit.num_ranges] = info->dlpi_addr + info->dlpi_phdr[h].p_vaddr;
+            gs_allocaudit.xcb_end[gs_allocaudit.num_ranges]   = info->dlpi_addr + info->dlpi_phdr[h].p_vaddr + info->dlpi_phdr[h].p_memsz;
+            gs_allocaudit.num_ranges++;
+        }
+    }
+    return 0;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// alloc_audit_init()
+///////////////////////////////////////////////////////////////////////////////
+/** Locate libxcb's code for attributing allocations and take the allocations
+    made during initialization as baseline.
+
+    @see alloc_audit_phdr_callback
+*/
+#ifdef ALLOC_AUDIT
+static void alloc_audit_init(void) {
+    (void)dl_iterate_phdr(alloc_audit_phdr_callback, NULL);
+    gs_allocaudit.state = STATE_UNKNOWN;
+    gs_allocaudit.allocs_last     = atomic_load(&gs_allocaudit.allocs);
+    gs_allocaudit.allocs_xcb_last = atomic_load(&gs_allocaudit.allocs_xcb);
+    DEBUG("[alloc_audit] found %u libxcb code segments, %lu allocations during init\n", gs_allocaudit.num_ranges, (unsigned long)gs_allocaudit.allocs_last);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// alloc_audit_checkpoint()
+///////////////////////////////////////////////////////////////////////////////
+/** Account the allocations of the event loop iteration just finished.
+
+    The replies and events libxcb allocates are inherent to the protocol
+    and merely counted. Any other allocation is tolerated only the first time
+    a state is handled (warm-up) while `STATE_UNKNOWN` stands for iterations
+    that did not handle a transition. After warm-up, an allocation of our own
+    aborts the daemon so that a regression cannot go unnoticed.
+
+    @see Tallocaudit
+*/
+#ifdef ALLOC_AUDIT
+static void alloc_audit_checkpoint(void) {
+    uint64_t allocs     = atomic_load(&gs_allocaudit.allocs);
+    uint64_t allocs_xcb = atomic_load(&gs_allocaudit.allocs_xcb);
+    uint64_t total      = allocs - gs_allocaudit.allocs_last;
+    uint64_t own        = total - (allocs_xcb - gs_allocaudit.allocs_xcb_last);
+    uint8_t  state      = gs_allocaudit.state;
+
+    gs_allocaudit.allocs_last     = allocs;
+    gs_allocaudit.allocs_xcb_last = allocs_xcb;
+    gs_allocaudit.state           = STATE_UNKNOWN;
+    gs_allocaudit.iterations++;
+    if (total > 0) {
+        gs_allocaudit.iterations_allocating++;
+        TRACE("[alloc_audit] state %u: %lu allocations, %lu outside of libxcb\n", state, (unsigned long)total, (unsigned long)own);
+    }
+    if (total > gs_allocaudit.max_per_iteration) {
+        gs_allocaudit.max_per_iteration = total;
+    }
+
+    if ( !(gs_allocaudit.warm & (1U << state)) ) {
+        gs_allocaudit.warm       |= 1U << state;
+        gs_allocaudit.own_warmup += own;
+        return;
+    }
+    if (own > 0) {
+        ERROR("Error: [alloc_audit] %lu allocations outside of libxcb while handling state %u\n", (unsigned long)own, state);
+        exit(EX_SOFTWARE);
+    }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// signal_handler()
+///////////////////////////////////////////////////////////////////////////////
+/** Signal Handler initiating a proper shutdown when being interrupted or killed.
+
+    SIGUSR1 is not handled here but read from a signalfd by the event loop,
+    as printing the counters is not async-signal-safe.
+
+    @param sig              the signal number received
+
+    @see _event_loop_signal
+*/
+static void signal_handler(const int sig) {
+    switch(sig){
+        case SIGTERM:
+        case SIGINT:
+        case SIGQUIT:
+            DEBUG("[signal_handler] received SIG_TERM/SIG_QUIT, exiting\n");
+            exit(EXIT_SUCCESS);
+    }
+    DEBUG("[signal_handler] received unhandled signal %d.\n", sig);
+    exit(EXIT_FAILURE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// state_name()
+///////////////////////////////////////////////////////////////////////////////
+/** Name a state of the state machine for the subscription stream.
+
+    @param state            the state_t value
+    @return                 the state's name
+*/
+static const char *state_name(const uint8_t state) {
+    switch ((state_t)state) {
+        case STATE_DPMS_STANDBY:            return "dpms_standby";
+        case STATE_DPMS_SUSPEND:            return "dpms_suspend";
+        case STATE_DPMS_OFF:                return "dpms_off";
+        case STATE_SCREENSAVER_ON_TIMEOUT:  return "timeout";
+        case STATE_SCREENSAVER_ON_INTERVAL: return "interval";
+        case STATE_SCREENSAVER_OFF:         return "off";
+        case STATE_SCREENSAVER_CYCLE:       return "cycle";
+        case STATE_SCREENSAVER_DISABLED:    return "disabled";
+        case STATE_UNKNOWN:                 return "unknown";
+    }
+    return "unknown";
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// subscription_open()
+///////////////////////////////////////////////////////////////////////////////
+/** Listen on `$XDG_RUNTIME_DIR/brightnessd.sock` for status subscribers.
+
+    A socket passed by the session manager is taken as is. A socket left
+    behind by a crashed instance is replaced, one of a running instance is not.
+    The path is removed again on exit, see `subscription_close()`.
+
+    @return                 true if listening, false otherwise
+
+    @see listen_fds
+*/
+static bool subscription_open(void) {
+    int activated_fd = listen_fds();
+    if (activated_fd >= 0) {
+        gs_pollfds[POLL_SOURCE_SUBSCRIBE].fd = activated_fd;
+        DEBUG("[subscription] listening on the socket passed by the session manager\n");
+        return true;
+    }
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (!runtime_dir || runtime_dir[0] != '/') {
+        return false;
+    }
+    int length = snprintf(address.sun_path, sizeof(address.sun_path), "%s/"PROGNAME".sock", runtime_dir);
+    if (length < 0 || (size_t)length >= sizeof(address.sun_path)) {
+        return false;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (bind(fd, (const struct sockaddr *)&address, sizeof(address)) < 0) {
+        if (errno != EADDRINUSE) {
+            WARN("Warning: cannot bind %s (%s)\n", address.sun_path, strerror(errno));
+            (void)close(fd);
+            return false;
+        }
+        if (connect(fd, (const struct sockaddr *)&address, sizeof(address)) == 0 || errno == EAGAIN) {
+            WARN("Warning: %s is served by another instance\n", address.sun_path);
+            (void)close(fd);
+            return false;
+        }
+        (void)close(fd);
+        (void)unlink(address.sun_path);
+        if ( (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0 ||
+              bind(fd, (const struct sockaddr *)&address, sizeof(address)) < 0 ) {
+            if (fd >= 0) { (void)close(fd); }
+            return false;
+        }
+    }
+    gs_subscription.address = address;
+    gs_subscription.created = true;
+    if (listen(fd, MAX_SUBSCRIBERS) < 0) {
+        (void)close(fd);
+        subscription_close();
+        return false;
+    }
+    gs_pollfds[POLL_SOURCE_SUBSCRIBE].fd = fd;
+    DEBUG("[subscription] listening on %s\n", address.sun_path);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// subscription_close()
+///////////////////////////////////////////////////////////////////////////////
+/** Remove the subscription socket's path on exit if it was bound here.
+
+    A socket passed by the session manager is left to it.
+
+    @see subscription_open
+*/
+static void subscription_close(void) {
+    if (gs_subscription.created) {
+        (void)unlink(gs_subscription.address.sun_path);
+        gs_subscription.created = false;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// listen_fds()
+///////////////////////////////////////////////////////////////////////////////
+/** Take over a listening socket passed by the session manager.
+
+    Implements the receiving end of the socket activation protocol, i.e.,
+    `LISTEN_PID` naming this process and `LISTEN_FDS` counting the sockets
+    passed from file descriptor 3 on, without linking libsystemd. Only the
+    first socket is used, it has to be a listening unix stream socket. The
+    variables are unset, so they are not passed on.
+
+    @return                 the listening socket, or -1 if none was passed
+*/
+static int listen_fds(void) {
+    const char *listen_pid = getenv("LISTEN_PID");
+    const char *listen_num = getenv("LISTEN_FDS");
+    int fd = -1;
+
+    if (listen_pid && listen_num && strtol(listen_pid, NULL, 10) == (long)getpid() && strtol(listen_num, NULL, 10) >= 1) {
+        int type = 0, listening = 0;
+        socklen_t length = sizeof(type);
+        struct sockaddr_un address;
+        socklen_t address_length = sizeof(address);
+        if (getsockopt(LISTEN_FDS_START, SOL_SOCKET, SO_TYPE, &type, &length) == 0 && type == SOCK_STREAM &&
+            (length = sizeof(listening), getsockopt(LISTEN_FDS_START, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length)) == 0 && listening &&
+            getsockname(LISTEN_FDS_START, (struct sockaddr *)&address, &address_length) == 0 && address.sun_family == AF_UNIX) {
+            fd = LISTEN_FDS_START;
+            (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+            (void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        } else {
+            WARN("Warning: the passed file descriptor %d is no listening unix stream socket\n", LISTEN_FDS_START);
+        }
+    }
+    (void)unsetenv("LISTEN_PID");
+    (void)unsetenv("LISTEN_FDS");
+    (void)unsetenv("LISTEN_FDNAMES");
+    return fd;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// notify_ready()
+///////////////////////////////////////////////////////////////////////////////
+/** Tell the session manager that the event loop is about to run.
+
+    Sends `READY=1` to the datagram socket named by `NOTIFY_SOCKET`, a leading
+    `@` denoting the abstract namespace, without linking libsystemd. The
+    variable is unset, so it is not passed on.
+*/
+static void notify_ready(void) {
+    const char *notify_socket = getenv("NOTIFY_SOCKET");
+    if (!notify_socket) {
+        return;
+    }
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    size_t length = strlen(notify_socket);
+    if ((notify_socket[0] != '/' && notify_socket[0] != '@') || length < 2 || length >= sizeof(address.sun_path)) {
+        WARN("Warning: ignoring NOTIFY_SOCKET=%s\n", notify_socket);
+        (void)unsetenv("NOTIFY_SOCKET");
+        return;
+    }
+    memcpy(address.sun_path, notify_socket, length);
+    if (address.sun_path[0] == '@') {
+        address.sun_path[0] = '\0';
+    }
+
+    char message[64];
+    int message_length = snprintf(message, sizeof(message), "READY=1\nMAINPID=%ld\n", (long)getpid());
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || sendto(fd, message, (size_t)message_length, MSG_NOSIGNAL, (const struct sockaddr *)&address,
+                         (socklen_t)(offsetof(struct sockaddr_un, sun_path) + length)) < 0) {
+        WARN("Warning: cannot notify readiness to %s (%s)\n", notify_socket, strerror(errno));
+    } else {
+        DEBUG("[init] notified readiness to %s\n", notify_socket);
+    }
+    if (fd >= 0) {
+        (void)close(fd);
+    }
+    (void)unsetenv("NOTIFY_SOCKET");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// subscription_remove()
+///////////////////////////////////////////////////////////////////////////////
+/** Drop a subscriber that hung up or failed.
+
+    @param s                the subscriber's slot
+*/
+static void subscription_remove(const uint8_t s) {
+    (void)close(gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s].fd);
+    gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s].fd     = -1;
+    gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s].events = POLLIN;
+    gs_subscription.num_subscribers--;
+    DEBUG("[subscription] subscriber %u left\n", s);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// subscription_format()
+///////////////////////////////////////////////////////////////////////////////
+/** Format the current status as a line of `key=value` pairs.
+
+    E.g. `state=timeout dimmed=1 brightness=40 outputs=66:40,68:40`, with the
+    outputs given as randr output id (the sysfs backend reports `backlight`)
+    and brightness percentage.
+
+    @param line             the buffer to format the line into
+    @param size             the size of the buffer
+    @return                 the length of the line
+*/
+static int subscription_format(char *line, const size_t size) {
+    const struct Tstatus *pstatus = &gs_subscription.status;
+    int length = snprintf(line, size, "state=%s dimmed=%d brightness=%u outputs=",
+        state_name(pstatus->state), pstatus->dimmed, pstatus->brn_cur_perc);
+    for (uint8_t o = 0; o < pstatus->num_outputs && length > 0 && (size_t)length < size; o++) {
+        #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+        length += snprintf(line + length, size - (size_t)length, "%sbacklight:%u", o ? "," : "", pstatus->brn_perc[o]);
+        #else
+        length += snprintf(line + length, size - (size_t)length, "%s%u:%u", o ? "," : "", gs_outputs.outputs[o].output, pstatus->brn_perc[o]);
+        #endif
+    }
+    if (length < 0 || (size_t)length >= size - 1) {
+        length = (int)size - 2;
+    }
+    line[length++] = '\n';
+    line[length]   = '\0';
+    return length;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// subscription_send()
+///////////////////////////////////////////////////////////////////////////////
+/** Send the current status to a subscriber, or the rest of its pending line.
+
+    Whatever the socket does not take stays pending and is sent once the
+    subscriber can read again, see `_event_loop_subscription()`.
+
+    @param s                the subscriber's slot
+*/
+static void subscription_send(const uint8_t s) {
+    struct Tsubscriber *psubscriber = &gs_subscription.subscribers[s];
+    struct pollfd      *ppollfd     = &gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s];
+
+    if (psubscriber->pending_length == 0) {
+        psubscriber->pending_length = (uint16_t)subscription_format(psubscriber->pending, sizeof(psubscriber->pending));
+        psubscriber->pending_offset = 0;
+        psubscriber->dirty          = false;
+        gs_subscription.pushed++;
+    }
+    ssize_t sent = send(ppollfd->fd, psubscriber->pending + psubscriber->pending_offset,
+                        (size_t)(psubscriber->pending_length - psubscriber->pending_offset), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        subscription_remove(s);
+        return;
+    }
+    if (sent > 0) {
+        psubscriber->pending_offset = (uint16_t)(psubscriber->pending_offset + sent);
+    }
+    if (psubscriber->pending_offset >= psubscriber->pending_length) {
+        psubscriber->pending_length = 0;
+        ppollfd->events             = POLLIN;
+    } else {
+        ppollfd->events             = POLLIN | POLLOUT;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// status_page_open()
+///////////////////////////////////////////////////////////////////////////////
+/** Map the status page `$XDG_RUNTIME_DIR/brightnessd.status` read-write.
+
+    A page left behind by a previous instance is taken over, its generation
+    counts on.
+
+    @return                 true if mapped, false otherwise
+
+    @see brightnessd_status.h
+*/
+static bool status_page_open(void) {
+    char path[PATH_MAX];
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (!runtime_dir || runtime_dir[0] != '/') {
+        return false;
+    }
+    int length = snprintf(path, sizeof(path), "%s/" BRIGHTNESSD_STATUS_NAME, runtime_dir);
+    if (length < 0 || (size_t)length >= sizeof(path)) {
+        return false;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, sizeof(struct brightnessd_status)) < 0) {
+        (void)close(fd);
+        return false;
+    }
+    void *page = mmap(NULL, sizeof(struct brightnessd_status), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (page == MAP_FAILED) {
+        return false;
+    }
+    gs_statuspage = (struct brightnessd_status *)page;
+    if (gs_statuspage->magic != BRIGHTNESSD_STATUS_MAGIC || gs_statuspage->version != BRIGHTNESSD_STATUS_VERSION) {
+        memset(gs_statuspage, 0, sizeof(*gs_statuspage));
+    }
+    // an odd sequence left by a crashed instance would keep readers retrying
+    gs_statuspage->sequence &= ~UINT32_C(1);
+    gs_statuspage->pid       = (uint32_t)getpid();
+    gs_statuspage->state     = STATE_UNKNOWN;
+    gs_statuspage->version   = BRIGHTNESSD_STATUS_VERSION;
+    __atomic_store_n(&gs_statuspage->magic, BRIGHTNESSD_STATUS_MAGIC, __ATOMIC_RELEASE);
+    DEBUG("[status] publishing the status at %s\n", path);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// status_page_publish()
+///////////////////////////////////////////////////////////////////////////////
+/** Write a changed status to the status page under its sequence lock.
+
+    Readers retry while the sequence is odd or changed while copying, so there
+    is a single writer and no system call involved.
+
+    @param pstatus          the status pushed to the subscribers
+
+    @see brightnessd_status_read
+*/
+static void status_page_publish(const struct Tstatus *pstatus) {
+    const uint32_t sequence = gs_statuspage->sequence;
+    __atomic_store_n(&gs_statuspage->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(gs_statuspage->brn_abs,  pstatus->brn_abs,  sizeof(gs_statuspage->brn_abs));
+    memcpy(gs_statuspage->brn_perc, pstatus->brn_perc, sizeof(gs_statuspage->brn_perc));
+    gs_statuspage->state        = pstatus->state;
+    gs_statuspage->brn_cur_perc = pstatus->brn_cur_perc;
+    gs_statuspage->num_outputs  = pstatus->num_outputs;
+    gs_statuspage->dimmed       = pstatus->dimmed;
+    gs_statuspage->generation++;
+    __atomic_store_n(&gs_statuspage->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// power_open()
+///////////////////////////////////////////////////////////////////////////////
+/** Listen for the kernel's power_supply uevents and apply the current profile.
+
+    The uevents come in on a `NETLINK_KOBJECT_UEVENT` socket in the event
+    loop, there is no polling of `/sys/class/power_supply`. It is read once
+    here for the adapters and the power source at startup. With FAKE_X, the
+    fake X server injects the uevents instead, starting with an `add` per
+    adapter.
+
+    @param ppower           power profiles container struct
+    @return                 true if listening, false otherwise
+
+    @see _event_loop_power
+*/
+static bool power_open(struct Tpower *ppower) {
+    #ifdef FAKE_X
+    const int fd = fakex_uevents();
+    #else
+    const int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    #endif
+    if (fd < 0) {
+        return false;
+    }
+    #ifndef FAKE_X
+    // group 1 carries the kernel's uevents, those relayed by udev are left alone
+    struct sockaddr_nl address = { .nl_family = AF_NETLINK, .nl_groups = 1 };
+    if (bind(fd, (const struct sockaddr *)&address, sizeof(address)) < 0) {
+        (void)close(fd);
+        return false;
+    }
+    #endif
+    gs_pollfds[POLL_SOURCE_UEVENT].fd = fd;
+    #ifdef FAKE_X
+    // the fake X server announces its adapters by add uevents instead of in sysfs
+    power_receive(ppower);
+    int online = ppower->num_adapters > 0 ? 0 : -1;
+    for (uint8_t a = 0; a < ppower->num_adapters; a++) {
+        online = online || ppower->online[a];
+    }
+    #else
+    const int online = power_scan(ppower);
+    #endif
+    power_apply(ppower, online == 0 ? POWER_SOURCE_BATTERY : POWER_SOURCE_AC);
+    DEBUG("[power] listening for power_supply uevents, %s\n", online < 0 ? "no mains adapter found" : online ? "on ac" : "on battery");
+    return true;
+}
+
+
+#ifndef FAKE_X
+///////////////////////////////////////////////////////////////////////////////
+// power_read()
+///////////////////////////////////////////////////////////////////////////////
+/** Read the first line of a sysfs attribute.
+
+    @param path             the attribute's path
+    @param value            where to put the line, without the newline
+    @param size             the size of `value`
+    @return                 true on success, false otherwise
+*/
+static bool power_read(const char *path, char *value, const size_t size) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const ssize_t length = read(fd, value, size - 1);
+    (void)close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    value[length] = '\0';
+    value[strcspn(value, "\n")] = '\0';
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// power_scan()
+///////////////////////////////////////////////////////////////////////////////
+/** Learn the mains adapters and whether any is online from POWER_SUPPLY_PATH.
+
+    @param ppower           power profiles container struct
+    @return                 1 if a mains adapter is online, 0 if none is, -1 if there is none
+*/
+static int power_scan(struct Tpower *ppower) {
+    DIR *dir = opendir(POWER_SUPPLY_PATH);
+    if (!dir) {
+        return -1;
+    }
+    int online = -1;
+    struct dirent *entry;
+    while ( (entry = readdir(dir)) ) {
+        char path[PATH_MAX];
+        char value[16];
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        (void)snprintf(path, sizeof(path), POWER_SUPPLY_PATH "%s/type", entry->d_name);
+        if (!power_read(path, value, sizeof(value)) || strcmp(value, "Mains") != 0) {
+            continue;
+        }
+        (void)snprintf(path, sizeof(path), POWER_SUPPLY_PATH "%s/online", entry->d_name);
+        if (power_read(path, value, sizeof(value))) {
+            online = online == 1 || value[0] == '1';
+            (void)power_adapter(ppower, entry->d_name, value[0] == '1');
+        }
+    }
+    (void)closedir(dir);
+    return online;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// power_adapter()
+///////////////////////////////////////////////////////////////////////////////
+/** Keep track of a mains adapter by its name, i.e., the last part of its DEVPATH.
+
+    Adapters beyond MAX_ADAPTERS are ignored.
+
+    @param ppower           power profiles container struct
+    @param name             the adapter's name
+    @param online           1 if online, 0 if offline, -1 if removed
+    @return                 true if the adapter is or was a known one, false otherwise
+*/
+static bool power_adapter(struct Tpower *ppower, const char *name, const int online) {
+    uint8_t a = 0;
+    while (a < ppower->num_adapters && strncmp(ppower->adapters[a], name, ADAPTER_NAME_MAX - 1) != 0) {
+        a++;
+    }
+    if (online < 0) {
+        if (a == ppower->num_adapters) {
+            return false;
+        }
+        ppower->num_adapters--;
+        memcpy(ppower->adapters[a], ppower->adapters[ppower->num_adapters], ADAPTER_NAME_MAX);
+        ppower->online[a] = ppower->online[ppower->num_adapters];
+        return true;
+    }
+    if (a == ppower->num_adapters) {
+        if (a == MAX_ADAPTERS) {
+            return false;
+        }
+        (void)snprintf(ppower->adapters[a], ADAPTER_NAME_MAX, "%s", name);
+        ppower->num_adapters++;
+    }
+    ppower->online[a] = online;
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// power_apply()
+///////////////////////////////////////////////////////////////////////////////
+/** Switch the dim levels to a power source's profile.
+
+    @param ppower           power profiles container struct
+    @param source           the power source now in use
+*/
+static void power_apply(struct Tpower *ppower, const uint8_t source) {
+    DIM_PERCENT_TIMEOUT  = ppower->percent_timeout[source];
+    DIM_PERCENT_INTERVAL = ppower->percent_interval[source];
+    if (source != ppower->source) {
+        ppower->source = source;
+        ppower->switches++;
+    }
+    DEBUG("[power] on %s, dimming to %u%% on timeout and %u%% on cycle\n", source == POWER_SOURCE_BATTERY ? "battery" : "ac", DIM_PERCENT_TIMEOUT, DIM_PERCENT_INTERVAL);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// power_uevent()
+///////////////////////////////////////////////////////////////////////////////
+/** Apply a uevent of a mains adapter going on- or offline, or going away.
+
+    A uevent is `ACTION@DEVPATH` followed by `KEY=VALUE` fields, each
+    terminated by a NUL. All others than power_supply uevents of a mains
+    adapter are ignored. A single adapter going offline does not mean the
+    machine is on battery, e.g., with a dock's adapter still plugged in, so
+    the power source is the one of all adapters known.
+
+    @param ppower           power profiles container struct
+    @param message          the uevent, NUL-terminated
+    @param length           the length of the uevent
+*/
+static void power_uevent(struct Tpower *ppower, const char *message, const size_t length) {
+    const char *name   = strrchr(message, '/');
+    const bool  remove = strncmp(message, "remove@", strlen("remove@")) == 0;
+    bool power_supply = false;
+    bool mains        = false;
+    int  online       = -1;
+    for (size_t offset = strnlen(message, length) + 1; offset < length; offset += strnlen(message + offset, length - offset) + 1) {
+        const char *field = message + offset;
+        if (strcmp(field, "SUBSYSTEM=power_supply") == 0) {
+            power_supply = true;
+        } else if (strcmp(field, "POWER_SUPPLY_TYPE=Mains") == 0) {
+            mains = true;
+        } else if (strncmp(field, "POWER_SUPPLY_ONLINE=", strlen("POWER_SUPPLY_ONLINE=")) == 0) {
+            online = field[strlen("POWER_SUPPLY_ONLINE=")] == '1';
+        }
+    }
+    // the fields of a removed adapter may be gone already, it is known by name
+    if (!power_supply || !name || (!remove && (!mains || online < 0))) {
+        return;
+    }
+    if (!power_adapter(ppower, name + 1, remove ? -1 : online)) {
+        return;
+    }
+    ppower->uevents++;
+    TRACE("[power] uevent %s: online=%d\n", message, online);
+    bool any_online = false;
+    for (uint8_t a = 0; a < ppower->num_adapters; a++) {
+        any_online = any_online || ppower->online[a];
+    }
+    const uint8_t source = any_online ? POWER_SOURCE_AC : POWER_SOURCE_BATTERY;
+    if (source != ppower->source) {
+        power_apply(ppower, source);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// power_receive()
+///////////////////////////////////////////////////////////////////////////////
+/** Drain the uevent socket, ignoring anything not sent by the kernel.
+
+    @param ppower           power profiles container struct
+*/
+static void power_receive(struct Tpower *ppower) {
+    static char buffer[UEVENT_BUFFER_SIZE + 1];
+    while (true) {
+        struct sockaddr_nl sender = { 0 };
+        struct iovec iov = { .iov_base = buffer, .iov_len = UEVENT_BUFFER_SIZE };
+        struct msghdr message = { .msg_name = &sender, .msg_namelen = sizeof(sender), .msg_iov = &iov, .msg_iovlen = 1 };
+        const ssize_t length = recvmsg(gs_pollfds[POLL_SOURCE_UEVENT].fd, &message, MSG_DONTWAIT);
+        if (length < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+                WARN("Warning: cannot receive uevents (%s)\n", strerror(errno));
+            }
+            return;
+        }
+        #ifndef FAKE_X
+        if (sender.nl_pid != 0) {
+            continue;
+        }
+        #endif
+        buffer[length] = '\0';
+        power_uevent(ppower, buffer, (size_t)length);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// leds_open()
+///////////////////////////////////////////////////////////////////////////////
+/** Open the LED class devices matching the --led policies.
+
+    A device matches a policy by its name, or by the end of its name, e.g.,
+    `kbd_backlight` matches `tpacpi::kbd_backlight`. The first matching
+    policy applies.
+
+    @param pleds            LED devices container struct
+    @return                 the number of devices opened
+
+    @see leds_commit
+*/
+static uint8_t leds_open(struct Tleds *pleds) {
+    DIR *dir = opendir(LEDS_PATH);
+    if (!dir) {
+        WARN("Warning: cannot open %s (%s)\n", LEDS_PATH, strerror(errno));
+        return 0;
+    }
+    const struct dirent *entry;
+    while ( (entry = readdir(dir)) && pleds->num_leds < MAX_LEDS ) {
+        const size_t length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' || length >= LED_NAME_MAX) {
+            continue;
+        }
+        const struct Tledpolicy *ppolicy = NULL;
+        for (uint8_t p = 0; p < pleds->num_policies && !ppolicy; p++) {
+            const size_t name_length = strlen(pleds->policies[p].name);
+            if (name_length <= length && strcmp(entry->d_name + length - name_length, pleds->policies[p].name) == 0) {
+                ppolicy = &pleds->policies[p];
+            }
+        }
+        if (!ppolicy) {
+            continue;
+        }
+        struct Tled *pled = &pleds->leds[pleds->num_leds];
+        char path[sizeof(LEDS_PATH) + LED_NAME_MAX + sizeof("/max_brightness")];
+        (void)snprintf(path, sizeof(path), LEDS_PATH "%s/max_brightness", entry->d_name);
+        const int max_fd = open(path, O_RDONLY | O_CLOEXEC);
+        pled->max_abs = max_fd < 0 ? NO_BRIGHTNESS : get_brightness_file(max_fd);
+        if (max_fd >= 0) {
+            (void)close(max_fd);
+        }
+        (void)snprintf(path, sizeof(path), LEDS_PATH "%s/brightness", entry->d_name);
+        if (pled->max_abs <= 0 || (pled->fd = open(path, O_RDWR | O_CLOEXEC)) < 0) {
+            WARN("Warning: cannot use LED %s (%s)\n", entry->d_name, pled->max_abs <= 0 ? "no max_brightness" : strerror(errno));
+            continue;
+        }
+        memcpy(pled->name, entry->d_name, length + 1);
+        pled->cur_abs          = NO_BRIGHTNESS;
+        pled->restore_abs      = NO_BRIGHTNESS;
+        pled->from_abs         = NO_BRIGHTNESS;
+        pled->read             = LED_READ_IDLE;
+        pled->percent_timeout  = ppolicy->percent_timeout;
+        pled->percent_interval = ppolicy->percent_interval;
+        pled->file             = 0;
+        pleds->num_leds++;
+        DEBUG("[leds] %s, max_brightness=%d, dimming to %u%% on timeout and %u%% on cycle\n",
+              pled->name, pled->max_abs, pled->percent_timeout, pled->percent_interval);
+    }
+    (void)closedir(dir);
+    return pleds->num_leds;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// led_write()
+///////////////////////////////////////////////////////////////////////////////
+/** Write a brightness value to an LED by the io_uring if it is registered there, else by the writer thread if running.
+
+    @param pleds            LED devices container struct
+    @param pled             the LED to write to
+    @param value_abs        the *absolute* brightness value in the LED's range
+*/
+static void led_write(struct Tleds *pleds, struct Tled *pled, const int32_t value_abs) {
+    TRACE("[led_write] %s brightness_abs=%d\n", pled->name, value_abs);
+    pled->cur_abs = value_abs;
+    pleds->writes++;
+    #ifdef USE_IO_URING
+    if (gs_uring.running && pled->file > 0) {
+        uring_write(&gs_uring, pled->file, value_abs);
+        return;
+    }
+    #endif
+    #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    if (gs_worker.running) {
+        backlight_worker_led(&gs_worker, (uint8_t)(pled - pleds->leds), value_abs);
+        return;
+    }
+    #endif
+    (void)set_brightness_file(pled->fd, value_abs);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// led_read()
+///////////////////////////////////////////////////////////////////////////////
+/** Read the brightness of an LED by the io_uring or the writer thread, like `led_write()`.
+
+    The first call asks for the value, a later one takes it once the read is
+    done, which wakes up the event loop. A failed read is not retried before
+    the LED is restored. Without either writer, the file is read at once.
+
+    @param pleds            LED devices container struct
+    @param pled             the LED to read
+    @return                 the *absolute* brightness value in the LED's range, or NO_BRIGHTNESS while the read is in flight or if it failed
+
+    @see led_read_t
+*/
+static int32_t led_read(struct Tleds *pleds, struct Tled *pled) {
+    if (pled->read == LED_READ_FAILED) {
+        return NO_BRIGHTNESS;
+    }
+    int32_t value_abs;
+    #ifdef USE_IO_URING
+    if (gs_uring.running && pled->file > 0) {
+        if (pled->read == LED_READ_IDLE) {
+            uring_read(&gs_uring, pled->file);
+            pled->read = LED_READ_PENDING;
+        }
+        if (gs_uring.reading[pled->file]) {
+            return NO_BRIGHTNESS;
+        }
+        value_abs = gs_uring.read_abs[pled->file];
+    } else
+    #endif
+    #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    if (gs_worker.running) {
+        const uint8_t led = (uint8_t)(pled - pleds->leds);
+        if (pled->read == LED_READ_IDLE) {
+            backlight_worker_led_read(&gs_worker, led);
+            pled->read = LED_READ_PENDING;
+        }
+        if (atomic_load(&gs_worker.led_reading) & (1U << led)) {
+            return NO_BRIGHTNESS;
+        }
+        value_abs = atomic_load(&gs_worker.led_values[led]);
+    } else
+    #endif
+    {
+        (void)pleds;
+        value_abs = get_brightness_file(pled->fd);
+    }
+    pled->read = value_abs == NO_BRIGHTNESS ? LED_READ_FAILED : LED_READ_IDLE;
+    return value_abs;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// leds_commit()
+///////////////////////////////////////////////////////////////////////////////
+/** Bring the LEDs in line with the screen, in the pass committing its writes.
+
+    While the screen is dimmed, each LED is set to its policy's percentage
+    for the timeout or the cycle, never brighter than before. While the
+    screen fades, the LEDs follow it by the same progress from where they
+    were at its start. Once the screen is restored, so are the LEDs. An LED
+    is only written to if its value changes, i.e., events not changing the
+    screen's dimming leave it alone.
+
+    @param pleds            LED devices container struct
+    @param state            the current state_t
+    @param dimmed           whether the screen is dimmed
+    @param brn_cur_perc     the screen's current brightness
+
+    @see leds_open
+    @see led_read
+*/
+static void leds_commit(struct Tleds *pleds, const uint8_t state, const bool dimmed, const uint8_t brn_cur_perc) {
+    const bool fading       = gs_timer.action == TIMER_FADE && gs_fade.to_perc != gs_fade.from_perc;
+    const bool fade_started = fading && pleds->fade_started_at_ms != gs_fade.started_at_ms;
+    double progress = 1.0;
+    if (fading) {
+        progress = (double)(brn_cur_perc - gs_fade.from_perc) / (gs_fade.to_perc - gs_fade.from_perc);
+        progress = progress < 0.0 ? 0.0 : progress > 1.0 ? 1.0 : progress;
+        pleds->fade_started_at_ms = gs_fade.started_at_ms;
+    }
+    for (uint8_t l = 0; l < pleds->num_leds; l++) {
+        struct Tled *pled = &pleds->leds[l];
+        if (!dimmed) {
+            if (pled->read == LED_READ_FAILED) {
+                pled->read = LED_READ_IDLE;
+            }
+            if (pled->restore_abs != NO_BRIGHTNESS) {
+                if (pled->cur_abs != pled->restore_abs) {
+                    led_write(pleds, pled, pled->restore_abs);
+                }
+                pled->restore_abs = NO_BRIGHTNESS;
+                pleds->restores++;
+            }
+            continue;
+        }
+        if (state != STATE_SCREENSAVER_ON_TIMEOUT && state != STATE_SCREENSAVER_ON_INTERVAL && state != STATE_SCREENSAVER_CYCLE) {
+            continue;
+        }
+        if (pled->restore_abs == NO_BRIGHTNESS) {
+            // the file lags behind while the restore is still in flight
+            bool lagging = false;
+            #ifdef USE_IO_URING
+            lagging = gs_uring.running && pled->file > 0 && (gs_uring.inflight[pled->file] || gs_uring.pending[pled->file] != NO_BRIGHTNESS);
+            #endif
+            pled->restore_abs = lagging ? pled->cur_abs : led_read(pleds, pled);
+            if (pled->restore_abs == NO_BRIGHTNESS) {
+                continue;
+            }
+            pled->cur_abs  = pled->restore_abs;
+            pled->from_abs = pled->restore_abs;
+            pleds->dims++;
+        } else if (fade_started) {
+            pled->from_abs = pled->cur_abs;
+        }
+        const uint8_t percent = state == STATE_SCREENSAVER_ON_TIMEOUT ? pled->percent_timeout : pled->percent_interval;
+        int32_t target_abs = percent * pled->max_abs / 100;
+        if (target_abs > pled->restore_abs) {
+            target_abs = pled->restore_abs;
+        }
+        if (fading) {
+            target_abs = pled->from_abs + (int32_t)lround((target_abs - pled->from_abs) * progress);
+        }
+        if (target_abs != pled->cur_abs) {
+            led_write(pleds, pled, target_abs);
+        }
+    }
+    #ifdef USE_IO_URING
+    if (gs_uring.running) {
+        uring_submit(&gs_uring);
+    }
+    #endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// leds_restore()
+///////////////////////////////////////////////////////////////////////////////
+/** Restore LEDs left dimmed on exit, written directly as the io_uring may be gone.
+
+    @see leds_commit
+*/
+static void leds_restore(void) {
+    for (uint8_t l = 0; l < gs_leds.num_leds; l++) {
+        if (gs_leds.leds[l].restore_abs != NO_BRIGHTNESS) {
+            (void)set_brightness_file(gs_leds.leds[l].fd, gs_leds.leds[l].restore_abs);
+            gs_leds.leds[l].restore_abs = NO_BRIGHTNESS;
+        }
+    }
+}
+
+
+#ifndef HAVE_SPAWN_CLOSEFROM
+///////////////////////////////////////////////////////////////////////////////
+// fds_cloexec()
+///////////////////////////////////////////////////////////////////////////////
+/** Mark every file descriptor but the standard ones close-on-exec.
+
+    Stands in for closing them in each hook without glibc 2.34: brightnessd
+    opens its own with O_CLOEXEC, this catches those it inherited. Done by
+    close_range() (Linux 5.11), or else one by one as listed in /proc.
+
+    @see hooks_spawn
+*/
+static void fds_cloexec(void) {
+    #ifdef SYS_close_range
+    if (syscall(SYS_close_range, STDERR_FILENO + 1, ~0U, CLOSE_RANGE_CLOEXEC) == 0) {
+        return;
+    }
+    #endif
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) {
+        WARN("Warning: cannot list the open file descriptors, hooks may inherit some (%s)\n", strerror(errno));
+        return;
+    }
+    struct dirent *entry;
+    while ( (entry = readdir(dir)) ) {
+        const int fd = (int)strtol(entry->d_name, NULL, 10);
+        if (fd > STDERR_FILENO && fd != dirfd(dir)) {
+            (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    (void)closedir(dir);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// hooks_open()
+///////////////////////////////////////////////////////////////////////////////
+/** Check that hooks can be reaped by pidfds, i.e., the kernel has pidfd_open().
+
+    @param phooks           hooks container struct
+    @return                 true if hooks can run, false otherwise
+
+    @see hooks_reap
+    @see fds_cloexec
+*/
+static bool hooks_open(struct Thooks *phooks) {
+    const int fd = (int)syscall(SYS_pidfd_open, getpid(), 0);
+    if (fd < 0) {
+        phooks->enabled = false;
+        return false;
+    }
+    (void)close(fd);
+    #ifndef HAVE_SPAWN_CLOSEFROM
+    fds_cloexec();
+    #endif
+    for (hook_event_t e = HOOK_TIMEOUT; e < HOOK_EVENT_COUNT; e++) {
+        if (phooks->commands[e]) {
+            DEBUG("[hooks] on %s: %s\n", state_name(gs_hook_states[e]), phooks->commands[e]);
+        }
+    }
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// hook_queue()
+///////////////////////////////////////////////////////////////////////////////
+/** Queue the hook of the state a transition entered, if there is one.
+
+    The hook is spawned once the event loop is about to wait, i.e., after the
+    transition's requests are flushed.
+
+    @param phooks           hooks container struct
+    @param state            the state_t the transition led to
+
+    @see hooks_spawn
+*/
+static void hook_queue(struct Thooks *phooks, const uint8_t state) {
+    hook_event_t event;
+    switch (state) {
+        case STATE_SCREENSAVER_ON_TIMEOUT:  event = HOOK_TIMEOUT;  break;
+        case STATE_SCREENSAVER_ON_INTERVAL: event = HOOK_INTERVAL; break;
+        case STATE_SCREENSAVER_OFF:         event = HOOK_OFF;      break;
+        default: return;
+    }
+    if (!phooks->enabled || !phooks->commands[event]) {
+        return;
+    }
+    if (phooks->num_queued == MAX_HOOKS) {
+        phooks->dropped++;
+        WARN("Warning: too many hooks pending, dropping the one on %s\n", state_name(state));
+        return;
+    }
+    phooks->queue[phooks->num_queued++] = (uint8_t)event;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// hooks_spawn()
+///////////////////////////////////////////////////////////////////////////////
+/** Spawn queued hooks as long as fewer than MAX_HOOKS are running.
+
+    A hook runs as `/bin/sh -c COMMAND brightnessd STATE BRIGHTNESS` in a
+    process group of its own, which is killed once it exceeds the hook
+    timeout or brightnessd exits. Its standard input is `/dev/null`, only
+    the standard output and error are inherited: with glibc 2.34 or newer,
+    any other file descriptor is closed even if it lacks FD_CLOEXEC, before
+    that, all of them have FD_CLOEXEC, brightnessd's own from the start and
+    those it inherited since fds_cloexec().
+    Hooks which cannot run yet stay queued until one exits.
+
+    @param phooks           hooks container struct
+    @param brn_cur_perc     the current brightness passed as $2
+
+    @see hooks_reap
+*/
+static void hooks_spawn(struct Thooks *phooks, const uint8_t brn_cur_perc) {
+    extern char **environ;
+    uint8_t q = 0;
+    for (; q < phooks->num_queued && phooks->num_running < MAX_HOOKS; q++) {
+        const uint8_t event = phooks->queue[q];
+        const uint8_t state = gs_hook_states[event];
+        char shell[] = HOOK_SHELL, option[] = "-c", name[] = PROGNAME, state_arg[16], brightness[4];
+        (void)snprintf(state_arg, sizeof(state_arg), "%s", state_name(state));
+        (void)snprintf(brightness, sizeof(brightness), "%u", brn_cur_perc);
+        char *const argv[] = { shell, option, phooks->commands[event], name, state_arg, brightness, NULL };
+
+        posix_spawnattr_t attr;
+        posix_spawn_file_actions_t actions;
+        sigset_t mask;
+        (void)sigemptyset(&mask);
+        (void)posix_spawnattr_init(&attr);
+        (void)posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+        (void)posix_spawnattr_setpgroup(&attr, 0);
+        (void)posix_spawnattr_setsigmask(&attr, &mask);
+        (void)posix_spawn_file_actions_init(&actions);
+        (void)posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        #ifdef HAVE_SPAWN_CLOSEFROM
+        (void)posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+        #endif
+        const uint64_t started_us = monotonic_us();
+        pid_t pid;
+        const int err = posix_spawn(&pid, HOOK_SHELL, &actions, &attr, argv, environ);
+        (void)posix_spawn_file_actions_destroy(&actions);
+        (void)posix_spawnattr_destroy(&attr);
+        if (err != 0) {
+            phooks->failed++;
+            WARN("Warning: cannot spawn the hook on %s (%s)\n", state_name(state), strerror(err));
+            continue;
+        }
+        const int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+        if (fd < 0) {
+            // without a pidfd the hook cannot be watched, do not leave it running untracked
+            (void)kill(-pid, SIGKILL);
+            (void)waitpid(pid, NULL, 0);
+            phooks->failed++;
+            WARN("Warning: cannot watch the hook on %s (%s)\n", state_name(state), strerror(errno));
+            continue;
+        }
+        const uint64_t spawn_us = monotonic_us() - started_us;
+        if (spawn_us > phooks->spawn_us_max) {
+            phooks->spawn_us_max = spawn_us;
+        }
+        uint8_t r = 0;
+        while (gs_pollfds[POLL_SOURCE_HOOKS + r].fd >= 0) { r++; }
+        gs_pollfds[POLL_SOURCE_HOOKS + r].fd = fd;
+        phooks->running[r] = (struct Thookprocess){ .deadline_ms = monotonic_ms() + HOOK_TIMEOUT_MS, .pid = pid, .event = event };
+        phooks->num_running++;
+        phooks->spawned++;
+        DEBUG("[hooks] spawned pid %d on %s in %luus\n", (int)pid, state_name(state), (unsigned long)spawn_us);
+    }
+    phooks->num_queued = (uint8_t)(phooks->num_queued - q);
+    memmove(phooks->queue, phooks->queue + q, phooks->num_queued);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// hooks_reap()
+///////////////////////////////////////////////////////////////////////////////
+/** Reap exited hooks and kill those past their deadline.
+
+    A hook's pidfd becomes readable once it exited. A killed hook keeps its
+    slot until then, its process group being gone with SIGKILL.
+
+    @param phooks           hooks container struct
+
+    @see hooks_spawn
+*/
+static void hooks_reap(struct Thooks *phooks) {
+    const uint64_t now_ms = monotonic_ms();
+    for (uint8_t r = 0; r < MAX_HOOKS; r++) {
+        struct pollfd       *ppollfd  = &gs_pollfds[POLL_SOURCE_HOOKS + r];
+        struct Thookprocess *pprocess = &phooks->running[r];
+        if (ppollfd->fd < 0) {
+            continue;
+        }
+        if (ppollfd->revents & POLLIN) {
+            int status = 0;
+            if (waitpid(pprocess->pid, &status, WNOHANG) != pprocess->pid) {
+                continue;
+            }
+            if (!pprocess->killed && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+                phooks->failed++;
+                WARN("Warning: the hook on %s failed (%s %d)\n", state_name(gs_hook_states[pprocess->event]),
+                     WIFEXITED(status) ? "exit status" : "signal", WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status));
+            }
+            phooks->exited++;
+            phooks->num_running--;
+            (void)close(ppollfd->fd);
+            ppollfd->fd = -1;
+            continue;
+        }
+        if (!pprocess->killed && now_ms >= pprocess->deadline_ms) {
+            WARN("Warning: the hook pid %d took longer than %ums, killing it\n", (int)pprocess->pid, HOOK_TIMEOUT_MS);
+            (void)kill(-pprocess->pid, SIGKILL);
+            pprocess->killed = true;
+            phooks->killed++;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// hooks_kill()
+///////////////////////////////////////////////////////////////////////////////
+/** Kill the process groups of the hooks still running on exit.
+
+    Like a hook past its deadline, so that no hook outlives brightnessd; the
+    processes are left to init to reap.
+
+    @see hooks_spawn
+*/
+static void hooks_kill(void) {
+    for (uint8_t r = 0; r < MAX_HOOKS; r++) {
+        if (gs_pollfds[POLL_SOURCE_HOOKS + r].fd >= 0 && !gs_hooks.running[r].killed) {
+            DEBUG("[shutdown] killing the hook pid %d\n", (int)gs_hooks.running[r].pid);
+            (void)kill(-gs_hooks.running[r].pid, SIGKILL);
+            gs_hooks.running[r].killed = true;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// hook_timeout_ms()
+///////////////////////////////////////////////////////////////////////////////
+/** Milliseconds until the earliest deadline of a running hook.
+
+    @param phooks           hooks container struct
+    @return                 the timeout for poll(), -1 if no hook is due to be killed
+*/
+static int hook_timeout_ms(const struct Thooks *phooks) {
+    if (phooks->num_running == 0) {
+        return -1;
+    }
+    uint64_t deadline_ms = UINT64_MAX;
+    for (uint8_t r = 0; r < MAX_HOOKS; r++) {
+        if (gs_pollfds[POLL_SOURCE_HOOKS + r].fd >= 0 && !phooks->running[r].killed && phooks->running[r].deadline_ms < deadline_ms) {
+            deadline_ms = phooks->running[r].deadline_ms;
+        }
+    }
+    if (deadline_ms == UINT64_MAX) {
+        return -1;
+    }
+    const uint64_t now_ms = monotonic_ms();
+    return deadline_ms > now_ms ? (int)(deadline_ms - now_ms) : 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// subscription_publish()
+///////////////////////////////////////////////////////////////////////////////
+/** Push the status to all subscribers and the status page if it changed.
+
+    Called whenever the event loop is about to wait, so all changes made while
+    handling a burst of events are pushed as one line.
+
+    @param pglobalstate     state container struct
+    @param peventstate      event loop brightness state container struct
+
+    @see Tstatus
+*/
+static void subscription_publish(const struct Tglobalstate *pglobalstate, const struct Teventstate *peventstate) {
+    struct Tstatus status;
+    memset(&status, 0, sizeof(status));
+    status.state        = (uint8_t)pglobalstate->state;
+    status.brn_cur_perc = peventstate->brn_cur_perc;
+    status.dimmed       = peventstate->brn_priorscrsvr_perc != BRN_PRIORSCRSVR_UNDEFINED;
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    if (gs_sysfs.brn_cur_abs != NO_BRIGHTNESS && gs_sysfs.brn_max_abs > 0) {
+        status.brn_abs[0]  = gs_sysfs.brn_cur_abs;
+        status.brn_perc[0] = (uint8_t)(gs_sysfs.brn_cur_abs * 100 / gs_sysfs.brn_max_abs);
+        status.num_outputs = 1;
+    }
+#else
+    for (uint8_t o = 0; o < gs_outputs.num_outputs; o++) {
+        const struct Toutput *poutput = &gs_outputs.outputs[o];
+        status.brn_abs[o]  = poutput->brn_cur_abs;
+        if (poutput->brn_cur_abs != NO_BRIGHTNESS && poutput->brn_max_abs > poutput->brn_min_abs) {
+            status.brn_perc[o] = (uint8_t)((poutput->brn_cur_abs - poutput->brn_min_abs) * 100 / (poutput->brn_max_abs - poutput->brn_min_abs));
+        }
+    }
+    status.num_outputs = gs_outputs.num_outputs;
+#endif
+    if (gs_subscription.valid && memcmp(&status, &gs_subscription.status, sizeof(status)) == 0) {
+        return;
+    }
+    gs_subscription.status = status;
+    gs_subscription.valid  = true;
+    if (gs_statuspage) {
+        status_page_publish(&status);
+    }
+
+    for (uint8_t s = 0; s < MAX_SUBSCRIBERS; s++) {
+        if (gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s].fd < 0) {
+            continue;
+        }
+        if (gs_subscription.subscribers[s].pending_length > 0) {
+            gs_subscription.subscribers[s].dirty = true;
+            gs_subscription.coalesced++;
+            continue;
+        }
+        subscription_send(s);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_subscription()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` serving the subscription socket.
+
+    Accepts new subscribers, which get the current status right away, drops
+    the ones that hung up, and continues sending to the ones that can read
+    again; a subscriber marked dirty meanwhile gets the latest status next.
+
+    @see subscription_send
+*/
+static void _event_loop_subscription(void) {
+    if (gs_pollfds[POLL_SOURCE_SUBSCRIBE].revents & POLLIN) {
+        int fd = accept4(gs_pollfds[POLL_SOURCE_SUBSCRIBE].fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd >= 0) {
+            uint8_t s = 0;
+            while (s < MAX_SUBSCRIBERS && gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s].fd >= 0) { s++; }
+            if (s == MAX_SUBSCRIBERS) {
+                (void)close(fd);
+            } else {
+                gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s].fd = fd;
+                gs_subscription.subscribers[s].pending_length = 0;
+                gs_subscription.num_subscribers++;
+                DEBUG("[subscription] subscriber %u joined\n", s);
+                subscription_send(s);
+            }
+        }
+    }
+    for (uint8_t s = 0; s < MAX_SUBSCRIBERS; s++) {
+        const struct pollfd *ppollfd = &gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s];
+        if (ppollfd->fd < 0 || ppollfd->revents == 0) {
+            continue;
+        }
+        if (ppollfd->revents & (POLLIN | POLLHUP | POLLERR)) {
+            char discard[64];
+            if ((ppollfd->revents & (POLLHUP | POLLERR)) || recv(ppollfd->fd, discard, sizeof(discard), MSG_DONTWAIT) == 0) {
+                subscription_remove(s);
+                continue;
+            }
+        }
+        if (ppollfd->revents & POLLOUT) {
+            subscription_send(s);
+            if (gs_pollfds[POLL_SOURCE_SUBSCRIBERS + s].fd >= 0 && gs_subscription.subscribers[s].pending_length == 0 && gs_subscription.subscribers[s].dirty) {
+                subscription_send(s);
+            }
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_signal()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` dumping the counters on SIGUSR1.
+
+    SIGUSR1 is blocked and queued on a signalfd, so the stats are printed
+    from the event loop and never interrupt it halfway.
+
+    @see print_stats
+*/
+static void _event_loop_signal(void) {
+    struct signalfd_siginfo info;
+    while (read(gs_pollfds[POLL_SOURCE_SIGNAL].fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+        if (info.ssi_signo == SIGUSR1) {
+            print_stats();
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// monotonic_ms()
+///////////////////////////////////////////////////////////////////////////////
+/** Get the monotonic clock in milliseconds.
+
+    @return                 milliseconds since some unspecified starting point
+*/
+static uint64_t monotonic_ms(void) {
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// monotonic_us()
+///////////////////////////////////////////////////////////////////////////////
+/** Get the monotonic clock in microseconds.
+
+    @return                 microseconds since some unspecified starting point
+*/
+static uint64_t monotonic_us(void) {
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// metrics_transition()
+///////////////////////////////////////////////////////////////////////////////
+/** Account a handled transition and the round trips and writes it took.
+
+    @param state            the state_t the transition led to
+    @param round_trips      the round trip counter before handling the transition
+    @param writes           the write counter before handling the transition
+
+    @see Tmetrics
+*/
+static void metrics_transition(const uint8_t state, const uint64_t round_trips, const uint64_t writes) {
+    const uint8_t s = state < METRICS_STATES ? state : STATE_UNKNOWN;
+    gs_metrics.transitions[s]++;
+    gs_metrics.transition_round_trips[s] += gs_metrics.round_trips - round_trips;
+    gs_metrics.transition_writes[s]      += gs_metrics.writes - writes;
+    gs_metrics.dirty = true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// metrics_restore_done()
+///////////////////////////////////////////////////////////////////////////////
+/** Account the latency from the OFF event to the completed restore.
+
+    The restore is complete once the device confirmed every write, i.e., once
+    the X server notified the property changes or, with the sysfs backend,
+    once the writer has written the file.
+
+    @see Tmetrics
+*/
+static void metrics_restore_done(void) {
+    const uint64_t latency_us = monotonic_us() - gs_metrics.restore_started_us;
+    uint8_t b = 0;
+    while (b < METRICS_LATENCY_BUCKETS && latency_us > gs_metrics_latency_bounds_us[b]) {
+        b++;
+    }
+    gs_metrics.restore_latency[b]++;
+    gs_metrics.restore_latency_us_sum += latency_us;
+    gs_metrics.restores++;
+    gs_metrics.restore_started_us = 0;
+    gs_metrics.dirty = true;
+    TRACE("[metrics] restore took %luus\n", (unsigned long)latency_us);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// metrics_restore_issued()
+///////////////////////////////////////////////////////////////////////////////
+/** Account the daemon's time from receiving the OFF event to issuing the restore.
+
+    @param received_us      when the event loop received the OFF event
+
+    @see RESTORE_TARGET_US
+*/
+static void metrics_restore_issued(const uint64_t received_us) {
+    const uint64_t latency_us = monotonic_us() - received_us;
+    uint8_t b = 0;
+    while (b < METRICS_LATENCY_BUCKETS && latency_us > gs_metrics_latency_bounds_us[b]) {
+        b++;
+    }
+    gs_metrics.issue_latency[b]++;
+    gs_metrics.issue_latency_us_sum += latency_us;
+    if (latency_us > gs_metrics.issue_latency_us_max) {
+        gs_metrics.issue_latency_us_max = latency_us;
+    }
+    if (latency_us > RESTORE_TARGET_US) {
+        gs_metrics.issues_over_target++;
+        DEBUG("[metrics] restore took %luus of daemon time, above the target of %uus\n", (unsigned long)latency_us, RESTORE_TARGET_US);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// metrics_write()
+///////////////////////////////////////////////////////////////////////////////
+/** Write the counters to the metrics file in the Prometheus text format.
+
+    The file is replaced by renaming a fully written temporary file, i.e., a
+    scraper, e.g. node_exporter's textfile collector, never sees a partial
+    file and never has to wait for the event loop. Formatted into a static
+    buffer, so the event path stays allocation-free.
+
+    @see Tmetrics
+    @see metrics_timeout_ms
+*/
+static void metrics_write(void) {
+    static char text[METRICS_TEXT_MAX];
+    static char path_tmp[PATH_MAX];
+    size_t length = 0;
+    gs_metrics.dirty         = false;
+    gs_metrics.written_at_ms = monotonic_ms();
+
+    #define METRICS_APPEND(...)                                                                  \
+        do {                                                                                     \
+            if (length < sizeof(text)) {                                                         \
+                int n = snprintf(text + length, sizeof(text) - length, __VA_ARGS__);             \
+                length = n < 0 ? sizeof(text) : length + (size_t)n;                              \
+            }                                                                                    \
+        } while (0)
+
+    METRICS_APPEND("# HELP "PROGNAME"_transitions_total Handled screensaver transitions by resulting state.\n"
+                   "# TYPE "PROGNAME"_transitions_total counter\n");
+    for (uint8_t st = 0; st < METRICS_STATES; st++) {
+        METRICS_APPEND(PROGNAME"_transitions_total{state=\"%s\"} %lu\n", state_name(st), (unsigned long)gs_metrics.transitions[st]);
+    }
+    METRICS_APPEND("# HELP "PROGNAME"_transition_round_trips_total X server round trips taken by transitions.\n"
+                   "# TYPE "PROGNAME"_transition_round_trips_total counter\n");
+    for (uint8_t st = 0; st < METRICS_STATES; st++) {
+        METRICS_APPEND(PROGNAME"_transition_round_trips_total{state=\"%s\"} %lu\n", state_name(st), (unsigned long)gs_metrics.transition_round_trips[st]);
+    }
+    METRICS_APPEND("# HELP "PROGNAME"_transition_writes_total Brightness writes issued by transitions.\n"
+                   "# TYPE "PROGNAME"_transition_writes_total counter\n");
+    for (uint8_t st = 0; st < METRICS_STATES; st++) {
+        METRICS_APPEND(PROGNAME"_transition_writes_total{state=\"%s\"} %lu\n", state_name(st), (unsigned long)gs_metrics.transition_writes[st]);
+    }
+    METRICS_APPEND("# HELP "PROGNAME"_events_total X events received.\n"
+                   "# TYPE "PROGNAME"_events_total counter\n"
+                   PROGNAME"_events_total{kind=\"all\"} %lu\n"
+                   PROGNAME"_events_total{kind=\"screensaver\"} %lu\n"
+                   PROGNAME"_events_total{kind=\"dpms\"} %lu\n",
+                   (unsigned long)gs_stats.events_received,
+                   (unsigned long)gs_stats.events_screensaver,
+                   (unsigned long)gs_stats.events_dpms);
+    METRICS_APPEND("# HELP "PROGNAME"_transitions_elided_total Screensaver events coalesced away.\n"
+                   "# TYPE "PROGNAME"_transitions_elided_total counter\n"
+                   PROGNAME"_transitions_elided_total %lu\n"
+                   "# HELP "PROGNAME"_dims_inhibited_total Dims skipped for a fullscreen window.\n"
+                   "# TYPE "PROGNAME"_dims_inhibited_total counter\n"
+                   PROGNAME"_dims_inhibited_total %lu\n",
+                   (unsigned long)gs_stats.transitions_elided,
+                   (unsigned long)gs_stats.dims_inhibited);
+    METRICS_APPEND("# HELP "PROGNAME"_round_trips_total X server round trips.\n"
+                   "# TYPE "PROGNAME"_round_trips_total counter\n"
+                   PROGNAME"_round_trips_total %lu\n"
+                   "# HELP "PROGNAME"_writes_total Brightness writes issued.\n"
+                   "# TYPE "PROGNAME"_writes_total counter\n"
+                   PROGNAME"_writes_total %lu\n",
+                   (unsigned long)gs_metrics.round_trips,
+                   (unsigned long)gs_metrics.writes);
+    uint64_t backend_errors = gs_metrics.backend_errors;
+    #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    backend_errors += atomic_load(&gs_worker.errors) + atomic_load(&gs_worker.led_errors);
+    #endif
+    METRICS_APPEND("# HELP "PROGNAME"_backend_errors_total Failed brightness reads and writes.\n"
+                   "# TYPE "PROGNAME"_backend_errors_total counter\n"
+                   PROGNAME"_backend_errors_total %lu\n",
+                   (unsigned long)backend_errors);
+    METRICS_APPEND("# HELP "PROGNAME"_confirm_latency_seconds Time until a device reported a brightness write.\n"
+                   "# TYPE "PROGNAME"_confirm_latency_seconds summary\n");
+    for (uint8_t d = 0; d < gs_confirm.num_devices; d++) {
+        const struct Tconfirmdevice *pdevice = &gs_confirm.devices[d];
+        METRICS_APPEND(PROGNAME"_confirm_latency_seconds_sum{device=\"%u\"} %.6f\n"
+                       PROGNAME"_confirm_latency_seconds_count{device=\"%u\"} %lu\n"
+                       PROGNAME"_confirm_reissued_total{device=\"%u\"} %lu\n"
+                       PROGNAME"_confirm_failed_total{device=\"%u\"} %lu\n",
+                       pdevice->output, (double)pdevice->latency_us_sum / 1e6,
+                       pdevice->output, (unsigned long)pdevice->confirmed,
+                       pdevice->output, (unsigned long)pdevice->reissued,
+                       pdevice->output, (unsigned long)pdevice->failed);
+    }
+    METRICS_APPEND("# HELP "PROGNAME"_restore_latency_seconds Time from the OFF event to the completed restore.\n"
+                   "# TYPE "PROGNAME"_restore_latency_seconds histogram\n");
+    uint64_t cumulative = 0;
+    for (uint8_t b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+        cumulative += gs_metrics.restore_latency[b];
+        METRICS_APPEND(PROGNAME"_restore_latency_seconds_bucket{le=\"%g\"} %lu\n", gs_metrics_latency_bounds_us[b] / 1e6, (unsigned long)cumulative);
+    }
+    METRICS_APPEND(PROGNAME"_restore_latency_seconds_bucket{le=\"+Inf\"} %lu\n"
+                   PROGNAME"_restore_latency_seconds_sum %.6f\n"
+                   PROGNAME"_restore_latency_seconds_count %lu\n",
+                   (unsigned long)gs_metrics.restores,
+                   (double)gs_metrics.restore_latency_us_sum / 1e6,
+                   (unsigned long)gs_metrics.restores);
+    METRICS_APPEND("# HELP "PROGNAME"_restore_issue_latency_seconds Daemon time from receiving the OFF event to issuing the restore writes.\n"
+                   "# TYPE "PROGNAME"_restore_issue_latency_seconds histogram\n");
+    cumulative = 0;
+    for (uint8_t b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+        cumulative += gs_metrics.issue_latency[b];
+        METRICS_APPEND(PROGNAME"_restore_issue_latency_seconds_bucket{le=\"%g\"} %lu\n", gs_metrics_latency_bounds_us[b] / 1e6, (unsigned long)cumulative);
+    }
+    cumulative += gs_metrics.issue_latency[METRICS_LATENCY_BUCKETS];
+    METRICS_APPEND(PROGNAME"_restore_issue_latency_seconds_bucket{le=\"+Inf\"} %lu\n"
+                   PROGNAME"_restore_issue_latency_seconds_sum %.6f\n"
+                   PROGNAME"_restore_issue_latency_seconds_count %lu\n"
+                   "# HELP "PROGNAME"_restores_fast_total Restores written from the restore plan without a single reply.\n"
+                   "# TYPE "PROGNAME"_restores_fast_total counter\n"
+                   PROGNAME"_restores_fast_total %lu\n",
+                   (unsigned long)cumulative,
+                   (double)gs_metrics.issue_latency_us_sum / 1e6,
+                   (unsigned long)cumulative,
+                   (unsigned long)gs_metrics.restores_fast);
+    #undef METRICS_APPEND
+
+    if (length >= sizeof(text)) {
+        WARN("Warning: metrics exceed %d bytes, not exported\n", METRICS_TEXT_MAX);
+        return;
+    }
+    if (path_tmp[0] == '\0') {
+        (void)snprintf(path_tmp, sizeof(path_tmp), "%s.tmp", gs_metrics.path);
+    }
+    int fd = open(path_tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        gs_metrics.write_errors++;
+        return;
+    }
+    bool written = write(fd, text, length) == (ssize_t)length;
+    (void)close(fd);
+    if (!written || rename(path_tmp, gs_metrics.path) < 0) {
+        gs_metrics.write_errors++;
+        (void)unlink(path_tmp);
+        return;
+    }
+    gs_metrics.written++;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// metrics_timeout_ms()
+///////////////////////////////////////////////////////////////////////////////
+/** Get how long the event loop may wait before writing the metrics file.
+
+    The file is written at most every METRICS_INTERVAL_MS, and not while a
+    restore waits for its confirmation, so the file system's latency stays off
+    the restore path; a burst of transitions ends up in a single write.
+
+    @return                 the timeout in milliseconds for poll(), -1 if nothing is to be written
+
+    @see metrics_write
+*/
+static int metrics_timeout_ms(void) {
+    if (!gs_metrics.path || !gs_metrics.dirty || gs_metrics.restore_started_us > 0) {
+        return -1;
+    }
+    const uint64_t now_ms = monotonic_ms();
+    const uint64_t due_ms = gs_metrics.written_at_ms + METRICS_INTERVAL_MS;
+    return due_ms > now_ms ? (int)(due_ms - now_ms) : 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// confirm_device()
+///////////////////////////////////////////////////////////////////////////////
+/** Find or add the confirmation record of a device.
+
+    @param output           the randr output, 0 for the sysfs backlight
+    @param backlight_atom   the backlight property written, XCB_ATOM_NONE for the sysfs backlight
+    @return                 the device's record, or NULL if all records are taken
+
+    @see Tconfirm
+*/
+static struct Tconfirmdevice *confirm_device(const uint32_t output, const xcb_atom_t backlight_atom) {
+    for (uint8_t d = 0; d < gs_confirm.num_devices; d++) {
+        if (gs_confirm.devices[d].output == output && gs_confirm.devices[d].backlight_atom == backlight_atom) {
+            return &gs_confirm.devices[d];
+        }
+    }
+    if (gs_confirm.num_devices == MAX_OUTPUTS) {
+        return NULL;
+    }
+    struct Tconfirmdevice *pdevice = &gs_confirm.devices[gs_confirm.num_devices++];
+    memset(pdevice, 0, sizeof(*pdevice));
+    pdevice->output         = output;
+    pdevice->backlight_atom = backlight_atom;
+    pdevice->target_abs     = NO_BRIGHTNESS;
+    return pdevice;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// confirm_expect()
+///////////////////////////////////////////////////////////////////////////////
+/** Await the device's confirmation of a brightness write.
+
+    A newer write supersedes the awaited one. Rewriting the awaited target,
+    i.e., a reissue, keeps counting the attempts.
+
+    @param output           the randr output, 0 for the sysfs backlight
+    @param backlight_atom   the backlight property written, XCB_ATOM_NONE for the sysfs backlight
+    @param target_abs       the *absolute* brightness value written
+    @param sequence         the sequence number of the randr write request, 0 for the sysfs backlight
+
+    @see confirm_check
+*/
+static void confirm_expect(const uint32_t output, const xcb_atom_t backlight_atom, const int32_t target_abs, const unsigned int sequence) {
+    struct Tconfirmdevice *pdevice = confirm_device(output, backlight_atom);
+    if (!pdevice) {
+        return;
+    }
+    const uint64_t now_us = monotonic_us();
+    if (!pdevice->pending || pdevice->target_abs != target_abs) {
+        pdevice->attempts  = 0;
+        pdevice->issued_us = now_us;
+        pdevice->from_abs  = pdevice->target_abs;
+    }
+    if (!pdevice->pending) {
+        gs_confirm.num_pending++;
+    }
+    pdevice->target_abs  = target_abs;
+    pdevice->sequence    = (uint16_t)sequence;
+    pdevice->deadline_us = now_us + CONFIRM_TIMEOUT_MS * 1000;
+    pdevice->pending     = true;
+    pdevice->completed   = false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// confirm_done()
+///////////////////////////////////////////////////////////////////////////////
+/** Account a confirmed write.
+
+    @param pdevice          the device's record
+    @param done_us          when the write was confirmed
+*/
+static void confirm_done(struct Tconfirmdevice *pdevice, const uint64_t done_us) {
+    const uint64_t latency_us = done_us - pdevice->issued_us;
+    pdevice->latency_us_sum += latency_us;
+    if (latency_us > pdevice->latency_us_max) {
+        pdevice->latency_us_max = latency_us;
+    }
+    pdevice->confirmed++;
+    pdevice->pending = false;
+    gs_confirm.num_pending--;
+    TRACE("[confirm] device %u reached %d after %luus\n", pdevice->output, pdevice->target_abs, (unsigned long)latency_us);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// confirm_echo()
+///////////////////////////////////////////////////////////////////////////////
+/** Confirm a randr write by the server's echo of the property change.
+
+    An event carries the sequence number of the last request the server had
+    processed when generating it. Only a change notified once the awaited
+    write has been processed confirms it; the echoes of earlier writes, e.g.,
+    previous fade steps, and changes by other clients before are ignored.
+
+    @param output           the output whose property changed
+    @param backlight_atom   the property changed
+    @param sequence         the event's sequence number
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static void confirm_echo(const uint32_t output, const xcb_atom_t backlight_atom, const uint16_t sequence) {
+    for (uint8_t d = 0; d < gs_confirm.num_devices; d++) {
+        struct Tconfirmdevice *pdevice = &gs_confirm.devices[d];
+        if (pdevice->pending && pdevice->output == output && pdevice->backlight_atom == backlight_atom) {
+            // sequence numbers wrap at 16 bits on the wire, an echo is at most half the range later
+            if ((uint16_t)(sequence - pdevice->sequence) < UINT16_MAX / 2) {
+                confirm_done(pdevice, monotonic_us());
+            }
+            return;
+        }
+    }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// confirm_error()
+///////////////////////////////////////////////////////////////////////////////
+/** Fail a randr write the server answered with an error.
+
+    The write is reissued by the next `confirm_check()` right away rather
+    than after CONFIRM_TIMEOUT_MS, counting as an attempt.
+
+    @param error            the X error received as an event
+*/
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+static void confirm_error(const xcb_generic_error_t *error) {
+    for (uint8_t d = 0; d < gs_confirm.num_devices; d++) {
+        struct Tconfirmdevice *pdevice = &gs_confirm.devices[d];
+        if (pdevice->pending && pdevice->backlight_atom != XCB_ATOM_NONE && pdevice->sequence == error->sequence) {
+            gs_metrics.backend_errors++;
+            WARN("Warning: setting brightness %d of output %u failed (error %d)\n", pdevice->target_abs, pdevice->output, error->error_code);
+            pdevice->deadline_us = 0;
+            return;
+        }
+    }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// confirm_reached()
+///////////////////////////////////////////////////////////////////////////////
+/** Whether `actual_brightness` shows a sysfs write to have taken effect.
+
+    Drivers may report on a scale of their own, quantize, or follow the
+    written value only gradually, so a value within CONFIRM_TOLERANCE_PERCENT
+    of the range around the target, or one that moved towards the target from
+    the previous one, counts as reached.
+
+    @param pdevice          the device's record
+    @param actual_abs       the value read from `actual_brightness`
+    @return                 true if the write took effect, false otherwise
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static bool confirm_reached(const struct Tconfirmdevice *pdevice, const int32_t actual_abs) {
+    if (actual_abs == NO_BRIGHTNESS) {
+        return false;
+    }
+    const int32_t tolerance = gs_sysfs.brn_max_abs * CONFIRM_TOLERANCE_PERCENT / 100;
+    const int32_t distance  = abs(actual_abs - pdevice->target_abs);
+    return distance <= tolerance || (pdevice->from_abs != NO_BRIGHTNESS && distance < abs(pdevice->from_abs - pdevice->target_abs));
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// confirm_check()
+///////////////////////////////////////////////////////////////////////////////
+/** Confirm sysfs writes on their completion and reissue overdue writes.
+
+    A sysfs write is confirmed once the writer completed it and, if there is
+    an `actual_brightness`, it shows the write to have taken effect, see
+    `confirm_reached()`: read once on completion and, if not reached yet,
+    once more at the deadline, never polled in between. A write not confirmed
+    within CONFIRM_TIMEOUT_MS is written again, up to CONFIRM_ATTEMPTS times
+    in total, before it is given up on.
+
+    @param pxcb             the global xcb container struct
+
+    @see confirm_expect
+*/
+static void confirm_check(const struct Txcb *pxcb) {
+    const uint64_t now_us = monotonic_us();
+    for (uint8_t d = 0; d < gs_confirm.num_devices; d++) {
+        struct Tconfirmdevice *pdevice = &gs_confirm.devices[d];
+        if (!pdevice->pending) {
+            continue;
+        }
+        #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+        if (!pdevice->completed && !backlight_lagging()) {
+            pdevice->completed    = true;
+            pdevice->completed_us = now_us;
+            // without actual_brightness, the completed write is all there is to know
+            if (gs_sysfs.actual_brightness_fd < 0 || confirm_reached(pdevice, get_brightness_file(gs_sysfs.actual_brightness_fd))) {
+                confirm_done(pdevice, now_us);
+                continue;
+            }
+        }
+        if (now_us < pdevice->deadline_us) {
+            continue;
+        }
+        if (pdevice->completed && confirm_reached(pdevice, get_brightness_file(gs_sysfs.actual_brightness_fd))) {
+            confirm_done(pdevice, pdevice->completed_us);
+            continue;
+        }
+        #else
+        if (now_us < pdevice->deadline_us) {
+            continue;
+        }
+        #endif
+        if (++pdevice->attempts >= CONFIRM_ATTEMPTS) {
+            pdevice->failed++;
+            pdevice->pending = false;
+            gs_confirm.num_pending--;
+            WARN("Warning: device %u did not confirm brightness %d\n", pdevice->output, pdevice->target_abs);
+            continue;
+        }
+        DEBUG("[confirm] reissuing brightness %d to device %u\n", pdevice->target_abs, pdevice->output);
+        pdevice->reissued++;
+        #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+        (void)pxcb;
+        (void)backlight_write(pdevice->target_abs);
+        backlight_flush();
+        #else
+        xcb_void_cookie_t cookie = xcb_randr_change_output_property(pxcb->connection, pdevice->output, pdevice->backlight_atom,
+            XCB_ATOM_INTEGER, 32, XCB_PROP_MODE_REPLACE, 1, &pdevice->target_abs);
+        pdevice->sequence = (uint16_t)cookie.sequence;
+        gs_metrics.writes++;
+        #endif
+        pdevice->deadline_us = now_us + CONFIRM_TIMEOUT_MS * 1000;
+        pdevice->completed   = false;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// confirm_timeout_ms()
+///////////////////////////////////////////////////////////////////////////////
+/** Get how long the event loop may wait before the next confirmation check.
+
+    Only the deadlines count: the echoes of RandR writes and the completions
+    of sysfs writes wake the event loop by themselves.
+
+    @return                 the timeout in milliseconds for poll(), -1 if no write awaits confirmation
+*/
+static int confirm_timeout_ms(void) {
+    if (gs_confirm.num_pending == 0) {
+        return -1;
+    }
+    const uint64_t now_us = monotonic_us();
+    uint64_t timeout_us = CONFIRM_TIMEOUT_MS * 1000;
+    for (uint8_t d = 0; d < gs_confirm.num_devices; d++) {
+        const struct Tconfirmdevice *pdevice = &gs_confirm.devices[d];
+        if (pdevice->pending) {
+            uint64_t remaining_us = pdevice->deadline_us > now_us ? pdevice->deadline_us - now_us : 0;
+            timeout_us = remaining_us < timeout_us ? remaining_us : timeout_us;
+        }
+    }
+    return (int)((timeout_us + 999) / 1000);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fade_timeout_ms()
+///////////////////////////////////////////////////////////////////////////////
+/** Get how long the event loop may wait before the next step of a fade.
+
+    The poll() timeout is subject to the timer slack, see TIMER_SLACK_NS, so
+    the kernel may coalesce the wakeup with others. A late step is no harm,
+    the step due is derived from the time elapsed since the fade started.
+
+    @return                 the timeout in milliseconds for poll(), -1 if no fade is paced by the timeout
+
+    @see dim_to
+    @see _event_loop_fade
+*/
+static int fade_timeout_ms(void) {
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    if (gs_present.pacing) {
+        return -1;
+    }
+    #endif
+    if (gs_timer.action != TIMER_FADE) {
+        return -1;
+    }
+    const uint64_t due_ms = gs_fade.started_at_ms + (gs_fade.step + 1U) * FADE_STEP_MS;
+    const uint64_t now_ms = monotonic_ms();
+    return due_ms > now_ms ? (int)(due_ms - now_ms) : 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// stats_wakeup()
+///////////////////////////////////////////////////////////////////////////////
+/** Account a return from the event loop's poll() to the sources that woke it up.
+
+    @param ready            poll()'s return value
+
+    @see Tstats
+    @see wakeup_source_t
+*/
+static void stats_wakeup(const int ready) {
+    gs_stats.wakeups++;
+    if (ready < 0) {
+        gs_stats.wakeups_by_source[WAKEUP_SIGNAL]++;
+        return;
+    }
+    if (ready == 0) {
+        gs_stats.wakeups_by_source[WAKEUP_TIMEOUT]++;
+        return;
+    }
+    if (gs_pollfds[POLL_SOURCE_X].revents)      { gs_stats.wakeups_by_source[WAKEUP_X]++; }
+    if (gs_pollfds[POLL_SOURCE_TIMER].revents)  { gs_stats.wakeups_by_source[WAKEUP_TIMER]++; }
+    if (gs_pollfds[POLL_SOURCE_WORKER].revents || gs_pollfds[POLL_SOURCE_LEDS].revents) { gs_stats.wakeups_by_source[WAKEUP_WORKER]++; }
+    if (gs_pollfds[POLL_SOURCE_UEVENT].revents) { gs_stats.wakeups_by_source[WAKEUP_UEVENT]++; }
+    if (gs_pollfds[POLL_SOURCE_SIGNAL].revents) { gs_stats.wakeups_by_source[WAKEUP_SIGNAL]++; }
+    for (uint8_t p = POLL_SOURCE_HOOKS; p < POLL_SOURCE_SUBSCRIBE; p++) {
+        if (gs_pollfds[p].revents) {
+            gs_stats.wakeups_by_source[WAKEUP_HOOK]++;
+            break;
+        }
+    }
+    for (uint8_t p = POLL_SOURCE_SUBSCRIBE; p < POLL_SOURCE_COUNT; p++) {
+        if (gs_pollfds[p].revents) {
+            gs_stats.wakeups_by_source[WAKEUP_SOCKET]++;
+            break;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// timer_arm()
+///////////////////////////////////////////////////////////////////////////////
+/** Arm the dimming timer for an action.
+
+    @param action           what to do when the timer expires
+    @param delay_ms         milliseconds until the first expiration
+    @param interval_ms      milliseconds between further expirations, 0 for a one-shot timer
+
+    @see timer_action_t
+*/
+static void timer_arm(const timer_action_t action, const uint32_t delay_ms, const uint32_t interval_ms) {
+    const struct itimerspec spec = {
+        .it_value    = { .tv_sec = delay_ms / 1000,    .tv_nsec = (long)(delay_ms % 1000) * 1000000 },
+        .it_interval = { .tv_sec = interval_ms / 1000, .tv_nsec = (long)(interval_ms % 1000) * 1000000 },
+    };
+    if (timerfd_settime(gs_timer.fd, 0, &spec, NULL) < 0) {
+        ERROR("Error: cannot arm timer (%s)\n", strerror(errno));
+        return;
+    }
+    gs_timer.action = action;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// timer_disarm()
+///////////////////////////////////////////////////////////////////////////////
+/** Disarm the dimming timer, dropping a pending delayed dimming or fade.
+*/
+static void timer_disarm(void) {
+    const struct itimerspec spec = { .it_value = { 0, 0 }, .it_interval = { 0, 0 } };
+    if (gs_timer.action != TIMER_IDLE) {
+        (void)timerfd_settime(gs_timer.fd, 0, &spec, NULL);
+        gs_timer.action = TIMER_IDLE;
+    }
+}
+
+
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+///////////////////////////////////////////////////////////////////////////////
+// present_init()
+///////////////////////////////////////////////////////////////////////////////
+/** Set up the window whose MSC notifications pace the fades.
+
+    Nothing is ever presented, so the window is a never mapped 1x1 input only
+    window. PresentNotifyMSC reports the refresh of the crtc the server's
+    driver picks for the window, and drivers pick it from the window's
+    geometry alone, mapped or not (e.g., modesetting's ms_present_get_crtc()
+    takes the crtc covering the window's box), hence present_place() moves it
+    to the origin of the dimmed output's crtc. A window on no crtc gets
+    Present's fake clock instead: 60Hz on servers without vblank support such
+    as Xvfb, but 1Hz on real hardware, which is why a fade whose window could
+    not be placed is paced by the timer.
+
+    @param pxcb             xcb container struct
+    @param ppresent         present pacing container struct
+    @return                 true if fades can be paced by Present, false to keep the timer
+
+    @see Tpresent
+    @see present_place
+*/
+static bool present_init(const struct Txcb *pxcb, struct Tpresent *ppresent) {
+    const xcb_query_extension_reply_t *query_ext_reply = xcb_get_extension_data(pxcb->connection, &xcb_present_id);
+    if (!query_ext_reply || query_ext_reply->present == 0) {
+        return false;
+    }
+    ppresent->opcode = query_ext_reply->major_opcode;
+
+    xcb_present_query_version_reply_t *version_reply = xcb_present_query_version_reply(pxcb->connection,
+        xcb_present_query_version(pxcb->connection, 1, 0), NULL);
+    gs_metrics.round_trips++;
+    if (!version_reply) {
+        return false;
+    }
+    TRACE("[present] present version %u.%u\n", version_reply->major_version, version_reply->minor_version);
+    free(version_reply);
+
+    ppresent->window = xcb_generate_id(pxcb->connection);
+    ppresent->eid    = xcb_generate_id(pxcb->connection);
+    (void)xcb_create_window(pxcb->connection, XCB_COPY_FROM_PARENT, ppresent->window, pxcb->screen->root,
+        0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, NULL);
+    xcb_generic_error_t *error = xcb_request_check(pxcb->connection,
+        xcb_present_select_input_checked(pxcb->connection, ppresent->eid, ppresent->window, XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY));
+    if (error) {
+        WARN("Warning: cannot select present events (error %d), fades are paced by the timer\n", error->error_code);
+        free(error);
+        (void)xcb_destroy_window(pxcb->connection, ppresent->window);
+        ppresent->window = 0;
+        return false;
+    }
+    ppresent->enabled = true;
+    DEBUG("[present] fades are paced by msc notifications on window 0x%x\n", ppresent->window);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// present_place()
+///////////////////////////////////////////////////////////////////////////////
+/** Move the pacing window onto the crtc of the first output.
+
+    Only queries the server when the output changed since the last fade.
+
+    @param pxcb             xcb container struct
+    @param ppresent         present pacing container struct
+    @return                 true if the window is on the output's crtc, false if the output has none
+
+    @see present_init
+*/
+static bool present_place(const struct Txcb *pxcb, struct Tpresent *ppresent) {
+    if (gs_outputs.num_outputs == 0) {
+        return false;
+    }
+    if (ppresent->placed_output == gs_outputs.outputs[0].output) {
+        return true;
+    }
+    const struct Toutput *poutput = &gs_outputs.outputs[0];
+    xcb_randr_crtc_t crtc = poutput->crtc;
+    if (crtc == XCB_NONE) {
+        xcb_randr_get_output_info_reply_t *info_reply = xcb_randr_get_output_info_reply(pxcb->connection,
+            xcb_randr_get_output_info(pxcb->connection, poutput->output, XCB_CURRENT_TIME), NULL);
+        gs_metrics.round_trips++;
+        if (!info_reply) {
+            return false;
+        }
+        crtc = info_reply->crtc;
+        free(info_reply);
+    }
+    if (crtc == XCB_NONE) {
+        return false;
+    }
+    xcb_randr_get_crtc_info_reply_t *crtc_reply = xcb_randr_get_crtc_info_reply(pxcb->connection,
+        xcb_randr_get_crtc_info(pxcb->connection, crtc, XCB_CURRENT_TIME), NULL);
+    gs_metrics.round_trips++;
+    if (!crtc_reply) {
+        return false;
+    }
+    const uint32_t position[] = { (uint32_t)crtc_reply->x, (uint32_t)crtc_reply->y };
+    (void)xcb_configure_window(pxcb->connection, ppresent->window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, position);
+    ppresent->placed_output = poutput->output;
+    TRACE("[present] pacing window placed at %d,%d on crtc %u of output %u\n", crtc_reply->x, crtc_reply->y, crtc, poutput->output);
+    free(crtc_reply);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// present_request()
+///////////////////////////////////////////////////////////////////////////////
+/** Ask for a notification at the next refresh of the pacing window's crtc.
+
+    @param pxcb             xcb container struct
+    @param ppresent         present pacing container struct
+
+    @see _event_loop_present
+*/
+static void present_request(const struct Txcb *pxcb, struct Tpresent *ppresent) {
+    (void)xcb_present_notify_msc(pxcb->connection, ppresent->window, ++ppresent->serial, 0, 1, 0);
+    ppresent->pending = true;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// dim_to()
+///////////////////////////////////////////////////////////////////////////////
+/** Dim to a target brightness, at once or as a fade over FADE_MS, shaped by
+    the adaptive delay's curve if enabled.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @param brn_target_perc  the brightness to dim to
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see _event_loop_fade
+    @see _event_loop_present
+*/
+static uint8_t dim_to(struct Txcb *pxcb, struct Teventstate *peventstate, const uint8_t brn_target_perc) {
+    if (gs_adaptive.timeout_seen && !gs_adaptive.dimmed) {
+        gs_adaptive.dimmed       = true;
+        gs_adaptive.dimmed_at_ms = monotonic_ms();
+    }
+    if (FADE_MS < 2 * FADE_STEP_MS || gs_timer.fd < 0) {
+        if (!operation_handler(OPERATION_SETBRIGHTNESS, pxcb, brn_target_perc, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
+            return EXIT_FAILURE;
+        }
+        return RET_OK;
+    }
+    gs_fade.from_perc     = peventstate->brn_cur_perc;
+    gs_fade.to_perc       = brn_target_perc;
+    gs_fade.step          = 0;
+    gs_fade.steps         = FADE_MS / FADE_STEP_MS;
+    gs_fade.written       = false;
+    gs_fade.exponent      = gs_adaptive.curve;
+    gs_fade.started_at_ms = monotonic_ms();
+    // not armed, the event loop's poll() timeout paces the steps, see fade_timeout_ms()
+    timer_disarm();
+    gs_timer.action = TIMER_FADE;
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    // a window on no crtc would get Present's slow fake clock
+    gs_present.pacing = gs_present.enabled && present_place(pxcb, &gs_present);
+    if (gs_present.pacing) {
+        // one step per millisecond, the refresh decides which of them get written
+        gs_fade.steps = FADE_MS;
+        if (!gs_present.pending) {
+            present_request(pxcb, &gs_present);
+        }
+        DEBUG("[eventloop] fading %d%% -> %d%% in %ums paced by present (curve %.2f)\n", gs_fade.from_perc, gs_fade.to_perc, FADE_MS, gs_fade.exponent);
+        return RET_OK;
+    }
+    #endif
+    DEBUG("[eventloop] fading %d%% -> %d%% in %u steps (curve %.2f)\n", gs_fade.from_perc, gs_fade.to_perc, gs_fade.steps, gs_fade.exponent);
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// adaptive_decide()
+///////////////////////////////////////////////////////////////////////////////
+/** Choose the delay of the timeout stage's dimming and the fade curve.
+
+    The delay is the shortest one, bounded by ADAPTIVE_DELAY_MAX, after which
+    a user still idle comes back within ADAPTIVE_CANCEL_WINDOW seconds with a
+    probability of at most ADAPTIVE_CANCEL_TARGET_PERCENT, i.e., the dimming
+    is likely to stick. The remaining probability of a cancelled dim makes
+    the fade curve flatter in the beginning, so that a dim undone early is
+    barely visible.
+
+    @see Tadaptive
+*/
+static void adaptive_decide(void) {
+    if (gs_adaptive.samples < ADAPTIVE_MIN_SAMPLES) {
+        return;
+    }
+    const uint32_t window   = (ADAPTIVE_CANCEL_WINDOW + ADAPTIVE_BUCKET_SECONDS - 1) / ADAPTIVE_BUCKET_SECONDS;
+    const uint32_t last     = ADAPTIVE_DELAY_MAX / ADAPTIVE_BUCKET_SECONDS;
+    uint32_t       later    = gs_adaptive.samples;
+    uint32_t       soon     = 0;
+    uint32_t       b        = 0;
+
+    for (uint32_t w = 0; w < window && w < ADAPTIVE_BUCKETS; w++) {
+        soon += gs_adaptive.returns[w];
+    }
+    // later: returns after the delay b, soon: the ones among them within the cancel window
+    for (; b < last && b < ADAPTIVE_BUCKETS - 1; b++) {
+        if (later == 0 || (uint64_t)soon * 100 <= (uint64_t)later * ADAPTIVE_CANCEL_TARGET_PERCENT) {
+            break;
+        }
+        later -= gs_adaptive.returns[b];
+        soon  -= gs_adaptive.returns[b];
+        if (b + window < ADAPTIVE_BUCKETS) {
+            soon += gs_adaptive.returns[b + window];
+        }
+    }
+    gs_adaptive.delay_s            = b * ADAPTIVE_BUCKET_SECONDS;
+    gs_adaptive.cancel_probability = later ? (double)soon / later : 0.0;
+    gs_adaptive.curve              = 1.0 + 2.0 * gs_adaptive.cancel_probability;
+    gs_adaptive.decisions++;
+    DEBUG("[adaptive] %u samples: delay=%us curve=%.2f cancel_probability=%.2f\n",
+        gs_adaptive.samples, gs_adaptive.delay_s, gs_adaptive.curve, gs_adaptive.cancel_probability);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// adaptive_record_return()
+///////////////////////////////////////////////////////////////////////////////
+/** Record the user's return after the timeout stage and decide anew.
+
+    Classifies the timeout stage's dimming as avoided (the user came back
+    while it was still delayed), cancelled (came back within
+    ADAPTIVE_CANCEL_WINDOW seconds after it), or stuck.
+
+    @see adaptive_decide
+*/
+static void adaptive_record_return(void) {
+    if (!gs_adaptive.timeout_seen) {
+        return;
+    }
+    const uint64_t now    = monotonic_ms();
+    uint32_t       bucket = (uint32_t)((now - gs_adaptive.timeout_at_ms) / 1000 / ADAPTIVE_BUCKET_SECONDS);
+
+    if (!gs_adaptive.dimmed) {
+        gs_adaptive.dims_avoided++;
+    } else if (now - gs_adaptive.dimmed_at_ms <= ADAPTIVE_CANCEL_WINDOW * 1000) {
+        gs_adaptive.dims_cancelled++;
+    } else {
+        gs_adaptive.dims_stuck++;
+    }
+    gs_adaptive.timeout_seen = false;
+    gs_adaptive.dimmed       = false;
+
+    gs_adaptive.returns[bucket < ADAPTIVE_BUCKETS ? bucket : ADAPTIVE_BUCKETS - 1]++;
+    if (++gs_adaptive.samples >= ADAPTIVE_DECAY_SAMPLES) {
+        gs_adaptive.samples = 0;
+        for (uint32_t b = 0; b < ADAPTIVE_BUCKETS; b++) {
+            gs_adaptive.returns[b] /= 2;
+            gs_adaptive.samples    += gs_adaptive.returns[b];
+        }
+    }
+    adaptive_decide();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_scrsvr_on_timeout()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` handling the screensaver `timeout` event.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see event_loop
+    @see RET_OK
+*/
+static uint8_t _event_loop_scrsvr_on_timeout(struct Txcb *pxcb, struct Teventstate *peventstate) {
+    peventstate->brn_interval_set = false;
+    if (peventstate->brn_priorscrsvr_perc != BRN_PRIORSCRSVR_UNDEFINED) {
+        // the OFF in between got coalesced away: keep the brightness from before dimming, just re-enter the timeout stage
+        uint8_t brn_target_perc = peventstate->brn_priorscrsvr_perc < DIM_PERCENT_TIMEOUT ? peventstate->brn_priorscrsvr_perc : DIM_PERCENT_TIMEOUT;
+        if (dim_to(pxcb, peventstate, brn_target_perc) != RET_OK) {
+            ERROR("Error: Failed to re-enter screensaver timeout brightness. Exiting.\n");
+            return EXIT_FAILURE;
+        }
+        DEBUG("[eventloop] brightness %d%% -> %d%% (re-entered timeout)\n", peventstate->brn_old_perc, peventstate->brn_cur_perc);
+        return RET_OK;
+    }
+    if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_priorscrsvr_perc , &peventstate->brn_cur_perc)) {
+        ERROR("Error: Failed to get brightness on screensaver timeout. Exiting.\n");
+        return EXIT_FAILURE;
+    }
+    if (peventstate->brn_cur_perc == 0) {
+        // set once, the write is reissued only if the device does not confirm it, see confirm_check()
+        DEBUG("[eventloop] brightness is 0%% on timeout, setting 100%% brightness\n");
+        if (!operation_handler(OPERATION_SETBRIGHTNESS, pxcb, 100, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
+            ERROR("Error: Failed to set initial brightness to 100%% on screensaver timeout. Exiting.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (peventstate->brn_cur_perc < DIM_PERCENT_TIMEOUT) {
+        DEBUG("[eventloop] current brightness %d%% is below target brightness of %d%%, doing nothing.\n", peventstate->brn_cur_perc, DIM_PERCENT_TIMEOUT);
+        return RET_OK;
+    }
+    if (dim_to(pxcb, peventstate, DIM_PERCENT_TIMEOUT) != RET_OK) {
+        ERROR("Error: Failed to decrease brightness on screensaver timeout. Exiting.\n");
+        return EXIT_FAILURE;
+    }
+    DEBUG("[eventloop] brightness %d%% -> %d%%\n", peventstate->brn_priorscrsvr_perc, peventstate->brn_cur_perc);
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_scrsvr_on_interval()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` handling the screensaver `interval` event.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see event_loop
+    @see RET_OK
+*/
+static uint8_t _event_loop_scrsvr_on_interval(struct Txcb *pxcb, struct Teventstate *peventstate) {
+    if (peventstate->brn_priorscrsvr_perc == BRN_PRIORSCRSVR_UNDEFINED) {
+        // the timeout event got coalesced away: remember the brightness to restore on OFF first
+        if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_priorscrsvr_perc, &peventstate->brn_cur_perc)) {
+            ERROR("Error: Failed to get brightness on screensaver interval. Exiting.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (!peventstate->brn_interval_set) {
+        peventstate->brn_interval_set = true;
+        if (peventstate->brn_cur_perc < DIM_PERCENT_INTERVAL) {
+            DEBUG("[eventloop] current brightness %d%% is below target brightness of %d%%, doing nothing.\n", peventstate->brn_cur_perc, DIM_PERCENT_INTERVAL);
+            return RET_OK;
+        }
+        if (dim_to(pxcb, peventstate, DIM_PERCENT_INTERVAL) != RET_OK) {
+            ERROR("Error: Failed to decrease brightness on screensaver interval. Exiting.\n");
+            return EXIT_FAILURE;
+        }
+        DEBUG("[eventloop] brightness %d%% -> %d%%\n", peventstate->brn_old_perc, peventstate->brn_cur_perc);
+        return RET_OK;
+    }
+    DEBUG("[eventloop] brightness already set to %d%%\n", peventstate->brn_cur_perc);
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_scrsvr_off()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` handling the screensaver turn off event.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see event_loop
+    @see RET_OK
+*/
+static uint8_t _event_loop_scrsvr_off(struct Txcb *pxcb, struct Teventstate *peventstate) {
+    peventstate->brn_interval_set = false;
+    if (peventstate->brn_priorscrsvr_perc == BRN_PRIORSCRSVR_UNDEFINED) {
+        DEBUG("[eventloop] event: OFF received without being called on timeout or interval, not setting brightness\n");
+        DEBUG("[eventloop] getting current brightness\n");
+        if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
+            ERROR("Error: Failed to get brightness while setting screensaver OFF. Exiting.\n");
+            return EXIT_FAILURE;
+        }
+        return RET_OK;
+    }
+    if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
+        ERROR("Error: Failed to get brightness while setting screensaver OFF. Exiting.\n");
+        return EXIT_FAILURE;
+    }
+    if (peventstate->brn_cur_perc == 0) {
+        DEBUG("[eventloop] brightness is 0%% on setting OFF screensaver, setting to sane 100%% brightness\n");
+        peventstate->brn_priorscrsvr_perc = 100;
+    }
+    if (operation_handler(OPERATION_SETBRIGHTNESS, pxcb, peventstate->brn_priorscrsvr_perc, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
+        DEBUG("[eventloop] set to previous brightness %d%% from %d%%\n", peventstate->brn_priorscrsvr_perc, peventstate->brn_old_perc);
+    } else {
+        ERROR("Error: Failed to set prior brightness while setting screensaver OFF. Exiting.\n");
+        return EXIT_FAILURE;
+    }
+    peventstate->brn_priorscrsvr_perc = BRN_PRIORSCRSVR_UNDEFINED;
+    restore_plan_reset(&gs_restoreplan);
+    return RET_OK;
+}
 
-            if (error != NULL || prop_reply == NULL) {
-                TRACE("[operation_handler] error %u while querying output property, continuing to next display\n", error->error_code);
-                continue;
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_restore_plan()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` restoring the brightness from the restore plan.
+
+    Used when the screensaver turns off after the panel has been powered down
+    while dimmed: The prior brightness is written back in a single batch
+    without reading the current brightness first.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see event_loop
+    @see apply_plan
+    @see RET_OK
+*/
+static uint8_t _event_loop_restore_plan(struct Txcb *pxcb, struct Teventstate *peventstate) {
+    if (!apply_plan(pxcb, &gs_restoreplan)) {
+        ERROR("Error: Failed to restore prior brightness from restore plan. Exiting.\n");
+        return EXIT_FAILURE;
+    }
+    DEBUG("[eventloop] restored previous brightness %d%% from plan (%u outputs)\n", peventstate->brn_priorscrsvr_perc, gs_restoreplan.num_entries);
+    gs_stats.plan_restores++;
+    peventstate->brn_old_perc         = peventstate->brn_cur_perc;
+    peventstate->brn_cur_perc         = peventstate->brn_priorscrsvr_perc;
+    peventstate->brn_priorscrsvr_perc = BRN_PRIORSCRSVR_UNDEFINED;
+    peventstate->brn_interval_set     = false;
+    restore_plan_reset(&gs_restoreplan);
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_restore_fast()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` restoring the brightness right off the OFF event.
+
+    The screensaver notification already says the screensaver turned off and
+    the DPMS events keep the panel's power level current, so there is nothing
+    to ask the server: The restore plan recorded when dimming is written in a
+    single flush, without querying the state or reading any brightness first.
+
+    @param pglobalstate     state container struct
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @param received_us      when the event loop received the OFF event
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see _event_loop_restore_plan
+    @see metrics_restore_issued
+*/
+static uint8_t _event_loop_restore_fast(struct Tglobalstate *pglobalstate, struct Txcb *pxcb, struct Teventstate *peventstate, const uint64_t received_us) {
+    uint8_t result;
+    DEBUG("[eventloop] handling event: OFF (fast path)\n");
+    timer_disarm();
+    pglobalstate->screensaver_state = XCB_SCREENSAVER_STATE_OFF;
+    pglobalstate->state             = STATE_SCREENSAVER_OFF;
+    gs_metrics.restore_started_us   = received_us;
+    if ( RET_OK != (result = _event_loop_restore_plan(pxcb, peventstate)) ) { return result; }
+    metrics_restore_issued(received_us);
+    gs_metrics.restores_fast++;
+    adaptive_record_return();
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_stages_start()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` starting the dimming schedule on the ON event.
+
+    Captures the current brightness as restore plan, computes the plans of
+    all stages from it, and arms the timer for the first stage.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see Tstages
+    @see _event_loop_stage
+*/
+static uint8_t _event_loop_stages_start(struct Txcb *pxcb, struct Teventstate *peventstate) {
+    if (!gs_restoreplan.valid) {
+        if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_priorscrsvr_perc, &peventstate->brn_cur_perc)) {
+            ERROR("Error: Failed to get brightness on screensaver timeout. Exiting.\n");
+            return EXIT_FAILURE;
+        }
+        if (!plan_capture(pxcb, &gs_restoreplan)) {
+            ERROR("Error: Failed to capture brightness on screensaver timeout. Exiting.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    for (uint8_t st = 0; st < gs_stages.num_stages; st++) {
+        plan_scale(&gs_restoreplan, gs_stages.stages[st].perc, &gs_stages.plans[st]);
+    }
+    gs_stages.started_at_ms = monotonic_ms();
+    gs_stages.next          = 0;
+    timer_arm(TIMER_STAGE, gs_stages.stages[0].seconds * 1000U + 1, 0);
+    DEBUG("[eventloop] starting dimming schedule of %u stages\n", gs_stages.num_stages);
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_stage()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` firing the due stage of the dimming schedule.
+
+    Writes the precomputed plan of the latest due stage in one batch, i.e.,
+    stages that got due together are collapsed, and arms the timer for the
+    next stage.
+
+    @param pglobalstate     state container struct
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see _event_loop_stages_start
+    @see apply_plan
+*/
+static uint8_t _event_loop_stage(const struct Tglobalstate *pglobalstate, struct Txcb *pxcb, struct Teventstate *peventstate) {
+    const uint64_t elapsed_ms = monotonic_ms() - gs_stages.started_at_ms;
+    uint8_t due = gs_stages.next;
+    while (due + 1 < gs_stages.num_stages && gs_stages.stages[due + 1].seconds * 1000U <= elapsed_ms) {
+        due++;
+    }
+    gs_stages.next = (uint8_t)(due + 1);
+    timer_disarm();
+    if (gs_stages.next < gs_stages.num_stages) {
+        uint64_t next_ms = gs_stages.stages[gs_stages.next].seconds * 1000U;
+        timer_arm(TIMER_STAGE, (uint32_t)(next_ms > elapsed_ms ? next_ms - elapsed_ms : 1), 0);
+    }
+
+    if (pglobalstate->dpms_power_level != XCB_DPMS_DPMS_MODE_ON) {
+        gs_stats.backend_ops_suppressed++;
+        return RET_OK;
+    }
+    if (FULLSCREEN_INHIBIT && gs_inhibit.fullscreen) {
+        DEBUG("[eventloop] fullscreen window focused, skipping stage %u\n", due);
+        gs_stats.dims_inhibited++;
+        return RET_OK;
+    }
+    if (!apply_plan(pxcb, &gs_stages.plans[due])) {
+        ERROR("Error: Failed to write dimming stage %u. Exiting.\n", due);
+        return EXIT_FAILURE;
+    }
+    peventstate->brn_old_perc = peventstate->brn_cur_perc;
+    peventstate->brn_cur_perc = gs_stages.stages[due].perc < peventstate->brn_priorscrsvr_perc ? gs_stages.stages[due].perc : peventstate->brn_priorscrsvr_perc;
+    DEBUG("[eventloop] stage %u after %us: brightness %d%% -> %d%%\n", due, gs_stages.stages[due].seconds, peventstate->brn_old_perc, peventstate->brn_cur_perc);
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_fade()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` performing the due step of a fade.
+
+    Steps missed while the event loop was busy are skipped, only the
+    brightness of the latest due step is written.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @param expirations      the number of fade steps due
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see dim_to
+    @see Tfade
+*/
+static uint8_t _event_loop_fade(struct Txcb *pxcb, struct Teventstate *peventstate, const uint64_t expirations) {
+    gs_fade.step = (uint16_t)(gs_fade.step + expirations > gs_fade.steps ? gs_fade.steps : gs_fade.step + expirations);
+    double  progress = pow((double)gs_fade.step / gs_fade.steps, gs_fade.exponent);
+    uint8_t brn_perc = (uint8_t)lround(gs_fade.from_perc + (gs_fade.to_perc - gs_fade.from_perc) * progress);
+    if (gs_fade.step >= gs_fade.steps) {
+        timer_disarm();
+        brn_perc = gs_fade.to_perc;
+    }
+    if (brn_perc == peventstate->brn_cur_perc) {
+        return RET_OK;
+    }
+    if (!operation_handler(OPERATION_SETBRIGHTNESS, pxcb, brn_perc, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
+        ERROR("Error: Failed to set brightness while fading. Exiting.\n");
+        return EXIT_FAILURE;
+    }
+    gs_fade.written = true;
+    TRACE("[eventloop] fade step %u/%u: %d%%\n", gs_fade.step, gs_fade.steps, peventstate->brn_cur_perc);
+    return RET_OK;
+}
+
+
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_present()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` performing a fade step at a refresh.
+
+    Writes the step due by the time elapsed since the fade started. While a
+    previous write awaits its confirmation, the refresh is skipped, hence a
+    slow backend gets fewer steps instead of a backlog.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see dim_to
+    @see _event_loop_fade
+    @see Tpresent
+*/
+static uint8_t _event_loop_present(struct Txcb *pxcb, struct Teventstate *peventstate) {
+    gs_present.pending = false;
+    if (gs_timer.action != TIMER_FADE || !gs_present.pacing) {
+        // cancelled in the meantime, or the fade is paced by the timer
+        return RET_OK;
+    }
+    gs_present.frames++;
+    if (gs_confirm.num_pending > 0) {
+        gs_present.frames_busy++;
+        present_request(pxcb, &gs_present);
+        return RET_OK;
+    }
+    const uint64_t elapsed_ms = monotonic_ms() - gs_fade.started_at_ms;
+    const uint8_t  brn_perc   = peventstate->brn_cur_perc;
+    uint8_t result = _event_loop_fade(pxcb, peventstate, elapsed_ms > gs_fade.step ? elapsed_ms - gs_fade.step : 0);
+    if (peventstate->brn_cur_perc != brn_perc) {
+        gs_present.frames_written++;
+    }
+    if (result == RET_OK && gs_timer.action == TIMER_FADE) {
+        present_request(pxcb, &gs_present);
+    }
+    return result;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_timer()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` handling an expiration of the dimming timer.
+
+    @param pglobalstate     state container struct
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see timer_action_t
+*/
+static uint8_t _event_loop_timer(const struct Tglobalstate *pglobalstate, struct Txcb *pxcb, struct Teventstate *peventstate) {
+    uint64_t expirations = 0;
+    if (read(gs_timer.fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        // disarmed in the meantime
+        return RET_OK;
+    }
+    switch (gs_timer.action) {
+        case TIMER_DIM_DELAY:
+            timer_disarm();
+            if (pglobalstate->dpms_power_level != XCB_DPMS_DPMS_MODE_ON || (FULLSCREEN_INHIBIT && gs_inhibit.fullscreen)) {
+                return RET_OK;
             }
+            DEBUG("[eventloop] adaptive delay of %us elapsed, dimming\n", gs_adaptive.delay_s);
+            return _event_loop_scrsvr_on_timeout(pxcb, peventstate);
+        case TIMER_STAGE:
+            return _event_loop_stage(pglobalstate, pxcb, peventstate);
+        case TIMER_FADE:
+            // not armed, see fade_timeout_ms()
+        case TIMER_IDLE:
+            return RET_OK;
+    }
+    return RET_OK;
+}
 
-            if (prop_reply->range && xcb_randr_query_output_property_valid_values_length(prop_reply) == 2 ) {
-                int32_t *values = xcb_randr_query_output_property_valid_values(prop_reply);
-                free(prop_reply);
-
-                int32_t brn_min_abs = values[0];
-                int32_t brn_max_abs = values[1];
-                int32_t brn_new_abs = brn_percent * (brn_max_abs - brn_min_abs) / 100;
-                *brn_cur_perc = (uint8_t) ((brn_cur_abs - brn_min_abs) * 100 / (brn_max_abs - brn_min_abs));
-                *brn_new_perc = *brn_cur_perc;
-
-                switch (operation) {
-                    case OPERATION_GETBRIGHTNESS:
-                        TRACE("[operation_handler] OPERATION_GETBRIGHTNESS\n");
-                        TRACE("[operation_handler] min_abs:%d <= cur_abs:%d <= max_abs:%d\n", brn_min_abs, brn_cur_abs, brn_max_abs);
-                        free(resources_reply);
-                        return true;
-                    case OPERATION_SETBRIGHTNESS:
-                        brn_new_abs = brn_min_abs + brn_new_abs;
-                        TRACE("[operation_handler] OPERATION_SETBRIGHTNESS -> %d (abs)\n", brn_new_abs);
-                        break;
-                    case OPERATION_INCBRIGHTNESS:
-                        brn_new_abs = brn_cur_abs + brn_new_abs;
-                        TRACE("[operation_handler] OPERATION_INCBRIGHTNESS -> %d (abs)\n", brn_new_abs);
-                        break;
-                    case OPERATION_DECBRIGHTNESS:
-                        brn_new_abs = brn_cur_abs - brn_new_abs;
-                        TRACE("[operation_handler] OPERATION_DECBRIGHTNESS -> %d (abs)\n", brn_new_abs);
-                }
-                if (brn_new_abs > brn_max_abs) { brn_new_abs = brn_max_abs; }
-                if (brn_new_abs < brn_min_abs) { brn_new_abs = brn_min_abs; }
-                *brn_new_perc = (uint8_t) (brn_new_abs * 100 / (brn_max_abs - brn_min_abs));
 
-                TRACE("[operation_handler] min_abs:%d <= cur_abs:%d -> new_abs:%d <= max_abs:%d\n", brn_min_abs, brn_cur_abs, brn_new_abs, brn_max_abs);
-                TRACE("[operation_handler] cur_perc:%d -> new_perc:%d\n", *brn_cur_perc, *brn_new_perc);
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_dpms()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` handling a change of the dpms power level.
 
-                (void)set_brightness_randr(pxcb, outputs[o], brn_new_abs);
-                xcb_flush(pxcb->connection);
-            } else {
-                free(prop_reply);
+    While the panel is powered down, backend work is suppressed and the
+    restore plan is kept ready; once it is powered up again, a restore that
+    was requested meanwhile is written in a single batch.
+
+    @param pglobalstate     state container struct
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see event_loop
+    @see _event_loop_restore_plan
+*/
+static uint8_t _event_loop_dpms(const struct Tglobalstate *pglobalstate, struct Txcb *pxcb, struct Teventstate *peventstate) {
+    DEBUG("[eventloop] handling event: DPMS power level %u\n", pglobalstate->dpms_power_level);
+    if (pglobalstate->dpms_power_level != XCB_DPMS_DPMS_MODE_ON) {
+        gs_restoreplan.deferred = gs_restoreplan.valid;
+        if (gs_timer.action == TIMER_FADE) {
+            timer_disarm();
+        }
+        return RET_OK;
+    }
+    if (gs_restoreplan.pending) {
+        return _event_loop_restore_plan(pxcb, peventstate);
+    }
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_drain()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` draining all already queued events.
+
+    Starting with `event_generic`, consumes every event libxcb has already read
+    from the connection and collapses the screensaver notifications among them
+    into the net screensaver state, i.e., the state of the last one, the
+    same way as the idle alarms standing in for them. DPMS Info
+    events just update the tracked dpms power level, property changes of the
+    active window are merely flagged so that they are queried once per burst.
+    RandR notifications invalidate the cached backlight outputs, the Present
+    notification pacing a fade is flagged as well.
+
+    @param pglobalstate     state container struct
+    @param pxcb             the global xcb container struct
+    @param event_generic    the event that woke up the event loop, freed by this function
+    @param pburst           what the burst boils down to
+
+    @see event_loop
+    @see Tburst
+    @see Tstats
+*/
+static void _event_loop_drain(struct Tglobalstate *pglobalstate, const struct Txcb *pxcb, xcb_generic_event_t *event_generic, struct Tburst *pburst) {
+    pburst->screensaver_events    = 0;
+    pburst->saw_off               = false;
+    pburst->active_window_changed = false;
+    pburst->wm_state_changed      = false;
+    pburst->present_complete      = false;
+    do {
+        gs_stats.events_received++;
+        if (XCB_EVENT_RESPONSE_TYPE(event_generic) == pxcb->screensaver_id) {
+            const xcb_screensaver_notify_event_t *notify_event = (const xcb_screensaver_notify_event_t *)event_generic;
+            pburst->net_state = notify_event->state;
+            pburst->saw_off  |= notify_event->state == XCB_SCREENSAVER_STATE_OFF;
+            pburst->screensaver_events++;
+        } else if (gs_idle.first_event != 0 && XCB_EVENT_RESPONSE_TYPE(event_generic) == gs_idle.first_event + XCB_SYNC_ALARM_NOTIFY) {
+            // the alarms stand in for the screensaver notifications of the same burst semantics
+            static const uint8_t alarm_states[IDLE_ALARM_COUNT] = { XCB_SCREENSAVER_STATE_OFF, XCB_SCREENSAVER_STATE_ON, XCB_SCREENSAVER_STATE_CYCLE };
+            const xcb_sync_alarm_notify_event_t *alarm_event = (const xcb_sync_alarm_notify_event_t *)event_generic;
+            for (uint8_t a = 0; a < IDLE_ALARM_COUNT; a++) {
+                if (gs_idle.alarms[a] == 0 || alarm_event->alarm != gs_idle.alarms[a]) {
+                    continue;
+                }
+                gs_idle.fired     = a;
+                gs_idle.idle_ms   = alarm_event->counter_value.hi == 0 ? alarm_event->counter_value.lo : UINT32_MAX;
+                pburst->net_state = alarm_states[a];
+                pburst->saw_off  |= a == IDLE_ALARM_RESET;
+                pburst->screensaver_events++;
+            }
+        } else if (XCB_EVENT_RESPONSE_TYPE(event_generic) == XCB_PROPERTY_NOTIFY) {
+            const xcb_property_notify_event_t *property_event = (const xcb_property_notify_event_t *)event_generic;
+            if (property_event->window == pxcb->screen->root && property_event->atom == gs_inhibit.net_active_window_atom) {
+                pburst->active_window_changed = true;
+            } else if (property_event->window == gs_inhibit.active_window && property_event->atom == gs_inhibit.net_wm_state_atom) {
+                pburst->wm_state_changed = true;
+            }
+        #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+        } else if (pxcb->randr_first_event != 0 && XCB_EVENT_RESPONSE_TYPE(event_generic) == pxcb->randr_first_event + XCB_RANDR_NOTIFY &&
+                   ((const xcb_randr_notify_event_t *)event_generic)->subCode == XCB_RANDR_NOTIFY_OUTPUT_PROPERTY) {
+            const xcb_randr_output_property_t *property = &((const xcb_randr_notify_event_t *)event_generic)->u.op;
+            confirm_echo(property->output, property->atom, event_generic->sequence);
+        } else if (pxcb->randr_first_event != 0 && (
+                       XCB_EVENT_RESPONSE_TYPE(event_generic) == pxcb->randr_first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY ||
+                       XCB_EVENT_RESPONSE_TYPE(event_generic) == pxcb->randr_first_event + XCB_RANDR_NOTIFY)) {
+            // outputs may have come or gone, probe them again on the next brightness operation
+            gs_outputs.valid         = false;
+            gs_present.placed_output = 0;
+        } else if (event_generic->response_type == 0) {
+            confirm_error((const xcb_generic_error_t *)event_generic);
+        #endif
+        } else if (XCB_EVENT_RESPONSE_TYPE(event_generic) == XCB_GE_GENERIC) {
+            const xcb_ge_generic_event_t *ge_event = (const xcb_ge_generic_event_t *)event_generic;
+            if (pxcb->dpms_events && ge_event->extension == pxcb->dpms_opcode && ge_event->event_type == XCB_DPMS_INFO_NOTIFY) {
+                const xcb_dpms_info_notify_event_t *info_event = (const xcb_dpms_info_notify_event_t *)event_generic;
+                pglobalstate->dpms_power_level = info_event->power_level;
+                pglobalstate->dpms_state       = info_event->state;
+                gs_stats.events_dpms++;
+            #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+            } else if (gs_present.enabled && ge_event->extension == gs_present.opcode && ge_event->event_type == XCB_PRESENT_COMPLETE_NOTIFY) {
+                const xcb_present_complete_notify_event_t *complete_event = (const xcb_present_complete_notify_event_t *)event_generic;
+                pburst->present_complete |= complete_event->kind == XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC && complete_event->serial == gs_present.serial;
+            #endif
             }
         }
+        free(event_generic);
+    } while ( (event_generic = xcb_poll_for_queued_event(pxcb->connection)) );
+    gs_stats.events_screensaver += pburst->screensaver_events;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_fullscreen()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` following the active window's fullscreen state.
+
+    Only called when the active window or its `_NET_WM_STATE` property changed,
+    i.e., the dimming path itself never queries the window manager state. If a
+    fullscreen window gets focused while dimmed, the brightness is restored.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @param pburst           the drained burst of events
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see event_loop
+    @see query_active_window
+    @see query_fullscreen
+*/
+static uint8_t _event_loop_fullscreen(struct Txcb *pxcb, struct Teventstate *peventstate, const struct Tburst *pburst) {
+    bool active_window_changed = pburst->active_window_changed && query_active_window(&gs_inhibit, pxcb);
+    if (!active_window_changed && !pburst->wm_state_changed) {
+        return RET_OK;
+    }
+    if (!query_fullscreen(&gs_inhibit, pxcb) || !gs_inhibit.fullscreen) {
+        return RET_OK;
+    }
+    DEBUG("[eventloop] fullscreen window 0x%x focused, inhibiting dimming\n", gs_inhibit.active_window);
+    if (gs_restoreplan.valid && !gs_restoreplan.deferred) {
+        return _event_loop_restore_plan(pxcb, peventstate);
+    }
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// _event_loop_power()
+///////////////////////////////////////////////////////////////////////////////
+/** Helper function to `event_loop()` handling power_supply uevents.
+
+    A switch of the power source takes effect at once: While dimmed by the
+    timeout or cycle stage, the brightness follows the new profile's level.
+
+    @param pxcb             the global xcb container struct
+    @param peventstate      event loop brightness state container struct
+    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+
+    @see power_receive
+    @see RET_OK
+*/
+static uint8_t _event_loop_power(struct Txcb *pxcb, struct Teventstate *peventstate) {
+    const uint8_t source = gs_power.source;
+    power_receive(&gs_power);
+    // while reconnecting, the new source's level is taken on by the next dim
+    if (gs_power.source == source || !pxcb->connection || peventstate->scrsvr_state != XCB_SCREENSAVER_STATE_ON ||
+        peventstate->brn_priorscrsvr_perc == BRN_PRIORSCRSVR_UNDEFINED || gs_stages.num_stages > 0 || gs_timer.action != TIMER_IDLE) {
+        return RET_OK;
+    }
+    const uint8_t level = peventstate->brn_interval_set ? DIM_PERCENT_INTERVAL : DIM_PERCENT_TIMEOUT;
+    const uint8_t brn_target_perc = peventstate->brn_priorscrsvr_perc < level ? peventstate->brn_priorscrsvr_perc : level;
+    if (brn_target_perc == peventstate->brn_cur_perc) {
+        return RET_OK;
+    }
+    DEBUG("[eventloop] power source changed while dimmed, %d%% -> %d%%\n", peventstate->brn_cur_perc, brn_target_perc);
+    if (dim_to(pxcb, peventstate, brn_target_perc) != RET_OK) {
+        ERROR("Error: Failed to dim to the new power source's level. Exiting.\n");
+        return EXIT_FAILURE;
+    }
+    return RET_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// setup_connection()
+///////////////////////////////////////////////////////////////////////////////
+/** Connect to the X server and set up the extensions brightnessd relies on.
+
+    Run once at startup and again by `reconnect()` after losing the server,
+    so it neither registers exit handlers nor touches the backlight.
+
+    @param pglobalstate     state container struct, queried once connected
+    @param pxcb             xcb container struct to fill in
+    @return                 RET_OK on success, failure exit code on error (e.g, EX_UNAVAILABLE)
+
+    @see reconnect
+    @see RET_OK
+*/
+static uint8_t setup_connection(struct Tglobalstate *pglobalstate, struct Txcb *pxcb) {
+    xcb_generic_error_t               *xcb_generic_error;
+    xcb_void_cookie_t                  xcb_void_cookie;
+    const xcb_query_extension_reply_t *query_ext_reply;
+
+    DEBUG("[init] getting xcb connection\n");
+    #ifdef FAKE_X
+    WARN("Warning: connecting to the built-in fake X server\n");
+    pxcb->connection = xcb_connect_to_fd(fakex_start(), NULL);
+    #else
+    pxcb->connection = xcb_connect(NULL, &pxcb->screen_nr);
+    #endif
+    if (!pxcb->connection || xcb_connection_has_error(pxcb->connection)) {
+        ERROR("Error: cannot open xcb connection\n");
+        return EX_UNAVAILABLE;
+    }
+    gs_pollfds[POLL_SOURCE_X].fd = xcb_get_file_descriptor(pxcb->connection);
+    TRACE("[init] running on screen #%u\n", pxcb->screen_nr);
+    xcb_screen_iterator_t screen_iterator = xcb_setup_roots_iterator(xcb_get_setup(pxcb->connection));
+    for (int screen_nr = pxcb->screen_nr; screen_iterator.rem; --screen_nr, xcb_screen_next(&screen_iterator)) {
+        if (screen_nr == 0) {
+          pxcb->screen = screen_iterator.data;
+          break;
+        }
+    }
+    TRACE("[init] screen #%u's dimensions: %ux%u\n",
+            pxcb->screen_nr,
+            pxcb->screen->width_in_pixels,
+            pxcb->screen->height_in_pixels
+    );
+
+    // send all init queries up front, the sections below merely collect the replies
+    DEBUG("[init] sending init queries\n");
+    xcb_prefetch_extension_data(pxcb->connection, &xcb_randr_id);
+    xcb_prefetch_extension_data(pxcb->connection, &xcb_dpms_id);
+    xcb_prefetch_extension_data(pxcb->connection, &xcb_screensaver_id);
+    if (gs_idle.enabled) {
+        xcb_prefetch_extension_data(pxcb->connection, &xcb_sync_id);
+    }
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    if (FADE_MS >= 2 * FADE_STEP_MS) {
+        xcb_prefetch_extension_data(pxcb->connection, &xcb_present_id);
+    }
+    #endif
+    xcb_randr_query_version_cookie_t gs_xcb_randr_query_version_cookie = xcb_randr_query_version(pxcb->connection, 1, 2);
+    xcb_intern_atom_cookie_t  gs_xcb_intern_atom_cookie_backlight[2];
+    gs_xcb_intern_atom_cookie_backlight[0] = xcb_intern_atom(pxcb->connection, 1, strlen("Backlight"), "Backlight");
+    gs_xcb_intern_atom_cookie_backlight[1] = xcb_intern_atom(pxcb->connection, 1, strlen("BACKLIGHT"), "BACKLIGHT");
+    xcb_intern_atom_cookie_t gs_xcb_intern_atom_cookie_edid = xcb_intern_atom(pxcb->connection, 1, strlen("EDID"), "EDID");
+    xcb_intern_atom_cookie_t intern_atom_cookie = { 0 };
+    if (!gs_idle.enabled) {
+        intern_atom_cookie = xcb_intern_atom(pxcb->connection, 0, strlen("_SCREEN_SAVER_ID"), "_SCREEN_SAVER_ID");
+    }
+    xcb_flush(pxcb->connection);
+
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // randr
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    DEBUG("[init] querying randr extension\n");
+    xcb_randr_query_version_reply_t *gs_xcb_randr_query_version_reply  = xcb_randr_query_version_reply(pxcb->connection, gs_xcb_randr_query_version_cookie, &xcb_generic_error);
+    if (xcb_generic_error != NULL || gs_xcb_randr_query_version_reply == NULL) {
+        ERROR("Error: cannot query randr extension\n");
+        return EX_UNAVAILABLE;
+    }
+    if (gs_xcb_randr_query_version_reply->major_version != 1 || gs_xcb_randr_query_version_reply->minor_version < 2) {
+        ERROR("Error: randr version %d.%d too old\n", gs_xcb_randr_query_version_reply->major_version, gs_xcb_randr_query_version_reply->minor_version);
+        free(gs_xcb_randr_query_version_reply);
+        return EX_UNAVAILABLE;
     }
-    free(resources_reply);
-    if (!output_found) {
-        ERROR("Error: Couldn't get brightness for any output.\n");
+    free(gs_xcb_randr_query_version_reply);
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    query_ext_reply = xcb_get_extension_data(pxcb->connection, &xcb_randr_id);
+    if (query_ext_reply && query_ext_reply->present) {
+        pxcb->randr_first_event = query_ext_reply->first_event;
+        (void)xcb_randr_select_input(pxcb->connection, pxcb->screen->root,
+                                     XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE | XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE | XCB_RANDR_NOTIFY_MASK_OUTPUT_PROPERTY);
     }
-    return output_found;
-}
-#endif
+    if (FADE_MS >= 2 * FADE_STEP_MS && !present_init(pxcb, &gs_present)) {
+        DEBUG("[init] no present extension, fades are paced by the timer\n");
+    }
+    #endif
 
+    xcb_intern_atom_reply_t  *gs_xcb_intern_atom_reply_backlight;
+    gs_xcb_intern_atom_reply_backlight     = xcb_intern_atom_reply(pxcb->connection, gs_xcb_intern_atom_cookie_backlight[0], &xcb_generic_error);
+    if (xcb_generic_error != NULL || gs_xcb_intern_atom_reply_backlight == NULL) {
+        ERROR("Error: Intern Atom returned error %d while querying backlight property\n", xcb_generic_error ? xcb_generic_error->error_code : -1);
+        return EX_UNAVAILABLE;
+    }
+    pxcb->backlight_new_atom = gs_xcb_intern_atom_reply_backlight->atom;
+    free(gs_xcb_intern_atom_reply_backlight);
 
-///////////////////////////////////////////////////////////////////////////////
-// _operation_handler_file()
-///////////////////////////////////////////////////////////////////////////////
-/** Provides set/get/increase/decrease brightness operations using sysfs files.
+    gs_xcb_intern_atom_reply_backlight     = xcb_intern_atom_reply(pxcb->connection, gs_xcb_intern_atom_cookie_backlight[1], &xcb_generic_error);
+    if (xcb_generic_error != NULL || gs_xcb_intern_atom_reply_backlight == NULL) {
+        ERROR("Error: Intern Atom returned error %d while querying backlight property\n", xcb_generic_error ? xcb_generic_error->error_code : -1);
+        return EX_UNAVAILABLE;
+    }
+    pxcb->backlight_legacy_atom = gs_xcb_intern_atom_reply_backlight->atom;
+    free(gs_xcb_intern_atom_reply_backlight);
 
-    @param operation        the brightness operation to perform
-    @param brn_percent      brightness percentage to set/increase/decrease depending on `operation`
-    @param brn_cur_perc     the current brightness as percentage
-    @param brn_new_perc     the new brightness as percentage
-    @return                 true if operation could be performed, false on an unrecoverable error
+    if (pxcb->backlight_new_atom == XCB_NONE && pxcb->backlight_legacy_atom == XCB_NONE && !GAMMA_DIMMING) {
+        ERROR("Error: No outputs have backlight property\n");
+        return EX_UNAVAILABLE;
+    }
 
-    @see operations_t
-*/
-#ifdef USE_SYSFS_BACKLIGHT_CONTROL
-bool _operation_handler_file(const operations_t operation, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc) {
-    int32_t brn_min_abs = 0;
-    int32_t brn_max_abs = 0;
-    int32_t brn_cur_abs = 0;
+    gs_xcb_intern_atom_reply_backlight = xcb_intern_atom_reply(pxcb->connection, gs_xcb_intern_atom_cookie_edid, NULL);
+    if (gs_xcb_intern_atom_reply_backlight) {
+        #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+        if (gs_statefile) {
+            pxcb->edid_atom = gs_xcb_intern_atom_reply_backlight->atom;
+        }
+        #endif
+        free(gs_xcb_intern_atom_reply_backlight);
+    }
 
-    if ( NO_BRIGHTNESS == (brn_cur_abs = get_brightness_file(SYSFS_BACKLIGHT_PATH "brightness")) ) {
-        ERROR("Error: Couldn't get current brightness for output.\n");
-        return false;
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // DPMS
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    DEBUG("[init] querying dpms extension\n");
+    query_ext_reply = xcb_get_extension_data(pxcb->connection, &xcb_dpms_id);
+    if ( !query_ext_reply || query_ext_reply->present == 0 ) {
+        ERROR("Error: cannot query dpms extension.\n");
+        return EXIT_FAILURE;
     }
-    if ( NO_BRIGHTNESS == (brn_max_abs = get_brightness_file(SYSFS_BACKLIGHT_PATH "max_brightness")) ) {
-        ERROR("Error: Couldn't get maximal brightness for output.\n");
-        return false;
+
+    xcb_dpms_capable_cookie_t gs_xcb_dpms_capable_cookie = xcb_dpms_capable_unchecked(pxcb->connection);
+    xcb_dpms_capable_reply_t *gs_xcb_dpms_capable_reply  = xcb_dpms_capable_reply(pxcb->connection, gs_xcb_dpms_capable_cookie, NULL);
+    if (!gs_xcb_dpms_capable_reply || gs_xcb_dpms_capable_reply->capable == 0) {
+        free(gs_xcb_dpms_capable_reply);
+        ERROR("Error: display not capable of dpms.\n");
+        return EXIT_FAILURE;
     }
-    int32_t brn_new_abs = brn_percent * (brn_max_abs - brn_min_abs) / 100;
-    *brn_cur_perc = (uint8_t) ((brn_cur_abs - brn_min_abs) * 100 / (brn_max_abs - brn_min_abs));
-    *brn_new_perc = *brn_cur_perc;
+    free(gs_xcb_dpms_capable_reply);
 
-    switch (operation) {
-        case OPERATION_GETBRIGHTNESS:
-            TRACE("[operation_handler] OPERATION_GETBRIGHTNESS\n");
-            TRACE("[operation_handler] min_abs:%d <= cur_abs:%d <= max_abs:%d\n", brn_min_abs, brn_cur_abs, brn_max_abs);
-            return true;
-        case OPERATION_SETBRIGHTNESS:
-            brn_new_abs = brn_min_abs + brn_new_abs;
-            TRACE("[operation_handler] OPERATION_SETBRIGHTNESS -> %d (abs)\n", brn_new_abs);
-            break;
-        case OPERATION_INCBRIGHTNESS:
-            brn_new_abs = brn_cur_abs + brn_new_abs;
-            TRACE("[operation_handler] OPERATION_INCBRIGHTNESS -> %d (abs)\n", brn_new_abs);
-            break;
-        case OPERATION_DECBRIGHTNESS:
-            brn_new_abs = brn_cur_abs - brn_new_abs;
-            TRACE("[operation_handler] OPERATION_DECBRIGHTNESS -> %d (abs)\n", brn_new_abs);
+    // DPMS 1.2 reports power level changes by events, sparing the per-event dpms queries
+    #if XCB_DPMS_MAJOR_VERSION > 1 || XCB_DPMS_MINOR_VERSION >= 2
+    xcb_dpms_get_version_cookie_t gs_xcb_dpms_version_cookie = xcb_dpms_get_version(pxcb->connection, 1, 2);
+    xcb_dpms_get_version_reply_t *gs_xcb_dpms_version_reply  = xcb_dpms_get_version_reply(pxcb->connection, gs_xcb_dpms_version_cookie, NULL);
+    if (gs_xcb_dpms_version_reply && (gs_xcb_dpms_version_reply->server_major_version > 1 ||
+            (gs_xcb_dpms_version_reply->server_major_version == 1 && gs_xcb_dpms_version_reply->server_minor_version >= 2))) {
+        DEBUG("[init] subscribing to dpms info events\n");
+        xcb_void_cookie = xcb_dpms_select_input_checked(pxcb->connection, XCB_DPMS_EVENT_MASK_INFO_NOTIFY);
+        if ( (xcb_generic_error = xcb_request_check(pxcb->connection, xcb_void_cookie)) ) {
+            WARN("Warning: cannot subscribe to dpms info events, querying dpms state per event\n");
+            free(xcb_generic_error);
+        } else {
+            pxcb->dpms_events = true;
+            pxcb->dpms_opcode = query_ext_reply->major_opcode;
+        }
+    }
+    free(gs_xcb_dpms_version_reply);
+    #endif
+    if (!query_state_dpms(pglobalstate, pxcb)) {
+        ERROR("Error: cannot get dpms settings.\n");
+        return EXIT_FAILURE;
     }
-    if (brn_new_abs > brn_max_abs) { brn_new_abs = brn_max_abs; }
-    if (brn_new_abs < brn_min_abs) { brn_new_abs = brn_min_abs; }
-    *brn_new_perc = (uint8_t) (brn_new_abs * 100 / (brn_max_abs - brn_min_abs));
 
-    TRACE("[operation_handler] min_abs:%d <= cur_abs:%d -> new_abs:%d <= max_abs:%d\n", brn_min_abs, brn_cur_abs, brn_new_abs, brn_max_abs);
-    TRACE("[operation_handler] cur_perc:%d -> new_perc:%d\n", *brn_cur_perc, *brn_new_perc);
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // Screensaver
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    DEBUG("[init] querying screensaver extension\n");
+    query_ext_reply = xcb_get_extension_data(pxcb->connection, &xcb_screensaver_id);
+    if ( !query_ext_reply || query_ext_reply->present == 0 ) {
+        ERROR("Error: cannot query screensaver extension.\n");
+        return EXIT_FAILURE;
+    }
+    pxcb->screensaver_id = query_ext_reply->first_event + XCB_SCREENSAVER_NOTIFY;
 
-    (void)set_brightness_file(SYSFS_BACKLIGHT_PATH "brightness", brn_new_abs);
+    DEBUG("[init] querying screensaver settings\n");
+    if (!query_state(pglobalstate, pxcb)) {
+        ERROR("Error: cannot get screensaver settings\n");
+        return EXIT_FAILURE;
+    }
 
-    return true;
-}
-#endif
+    if (gs_idle.enabled) {
+        DEBUG("[init] arming idle alarms instead of acting as the screensaver\n");
+        if (!idle_alarms_init(pxcb, &gs_idle)) {
+            ERROR("Error: cannot arm idle alarms.\n");
+            return EX_UNAVAILABLE;
+        }
+    } else {
+        // Create a pixmap and register it as the screensaver's "window" via _SCREEN_SAVER_ID property
+        DEBUG("[init] creating and registering screensaver's window\n");
+        pxcb->pixmap = xcb_generate_id(pxcb->connection);
+        xcb_void_cookie   = xcb_create_pixmap(pxcb->connection, 1, pxcb->pixmap , pxcb->screen->root, 1, 1);
+        if ( (xcb_generic_error = xcb_request_check(pxcb->connection, xcb_void_cookie)) ) {
+            ERROR("Error: cannot create screensaver window's pixmap.\n");
+            return EXIT_FAILURE;
+        }
 
+        pxcb->screensaver_id_atom                  = xcb_intern_atom_reply(pxcb->connection, intern_atom_cookie, NULL);
+        if (!pxcb->screensaver_id_atom) {
+            ERROR("Error: cannot create _SCREEN_SAVER_ID property.\n");
+            return EXIT_FAILURE;
+        }
+        xcb_void_cookie = xcb_change_property(
+                pxcb->connection,
+                XCB_PROP_MODE_REPLACE,
+                pxcb->screen->root,
+                pxcb->screensaver_id_atom->atom, XCB_ATOM_PIXMAP, 32, 1, &pxcb->pixmap
+        );
+        if ( (xcb_generic_error = xcb_request_check(pxcb->connection, xcb_void_cookie)) ) {
+            ERROR("Error: cannot register _SCREEN_SAVER_ID property.\n");
+            return EXIT_FAILURE;
+        }
 
-///////////////////////////////////////////////////////////////////////////////
-// operation_handler()
-///////////////////////////////////////////////////////////////////////////////
-/** Wrapper function calling the sysfs files backend or the xrandr backend variant.
+        // set attributes for use as "external" screensaver
+        xcb_void_cookie = xcb_screensaver_set_attributes(
+            pxcb->connection,
+            pxcb->screen->root,
+            -1, -1, 1, 1,
+            0,
+            XCB_WINDOW_CLASS_COPY_FROM_PARENT,
+            pxcb->screen->root_depth,
+            pxcb->screen->root_visual,
+            0, NULL
+        );
+        if ( (xcb_generic_error = xcb_request_check(pxcb->connection, xcb_void_cookie)) ) {
+            ERROR("Error: cannot set screensaver attributes.\n");
+            return EXIT_FAILURE;
+        }
 
-    @param operation        the brightness operation to perform
-    @param pxcb             the global xcb container struct
-    @param brn_percent      brightness percentage to set/increase/decrease depending on `operation`
-    @param brn_cur_perc     the current brightness as percentage
-    @param brn_new_perc     the new brightness as percentage
-    @return                 true if operation could be performed, false on an unrecoverable error
+        // register some "known" environment variables pointing to the screensaver
+        char xid[32];
+        (void)snprintf(xid, sizeof(xid), "0x%lx", (unsigned long)pxcb->pixmap);
+        (void)setenv("XSS_WINDOW", xid, 1);
+        (void)snprintf(xid, sizeof(xid), "0x%lx", (unsigned long)pxcb->pixmap);
+        (void)setenv("XSCREENSAVER_WINDOW", xid, 1);
+
+        DEBUG("[init] subscribing to screensaver events\n");
+        xcb_void_cookie = xcb_screensaver_select_input(
+                pxcb->connection,
+                pxcb->screen->root,
+                // the dimming schedule does without cycle events
+                gs_stages.num_stages > 0 ? XCB_SCREENSAVER_EVENT_NOTIFY_MASK : XCB_SCREENSAVER_EVENT_NOTIFY_MASK | XCB_SCREENSAVER_EVENT_CYCLE_MASK
+        );
+        if ( (xcb_generic_error = xcb_request_check(pxcb->connection, xcb_void_cookie)) ) {
+            ERROR("Error: cannot subscribe to screensaver events.\n");
+            return EXIT_FAILURE;
+        }
+    }
 
-    @see _operation_handler_file
-    @see _operation_handler_randr
-*/
-static inline bool operation_handler(const operations_t operation, struct Txcb *pxcb, const uint8_t brn_percent, uint8_t *brn_cur_perc, uint8_t *brn_new_perc){
-#ifdef USE_SYSFS_BACKLIGHT_CONTROL
-    (void)pxcb;
-    return _operation_handler_file(operation, brn_percent, brn_cur_perc, brn_new_perc);
-#else
-    return _operation_handler_randr(operation, pxcb, brn_percent, brn_cur_perc, brn_new_perc);
-#endif
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // Fullscreen Inhibit
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if (FULLSCREEN_INHIBIT) {
+        DEBUG("[init] following the active window's fullscreen state\n");
+        static const char *inhibit_atom_names[] = { "_NET_ACTIVE_WINDOW", "_NET_WM_STATE", "_NET_WM_STATE_FULLSCREEN" };
+        xcb_atom_t *inhibit_atoms[] = { &gs_inhibit.net_active_window_atom, &gs_inhibit.net_wm_state_atom, &gs_inhibit.net_wm_state_fullscreen_atom };
+        xcb_intern_atom_cookie_t inhibit_atom_cookies[3];
+        for (uint8_t a = 0; a < 3; a++) {
+            inhibit_atom_cookies[a] = xcb_intern_atom(pxcb->connection, 0, (uint16_t)strlen(inhibit_atom_names[a]), inhibit_atom_names[a]);
+        }
+        for (uint8_t a = 0; a < 3; a++) {
+            xcb_intern_atom_reply_t *inhibit_atom_reply = xcb_intern_atom_reply(pxcb->connection, inhibit_atom_cookies[a], NULL);
+            if (!inhibit_atom_reply) {
+                ERROR("Error: cannot intern atom %s.\n", inhibit_atom_names[a]);
+                return EXIT_FAILURE;
+            }
+            *inhibit_atoms[a] = inhibit_atom_reply->atom;
+            free(inhibit_atom_reply);
+        }
+        const uint32_t root_events[] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
+        (void)xcb_change_window_attributes(pxcb->connection, pxcb->screen->root, XCB_CW_EVENT_MASK, root_events);
+        (void)query_active_window(&gs_inhibit, pxcb);
+        (void)query_fullscreen(&gs_inhibit, pxcb);
+    }
+    return RET_OK;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// signal_handler()
+// disconnect()
 ///////////////////////////////////////////////////////////////////////////////
-/** Signal Handler initiating a proper shutdown when being interrupted or killed.
+/** Drop the connection to the X server and everything living on it.
 
-    @param sig              the signal number received
+    The server's resources (the screensaver pixmap, the idle alarms, the
+    Present window) are gone with the connection, so they are only forgotten.
+    Pending fades, stages and write confirmations are abandoned.
+
+    @param pxcb             xcb container struct
+
+    @see reconnect
 */
-static void signal_handler(const int sig) {
-    switch(sig){
-        case SIGTERM:
-        case SIGINT:
-        case SIGQUIT:
-            DEBUG("[signal_handler] received SIG_TERM/SIG_QUIT, exiting\n");
-            exit(EXIT_SUCCESS);
+static void disconnect(struct Txcb *pxcb) {
+    timer_disarm();
+    for (uint8_t d = 0; d < gs_confirm.num_devices; d++) {
+        gs_confirm.devices[d].pending = false;
     }
-    DEBUG("[signal_handler] received unhandled signal %d.\n", sig);
-    exit(EXIT_FAILURE);
+    gs_confirm.num_pending = 0;
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    gs_present.enabled       = false;
+    gs_present.pending       = false;
+    gs_present.pacing        = false;
+    gs_present.window        = 0;
+    gs_present.placed_output = 0;
+    #endif
+    memset(gs_idle.alarms, 0, sizeof(gs_idle.alarms));
+    gs_idle.counter          = 0;
+    // the new alarms fire on transitions only, so start out as if active
+    gs_idle.fired            = IDLE_ALARM_RESET;
+    gs_inhibit.active_window = 0;
+    gs_inhibit.fullscreen    = false;
+    free(pxcb->screensaver_id_atom);
+    pxcb->screensaver_id_atom = NULL;
+    pxcb->pixmap              = 0;
+    pxcb->dpms_events         = false;
+    pxcb->randr_first_event   = 0;
+    if (pxcb->connection) {
+        xcb_disconnect(pxcb->connection);
+        pxcb->connection = NULL;
+    }
+    gs_pollfds[POLL_SOURCE_X].fd = -1;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// _event_loop_scrsvr_on_timeout()
+// reconnect_start()
 ///////////////////////////////////////////////////////////////////////////////
-/** Helper function to `event_loop()` handling the screensaver `timeout` event.
+/** Drop a lost X connection and have the event loop reconnect to the server.
 
-    @param pxcb             the global xcb container struct
-    @param peventstate      event loop brightness state container struct
-    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+    @param pxcb             xcb container struct
+    @return                 true if reconnecting, false if RECONNECT_S is 0
 
-    @see event_loop
-    @see RET_OK
+    @see reconnect
 */
-static uint8_t _event_loop_scrsvr_on_timeout(struct Txcb *pxcb, struct Teventstate *peventstate) {
-    if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_priorscrsvr_perc , &peventstate->brn_cur_perc)) {
-        ERROR("Error: Failed to get brightness on screensaver timeout. Exiting.\n");
-        return EXIT_FAILURE;
-    }
-    if (peventstate->brn_cur_perc == 0) {
-        DEBUG("[eventloop] brightness is 0%% on timeout, setting 100%% brightness\n");
-        if (!operation_handler(OPERATION_SETBRIGHTNESS, pxcb, 100, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
-            ERROR("Error: Failed to set initial brightness to 100%% on screensaver timeout. Exiting.\n");
-            return EXIT_FAILURE;
-        }
-        DEBUG("[eventloop] backlight reports brightness %d%% set\n", peventstate->brn_cur_perc);
-        if (peventstate->brn_cur_perc == 0) {
-            DEBUG("[eventloop] brightness is still 0%%, setting 100%% brightness\n");
-            if (!operation_handler(OPERATION_SETBRIGHTNESS, pxcb, 100, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
-                ERROR("Error: Failed to set brightness to 100%% on screensaver timeout again. Exiting.\n");
-                return EXIT_FAILURE;
-            }
-            DEBUG("[eventloop] backlight reports brightness %d%% set\n", peventstate->brn_cur_perc);
-        }
-    }
-    if (peventstate->brn_cur_perc < DIM_PERCENT_TIMEOUT) {
-        DEBUG("[eventloop] current brightness %d%% is below target brightness of %d%%, doing nothing.\n", peventstate->brn_cur_perc, DIM_PERCENT_TIMEOUT);
-        return RET_OK;
-    }
-    if (!operation_handler(OPERATION_SETBRIGHTNESS, pxcb, DIM_PERCENT_TIMEOUT, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
-        ERROR("Error: Failed to decrease brightness on screensaver timeout. Exiting.\n");
-        return EXIT_FAILURE;
+static bool reconnect_start(struct Txcb *pxcb) {
+    if (RECONNECT_S == 0) {
+        return false;
     }
-    DEBUG("[eventloop] brightness %d%% -> %d%%\n", peventstate->brn_priorscrsvr_perc, peventstate->brn_cur_perc);
-    return RET_OK;
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    gs_reconnect.backlight_new_atom    = pxcb->backlight_new_atom;
+    gs_reconnect.backlight_legacy_atom = pxcb->backlight_legacy_atom;
+    #endif
+    WARN("Warning: lost the connection to the X server, reconnecting for up to %us\n", RECONNECT_S);
+    disconnect(pxcb);
+    gs_reconnect.lost_at_us = monotonic_us();
+    gs_reconnect.next_at_us = gs_reconnect.lost_at_us;
+    gs_reconnect.backoff_ms = RECONNECT_BACKOFF_MIN_MS;
+    gs_reconnect.active     = true;
+    return true;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// _event_loop_scrsvr_on_interval()
+// reconnect_timeout_ms()
 ///////////////////////////////////////////////////////////////////////////////
-/** Helper function to `event_loop()` handling the screensaver `interval` event.
+/** Get how long the event loop may wait before the next reconnection attempt.
 
-    @param pxcb             the global xcb container struct
-    @param peventstate      event loop brightness state container struct
-    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+    @return                 the timeout in milliseconds for poll(), -1 if connected
 
-    @see event_loop
-    @see RET_OK
+    @see reconnect
 */
-static uint8_t _event_loop_scrsvr_on_interval(struct Txcb *pxcb, struct Teventstate *peventstate) {
-    if (!peventstate->brn_interval_set) {
-        peventstate->brn_interval_set = true;
-        if (peventstate->brn_cur_perc < DIM_PERCENT_INTERVAL) {
-            DEBUG("[eventloop] current brightness %d%% is below target brightness of %d%%, doing nothing.\n", peventstate->brn_cur_perc, DIM_PERCENT_INTERVAL);
-            return RET_OK;
-        }
-        if (!operation_handler(OPERATION_SETBRIGHTNESS, pxcb, DIM_PERCENT_INTERVAL, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
-            ERROR("Error: Failed to decrease brightness on screensaver interval. Exiting.\n");
-            return EXIT_FAILURE;
-        }
-        DEBUG("[eventloop] brightness %d%% -> %d%%\n", peventstate->brn_old_perc, peventstate->brn_cur_perc);
-        return RET_OK;
+static int reconnect_timeout_ms(void) {
+    if (!gs_reconnect.active) {
+        return -1;
     }
-    DEBUG("[eventloop] brightness already set to %d%%\n", peventstate->brn_cur_perc);
-    return RET_OK;
+    const uint64_t now_us = monotonic_us();
+    return gs_reconnect.next_at_us > now_us ? (int)((gs_reconnect.next_at_us - now_us + 999) / 1000) : 0;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// _event_loop_scrsvr_off()
+// reconnect()
 ///////////////////////////////////////////////////////////////////////////////
-/** Helper function to `event_loop()` handling the screensaver turn off event.
+/** Try to reconnect to the X server once and, if connected, rehydrate the state.
 
-    @param pxcb             the global xcb container struct
+    Called by the event loop once `reconnect_timeout_ms()` is due: a failed
+    attempt schedules the next one after an exponential backoff from
+    RECONNECT_BACKOFF_MIN_MS up to RECONNECT_BACKOFF_MAX_MS, until
+    RECONNECT_S seconds have passed since `reconnect_start()`. Once
+    connected, the cached outputs are kept if the server still has them (see
+    `outputs_unchanged()`), and a brightness left dimmed is restored unless
+    the screensaver is still on, by the restore plan if there is one. The
+    time from losing the connection until then is kept in `gs_stats`.
+
+    @param pglobalstate     state container struct
+    @param pxcb             xcb container struct
     @param peventstate      event loop brightness state container struct
-    @return                 RET_OK on success, failure exit code on error (e.g, EXIT_FAILURE)
+    @return                 RET_OK once reconnected or while still trying, EXIT_FAILURE if giving up
 
-    @see event_loop
-    @see RET_OK
+    @see reconnect_start
+    @see setup_connection
+    @see disconnect
 */
-static uint8_t _event_loop_scrsvr_off(struct Txcb *pxcb, struct Teventstate *peventstate) {
-    peventstate->brn_interval_set = false;
-    if (peventstate->brn_priorscrsvr_perc == BRN_PRIORSCRSVR_UNDEFINED) {
-        DEBUG("[eventloop] event: OFF received without being called on timeout or interval, not setting brightness\n");
-        DEBUG("[eventloop] getting current brightness\n");
-        if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
-            ERROR("Error: Failed to get brightness while setting screensaver OFF. Exiting.\n");
+static uint8_t reconnect(struct Tglobalstate *pglobalstate, struct Txcb *pxcb, struct Teventstate *peventstate) {
+    gs_stats.reconnect_attempts++;
+    if (setup_connection(pglobalstate, pxcb) != RET_OK) {
+        disconnect(pxcb);
+        const uint64_t now_us = monotonic_us();
+        if (now_us - gs_reconnect.lost_at_us + gs_reconnect.backoff_ms * 1000ULL > RECONNECT_S * 1000000ULL) {
+            ERROR("Error: cannot reconnect to the X server within %us\n", RECONNECT_S);
             return EXIT_FAILURE;
         }
+        DEBUG("[reconnect] retrying in %ums\n", gs_reconnect.backoff_ms);
+        gs_reconnect.next_at_us = now_us + gs_reconnect.backoff_ms * 1000ULL;
+        gs_reconnect.backoff_ms = gs_reconnect.backoff_ms * 2 < RECONNECT_BACKOFF_MAX_MS ? gs_reconnect.backoff_ms * 2 : RECONNECT_BACKOFF_MAX_MS;
         return RET_OK;
     }
-    if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
-        ERROR("Error: Failed to get brightness while setting screensaver OFF. Exiting.\n");
-        return EXIT_FAILURE;
-    }
-    if (peventstate->brn_cur_perc == 0) {
-        DEBUG("[eventloop] brightness is 0%% on setting OFF screensaver, setting to sane 100%% brightness\n");
-        peventstate->brn_priorscrsvr_perc = 100;
-    }
-    if (operation_handler(OPERATION_SETBRIGHTNESS, pxcb, peventstate->brn_priorscrsvr_perc, &peventstate->brn_old_perc, &peventstate->brn_cur_perc)) {
-        DEBUG("[eventloop] set to previous brightness %d%% from %d%%\n", peventstate->brn_priorscrsvr_perc, peventstate->brn_old_perc);
+    gs_reconnect.active = false;
+
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    if (gs_outputs.valid && outputs_unchanged(pxcb, gs_reconnect.backlight_new_atom, gs_reconnect.backlight_legacy_atom)) {
+        gs_stats.reconnect_topology_reused++;
+        DEBUG("[reconnect] outputs unchanged, keeping %u cached outputs\n", gs_outputs.num_outputs);
     } else {
-        ERROR("Error: Failed to set prior brightness while setting screensaver OFF. Exiting.\n");
+        // the plan names outputs and atoms of the previous server
+        gs_outputs.valid = false;
+        restore_plan_reset(&gs_restoreplan);
+    }
+    #endif
+
+    peventstate->scrsvr_state = pglobalstate->screensaver_state == XCB_SCREENSAVER_STATE_OFF ? XCB_SCREENSAVER_STATE_OFF : XCB_SCREENSAVER_STATE_ON;
+    if (peventstate->scrsvr_state == XCB_SCREENSAVER_STATE_OFF && gs_restoreplan.valid) {
+        if (_event_loop_restore_plan(pxcb, peventstate) != RET_OK) { return EXIT_FAILURE; }
+    } else if (peventstate->scrsvr_state == XCB_SCREENSAVER_STATE_OFF && peventstate->brn_priorscrsvr_perc != BRN_PRIORSCRSVR_UNDEFINED) {
+        if (_event_loop_scrsvr_off(pxcb, peventstate) != RET_OK) { return EXIT_FAILURE; }
+    } else if (!operation_handler(OPERATION_GETBRIGHTNESS, pxcb, 0, &peventstate->brn_cur_perc, &peventstate->brn_old_perc)) {
+        ERROR("Error: cannot get brightness after reconnecting\n");
         return EXIT_FAILURE;
     }
-    peventstate->brn_priorscrsvr_perc = BRN_PRIORSCRSVR_UNDEFINED;
+    (void)xcb_flush(pxcb->connection);
+
+    const uint64_t recovery_us = monotonic_us() - gs_reconnect.lost_at_us;
+    gs_stats.reconnects++;
+    gs_stats.recovery_us_last = recovery_us;
+    if (recovery_us > gs_stats.recovery_us_max) {
+        gs_stats.recovery_us_max = recovery_us;
+    }
+    DEBUG("[reconnect] recovered in %luus, brightness %u%%\n", (unsigned long)recovery_us, peventstate->brn_cur_perc);
     return RET_OK;
 }
 
@@ -955,15 +7624,30 @@ static uint8_t _event_loop_scrsvr_off(struct Txcb *pxcb, struct Teventstate *pev
 
     The event loop is an indefinite loop only interrupted by errors or signals,
     hence the return code is propagated to exit() upon returning.
+    Once libxcb has no more events queued, it sleeps in poll() on the X
+    connection and the other sources in `gs_pollfds`, e.g., the completion
+    notifications of the backlight writer thread.
+    Before touching the backend, all events already queued are drained and
+    collapsed into the net state transition (see `_event_loop_drain()`): A burst
+    not changing the screensaver state is dropped altogether, otherwise only the
+    last transition is acted upon. Elided transitions are counted in `gs_stats`.
     For brevity, it calls several helper functions to do the actual work, namely
     * _event_loop_scrsvr_on_timeout     called when getting the `timeout` event
     * _event_loop_scrsvr_on_interval    called when getting the `interval` event
     * _event_loop_scrsvr_off            called when the screensaver should turn off
+    * _event_loop_restore_plan          called instead when the panel was powered down while dimmed
+    * _event_loop_dpms                  called when the dpms power level changes
+    * _event_loop_fullscreen            called when the active window or its state changes
+    * _event_loop_present               called at a refresh while a fade is paced by Present
+    * _event_loop_power                 called when the power source changes
+    Dimming is suppressed while a fullscreen window is focused.
 
     @param pglobalstate     state container struct
     @param pxcb             xcb container struct
     @param peventstate      event loop brightness state  container struct
-    @return                 failure code on error (e.g, EXIT_FAILURE) propagated to exit()
+    @return                 failure code on error (e.g, EXIT_FAILURE) propagated to exit(),
+                            unless the connection was lost and `reconnect_start()` lets
+                            the event loop reconnect
 
     @see Tglobalstate
     @see Txcb
@@ -972,41 +7656,234 @@ static uint8_t _event_loop_scrsvr_off(struct Txcb *pxcb, struct Teventstate *pev
     @see _event_loop_scrsvr_on_timeout
     @see _event_loop_scrsvr_on_interval
     @see _event_loop_scrsvr_off
+    @see _event_loop_drain
+    @see _event_loop_restore_plan
+    @see _event_loop_restore_fast
+    @see _event_loop_dpms
+    @see _event_loop_fullscreen
+    @see _event_loop_present
 */
 static uint8_t event_loop(struct Tglobalstate *pglobalstate, struct Txcb *pxcb, struct Teventstate *peventstate) {
     xcb_generic_event_t *event_generic;
     uint8_t result;
+    struct Tburst burst = { .net_state = XCB_SCREENSAVER_STATE_OFF };
 
     while (true) {
-        if (xcb_connection_has_error(pxcb->connection)) {
-            ERROR("Error: xcb connection error while waiting for events\n");
+        ALLOC_AUDIT_CHECKPOINT();
+        if (!gs_reconnect.active && xcb_connection_has_error(pxcb->connection)) {
+            ERROR("Error: lost the xcb connection while waiting for events\n");
             return EXIT_FAILURE;
         }
+        if (gs_reconnect.active && reconnect_timeout_ms() == 0) {
+            if ( RET_OK != (result = reconnect(pglobalstate, pxcb, peventstate))              ) { return result; }
+        }
+        #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+        if (gs_logind.lost && !logind_reconnect(&gs_logind)) {
+            return EX_UNAVAILABLE;
+        }
+        #endif
+
+        // while reconnecting, there is no connection to take events from
+        if (gs_reconnect.active || !(event_generic = xcb_poll_for_event(pxcb->connection))) {
+            subscription_publish(pglobalstate, peventstate);
+            // before the flush for the reissued writes, and before the timeouts, e.g., to
+            // confirm a write the sync writer has already completed
+            if (gs_confirm.num_pending > 0) {
+                confirm_check(pxcb);
+            }
+            if (pxcb->connection) {
+                (void)xcb_flush(pxcb->connection);
+            }
+            #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+            if (gs_metrics.restore_started_us > 0 && !backlight_lagging()) {
+            #else
+            if (gs_metrics.restore_started_us > 0 && gs_confirm.num_pending == 0) {
+            #endif
+                metrics_restore_done();
+            }
+            if (gs_leds.num_leds > 0) {
+                leds_commit(&gs_leds, pglobalstate->state, peventstate->brn_priorscrsvr_perc != BRN_PRIORSCRSVR_UNDEFINED || gs_restoreplan.valid, peventstate->brn_cur_perc);
+            }
+            // with the transition's writes on their way, a hook cannot hold them up anymore
+            if (gs_hooks.num_queued > 0) {
+                hooks_spawn(&gs_hooks, peventstate->brn_cur_perc);
+            }
+            if (metrics_timeout_ms() == 0) {
+                metrics_write();
+            }
+            // nothing pending means no timeout at all, i.e., no wakeup until an event arrives
+            const int fade_timeout    = fade_timeout_ms();
+            const int confirm_timeout = confirm_timeout_ms();
+            const int hook_timeout    = hook_timeout_ms(&gs_hooks);
+            const int reconnect_timeout = reconnect_timeout_ms();
+            const int metrics_timeout = metrics_timeout_ms();
+            int timeout = fade_timeout < 0 || (confirm_timeout >= 0 && confirm_timeout < fade_timeout) ? confirm_timeout : fade_timeout;
+            if (hook_timeout >= 0 && (timeout < 0 || hook_timeout < timeout)) {
+                timeout = hook_timeout;
+            }
+            if (reconnect_timeout >= 0 && (timeout < 0 || reconnect_timeout < timeout)) {
+                timeout = reconnect_timeout;
+            }
+            if (metrics_timeout >= 0 && (timeout < 0 || metrics_timeout < timeout)) {
+                timeout = metrics_timeout;
+            }
+            const int ready   = poll(gs_pollfds, POLL_SOURCE_COUNT, timeout);
+            stats_wakeup(ready);
+            if (ready < 0) {
+                if (errno == EINTR) { continue; }
+                ERROR("Error: cannot wait for events (%s)\n", strerror(errno));
+                return EXIT_FAILURE;
+            }
+            if (fade_timeout >= 0 && fade_timeout_ms() == 0) {
+                const uint64_t steps_due = (monotonic_ms() - gs_fade.started_at_ms) / FADE_STEP_MS;
+                if ( RET_OK != (result = _event_loop_fade(pxcb, peventstate, steps_due - gs_fade.step)) ) { return result; }
+            }
+            #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+            if (gs_pollfds[POLL_SOURCE_WORKER].revents & (POLLIN | POLLOUT)) {
+                if (gs_logind.running) {
+                    logind_complete(&gs_logind);
+                } else
+                #ifdef USE_IO_URING
+                if (gs_uring.running) {
+                    uring_complete(&gs_uring);
+                } else
+                #endif
+                backlight_worker_complete(&gs_worker);
+            }
+            if (gs_pollfds[POLL_SOURCE_LEDS].revents & POLLIN) {
+                backlight_worker_complete(&gs_worker);
+            }
+            #endif
+            if (gs_pollfds[POLL_SOURCE_TIMER].revents & POLLIN) {
+                if ( RET_OK != (result = _event_loop_timer(pglobalstate, pxcb, peventstate))  ) { return result; }
+            }
+            if (gs_pollfds[POLL_SOURCE_UEVENT].revents & POLLIN) {
+                if ( RET_OK != (result = _event_loop_power(pxcb, peventstate))                ) { return result; }
+            }
+            if (gs_pollfds[POLL_SOURCE_SIGNAL].revents & POLLIN) {
+                _event_loop_signal();
+            }
+            if (gs_hooks.num_running > 0) {
+                hooks_reap(&gs_hooks);
+            }
+            _event_loop_subscription();
+            continue;
+        }
+        const uint64_t burst_at_us = monotonic_us();
+        uint16_t dpms_power_level = pglobalstate->dpms_power_level;
+        _event_loop_drain(pglobalstate, pxcb, event_generic, &burst);
+        if (pglobalstate->dpms_power_level != dpms_power_level) {
+            if ( RET_OK != (result = _event_loop_dpms(pglobalstate, pxcb, peventstate))       ) { return result; }
+        }
+        if (FULLSCREEN_INHIBIT) {
+            if ( RET_OK != (result = _event_loop_fullscreen(pxcb, peventstate, &burst))      ) { return result; }
+        }
+        #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+        if (burst.present_complete) {
+            if ( RET_OK != (result = _event_loop_present(pxcb, peventstate))                 ) { return result; }
+        }
+        #endif
+        if (burst.screensaver_events == 0) {
+            continue;
+        }
+        gs_stats.bursts++;
 
-        event_generic = xcb_wait_for_event(pxcb->connection);
-        if (XCB_EVENT_RESPONSE_TYPE(event_generic) != pxcb->screensaver_id) {
-            free(event_generic);
+        // a cycle notification is a further ON stage, an OFF in the burst restarts the ON stages
+        uint8_t net_onoff = burst.net_state == XCB_SCREENSAVER_STATE_CYCLE ? XCB_SCREENSAVER_STATE_ON : burst.net_state;
+        if (burst.net_state != XCB_SCREENSAVER_STATE_CYCLE && net_onoff == peventstate->scrsvr_state && (net_onoff == XCB_SCREENSAVER_STATE_OFF || !burst.saw_off)) {
+            gs_stats.transitions_elided += burst.screensaver_events;
+            DEBUG("[eventloop] coalesced %u events into no transition\n", burst.screensaver_events);
+            continue;
+        }
+        gs_stats.transitions_elided += burst.screensaver_events - 1;
+        gs_stats.transitions_handled++;
+        if (burst.screensaver_events > 1) {
+            DEBUG("[eventloop] coalesced %u events into one transition\n", burst.screensaver_events);
+        }
+        peventstate->scrsvr_state = net_onoff;
+        const uint64_t round_trips = gs_metrics.round_trips;
+        const uint64_t writes      = gs_metrics.writes;
+
+        if (net_onoff == XCB_SCREENSAVER_STATE_OFF && gs_restoreplan.valid && !gs_restoreplan.deferred &&
+            pxcb->dpms_events && pglobalstate->dpms_power_level == XCB_DPMS_DPMS_MODE_ON) {
+            if ( RET_OK != (result = _event_loop_restore_fast(pglobalstate, pxcb, peventstate, burst_at_us)) ) { return result; }
+            metrics_transition(pglobalstate->state, round_trips, writes);
+            hook_queue(&gs_hooks, pglobalstate->state);
             continue;
         }
-        free(event_generic);
 
         if (!query_state(pglobalstate, pxcb)) {
             ERROR("Error: cannot query screensaver/dpms settings. Exiting.\n");
             return EXIT_FAILURE;
         }
+        ALLOC_AUDIT_STATE(pglobalstate->state);
 
         switch (pglobalstate->state) {
             case STATE_SCREENSAVER_ON_TIMEOUT:
                 DEBUG("[eventloop] handling event: ON (timeout)      [idle=%ds]\n", pglobalstate->screensaver_idlesecuser);
+                if (FULLSCREEN_INHIBIT && gs_inhibit.fullscreen) {
+                    DEBUG("[eventloop] fullscreen window focused, not dimming\n");
+                    gs_stats.dims_inhibited++;
+                    break;
+                }
+                if (gs_stages.num_stages > 0) {
+                    if ( RET_OK != (result = _event_loop_stages_start(pxcb, peventstate))   ) { return result; }
+                    break;
+                }
+                if (ADAPTIVE_DELAY_MAX > 0) {
+                    gs_adaptive.timeout_seen  = true;
+                    gs_adaptive.dimmed        = false;
+                    gs_adaptive.timeout_at_ms = monotonic_ms();
+                    if (gs_adaptive.delay_s > 0 && peventstate->brn_priorscrsvr_perc == BRN_PRIORSCRSVR_UNDEFINED) {
+                        DEBUG("[eventloop] delaying dimming by %us\n", gs_adaptive.delay_s);
+                        timer_arm(TIMER_DIM_DELAY, gs_adaptive.delay_s * 1000, 0);
+                        break;
+                    }
+                }
                 if ( RET_OK != (result = _event_loop_scrsvr_on_timeout(pxcb, peventstate))  ) { return result; }
                 break;
             case STATE_SCREENSAVER_ON_INTERVAL:
                 DEBUG("[eventloop] handling event: ON (interval)     [idle=%ds]\n", pglobalstate->screensaver_idlesecuser);
+                if (FULLSCREEN_INHIBIT && gs_inhibit.fullscreen) {
+                    DEBUG("[eventloop] fullscreen window focused, not dimming\n");
+                    gs_stats.dims_inhibited++;
+                    break;
+                }
+                if (gs_stages.num_stages > 0) {
+                    break;
+                }
+                if (gs_timer.action == TIMER_DIM_DELAY) {
+                    timer_disarm();
+                }
                 if ( RET_OK != (result = _event_loop_scrsvr_on_interval(pxcb, peventstate)) ) { return result; }
                 break;
             case STATE_SCREENSAVER_OFF:
                 DEBUG("[eventloop] handling event: OFF               [idle=%ds]\n", pglobalstate->screensaver_idlesecuser);
+                timer_disarm();
+                adaptive_record_return();
+                if (pglobalstate->dpms_power_level != XCB_DPMS_DPMS_MODE_ON) {
+                    // no point in touching the backlight of a powered-down panel, restore once it is back
+                    gs_stats.backend_ops_suppressed++;
+                    gs_restoreplan.pending = gs_restoreplan.valid;
+                    if (!gs_restoreplan.valid) {
+                        peventstate->brn_priorscrsvr_perc = BRN_PRIORSCRSVR_UNDEFINED;
+                        peventstate->brn_interval_set     = false;
+                    }
+                    DEBUG("[eventloop] panel is powered down, %s\n", gs_restoreplan.pending ? "deferring restore" : "nothing to restore");
+                    break;
+                }
+                if (peventstate->brn_priorscrsvr_perc != BRN_PRIORSCRSVR_UNDEFINED || gs_restoreplan.valid) {
+                    gs_metrics.restore_started_us = burst_at_us;
+                }
+                if (gs_restoreplan.deferred || (gs_stages.num_stages > 0 && gs_restoreplan.valid)) {
+                    if ( RET_OK != (result = _event_loop_restore_plan(pxcb, peventstate))   ) { return result; }
+                    metrics_restore_issued(burst_at_us);
+                    break;
+                }
                 if ( RET_OK != (result = _event_loop_scrsvr_off(pxcb, peventstate))         ) { return result; }
+                if (gs_metrics.restore_started_us > 0) {
+                    metrics_restore_issued(burst_at_us);
+                }
                 break;
             case STATE_SCREENSAVER_CYCLE:
                 DEBUG("[eventloop] handling event: CYCLE             [idle=%ds]\n", pglobalstate->screensaver_idlesecuser);
@@ -1028,31 +7905,223 @@ static uint8_t event_loop(struct Tglobalstate *pglobalstate, struct Txcb *pxcb,
                 DEBUG("[eventloop] unknown event %d received!        [idle=%ds]\n", pglobalstate->state, pglobalstate->screensaver_idlesecuser);
                 break;
         }
+        metrics_transition(pglobalstate->state, round_trips, writes);
+        hook_queue(&gs_hooks, pglobalstate->state);
     }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// parse_uint8_t()
+// parse_uint()
 ///////////////////////////////////////////////////////////////////////////////
-/** Converts a string to an uint8_t.
+/** Converts a string to an unsigned integer within a range.
 
     @param input            the string which should be converted
+    @param min              the smallest value accepted
+    @param max              the largest value accepted
     @param output           a pointer in which the conversion result will be written
     @return                 a non-zero value means the conversion has failed
 */
-static int parse_uint8_t(char* input, uint8_t* output) {
+static int parse_uint(char* input, const uint16_t min, const uint16_t max, uint16_t* output) {
     char *end = NULL;
     errno = 0;
 
     long temp = strtol(input, &end, 10);
-    if (end != input && errno != ERANGE && temp >= 0 && temp <= UINT8_MAX) {
-        *output = (uint8_t)temp;
+    if (end != input && *end == '\0' && errno != ERANGE && temp >= min && temp <= max) {
+        *output = (uint16_t)temp;
         return 0;
     }
-    ERROR("[parse_uint8_t] Unable to convert %s to uint8_t\n", input);
+    ERROR("[parse_uint] Unable to convert %s to a number from %u to %u\n", input, min, max);
     return 1;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// parse_stage()
+///////////////////////////////////////////////////////////////////////////////
+/** Converts a string SECONDS:PERCENT to a stage of the dimming schedule.
+
+    Stages are kept sorted by their seconds.
+
+    @param input            the string which should be converted
+    @param pstages          the dimming schedule to add the stage to
+    @return                 a non-zero value means the conversion has failed
+*/
+static int parse_stage(char* input, struct Tstages *pstages) {
+    char *separator = strchr(input, ':');
+    struct Tstage stage = { .seconds = 0, .perc = 0 };
+    uint16_t perc;
+
+    if (pstages->num_stages >= MAX_STAGES) {
+        ERROR("[parse_stage] At most %d stages are supported\n", MAX_STAGES);
+        return 1;
+    }
+    if (!separator) {
+        ERROR("[parse_stage] Unable to convert %s to SECONDS:PERCENT\n", input);
+        return 1;
+    }
+    *separator = '\0';
+    if (parse_uint(input, 0, UINT16_MAX, &stage.seconds) || parse_uint(separator + 1, 0, 100, &perc)) {
+        return 1;
+    }
+    stage.perc = (uint8_t)perc;
+    uint8_t st = pstages->num_stages++;
+    for (; st > 0 && pstages->stages[st - 1].seconds > stage.seconds; st--) {
+        pstages->stages[st] = pstages->stages[st - 1];
+    }
+    pstages->stages[st] = stage;
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// parse_idle_alarms()
+///////////////////////////////////////////////////////////////////////////////
+/** Converts a string TIMEOUT:INTERVAL to the thresholds of the idle alarms.
+
+    @param input            the string which should be converted
+    @param pidle            the idle alarms to configure
+    @return                 a non-zero value means the conversion has failed
+*/
+static int parse_idle_alarms(char* input, struct Tidle *pidle) {
+    char *separator = strchr(input, ':');
+
+    if (!separator) {
+        ERROR("[parse_idle_alarms] Unable to convert %s to TIMEOUT:INTERVAL\n", input);
+        return 1;
+    }
+    *separator = '\0';
+    if (parse_uint(input, 1, UINT16_MAX, &pidle->timeout) || parse_uint(separator + 1, 0, UINT16_MAX, &pidle->interval)) {
+        return 1;
+    }
+    pidle->enabled = true;
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// parse_battery_brightness()
+///////////////////////////////////////////////////////////////////////////////
+/** Converts a string TIMEOUT:CYCLE to the dim levels while on battery.
+
+    @param input            the string which should be converted
+    @param ppower           the power profiles to configure
+    @return                 a non-zero value means the conversion has failed
+*/
+static int parse_battery_brightness(char* input, struct Tpower *ppower) {
+    char *separator = strchr(input, ':');
+    uint16_t perc_timeout, perc_interval;
+
+    if (!separator) {
+        ERROR("[parse_battery_brightness] Unable to convert %s to TIMEOUT:CYCLE\n", input);
+        return 1;
+    }
+    *separator = '\0';
+    if (parse_uint(input, 0, 100, &perc_timeout) || parse_uint(separator + 1, 0, 100, &perc_interval)) {
+        return 1;
+    }
+    ppower->percent_timeout[POWER_SOURCE_BATTERY]  = (uint8_t)perc_timeout;
+    ppower->percent_interval[POWER_SOURCE_BATTERY] = (uint8_t)perc_interval;
+    ppower->enabled = true;
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// parse_hook()
+///////////////////////////////////////////////////////////////////////////////
+/** Converts a string STATE:COMMAND to the hook run on entering STATE.
+
+    @param input            the string which should be converted, STATE being timeout, interval, or off
+    @param phooks           the hooks to configure
+    @return                 a non-zero value means the conversion has failed
+*/
+static int parse_hook(char* input, struct Thooks *phooks) {
+    char *separator = strchr(input, ':');
+
+    if (!separator || separator[1] == '\0') {
+        ERROR("[parse_hook] Unable to convert %s to STATE:COMMAND\n", input);
+        return 1;
+    }
+    *separator = '\0';
+    if (strcmp(input, "timeout") == 0) {
+        phooks->commands[HOOK_TIMEOUT] = separator + 1;
+    } else if (strcmp(input, "interval") == 0) {
+        phooks->commands[HOOK_INTERVAL] = separator + 1;
+    } else if (strcmp(input, "off") == 0) {
+        phooks->commands[HOOK_OFF] = separator + 1;
+    } else {
+        ERROR("[parse_hook] Unknown state %s, expected timeout, interval, or off\n", input);
+        return 1;
+    }
+    phooks->enabled = true;
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// parse_led()
+///////////////////////////////////////////////////////////////////////////////
+/** Converts a string NAME:TIMEOUT:INTERVAL to an LED dimming policy.
+
+    NAME may contain colons itself, as LED class device names usually do.
+
+    @param input            the string which should be converted
+    @param pleds            the LED devices to configure
+    @return                 a non-zero value means the conversion has failed
+*/
+static int parse_led(char* input, struct Tleds *pleds) {
+    if (pleds->num_policies == MAX_LEDS) {
+        ERROR("[parse_led] Too many LEDs, at most %d\n", MAX_LEDS);
+        return 1;
+    }
+    char *interval = strrchr(input, ':');
+    if (!interval || interval == input) {
+        ERROR("[parse_led] Unable to convert %s to NAME:TIMEOUT:INTERVAL\n", input);
+        return 1;
+    }
+    *interval = '\0';
+    char *timeout = strrchr(input, ':');
+    if (!timeout || timeout == input) {
+        ERROR("[parse_led] Unable to convert %s to NAME:TIMEOUT:INTERVAL\n", input);
+        return 1;
+    }
+    *timeout = '\0';
+    struct Tledpolicy *ppolicy = &pleds->policies[pleds->num_policies];
+    uint16_t perc_timeout, perc_interval;
+    if (parse_uint(timeout + 1, 0, 100, &perc_timeout) || parse_uint(interval + 1, 0, 100, &perc_interval)) {
+        return 1;
+    }
+    ppolicy->percent_timeout  = (uint8_t)perc_timeout;
+    ppolicy->percent_interval = (uint8_t)perc_interval;
+    ppolicy->name = input;
+    pleds->num_policies++;
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// parse_writer()
+///////////////////////////////////////////////////////////////////////////////
+/** Converts a string uring, thread, sync, or logind to how brightness values are written.
+
+    @param input            the string which should be converted
+    @param pwriter          the writer to configure
+    @return                 a non-zero value means the conversion has failed
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static int parse_writer(char* input, writer_t *pwriter) {
+    if (strcmp(input, "sync") == 0) {
+        *pwriter = WRITER_SYNC;
+    } else if (strcmp(input, "thread") == 0) {
+        *pwriter = WRITER_THREAD;
+    } else if (strcmp(input, "logind") == 0) {
+        *pwriter = WRITER_LOGIND;
+    #ifdef USE_IO_URING
+    } else if (strcmp(input, "uring") == 0) {
+        *pwriter = WRITER_URING;
+    #endif
+    } else {
+        ERROR("[parse_writer] Unknown writer %s\n", input);
+        return 1;
+    }
+    return 0;
+}
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // print_usage()
 ///////////////////////////////////////////////////////////////////////////////
@@ -1062,6 +8131,24 @@ void print_usage(void) {
            "Available options:\n"
            "  --cycle-brightness   PERCENTAGE               Screen brightness percentage on cycle event (X11)\n"
            "  --timeout-brightness PERCENTAGE               Screen brightness percentage on timeout event (X11)\n"
+           "  --no-fullscreen-inhibit                       Dim even while a fullscreen window is focused\n"
+           "  --fade-ms            MILLISECONDS             Fade to the dimmed brightness instead of setting it at once\n"
+           "  --stage              SECONDS:PERCENT          Dim to PERCENT SECONDS after the timeout (repeatable, replaces the two stages)\n"
+           "  --adaptive-delay     SECONDS                  Delay dimming by up to SECONDS as learned from when the user returns\n"
+           "  --metrics            FILE                     Export counters to FILE in the Prometheus text format\n"
+           "  --idle-alarms        TIMEOUT:INTERVAL         Detect idleness by SYNC IDLETIME alarms instead of acting as the screensaver\n"
+           "  --reconnect          SECONDS                  Keep reconnecting to a lost X server for SECONDS, 0 exits at once (default 60)\n"
+           "  --battery-brightness TIMEOUT:CYCLE            Screen brightness percentages on timeout and cycle events while on battery\n"
+           "  --led                NAME:TIMEOUT:CYCLE       Dim LEDs named or ending in NAME, e.g., kbd_backlight, with the screen (repeatable)\n"
+           "  --hook               STATE:COMMAND            Run COMMAND on entering STATE timeout, interval, or off (repeatable)\n"
+           "  --hook-timeout-ms    MILLISECONDS             Kill hooks running longer than MILLISECONDS (default 5000)\n"
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+           "  --gamma                                       Dim outputs without backlight by their gamma ramps\n"
+#elif defined(USE_IO_URING)
+           "  --writer             uring|thread|sync|logind Write the brightness file by io_uring (default), a thread, at once, or by logind\n"
+#else
+           "  --writer             thread|sync|logind       Write the brightness file from a thread (default), at once, or by logind\n"
+#endif
            );
 }
 
@@ -1079,23 +8166,87 @@ static int parse_args(int len, char** args) {
 
     int err = 0;
     int opt = 0;
+    uint16_t value = 0;
+    bool fade_ms_given = false;
     static struct option long_options[] = {
         {"cycle-brightness",   required_argument,       0,  'c' },
         {"timeout-brightness", required_argument,       0,  't' },
+        {"no-fullscreen-inhibit", no_argument,          0,  'F' },
+        {"fade-ms",            required_argument,       0,  'f' },
+        {"stage",              required_argument,       0,  's' },
+        {"adaptive-delay",     required_argument,       0,  'a' },
+        {"metrics",            required_argument,       0,  'm' },
+        {"idle-alarms",        required_argument,       0,  'i' },
+        {"reconnect",          required_argument,       0,  'r' },
+        {"battery-brightness", required_argument,       0,  'b' },
+        {"led",                required_argument,       0,  'l' },
+        {"hook",               required_argument,       0,  'x' },
+        {"hook-timeout-ms",    required_argument,       0,  'X' },
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+        {"gamma",              no_argument,             0,  'g' },
+#else
+        {"writer",             required_argument,       0,  'w' },
+#endif
         {"help",               no_argument,             0,  'h' },
         {0,                    0,                       0,  0   }
     };
 
     int long_index = 0;
-    while ((opt = getopt_long(len, args, "c:t:h",
+    while ((opt = getopt_long(len, args, "c:t:Ff:s:a:m:i:r:b:l:x:X:gw:h",
                               long_options, &long_index)) != -1) {
         switch (opt) {
         case 'c':
-            err = parse_uint8_t(optarg, &DIM_PERCENT_INTERVAL);
+            err = parse_uint(optarg, 0, 100, &value);
+            DIM_PERCENT_INTERVAL = (uint8_t)value;
             break;
         case 't':
-            err = parse_uint8_t(optarg, &DIM_PERCENT_TIMEOUT);
+            err = parse_uint(optarg, 0, 100, &value);
+            DIM_PERCENT_TIMEOUT = (uint8_t)value;
+            break;
+        case 'F':
+            FULLSCREEN_INHIBIT = false;
+            break;
+        case 'f':
+            err = parse_uint(optarg, 0, UINT16_MAX, &FADE_MS);
+            fade_ms_given = true;
+            break;
+        case 'a':
+            err = parse_uint(optarg, 0, UINT8_MAX, &value);
+            ADAPTIVE_DELAY_MAX = (uint8_t)value;
+            break;
+        case 's':
+            err = parse_stage(optarg, &gs_stages);
+            break;
+        case 'm':
+            gs_metrics.path = optarg;
+            break;
+        case 'i':
+            err = parse_idle_alarms(optarg, &gs_idle);
             break;
+        case 'r':
+            err = parse_uint(optarg, 0, UINT16_MAX, &RECONNECT_S);
+            break;
+        case 'b':
+            err = parse_battery_brightness(optarg, &gs_power);
+            break;
+        case 'l':
+            err = parse_led(optarg, &gs_leds);
+            break;
+        case 'x':
+            err = parse_hook(optarg, &gs_hooks);
+            break;
+        case 'X':
+            err = parse_uint(optarg, 0, UINT16_MAX, &HOOK_TIMEOUT_MS);
+            break;
+#ifndef USE_SYSFS_BACKLIGHT_CONTROL
+        case 'g':
+            GAMMA_DIMMING = true;
+            break;
+#else
+        case 'w':
+            err = parse_writer(optarg, &SYSFS_WRITER);
+            break;
+#endif
         case 'h':
             print_usage();
             exit(EXIT_SUCCESS);
@@ -1104,6 +8255,10 @@ static int parse_args(int len, char** args) {
             err = 1;
         }
     }
+    // the adaptive delay shapes a fade's curve, so it comes with one unless told otherwise
+    if (ADAPTIVE_DELAY_MAX > 0 && !fade_ms_given) {
+        FADE_MS = FADE_MS_ADAPTIVE;
+    }
     return err;
 }
 
@@ -1123,10 +8278,10 @@ int main(int argc, char** argv) {
         exit(EXIT_FAILURE);
     }
     DEBUG("[main] Configuration: DIM_PERCENT_INTERVAL=%d, DIM_PERCENT_TIMEOUT=%d\n", DIM_PERCENT_INTERVAL, DIM_PERCENT_TIMEOUT);
+    gs_power.percent_timeout[POWER_SOURCE_AC]  = DIM_PERCENT_TIMEOUT;
+    gs_power.percent_interval[POWER_SOURCE_AC] = DIM_PERCENT_INTERVAL;
 
-    xcb_generic_error_t               *xcb_generic_error;
-    xcb_void_cookie_t                  xcb_void_cookie;
-    const xcb_query_extension_reply_t *query_ext_reply;
+    uint8_t result;
 
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     // Color Output
@@ -1139,180 +8294,179 @@ int main(int argc, char** argv) {
         gs_color.reset  = "";
     }
 
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // State Cache
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    DEBUG("[init] mapping state file\n");
+    if (!state_cache_open()) {
+        WARN("Warning: running without state file, panels are probed on every start\n");
+    }
+
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     // Test SysFS Brightness File(s)
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     #ifdef USE_SYSFS_BACKLIGHT_CONTROL
     DEBUG("[init] testing availability of brightness files\n");
-    if ( !is_file_accessible(SYSFS_BACKLIGHT_PATH "brightness",        R_OK | W_OK) ) { exit(EX_UNAVAILABLE); }
+    if (SYSFS_WRITER != WRITER_LOGIND && access(SYSFS_BACKLIGHT_PATH "brightness", W_OK) != 0) {
+        DEBUG("[init] %s is not writable, setting the brightness by logind\n", SYSFS_BACKLIGHT_PATH "brightness");
+        SYSFS_WRITER = WRITER_LOGIND;
+    }
+    if ( !is_file_accessible(SYSFS_BACKLIGHT_PATH "brightness",        SYSFS_WRITER == WRITER_LOGIND ? R_OK : R_OK | W_OK) ) { exit(EX_UNAVAILABLE); }
     if ( !is_file_accessible(SYSFS_BACKLIGHT_PATH "max_brightness",    R_OK       ) ) { exit(EX_UNAVAILABLE); }
     if ( !is_file_accessible(SYSFS_BACKLIGHT_PATH "actual_brightness", R_OK       ) ) { exit(EX_UNAVAILABLE); }
-    #endif
-
-    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    // xcb
-    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    DEBUG("[init] getting xcb connection\n");
-    gs_xcb.connection = xcb_connect(NULL, &gs_xcb.screen_nr);
-    if (!gs_xcb.connection || xcb_connection_has_error(gs_xcb.connection)) {
-        ERROR("Error: cannot open xcb connection\n");
+    gs_sysfs.ppanel = state_cache_panel(fnv1a_64((const uint8_t *)SYSFS_BACKLIGHT_PATH, strlen(SYSFS_BACKLIGHT_PATH)));
+    if (gs_sysfs.ppanel && gs_sysfs.ppanel->brn_max_abs > 0) {
+        gs_sysfs.brn_max_abs = gs_sysfs.ppanel->brn_max_abs;
+    } else {
+        int max_brightness_fd = open(SYSFS_BACKLIGHT_PATH "max_brightness", O_RDONLY | O_CLOEXEC);
+        if (max_brightness_fd < 0 || (gs_sysfs.brn_max_abs = get_brightness_file(max_brightness_fd)) == NO_BRIGHTNESS) {
+            ERROR("Error: cannot read %s\n", SYSFS_BACKLIGHT_PATH "max_brightness");
+            exit(EX_UNAVAILABLE);
+        }
+        (void)close(max_brightness_fd);
+        if (gs_sysfs.ppanel) {
+            gs_sysfs.ppanel->brn_max_abs = gs_sysfs.brn_max_abs;
+        }
+    }
+    if ( (gs_sysfs.brightness_fd = open(SYSFS_BACKLIGHT_PATH "brightness", (SYSFS_WRITER == WRITER_LOGIND ? O_RDONLY : O_RDWR) | O_CLOEXEC)) < 0 ) {
+        ERROR("Error: cannot open file %s (%s)\n", SYSFS_BACKLIGHT_PATH "brightness", strerror(errno));
         exit(EX_UNAVAILABLE);
     }
-    TRACE("[init] running on screen #%u\n", gs_xcb.screen_nr);
-    xcb_screen_iterator_t screen_iterator = xcb_setup_roots_iterator(xcb_get_setup(gs_xcb.connection));
-    for (; screen_iterator.rem; --gs_xcb.screen_nr, xcb_screen_next(&screen_iterator)) {
-        if (gs_xcb.screen_nr == 0) {
-          gs_xcb.screen = screen_iterator.data;
-          break;
-        }
+    if ( (gs_sysfs.actual_brightness_fd = open(SYSFS_BACKLIGHT_PATH "actual_brightness", O_RDONLY | O_CLOEXEC)) < 0 ) {
+        WARN("Warning: cannot open %s, writes are confirmed once written\n", SYSFS_BACKLIGHT_PATH "actual_brightness");
     }
-    TRACE("[init] screen #%u's dimensions: %ux%u\n",
-            gs_xcb.screen_nr,
-            gs_xcb.screen->width_in_pixels,
-            gs_xcb.screen->height_in_pixels
-    );
-
-    atexit(shutdown_connection);
+    #endif
 
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    // randr
+    // Event Sources
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    DEBUG("[init] querying randr extension\n");
-    xcb_randr_query_version_cookie_t gs_xcb_randr_query_version_cookie = xcb_randr_query_version(gs_xcb.connection, 1, 2);
-    xcb_randr_query_version_reply_t *gs_xcb_randr_query_version_reply  = xcb_randr_query_version_reply(gs_xcb.connection, gs_xcb_randr_query_version_cookie, &xcb_generic_error);
-    if (xcb_generic_error != NULL || gs_xcb_randr_query_version_reply == NULL) {
-        ERROR("Error: cannot query randr extension\n");
-        exit(EX_UNAVAILABLE);
+    for (uint8_t p = 0; p < POLL_SOURCE_COUNT; p++) {
+        gs_pollfds[p].fd     = -1;
+        gs_pollfds[p].events = POLLIN;
     }
-    if (gs_xcb_randr_query_version_reply->major_version != 1 || gs_xcb_randr_query_version_reply->minor_version < 2) {
-        ERROR("Error: randr version %d.%d too old\n", gs_xcb_randr_query_version_reply->major_version, gs_xcb_randr_query_version_reply->minor_version);
-        free(gs_xcb_randr_query_version_reply);
-        exit(EX_UNAVAILABLE);
+    // blocked before any thread is started, so SIGUSR1 only ever ends up in the signalfd
+    sigset_t signals;
+    (void)sigemptyset(&signals);
+    (void)sigaddset(&signals, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &signals, NULL) < 0 || (gs_pollfds[POLL_SOURCE_SIGNAL].fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+        WARN("Warning: cannot read SIGUSR1 from a signalfd (%s), not printing stats\n", strerror(errno));
     }
-    free(gs_xcb_randr_query_version_reply);
-
-    xcb_intern_atom_cookie_t  gs_xcb_intern_atom_cookie_backlight[2];
-    xcb_intern_atom_reply_t  *gs_xcb_intern_atom_reply_backlight;
-    gs_xcb_intern_atom_cookie_backlight[0] = xcb_intern_atom(gs_xcb.connection, 1, strlen("Backlight"), "Backlight");
-    gs_xcb_intern_atom_reply_backlight     = xcb_intern_atom_reply(gs_xcb.connection, gs_xcb_intern_atom_cookie_backlight[0], &xcb_generic_error);
-    if (xcb_generic_error != NULL || gs_xcb_intern_atom_reply_backlight == NULL) {
-        ERROR("Error: Intern Atom returned error %d while querying backlight property\n", xcb_generic_error ? xcb_generic_error->error_code : -1);
-        exit(EX_UNAVAILABLE);
+    // the only timeouts are fade steps and confirmation deadlines, let the kernel batch them with other wakeups
+    if (prctl(PR_SET_TIMERSLACK, TIMER_SLACK_NS) < 0) {
+        WARN("Warning: cannot set timer slack (%s)\n", strerror(errno));
     }
-    gs_xcb.backlight_new_atom = gs_xcb_intern_atom_reply_backlight->atom;
-    free(gs_xcb_intern_atom_reply_backlight);
-
-    gs_xcb_intern_atom_cookie_backlight[1] = xcb_intern_atom(gs_xcb.connection, 1, strlen("BACKLIGHT"), "BACKLIGHT");
-    gs_xcb_intern_atom_reply_backlight     = xcb_intern_atom_reply(gs_xcb.connection, gs_xcb_intern_atom_cookie_backlight[1], &xcb_generic_error);
-    if (xcb_generic_error != NULL || gs_xcb_intern_atom_reply_backlight == NULL) {
-        ERROR("Error: Intern Atom returned error %d while querying backlight property\n", xcb_generic_error ? xcb_generic_error->error_code : -1);
-        exit(EX_UNAVAILABLE);
+    if (FADE_MS > 0 || ADAPTIVE_DELAY_MAX > 0 || gs_stages.num_stages > 0) {
+        if ( (gs_timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ) {
+            if (gs_stages.num_stages > 0) {
+                ERROR("Error: cannot create timer for the dimming schedule (%s). Exiting.\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            WARN("Warning: cannot create timer (%s), neither fading nor delaying\n", strerror(errno));
+            ADAPTIVE_DELAY_MAX = 0;
+            FADE_MS            = 0;
+        }
+        gs_pollfds[POLL_SOURCE_TIMER].fd = gs_timer.fd;
     }
-    gs_xcb.backlight_legacy_atom = gs_xcb_intern_atom_reply_backlight->atom;
-    free(gs_xcb_intern_atom_reply_backlight);
-
-    if (gs_xcb.backlight_new_atom == XCB_NONE && gs_xcb.backlight_legacy_atom == XCB_NONE) {
-        ERROR("Error: No outputs have backlight property\n");
-        exit(EX_UNAVAILABLE);
+    if (subscription_open()) {
+        atexit(subscription_close);
+    } else {
+        DEBUG("[init] no subscription socket\n");
     }
-
-    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    // DPMS
-    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    DEBUG("[init] querying dpms extension\n");
-    query_ext_reply = xcb_get_extension_data(gs_xcb.connection, &xcb_dpms_id);
-    if ( !query_ext_reply || query_ext_reply->present == 0 ) {
-        ERROR("Error: cannot query dpms extension. Exiting.\n");
-        exit(EXIT_FAILURE);
+    if (!status_page_open()) {
+        DEBUG("[init] no status page\n");
     }
-
-    xcb_dpms_capable_cookie_t gs_xcb_dpms_capable_cookie = xcb_dpms_capable_unchecked(gs_xcb.connection);
-    xcb_dpms_capable_reply_t *gs_xcb_dpms_capable_reply  = xcb_dpms_capable_reply(gs_xcb.connection, gs_xcb_dpms_capable_cookie, NULL);
-    if (!gs_xcb_dpms_capable_reply || gs_xcb_dpms_capable_reply->capable == 0) {
-        free(gs_xcb_dpms_capable_reply);
-        ERROR("Error: display not capable of dpms. Exiting.\n");
-        exit(EXIT_FAILURE);
+    if (gs_power.enabled && !power_open(&gs_power)) {
+        WARN("Warning: cannot listen for power_supply uevents, dimming as on ac\n");
     }
-    free(gs_xcb_dpms_capable_reply);
-
-    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    // Screensaver
-    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    DEBUG("[init] querying screensaver extension\n");
-    query_ext_reply = xcb_get_extension_data(gs_xcb.connection, &xcb_screensaver_id);
-    if ( !query_ext_reply || query_ext_reply->present == 0 ) {
-        ERROR("Error: cannot query screensaver extension. Exiting.\n");
-        exit(EXIT_FAILURE);
+    if (gs_hooks.enabled) {
+        if (hooks_open(&gs_hooks)) {
+            atexit(hooks_kill);
+        } else {
+            WARN("Warning: hooks need pidfd_open() (Linux 5.3), not running them\n");
+        }
     }
-    gs_xcb.screensaver_id = query_ext_reply->first_event + XCB_SCREENSAVER_NOTIFY;
-
-    DEBUG("[init] querying screensaver settings\n");
-    if (!query_state(&gs_globalstate, &gs_xcb)) {
-        ERROR("Error: cannot get screensaver settings\n");
-        exit(EXIT_FAILURE);
+    if (gs_leds.num_policies > 0) {
+        if (leds_open(&gs_leds) == 0) {
+            WARN("Warning: no LED matches --led\n");
+        }
+        atexit(leds_restore);
     }
-
-    // Create a pixmap and register it as the screensaver's "window" via _SCREEN_SAVER_ID property
-    DEBUG("[init] creating and registering screensaver's window\n");
-    gs_xcb.pixmap = xcb_generate_id(gs_xcb.connection);
-    xcb_void_cookie   = xcb_create_pixmap(gs_xcb.connection, 1, gs_xcb.pixmap , gs_xcb.screen->root, 1, 1);
-    if ( (xcb_generic_error = xcb_request_check(gs_xcb.connection, xcb_void_cookie)) ) {
-        ERROR("Error: cannot create screensaver window's pixmap. Exiting.\n");
-        exit(EXIT_FAILURE);
+    #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    if (SYSFS_WRITER == WRITER_LOGIND) {
+        DEBUG("[init] connecting to logind\n");
+        if (!logind_start(&gs_logind)) {
+            ERROR("Error: cannot set the brightness by logind. Exiting.\n");
+            exit(EX_UNAVAILABLE);
+        }
+        gs_pollfds[POLL_SOURCE_WORKER].fd = gs_logind.fd;
+        atexit(logind_stop);
+        // logind has no call for LEDs, they are written by the thread on their own
+        if (gs_leds.num_leds > 0) {
+            if (backlight_worker_start(&gs_worker, -1)) {
+                gs_pollfds[POLL_SOURCE_LEDS].fd = gs_worker.completion_fd;
+                atexit(backlight_worker_stop);
+            } else {
+                WARN("Warning: writing LEDs from the event loop\n");
+            }
+        }
     }
-
-    xcb_intern_atom_cookie_t intern_atom_cookie = xcb_intern_atom(gs_xcb.connection, 0, strlen("_SCREEN_SAVER_ID"), "_SCREEN_SAVER_ID");
-    gs_xcb.screensaver_id_atom                  = xcb_intern_atom_reply(gs_xcb.connection, intern_atom_cookie, NULL);
-    if (!gs_xcb.screensaver_id_atom) {
-        ERROR("Error: cannot create _SCREEN_SAVER_ID property. Exiting.\n");
-        exit(EXIT_FAILURE);
+    #endif
+    #ifdef USE_IO_URING
+    if (SYSFS_WRITER == WRITER_URING) {
+        DEBUG("[init] setting up io_uring\n");
+        // the LEDs are registered after the brightness file, so their writes share its io_uring_enter()
+        int fds[URING_MAX_FILES] = { gs_sysfs.brightness_fd };
+        for (uint8_t l = 0; l < gs_leds.num_leds; l++) {
+            fds[l + 1] = gs_leds.leds[l].fd;
+        }
+        if (uring_start(&gs_uring, fds, (uint8_t)(1 + gs_leds.num_leds))) {
+            for (uint8_t l = 0; l < gs_leds.num_leds; l++) {
+                gs_leds.leds[l].file = (uint8_t)(l + 1);
+            }
+            gs_pollfds[POLL_SOURCE_WORKER].fd = gs_uring.event_fd;
+            atexit(uring_stop);
+        } else {
+            WARN("Warning: falling back to the backlight worker\n");
+            SYSFS_WRITER = WRITER_THREAD;
+        }
     }
-    xcb_void_cookie = xcb_change_property(
-            gs_xcb.connection,
-            XCB_PROP_MODE_REPLACE,
-            gs_xcb.screen->root,
-            gs_xcb.screensaver_id_atom->atom, XCB_ATOM_PIXMAP, 32, 1, &gs_xcb.pixmap
-    );
-    if ( (xcb_generic_error = xcb_request_check(gs_xcb.connection, xcb_void_cookie)) ) {
-        ERROR("Error: cannot register _SCREEN_SAVER_ID property. Exiting.\n");
-        exit(EXIT_FAILURE);
+    #endif
+    #ifdef USE_SYSFS_BACKLIGHT_CONTROL
+    if (SYSFS_WRITER == WRITER_THREAD) {
+        DEBUG("[init] starting backlight worker\n");
+        if (backlight_worker_start(&gs_worker, gs_sysfs.brightness_fd)) {
+            gs_pollfds[POLL_SOURCE_WORKER].fd = gs_worker.completion_fd;
+            atexit(backlight_worker_stop);
+        } else {
+            WARN("Warning: writing brightness from the event loop\n");
+            SYSFS_WRITER = WRITER_SYNC;
+        }
     }
+    #endif
 
-    // set attributes for use as "external" screensaver
-    xcb_void_cookie = xcb_screensaver_set_attributes(
-        gs_xcb.connection,
-        gs_xcb.screen->root,
-        -1, -1, 1, 1,
-        0,
-        XCB_WINDOW_CLASS_COPY_FROM_PARENT,
-        gs_xcb.screen->root_depth,
-        gs_xcb.screen->root_visual,
-        0, NULL
-    );
-    if ( (xcb_generic_error = xcb_request_check(gs_xcb.connection, xcb_void_cookie)) ) {
-        ERROR("Error: cannot set screensaver attributes. Exiting.\n");
-        exit(EXIT_FAILURE);
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // xcb
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    #ifdef FAKE_X
+    atexit(fakex_stop);
+    #endif
+    atexit(shutdown_connection);
+    if ( RET_OK != (result = setup_connection(&gs_globalstate, &gs_xcb)) ) {
+        exit(result);
     }
-
-    // register some "known" environment variables pointing to the screensaver
-	char xid[32];
-	(void)snprintf(xid, sizeof(xid), "0x%lx", (unsigned long)gs_xcb.pixmap);
-	(void)setenv("XSS_WINDOW", xid, 1);
-	(void)snprintf(xid, sizeof(xid), "0x%lx", (unsigned long)gs_xcb.pixmap);
-	(void)setenv("XSCREENSAVER_WINDOW", xid, 1);
-
-    DEBUG("[init] subscribing to screensaver events\n");
-    xcb_void_cookie = xcb_screensaver_select_input(
-            gs_xcb.connection,
-            gs_xcb.screen->root,
-            XCB_SCREENSAVER_EVENT_NOTIFY_MASK | XCB_SCREENSAVER_EVENT_CYCLE_MASK
-    );
-    if ( (xcb_generic_error = xcb_request_check(gs_xcb.connection, xcb_void_cookie)) ) {
-        ERROR("Error: cannot subscribe to screensaver events. Exiting.\n");
-        exit(EXIT_FAILURE);
+    #ifndef USE_SYSFS_BACKLIGHT_CONTROL
+    if (GAMMA_DIMMING) {
+        atexit(shutdown_restore_gamma);
+    }
+    #endif
+    if (!gs_idle.enabled) {
+        atexit(shutdown_deregister_events);
     }
 
-    atexit(shutdown_deregister_events);
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // Restore Brightness Left Dimmed by a Previous Instance
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    state_cache_restore(&gs_xcb);
 
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     // Get Initial Brightness from Backlight
@@ -1343,12 +8497,27 @@ int main(int argc, char** argv) {
     signal(SIGTERM, signal_handler);
     signal(SIGQUIT, signal_handler);
     signal(SIGINT,  signal_handler);
+    #ifdef DEBUGLOG
+    atexit(print_stats);
+    #endif
+    // the counters since the last write, rate-limited by metrics_timeout_ms()
+    if (gs_metrics.path) {
+        atexit(metrics_write);
+    }
 
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     // Event Loop
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    gs_eventstate.scrsvr_state = gs_globalstate.screensaver_state == XCB_SCREENSAVER_STATE_OFF ? XCB_SCREENSAVER_STATE_OFF : XCB_SCREENSAVER_STATE_ON;
     DEBUG("[init] waiting for screensaver events (current brightness: %u%%)\n", brn_cur_perc);
-    exit( event_loop(&gs_globalstate, &gs_xcb, &gs_eventstate) );
+    notify_ready();
+    #ifdef ALLOC_AUDIT
+    alloc_audit_init();
+    #endif
+    do {
+        result = event_loop(&gs_globalstate, &gs_xcb, &gs_eventstate);
+    } while (gs_xcb.connection && xcb_connection_has_error(gs_xcb.connection) && reconnect_start(&gs_xcb));
+    exit(result);
 }
 
 // vim: expandtab tabstop=4 shiftwidth=4
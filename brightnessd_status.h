@@ -0,0 +1,149 @@
+/*
+ * Copyright © 2015 Christian Storm <Christian.Storm at tngtech dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Reader of brightnessd's status page.
+ *
+ * brightnessd publishes its state and the brightness of its outputs in the
+ * file `$XDG_RUNTIME_DIR/brightnessd.status`, which clients map once and then
+ * read without any system call, without talking to brightnessd or the X
+ * server. The page is guarded by a sequence lock: brightnessd makes the
+ * sequence odd while updating the page and even again once done, so a reader
+ * copying the page in between the same even sequence got a consistent
+ * snapshot. E.g.,
+ *
+ *   const struct brightnessd_status *page = brightnessd_status_map();
+ *   struct brightnessd_status status;
+ *   if (page && brightnessd_status_read(page, &status)) {
+ *       printf("%u%% %s\n", status.brn_cur_perc, status.dimmed ? "dimmed" : "");
+ *   }
+ *
+ * The page stays mapped, so later reads see brightnessd's latest changes.
+ * `generation` counts the changes, so a poller may skip an unchanged page.
+ * The page is left as is when brightnessd exits.
+ */
+
+#ifndef BRIGHTNESSD_STATUS_H
+#define BRIGHTNESSD_STATUS_H
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define BRIGHTNESSD_STATUS_MAGIC UINT32_C(0x62726e73)
+#define BRIGHTNESSD_STATUS_VERSION 1
+#define BRIGHTNESSD_STATUS_NAME "brightnessd.status"
+#define BRIGHTNESSD_STATUS_OUTPUTS 8
+#define BRIGHTNESSD_STATUS_RETRIES 64
+
+// brightnessd's state as of the last screensaver or dpms event
+enum brightnessd_state {
+    BRIGHTNESSD_STATE_DPMS_STANDBY,
+    BRIGHTNESSD_STATE_DPMS_SUSPEND,
+    BRIGHTNESSD_STATE_DPMS_OFF,
+    BRIGHTNESSD_STATE_SCREENSAVER_ON_TIMEOUT,
+    BRIGHTNESSD_STATE_SCREENSAVER_ON_INTERVAL,
+    BRIGHTNESSD_STATE_SCREENSAVER_OFF,
+    BRIGHTNESSD_STATE_SCREENSAVER_CYCLE,
+    BRIGHTNESSD_STATE_SCREENSAVER_DISABLED,
+    BRIGHTNESSD_STATE_UNKNOWN,
+};
+
+struct brightnessd_status {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sequence;
+    uint32_t pid;
+    uint64_t generation;
+    int32_t  brn_abs[BRIGHTNESSD_STATUS_OUTPUTS];
+    uint8_t  brn_perc[BRIGHTNESSD_STATUS_OUTPUTS];
+    uint8_t  state;
+    uint8_t  brn_cur_perc;
+    uint8_t  num_outputs;
+    uint8_t  dimmed;
+    char     _padding[4];
+};
+
+
+/** Map brightnessd's status page read-only.
+
+    @return                 the page, or NULL if there is none (yet)
+*/
+static inline const struct brightnessd_status *brightnessd_status_map(void) {
+    char path[4096];
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (!runtime_dir || runtime_dir[0] != '/') {
+        return NULL;
+    }
+    const int length = snprintf(path, sizeof(path), "%s/" BRIGHTNESSD_STATUS_NAME, runtime_dir);
+    if (length < 0 || (size_t)length >= sizeof(path)) {
+        return NULL;
+    }
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    void *page = mmap(NULL, sizeof(struct brightnessd_status), PROT_READ, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (page == MAP_FAILED) {
+        return NULL;
+    }
+    const struct brightnessd_status *pstatus = (const struct brightnessd_status *)page;
+    if (pstatus->magic != BRIGHTNESSD_STATUS_MAGIC || pstatus->version != BRIGHTNESSD_STATUS_VERSION) {
+        (void)munmap(page, sizeof(struct brightnessd_status));
+        return NULL;
+    }
+    return pstatus;
+}
+
+
+/** Copy a consistent snapshot of the status page, without any system call.
+
+    @param page             the page returned by brightnessd_status_map()
+    @param snapshot         where to copy the page to
+    @return                 true on success, false if brightnessd kept updating the page
+*/
+static inline bool brightnessd_status_read(const struct brightnessd_status *page, struct brightnessd_status *snapshot) {
+    for (unsigned int retry = 0; retry < BRIGHTNESSD_STATUS_RETRIES; retry++) {
+        const uint32_t sequence = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            continue;
+        }
+        memcpy(snapshot, page, sizeof(*snapshot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->sequence, __ATOMIC_RELAXED) == sequence) {
+            snapshot->sequence = sequence;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
+
+// vim: expandtab tabstop=4 shiftwidth=4
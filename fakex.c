@@ -0,0 +1,1501 @@
+/*
+ * Copyright © 2015 Christian Storm <Christian.Storm at tngtech dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * A fake X server for benchmarking brightnessd without a display.
+ *
+ * Built into brightnessd by the `fakex` make target, it serves the subset of
+ * the core, RandR, MIT-SCREEN-SAVER, DPMS, SYNC, and Present protocol brightnessd
+ * uses from a thread at the other end of a socketpair. It offers backlit outputs,
+ * answers with a configurable latency, fails a share of the brightness writes,
+ * refreshes at 60Hz for MSC notifications, and drives the screensaver, and the
+ * idle alarms if any, through a number of ON/OFF cycles before terminating
+ * brightnessd, whose statistics then tell the round trips and latencies. It
+ * may also restart every few cycles while the screensaver is on, dropping the
+ * connection and coming back with the screensaver off and the backlight kept,
+ * and plug or unplug a mains adapter while the screensaver is on, sending the
+ * kernel's power_supply uevent on a socket standing in for the netlink socket,
+ * with further adapters, e.g., a dock's, staying plugged in throughout.
+ * Outputs may lack the backlight property to be dimmed by their crtc's gamma
+ * ramps instead, each crtc starting with ramps of its own; the ramps left
+ * behind when brightnessd exits are compared with those.
+ * For the sysfs backend's logind writer, it also mocks the system bus and
+ * logind's Session.SetBrightness, writing the value to SYSFS_BACKLIGHT_PATH,
+ * checking how the calls are marshalled and how many are in flight at once,
+ * and failing a share of them or dropping the connection on request.
+ *
+ * Configured by environment variables:
+ *   FAKEX_OUTPUTS          number of outputs (1..8, default 1)
+ *   FAKEX_GAMMA_OUTPUTS    number of those without a backlight, dimmed by gamma (default 0)
+ *   FAKEX_LATENCY_US       time taken per request (default 0)
+ *   FAKEX_ERROR_PERCENT    share of brightness writes failing with BadValue (default 0)
+ *   FAKEX_CYCLES           screensaver ON/OFF cycles to run (default 100)
+ *   FAKEX_PERIOD_MS        time between screensaver notifications (default 20)
+ *   FAKEX_RESTART_EVERY    restart the server every this many cycles (default 0, never)
+ *   FAKEX_POWER_EVERY      toggle the mains adapter every this many cycles (default 0, never)
+ *   FAKEX_ADAPTERS         number of mains adapters, only the first is toggled (1..4, default 1)
+ *   FAKEX_BUS_LATENCY_US   time logind takes per SetBrightness call (default 0)
+ *   FAKEX_BUS_ERROR_PERCENT share of SetBrightness calls answered by an error (default 0)
+ *   FAKEX_BUS_DROP_AFTER   close each bus connection after this many SetBrightness calls (default 0, never)
+ *   FAKEX_BUS_CONNECTIONS  bus connections accepted, later ones are refused (default 0, unlimited)
+ *   FAKEX_BUS_REORDER      answer the newest call in flight first (default 0, in order)
+ *   FAKEX_BUS_MUTE         never answer the authentication of a bus connection made again (default 0)
+ *
+ * Only little-endian clients on a little-endian host are served.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#define FAKEX_MAX_OUTPUTS 8
+#define FAKEX_MAX_ADAPTERS 4
+#define FAKEX_MAX_ATOMS 64
+#define FAKEX_BUFFER_SIZE 65536
+#define FAKEX_ROOT 0x100
+#define FAKEX_VISUAL 0x21
+#define FAKEX_OUTPUT_BASE 0x40
+#define FAKEX_CRTC_BASE 0x60
+#define FAKEX_FIRST_ATOM 100
+#define FAKEX_BRIGHTNESS_MAX 1000
+#define FAKEX_SCREENSAVER_TIMEOUT 600
+#define FAKEX_GAMMA_SIZE 256
+#define FAKEX_GAMMA_DIMMED_PERMILLE 900
+#define FAKEX_EXIT_WAIT_S 2
+#define FAKEX_MAX_ALARMS 8
+#define FAKEX_IDLETIME_COUNTER 0x30
+#define FAKEX_REFRESH_NS 16666667
+#define FAKEX_BUS_MESSAGE_MAX 1024
+#define FAKEX_BUS_MAX_QUEUE 16
+#define FAKEX_BUS_FIELDS 9
+
+// opcodes of the requests served
+#define X_CREATE_WINDOW 1
+#define X_CHANGE_WINDOW_ATTRIBUTES 2
+#define X_DESTROY_WINDOW 4
+#define X_CONFIGURE_WINDOW 12
+#define X_INTERN_ATOM 16
+#define X_CHANGE_PROPERTY 18
+#define X_DELETE_PROPERTY 19
+#define X_GET_PROPERTY 20
+#define X_GET_INPUT_FOCUS 43
+#define X_CREATE_PIXMAP 53
+#define X_FREE_PIXMAP 54
+#define X_QUERY_EXTENSION 98
+#define X_GET_SCREEN_SAVER 108
+
+#define RANDR_OPCODE 140
+#define RANDR_FIRST_EVENT 89
+#define RANDR_FIRST_ERROR 147
+#define RANDR_QUERY_VERSION 0
+#define RANDR_SELECT_INPUT 4
+#define RANDR_GET_SCREEN_RESOURCES 8
+#define RANDR_GET_OUTPUT_INFO 9
+#define RANDR_QUERY_OUTPUT_PROPERTY 11
+#define RANDR_CHANGE_OUTPUT_PROPERTY 13
+#define RANDR_GET_OUTPUT_PROPERTY 15
+#define RANDR_GET_CRTC_INFO 20
+#define RANDR_GET_CRTC_GAMMA_SIZE 22
+#define RANDR_GET_CRTC_GAMMA 23
+#define RANDR_SET_CRTC_GAMMA 24
+#define RANDR_GET_SCREEN_RESOURCES_CURRENT 25
+#define RANDR_NOTIFY_MASK_OUTPUT_PROPERTY 8
+
+#define SCREENSAVER_OPCODE 141
+#define SCREENSAVER_FIRST_EVENT 95
+#define SCREENSAVER_QUERY_INFO 1
+#define SCREENSAVER_SELECT_INPUT 2
+#define SCREENSAVER_SET_ATTRIBUTES 3
+#define SCREENSAVER_UNSET_ATTRIBUTES 4
+
+#define DPMS_OPCODE 142
+#define DPMS_GET_VERSION 0
+#define DPMS_CAPABLE 1
+#define DPMS_GET_TIMEOUTS 2
+#define DPMS_INFO 7
+#define DPMS_SELECT_INPUT 8
+
+#define SYNC_OPCODE 143
+#define SYNC_FIRST_EVENT 100
+#define SYNC_FIRST_ERROR 160
+#define SYNC_INITIALIZE 0
+#define SYNC_LIST_SYSTEM_COUNTERS 1
+#define SYNC_CREATE_ALARM 8
+#define SYNC_DESTROY_ALARM 11
+#define SYNC_TESTTYPE_POSITIVE_TRANSITION 0
+#define SYNC_TESTTYPE_NEGATIVE_TRANSITION 1
+
+#define PRESENT_OPCODE 144
+#define PRESENT_QUERY_VERSION 0
+#define PRESENT_NOTIFY_MSC 2
+#define PRESENT_SELECT_INPUT 3
+#define PRESENT_COMPLETE_NOTIFY 1
+#define PRESENT_COMPLETE_KIND_NOTIFY_MSC 1
+#define PRESENT_EVENT_MASK_COMPLETE_NOTIFY 2
+#define X_GE_GENERIC 35
+
+#define X_ERROR_BAD_REQUEST 1
+#define X_ERROR_BAD_VALUE 2
+#define X_ATOM_INTEGER 19
+
+int fakex_start(void);
+int fakex_uevents(void);
+int fakex_bus(void);
+void fakex_stop(void);
+
+struct Tfakexalarm {
+    uint32_t id;
+    uint32_t value_ms;
+    uint32_t test_type;
+};
+
+static struct Tfakex {
+    pthread_t thread;
+    uint64_t  requests;
+    uint64_t  replies;
+    uint64_t  errors_injected;
+    uint64_t  next_event_ns;
+    uint64_t  next_msc_ns;
+    uint64_t  next_uevent_ns;
+    uint64_t  msc;
+    uint64_t  msc_notifications;
+    char     *atom_names[FAKEX_MAX_ATOMS];
+    struct Tfakexalarm alarms[FAKEX_MAX_ALARMS];
+    int32_t   brightness[FAKEX_MAX_OUTPUTS];
+    uint16_t  gamma[FAKEX_MAX_OUTPUTS][3 * FAKEX_GAMMA_SIZE];
+    uint64_t  gamma_sets;
+    uint32_t  gamma_outputs;
+    uint32_t  gamma_dimmed;
+    uint32_t  latency_us;
+    uint32_t  error_percent;
+    uint32_t  cycles;
+    uint32_t  period_ms;
+    uint32_t  notifications;
+    uint32_t  randr_mask;
+    uint32_t  screensaver_mask;
+    uint32_t  num_atoms;
+    uint32_t  num_alarms;
+    uint32_t  present_eid;
+    uint32_t  present_window;
+    uint32_t  present_mask;
+    uint32_t  present_serial;
+    uint32_t  restart_every;
+    uint32_t  restarts;
+    uint32_t  power_every;
+    uint32_t  uevents;
+    int       fd;
+    int       uevent_fd;
+    uint16_t  sequence;
+    uint8_t   num_outputs;
+    uint8_t   screensaver_state;
+    uint8_t   backlight_atom;
+    bool      dpms_events;
+    bool      present_pending;
+    bool      mains_online;
+    uint8_t   adapters;
+    bool      closed;
+    char      _padding[2];
+    pthread_mutex_t closed_mutex;
+    pthread_cond_t  closed_cond;
+    size_t    in_length;
+    uint8_t   in[FAKEX_BUFFER_SIZE];
+} gs_fakex;
+
+// a call taken by the mock system bus, in flight until answered
+struct Tfakexcall {
+    uint32_t serial;
+    uint32_t value;
+    bool     set_brightness;
+    char     _padding[3];
+};
+
+// the mock system bus, see fakex_bus(); one connection at a time, made
+// again by the client once the previous one is gone
+static struct Tfakexbus {
+    pthread_t thread;
+    uint64_t  calls;
+    uint64_t  errors;
+    uint64_t  malformed;
+    uint32_t  replies;
+    uint32_t  inflight_max;
+    uint32_t  latency_us;
+    uint32_t  error_percent;
+    uint32_t  drop_after;
+    uint32_t  drops;
+    uint32_t  connections;
+    uint32_t  max_connections;
+    uint32_t  reorder;
+    uint32_t  mute;
+    unsigned  seed;
+    char      _padding[4];
+} gs_fakexbus;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+static inline void put16(uint8_t *p, const uint32_t v) { uint16_t w = (uint16_t)v; memcpy(p, &w, sizeof(w)); }
+static inline void put32(uint8_t *p, const uint32_t v) { memcpy(p, &v, sizeof(v)); }
+static inline uint16_t get16(const uint8_t *p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+static inline uint32_t get32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+static uint32_t env_uint(const char *name, const uint32_t fallback) {
+    const char *value = getenv(name);
+    return value ? (uint32_t)strtoul(value, NULL, 10) : fallback;
+}
+
+// the ramp a crtc starts with, every crtc and channel with a maximum of its own
+static uint16_t gamma_original(const int crtc, const uint32_t channel, const uint32_t i) {
+    const uint32_t top = 0xffff - 0x1000 * (uint32_t)crtc - 0x400 * channel;
+    return (uint16_t)(i * top / (FAKEX_GAMMA_SIZE - 1));
+}
+
+// whether a crtc's ramps differ from those it started with
+static bool gamma_changed(const int crtc) {
+    for (uint32_t channel = 0; channel < 3; channel++) {
+        for (uint32_t i = 0; i < FAKEX_GAMMA_SIZE; i++) {
+            if (gs_fakex.gamma[crtc][channel * FAKEX_GAMMA_SIZE + i] != gamma_original(crtc, channel, i)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static bool send_all(const uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = write(gs_fakex.fd, data, length);
+        if (sent < 0 && errno == EINTR) { continue; }
+        if (sent <= 0) { return false; }
+        data   += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_reply()
+///////////////////////////////////////////////////////////////////////////////
+/** Send a reply to the current request.
+
+    @param reply            the reply, its first 32 bytes with the header left to fill in
+    @param length           the reply's length in bytes, at least 32 and a multiple of 4
+    @param data             the reply's data byte, i.e., its second byte
+*/
+static void fakex_reply(uint8_t *reply, const size_t length, const uint8_t data) {
+    reply[0] = 1;
+    reply[1] = data;
+    put16(reply + 2, gs_fakex.sequence);
+    put32(reply + 4, (uint32_t)((length - 32) / 4));
+    gs_fakex.replies++;
+    (void)send_all(reply, length);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_error()
+///////////////////////////////////////////////////////////////////////////////
+/** Send an error in response to the current request.
+
+    @param code             the error code
+    @param major            the request's major opcode
+    @param minor            the request's minor opcode
+*/
+static void fakex_error(const uint8_t code, const uint8_t major, const uint8_t minor) {
+    uint8_t error[32] = { 0, code };
+    put16(error + 2, gs_fakex.sequence);
+    put16(error + 8, minor);
+    error[10] = major;
+    (void)send_all(error, sizeof(error));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_intern()
+///////////////////////////////////////////////////////////////////////////////
+/** Look up or create an atom.
+
+    @param name             the atom's name, not NUL-terminated
+    @param length           the length of the name
+    @param only_if_exists   whether to create the atom if it is not known yet
+    @return                 the atom, or 0 if unknown or out of atoms
+*/
+static uint32_t fakex_intern(const char *name, const size_t length, const bool only_if_exists) {
+    for (uint32_t a = 0; a < gs_fakex.num_atoms; a++) {
+        if (strlen(gs_fakex.atom_names[a]) == length && memcmp(gs_fakex.atom_names[a], name, length) == 0) {
+            return FAKEX_FIRST_ATOM + a;
+        }
+    }
+    if (only_if_exists || gs_fakex.num_atoms == FAKEX_MAX_ATOMS) {
+        return 0;
+    }
+    gs_fakex.atom_names[gs_fakex.num_atoms] = strndup(name, length);
+    return FAKEX_FIRST_ATOM + gs_fakex.num_atoms++;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_output()
+///////////////////////////////////////////////////////////////////////////////
+/** Map an output id to the fake output's index.
+
+    @param output           the RandR output id
+    @return                 the output's index, or -1 if there is no such output
+*/
+static int fakex_output(const uint32_t output) {
+    return output >= FAKEX_OUTPUT_BASE && output < FAKEX_OUTPUT_BASE + (uint32_t)gs_fakex.num_outputs ? (int)(output - FAKEX_OUTPUT_BASE) : -1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_setup()
+///////////////////////////////////////////////////////////////////////////////
+/** Answer the connection setup with a single 1x1 screen of depth 24.
+
+    @return                 true on success, false if the client is not served
+*/
+static bool fakex_setup(void) {
+    uint8_t request[12];
+    size_t got = 0;
+    while (got < sizeof(request)) {
+        ssize_t n = read(gs_fakex.fd, request + got, sizeof(request) - got);
+        if (n <= 0) { return false; }
+        got += (size_t)n;
+    }
+    const uint16_t auth_length = (uint16_t)(((get16(request + 6) + 3) & ~3) + ((get16(request + 8) + 3) & ~3));
+    uint8_t discard[256];
+    for (size_t skipped = 0; skipped < auth_length; ) {
+        ssize_t n = read(gs_fakex.fd, discard, auth_length - skipped < sizeof(discard) ? auth_length - skipped : sizeof(discard));
+        if (n <= 0) { return false; }
+        skipped += (size_t)n;
+    }
+    if (request[0] != 'l') {
+        (void)fprintf(stderr, "[fakex] only little-endian clients are served\n");
+        return false;
+    }
+
+    // fixed part (40) + vendor (4) + one pixmap format (8) + screen (40) + depth (8) + visual (24)
+    uint8_t setup[124] = { 0 };
+    setup[0] = 1;
+    put16(setup + 2, 11);
+    put16(setup + 6, (sizeof(setup) - 8) / 4);
+    put32(setup + 8, 1);
+    put32(setup + 12, 0x200000);
+    put32(setup + 16, 0x1fffff);
+    put16(setup + 24, 4);
+    put16(setup + 26, 0xffff);
+    setup[28] = 1;
+    setup[29] = 1;
+    setup[32] = 32;
+    setup[33] = 32;
+    setup[34] = 8;
+    setup[35] = 255;
+    memcpy(setup + 40, "fake", 4);
+    setup[44] = 24;
+    setup[45] = 32;
+    setup[46] = 32;
+    uint8_t *screen = setup + 52;
+    put32(screen + 0, FAKEX_ROOT);
+    put32(screen + 4, 0x20);
+    put32(screen + 8, 0xffffff);
+    put16(screen + 20, 1);
+    put16(screen + 22, 1);
+    put16(screen + 24, 1);
+    put16(screen + 26, 1);
+    put16(screen + 28, 1);
+    put16(screen + 30, 1);
+    put32(screen + 32, FAKEX_VISUAL);
+    screen[38] = 24;
+    screen[39] = 1;
+    uint8_t *depth = screen + 40;
+    depth[0] = 24;
+    put16(depth + 2, 1);
+    uint8_t *visual = depth + 8;
+    put32(visual + 0, FAKEX_VISUAL);
+    visual[4] = 4;
+    visual[5] = 8;
+    put16(visual + 6, 256);
+    put32(visual + 8, 0xff0000);
+    put32(visual + 12, 0x00ff00);
+    put32(visual + 16, 0x0000ff);
+    return send_all(setup, sizeof(setup));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_core()
+///////////////////////////////////////////////////////////////////////////////
+/** Serve a core protocol request.
+
+    @param request          the request
+*/
+static void fakex_core(const uint8_t *request) {
+    uint8_t reply[64] = { 0 };
+    switch (request[0]) {
+        case X_CREATE_WINDOW:
+        case X_CHANGE_WINDOW_ATTRIBUTES:
+        case X_DESTROY_WINDOW:
+        case X_CONFIGURE_WINDOW:
+        case X_CHANGE_PROPERTY:
+        case X_DELETE_PROPERTY:
+        case X_CREATE_PIXMAP:
+        case X_FREE_PIXMAP:
+            return;
+        case X_INTERN_ATOM:
+            put32(reply + 8, fakex_intern((const char *)request + 8, get16(request + 4), request[1]));
+            fakex_reply(reply, 32, 0);
+            return;
+        case X_GET_PROPERTY:
+            // no window properties, e.g., no active window
+            fakex_reply(reply, 32, 0);
+            return;
+        case X_GET_INPUT_FOCUS:
+            put32(reply + 8, FAKEX_ROOT);
+            fakex_reply(reply, 32, 1);
+            return;
+        case X_QUERY_EXTENSION: {
+            // name, then major opcode, first event, and first error
+            static const char *extension_names[] = { "RANDR", "MIT-SCREEN-SAVER", "DPMS", "SYNC", "Present" };
+            static const uint8_t extension_codes[][3] = {
+                { RANDR_OPCODE,       RANDR_FIRST_EVENT,       RANDR_FIRST_ERROR },
+                { SCREENSAVER_OPCODE, SCREENSAVER_FIRST_EVENT, 0 },
+                { DPMS_OPCODE,        0,                       0 },
+                { SYNC_OPCODE,        SYNC_FIRST_EVENT,        SYNC_FIRST_ERROR },
+                { PRESENT_OPCODE,     0,                       0 },
+            };
+            const uint16_t length = get16(request + 4);
+            for (size_t e = 0; e < sizeof(extension_names) / sizeof(extension_names[0]); e++) {
+                if (strlen(extension_names[e]) == length && memcmp(extension_names[e], request + 8, length) == 0) {
+                    reply[8] = 1;
+                    memcpy(reply + 9, extension_codes[e], 3);
+                }
+            }
+            fakex_reply(reply, 32, 0);
+            return;
+        }
+        case X_GET_SCREEN_SAVER:
+            put16(reply + 8, FAKEX_SCREENSAVER_TIMEOUT);
+            put16(reply + 10, FAKEX_SCREENSAVER_TIMEOUT);
+            reply[12] = 1;
+            fakex_reply(reply, 32, 0);
+            return;
+        default:
+            (void)fprintf(stderr, "[fakex] unhandled core request %u\n", request[0]);
+            fakex_error(X_ERROR_BAD_REQUEST, request[0], 0);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_randr()
+///////////////////////////////////////////////////////////////////////////////
+/** Serve a RandR request.
+
+    Every output is connected to its own crtc with an identity gamma ramp and
+    has a `Backlight` property ranging from 0 to FAKEX_BRIGHTNESS_MAX.
+
+    @param request          the request
+*/
+static void fakex_randr(const uint8_t *request) {
+    static uint8_t reply[32 + 3 * 2 * FAKEX_GAMMA_SIZE];
+    memset(reply, 0, sizeof(reply));
+    const int o = request[1] == RANDR_SELECT_INPUT ? -1 : fakex_output(get32(request + 4));
+    const int c = request[1] == RANDR_SELECT_INPUT ? -1 : fakex_output(get32(request + 4) - FAKEX_CRTC_BASE + FAKEX_OUTPUT_BASE);
+    switch (request[1]) {
+        case RANDR_QUERY_VERSION:
+            put32(reply + 8, 1);
+            put32(reply + 12, 2);
+            fakex_reply(reply, 32, 0);
+            return;
+        case RANDR_SELECT_INPUT:
+            gs_fakex.randr_mask = get16(request + 8);
+            return;
+        case RANDR_GET_SCREEN_RESOURCES:
+        case RANDR_GET_SCREEN_RESOURCES_CURRENT:
+            put16(reply + 16, gs_fakex.num_outputs);
+            put16(reply + 18, gs_fakex.num_outputs);
+            for (uint8_t i = 0; i < gs_fakex.num_outputs; i++) {
+                put32(reply + 32 + 4 * i, FAKEX_CRTC_BASE + i);
+                put32(reply + 32 + 4 * (gs_fakex.num_outputs + i), FAKEX_OUTPUT_BASE + i);
+            }
+            fakex_reply(reply, 32 + 8 * (size_t)gs_fakex.num_outputs, 0);
+            return;
+        case RANDR_GET_OUTPUT_INFO:
+            if (o < 0) { break; }
+            put32(reply + 12, FAKEX_CRTC_BASE + (uint32_t)o);
+            put16(reply + 26, 1);
+            put32(reply + 36, FAKEX_CRTC_BASE + (uint32_t)o);
+            fakex_reply(reply, 40, 0);
+            return;
+        case RANDR_QUERY_OUTPUT_PROPERTY:
+            if (o < 0 || (uint32_t)o < gs_fakex.gamma_outputs || get32(request + 8) != gs_fakex.backlight_atom) { break; }
+            reply[9] = 1;
+            put32(reply + 32, 0);
+            put32(reply + 36, FAKEX_BRIGHTNESS_MAX);
+            fakex_reply(reply, 40, 0);
+            return;
+        case RANDR_CHANGE_OUTPUT_PROPERTY:
+            if (o < 0 || (uint32_t)o < gs_fakex.gamma_outputs || get32(request + 8) != gs_fakex.backlight_atom) { break; }
+            if (gs_fakex.error_percent > 0 && (uint32_t)rand() % 100 < gs_fakex.error_percent) {
+                gs_fakex.errors_injected++;
+                fakex_error(X_ERROR_BAD_VALUE, RANDR_OPCODE, RANDR_CHANGE_OUTPUT_PROPERTY);
+                return;
+            }
+            gs_fakex.brightness[o] = (int32_t)get32(request + 24);
+            if (gs_fakex.randr_mask & RANDR_NOTIFY_MASK_OUTPUT_PROPERTY) {
+                uint8_t event[32] = { RANDR_FIRST_EVENT + 1, 2 };
+                put16(event + 2, gs_fakex.sequence);
+                put32(event + 4, FAKEX_ROOT);
+                put32(event + 8, FAKEX_OUTPUT_BASE + (uint32_t)o);
+                put32(event + 12, gs_fakex.backlight_atom);
+                (void)send_all(event, sizeof(event));
+            }
+            return;
+        case RANDR_GET_OUTPUT_PROPERTY:
+            if (o < 0) { break; }
+            if ((uint32_t)o >= gs_fakex.gamma_outputs && get32(request + 8) == gs_fakex.backlight_atom) {
+                put32(reply + 8, X_ATOM_INTEGER);
+                put32(reply + 16, 1);
+                put32(reply + 32, (uint32_t)gs_fakex.brightness[o]);
+                fakex_reply(reply, 36, 32);
+            } else {
+                fakex_reply(reply, 32, 0);
+            }
+            return;
+        case RANDR_GET_CRTC_INFO:
+            // all crtcs show the single 1x1 screen
+            if (c < 0) { break; }
+            put16(reply + 16, 1);
+            put16(reply + 18, 1);
+            fakex_reply(reply, 32, 0);
+            return;
+        case RANDR_GET_CRTC_GAMMA_SIZE:
+            if (c < 0) { break; }
+            put16(reply + 8, FAKEX_GAMMA_SIZE);
+            fakex_reply(reply, 32, 0);
+            return;
+        case RANDR_GET_CRTC_GAMMA:
+            if (c < 0) { break; }
+            put16(reply + 8, FAKEX_GAMMA_SIZE);
+            memcpy(reply + 32, gs_fakex.gamma[c], sizeof(gs_fakex.gamma[c]));
+            fakex_reply(reply, sizeof(reply), 0);
+            return;
+        case RANDR_SET_CRTC_GAMMA: {
+            if (c < 0 || get16(request + 8) != FAKEX_GAMMA_SIZE) { break; }
+            // a dim counts once the red ramp's top entry crosses below the threshold
+            const uint32_t threshold = (uint32_t)gamma_original(c, 0, FAKEX_GAMMA_SIZE - 1) * FAKEX_GAMMA_DIMMED_PERMILLE / 1000;
+            const bool     bright    = gs_fakex.gamma[c][FAKEX_GAMMA_SIZE - 1] >= threshold;
+            memcpy(gs_fakex.gamma[c], request + 12, sizeof(gs_fakex.gamma[c]));
+            gs_fakex.gamma_sets++;
+            if (bright && gs_fakex.gamma[c][FAKEX_GAMMA_SIZE - 1] < threshold) {
+                gs_fakex.gamma_dimmed++;
+            }
+            return;
+        }
+        default:
+            (void)fprintf(stderr, "[fakex] unhandled randr request %u\n", request[1]);
+            fakex_error(X_ERROR_BAD_REQUEST, RANDR_OPCODE, request[1]);
+            return;
+    }
+    fakex_error(X_ERROR_BAD_VALUE, RANDR_OPCODE, request[1]);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_screensaver()
+///////////////////////////////////////////////////////////////////////////////
+/** Serve a MIT-SCREEN-SAVER request.
+
+    While the screensaver is on, the user has been idle for exactly the
+    timeout, i.e., brightnessd sees the `timeout` stage.
+
+    @param request          the request
+*/
+static void fakex_screensaver(const uint8_t *request) {
+    uint8_t reply[32] = { 0 };
+    switch (request[1]) {
+        case SCREENSAVER_QUERY_INFO:
+            put32(reply + 8, FAKEX_ROOT);
+            put32(reply + 16, gs_fakex.screensaver_state ? FAKEX_SCREENSAVER_TIMEOUT * 1000 : 0);
+            reply[24] = 2;
+            fakex_reply(reply, 32, gs_fakex.screensaver_state);
+            return;
+        case SCREENSAVER_SELECT_INPUT:
+            gs_fakex.screensaver_mask = get32(request + 8);
+            return;
+        case SCREENSAVER_SET_ATTRIBUTES:
+        case SCREENSAVER_UNSET_ATTRIBUTES:
+            return;
+        default:
+            (void)fprintf(stderr, "[fakex] unhandled screensaver request %u\n", request[1]);
+            fakex_error(X_ERROR_BAD_REQUEST, SCREENSAVER_OPCODE, request[1]);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_dpms()
+///////////////////////////////////////////////////////////////////////////////
+/** Serve a DPMS request, the panel is always on.
+
+    @param request          the request
+*/
+static void fakex_dpms(const uint8_t *request) {
+    uint8_t reply[32] = { 0 };
+    switch (request[1]) {
+        case DPMS_GET_VERSION:
+            put16(reply + 8, 1);
+            put16(reply + 10, 2);
+            fakex_reply(reply, 32, 0);
+            return;
+        case DPMS_CAPABLE:
+            reply[8] = 1;
+            fakex_reply(reply, 32, 0);
+            return;
+        case DPMS_GET_TIMEOUTS:
+            put16(reply + 8, 900);
+            put16(reply + 10, 1200);
+            put16(reply + 12, 1800);
+            fakex_reply(reply, 32, 0);
+            return;
+        case DPMS_INFO:
+            reply[10] = 1;
+            fakex_reply(reply, 32, 0);
+            return;
+        case DPMS_SELECT_INPUT:
+            gs_fakex.dpms_events = get32(request + 4) != 0;
+            return;
+        default:
+            (void)fprintf(stderr, "[fakex] unhandled dpms request %u\n", request[1]);
+            fakex_error(X_ERROR_BAD_REQUEST, DPMS_OPCODE, request[1]);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_sync()
+///////////////////////////////////////////////////////////////////////////////
+/** Serve a SYNC request, there is just the IDLETIME counter to set alarms on.
+
+    @param request          the request
+*/
+static void fakex_sync(const uint8_t *request) {
+    uint8_t reply[32 + 24] = { 0 };
+    switch (request[1]) {
+        case SYNC_INITIALIZE:
+            reply[8] = 3;
+            reply[9] = 1;
+            fakex_reply(reply, 32, 0);
+            return;
+        case SYNC_LIST_SYSTEM_COUNTERS:
+            put32(reply + 8, 1);
+            put32(reply + 32, FAKEX_IDLETIME_COUNTER);
+            put32(reply + 40, 1);
+            put16(reply + 44, strlen("IDLETIME"));
+            memcpy(reply + 46, "IDLETIME", strlen("IDLETIME"));
+            fakex_reply(reply, sizeof(reply), 0);
+            return;
+        case SYNC_CREATE_ALARM: {
+            if (gs_fakex.num_alarms == FAKEX_MAX_ALARMS) { break; }
+            struct Tfakexalarm *palarm = &gs_fakex.alarms[gs_fakex.num_alarms++];
+            const uint32_t value_mask = get32(request + 8);
+            const uint8_t *value = request + 12;
+            palarm->id = get32(request + 4);
+            // counter, value type, value (hi, lo), test type, delta (hi, lo), events
+            static const uint8_t value_words[] = { 1, 1, 2, 1, 2, 1 };
+            for (uint8_t bit = 0; bit < sizeof(value_words); bit++) {
+                if (!(value_mask & (1U << bit))) { continue; }
+                if (bit == 2) { palarm->value_ms  = get32(value + 4); }
+                if (bit == 3) { palarm->test_type = get32(value); }
+                value += 4 * value_words[bit];
+            }
+            return;
+        }
+        case SYNC_DESTROY_ALARM:
+            for (uint32_t a = 0; a < gs_fakex.num_alarms; a++) {
+                if (gs_fakex.alarms[a].id == get32(request + 4)) {
+                    gs_fakex.alarms[a] = gs_fakex.alarms[--gs_fakex.num_alarms];
+                    return;
+                }
+            }
+            break;
+        default:
+            (void)fprintf(stderr, "[fakex] unhandled sync request %u\n", request[1]);
+            fakex_error(X_ERROR_BAD_REQUEST, SYNC_OPCODE, request[1]);
+            return;
+    }
+    fakex_error(X_ERROR_BAD_VALUE, SYNC_OPCODE, request[1]);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_present()
+///////////////////////////////////////////////////////////////////////////////
+/** Serve a Present request, only MSC notifications are supported.
+
+    A notification is always sent at the next refresh, i.e., as if asked for
+    with a divisor of 1 and a target MSC already passed.
+
+    @param request          the request
+*/
+static void fakex_present(const uint8_t *request) {
+    uint8_t reply[32] = { 0 };
+    switch (request[1]) {
+        case PRESENT_QUERY_VERSION:
+            put32(reply + 8, 1);
+            put32(reply + 12, 2);
+            fakex_reply(reply, 32, 0);
+            return;
+        case PRESENT_NOTIFY_MSC:
+            gs_fakex.present_serial  = get32(request + 8);
+            gs_fakex.present_pending = get32(request + 4) == gs_fakex.present_window;
+            return;
+        case PRESENT_SELECT_INPUT:
+            gs_fakex.present_eid    = get32(request + 4);
+            gs_fakex.present_window = get32(request + 8);
+            gs_fakex.present_mask   = get32(request + 12);
+            return;
+        default:
+            (void)fprintf(stderr, "[fakex] unhandled present request %u\n", request[1]);
+            fakex_error(X_ERROR_BAD_REQUEST, PRESENT_OPCODE, request[1]);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_refresh()
+///////////////////////////////////////////////////////////////////////////////
+/** Advance the MSC and send the CompleteNotify event due at this refresh, if any.
+*/
+static void fakex_refresh(void) {
+    const uint64_t now = now_ns();
+    while (gs_fakex.next_msc_ns <= now) {
+        gs_fakex.msc++;
+        gs_fakex.next_msc_ns += FAKEX_REFRESH_NS;
+    }
+    if (!gs_fakex.present_pending) {
+        return;
+    }
+    gs_fakex.present_pending = false;
+    if (!(gs_fakex.present_mask & PRESENT_EVENT_MASK_COMPLETE_NOTIFY)) {
+        return;
+    }
+    uint8_t event[40] = { X_GE_GENERIC, PRESENT_OPCODE };
+    const uint64_t ust = now / 1000;
+    put16(event + 2, gs_fakex.sequence);
+    put32(event + 4, 2);
+    put16(event + 8, PRESENT_COMPLETE_NOTIFY);
+    event[10] = PRESENT_COMPLETE_KIND_NOTIFY_MSC;
+    put32(event + 12, gs_fakex.present_eid);
+    put32(event + 16, gs_fakex.present_window);
+    put32(event + 20, gs_fakex.present_serial);
+    memcpy(event + 24, &ust, sizeof(ust));
+    memcpy(event + 32, &gs_fakex.msc, sizeof(gs_fakex.msc));
+    gs_fakex.msc_notifications++;
+    (void)send_all(event, sizeof(event));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_alarm_notify()
+///////////////////////////////////////////////////////////////////////////////
+/** Send an AlarmNotify event.
+
+    @param palarm           the alarm that triggered
+    @param idle_ms          the IDLETIME counter's value
+*/
+static void fakex_alarm_notify(const struct Tfakexalarm *palarm, const uint32_t idle_ms) {
+    uint8_t event[32] = { SYNC_FIRST_EVENT + 1 };
+    put16(event + 2, gs_fakex.sequence);
+    put32(event + 4, palarm->id);
+    put32(event + 12, idle_ms);
+    put32(event + 20, palarm->value_ms);
+    (void)send_all(event, sizeof(event));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_alarm()
+///////////////////////////////////////////////////////////////////////////////
+/** Fire the idle alarms matching a screensaver toggle.
+
+    Turning on stands for the idle time rising across the lowest positive
+    transition alarm, turning off for user input resetting the idle time
+    across every negative transition alarm.
+*/
+static void fakex_alarm(void) {
+    const struct Tfakexalarm *plowest = NULL;
+    for (uint32_t a = 0; a < gs_fakex.num_alarms; a++) {
+        const struct Tfakexalarm *palarm = &gs_fakex.alarms[a];
+        if (!gs_fakex.screensaver_state && palarm->test_type == SYNC_TESTTYPE_NEGATIVE_TRANSITION) {
+            fakex_alarm_notify(palarm, 0);
+        } else if (gs_fakex.screensaver_state && palarm->test_type == SYNC_TESTTYPE_POSITIVE_TRANSITION &&
+                   (!plowest || palarm->value_ms < plowest->value_ms)) {
+            plowest = palarm;
+        }
+    }
+    if (plowest) {
+        fakex_alarm_notify(plowest, plowest->value_ms);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_uevent_send()
+///////////////////////////////////////////////////////////////////////////////
+/** Send the kernel's uevent of a mains adapter, the first one is `AC`, the others `ACn`.
+
+    @param action           the uevent's action, e.g., "change"
+    @param adapter          the adapter's index
+    @param online           whether the adapter is online
+*/
+static void fakex_uevent_send(const char *action, const uint8_t adapter, const bool online) {
+    char uevent[320];
+    char name[8];
+    if (adapter == 0) {
+        (void)snprintf(name, sizeof(name), "AC");
+    } else {
+        (void)snprintf(name, sizeof(name), "AC%u", adapter);
+    }
+    const int length = snprintf(uevent, sizeof(uevent),
+        "%s@/devices/LNXSYSTM:00/LNXSYBUS:00/ACPI0003:0%u/power_supply/%s%c"
+        "ACTION=%s%cDEVPATH=/devices/LNXSYSTM:00/LNXSYBUS:00/ACPI0003:0%u/power_supply/%s%c"
+        "SUBSYSTEM=power_supply%cPOWER_SUPPLY_NAME=%s%cPOWER_SUPPLY_TYPE=Mains%cPOWER_SUPPLY_ONLINE=%d%cSEQNUM=%u",
+        action, adapter, name, 0, action, 0, adapter, name, 0, 0, name, 0, 0, online, 0, 4000 + gs_fakex.uevents);
+    if (length > 0 && send(gs_fakex.uevent_fd, uevent, (size_t)length + 1, MSG_DONTWAIT) > 0) {
+        gs_fakex.uevents++;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_uevent()
+///////////////////////////////////////////////////////////////////////////////
+/** Plug or unplug the first mains adapter.
+*/
+static void fakex_uevent(void) {
+    gs_fakex.next_uevent_ns = UINT64_MAX;
+    gs_fakex.mains_online = !gs_fakex.mains_online;
+    fakex_uevent_send("change", 0, gs_fakex.mains_online);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_notify()
+///////////////////////////////////////////////////////////////////////////////
+/** Toggle the screensaver and notify the client, or end the benchmark.
+
+    After the last cycle, brightnessd is sent SIGTERM, i.e., it exits as if
+    stopped by the user, printing its statistics. Every FAKEX_RESTART_EVERY
+    cycles, the server goes away instead of turning the screensaver off.
+
+    @return                 false if the server restarts, true otherwise
+*/
+static bool fakex_notify(void) {
+    if (gs_fakex.notifications == 2 * gs_fakex.cycles) {
+        (void)fprintf(stderr, "[fakex] %u cycles done: requests=%lu replies=%lu errors_injected=%lu msc_notifications=%lu restarts=%u uevents=%u bus_calls=%lu bus_errors=%lu bus_malformed=%lu bus_inflight_max=%u bus_drops=%u bus_connections=%u\n",
+            gs_fakex.cycles,
+            (unsigned long)gs_fakex.requests,
+            (unsigned long)gs_fakex.replies,
+            (unsigned long)gs_fakex.errors_injected,
+            (unsigned long)gs_fakex.msc_notifications,
+            gs_fakex.restarts,
+            gs_fakex.uevents,
+            (unsigned long)gs_fakexbus.calls,
+            (unsigned long)gs_fakexbus.errors,
+            (unsigned long)gs_fakexbus.malformed,
+            gs_fakexbus.inflight_max,
+            gs_fakexbus.drops,
+            gs_fakexbus.connections
+        );
+        gs_fakex.next_event_ns = UINT64_MAX;
+        (void)kill(getpid(), SIGTERM);
+        return true;
+    }
+    gs_fakex.notifications++;
+    if (gs_fakex.restart_every > 0 && gs_fakex.screensaver_state && (gs_fakex.notifications / 2) % gs_fakex.restart_every == 0) {
+        // the screensaver is off on the restarted server, fakex_start() clears the rest
+        gs_fakex.restarts++;
+        gs_fakex.screensaver_state = 0;
+        return false;
+    }
+    gs_fakex.screensaver_state = !gs_fakex.screensaver_state;
+    gs_fakex.next_event_ns     = now_ns() + (uint64_t)gs_fakex.period_ms * 1000000;
+    if (gs_fakex.screensaver_mask & 1) {
+        uint8_t event[32] = { SCREENSAVER_FIRST_EVENT, gs_fakex.screensaver_state };
+        put16(event + 2, gs_fakex.sequence);
+        put32(event + 8, FAKEX_ROOT);
+        put32(event + 12, FAKEX_ROOT);
+        event[16] = 2;
+        (void)send_all(event, sizeof(event));
+    }
+    fakex_alarm();
+    // halfway through the dimmed period, i.e., while brightnessd is idle
+    if (gs_fakex.power_every > 0 && gs_fakex.uevent_fd > 0 && gs_fakex.screensaver_state && (gs_fakex.notifications / 2 + 1) % gs_fakex.power_every == 0) {
+        gs_fakex.next_uevent_ns = now_ns() + (uint64_t)gs_fakex.period_ms * 500000;
+    }
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_serve()
+///////////////////////////////////////////////////////////////////////////////
+/** Thread body serving the client's requests and injecting the notifications.
+
+    @param arg              unused
+    @return                 NULL
+*/
+static void *fakex_serve(void *arg) {
+    (void)arg;
+    sigset_t signals;
+    (void)sigfillset(&signals);
+    (void)pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    if (!fakex_setup()) {
+        (void)close(gs_fakex.fd);
+        return NULL;
+    }
+    gs_fakex.next_event_ns = now_ns() + (gs_fakex.restarts > 0 ? (uint64_t)gs_fakex.period_ms * 1000000 : 1000000000);
+    gs_fakex.next_msc_ns   = now_ns() + FAKEX_REFRESH_NS;
+
+    while (true) {
+        const uint64_t now = now_ns();
+        if (now >= gs_fakex.next_event_ns) {
+            if (!fakex_notify()) {
+                break;
+            }
+            continue;
+        }
+        if (now >= gs_fakex.next_msc_ns) {
+            fakex_refresh();
+            continue;
+        }
+        if (now >= gs_fakex.next_uevent_ns) {
+            fakex_uevent();
+            continue;
+        }
+        // the refresh only needs a wakeup while a notification is pending
+        struct pollfd pollfd = { .fd = gs_fakex.fd, .events = POLLIN };
+        uint64_t next_ns = gs_fakex.present_pending && gs_fakex.next_msc_ns < gs_fakex.next_event_ns ? gs_fakex.next_msc_ns : gs_fakex.next_event_ns;
+        if (gs_fakex.next_uevent_ns < next_ns) {
+            next_ns = gs_fakex.next_uevent_ns;
+        }
+        const uint64_t wait_ms = next_ns == UINT64_MAX ? UINT64_MAX : (next_ns - now) / 1000000 + 1;
+        if (poll(&pollfd, 1, wait_ms > 60000 ? 60000 : (int)wait_ms) <= 0) {
+            continue;
+        }
+        ssize_t n = read(gs_fakex.fd, gs_fakex.in + gs_fakex.in_length, sizeof(gs_fakex.in) - gs_fakex.in_length);
+        if (n <= 0) {
+            // the client is gone, its last requests have all been served
+            (void)pthread_mutex_lock(&gs_fakex.closed_mutex);
+            gs_fakex.closed = true;
+            (void)pthread_cond_signal(&gs_fakex.closed_cond);
+            (void)pthread_mutex_unlock(&gs_fakex.closed_mutex);
+            break;
+        }
+        gs_fakex.in_length += (size_t)n;
+
+        size_t offset = 0;
+        while (gs_fakex.in_length - offset >= 4) {
+            const uint8_t *request = gs_fakex.in + offset;
+            const size_t length = 4 * (size_t)get16(request + 2);
+            if (length == 0) {
+                (void)fprintf(stderr, "[fakex] big requests are not served\n");
+                (void)close(gs_fakex.fd);
+                return NULL;
+            }
+            if (gs_fakex.in_length - offset < length) {
+                break;
+            }
+            gs_fakex.sequence++;
+            gs_fakex.requests++;
+            if (gs_fakex.latency_us > 0) {
+                const struct timespec latency = {
+                    .tv_sec  = gs_fakex.latency_us / 1000000,
+                    .tv_nsec = (long)(gs_fakex.latency_us % 1000000) * 1000
+                };
+                (void)nanosleep(&latency, NULL);
+            }
+            switch (request[0]) {
+                case RANDR_OPCODE:       fakex_randr(request);       break;
+                case SCREENSAVER_OPCODE: fakex_screensaver(request); break;
+                case DPMS_OPCODE:        fakex_dpms(request);        break;
+                case SYNC_OPCODE:        fakex_sync(request);        break;
+                case PRESENT_OPCODE:     fakex_present(request);     break;
+                default:                 fakex_core(request);        break;
+            }
+            offset += length;
+        }
+        memmove(gs_fakex.in, gs_fakex.in + offset, gs_fakex.in_length - offset);
+        gs_fakex.in_length -= offset;
+    }
+    (void)close(gs_fakex.fd);
+    return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_stop()
+///////////////////////////////////////////////////////////////////////////////
+/** Tell how the gamma ramps have been left, if any output is dimmed by gamma.
+
+    Registered with atexit() to run after brightnessd released its connection,
+    it waits for the server to have served the last requests, e.g., the ramps
+    restored on exit, and counts the crtcs whose ramps differ from those they
+    started with.
+*/
+void fakex_stop(void) {
+    if (gs_fakex.gamma_outputs == 0) {
+        return;
+    }
+    struct timespec deadline;
+    (void)clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += FAKEX_EXIT_WAIT_S;
+    (void)pthread_mutex_lock(&gs_fakex.closed_mutex);
+    while (!gs_fakex.closed && pthread_cond_timedwait(&gs_fakex.closed_cond, &gs_fakex.closed_mutex, &deadline) == 0) {}
+    const bool closed = gs_fakex.closed;
+    (void)pthread_mutex_unlock(&gs_fakex.closed_mutex);
+
+    uint32_t changed = 0;
+    for (uint8_t o = 0; o < gs_fakex.num_outputs; o++) {
+        changed += gamma_changed(o);
+    }
+    (void)fprintf(stderr, "[fakex] gamma on exit: closed=%d gamma_sets=%lu gamma_dimmed=%u gamma_changed=%u\n",
+        closed, (unsigned long)gs_fakex.gamma_sets, gs_fakex.gamma_dimmed, changed);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_start()
+///////////////////////////////////////////////////////////////////////////////
+/** Start the fake X server, or restart it for a reconnecting client.
+
+    A restarted server keeps its atoms, outputs and backlight levels, but
+    none of the client's resources and selections.
+
+    @return                 the client's end of the connection for xcb_connect_to_fd(), or -1 on error
+*/
+int fakex_start(void) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        return -1;
+    }
+    gs_fakex.fd               = fds[1];
+    gs_fakex.in_length        = 0;
+    gs_fakex.sequence         = 0;
+    gs_fakex.randr_mask       = 0;
+    gs_fakex.screensaver_mask = 0;
+    gs_fakex.num_alarms       = 0;
+    gs_fakex.dpms_events      = false;
+    gs_fakex.present_mask     = 0;
+    gs_fakex.present_pending  = false;
+    gs_fakex.closed           = false;
+    if (gs_fakex.num_atoms == 0) {
+        gs_fakex.num_outputs   = (uint8_t)env_uint("FAKEX_OUTPUTS", 1);
+        gs_fakex.latency_us    = env_uint("FAKEX_LATENCY_US", 0);
+        gs_fakex.error_percent = env_uint("FAKEX_ERROR_PERCENT", 0);
+        gs_fakex.cycles        = env_uint("FAKEX_CYCLES", 100);
+        gs_fakex.period_ms     = env_uint("FAKEX_PERIOD_MS", 20);
+        gs_fakex.restart_every = env_uint("FAKEX_RESTART_EVERY", 0);
+        gs_fakex.power_every   = env_uint("FAKEX_POWER_EVERY", 0);
+        gs_fakex.mains_online  = true;
+        gs_fakex.next_uevent_ns = UINT64_MAX;
+        if (gs_fakex.num_outputs < 1 || gs_fakex.num_outputs > FAKEX_MAX_OUTPUTS) {
+            gs_fakex.num_outputs = 1;
+        }
+        gs_fakex.gamma_outputs = env_uint("FAKEX_GAMMA_OUTPUTS", 0);
+        gs_fakex.backlight_atom = (uint8_t)fakex_intern("Backlight", strlen("Backlight"), false);
+        (void)fakex_intern("EDID", strlen("EDID"), false);
+        for (uint8_t o = 0; o < gs_fakex.num_outputs; o++) {
+            gs_fakex.brightness[o] = FAKEX_BRIGHTNESS_MAX;
+            for (uint32_t channel = 0; channel < 3; channel++) {
+                for (uint32_t i = 0; i < FAKEX_GAMMA_SIZE; i++) {
+                    gs_fakex.gamma[o][channel * FAKEX_GAMMA_SIZE + i] = gamma_original(o, channel, i);
+                }
+            }
+        }
+        (void)pthread_mutex_init(&gs_fakex.closed_mutex, NULL);
+        (void)pthread_cond_init(&gs_fakex.closed_cond, NULL);
+        srand(1);
+    }
+    if (pthread_create(&gs_fakex.thread, NULL, fakex_serve, NULL) != 0) {
+        (void)close(fds[0]);
+        (void)close(fds[1]);
+        return -1;
+    }
+    (void)pthread_detach(gs_fakex.thread);
+    return fds[0];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_uevents()
+///////////////////////////////////////////////////////////////////////////////
+/** Open the stand-in for the kernel's uevent netlink socket.
+
+    The `FAKEX_ADAPTERS` adapters are announced right away by an `add`
+    uevent each, all of them online.
+
+    @return                 the client's end of a datagram socketpair, or -1 on error
+*/
+int fakex_uevents(void) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0) {
+        return -1;
+    }
+    gs_fakex.uevent_fd    = fds[1];
+    gs_fakex.mains_online = true;
+    gs_fakex.adapters     = (uint8_t)env_uint("FAKEX_ADAPTERS", 1);
+    if (gs_fakex.adapters < 1 || gs_fakex.adapters > FAKEX_MAX_ADAPTERS) {
+        gs_fakex.adapters = 1;
+    }
+    for (uint8_t a = 0; a < gs_fakex.adapters; a++) {
+        fakex_uevent_send("add", a, true);
+    }
+    return fds[0];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_bus_receive()
+///////////////////////////////////////////////////////////////////////////////
+/** Read exactly a number of bytes from the mock bus' client.
+
+    @param fd               the server's end of the connection
+    @param data             where to put the bytes
+    @param length           the number of bytes
+    @return                 false once the client is gone
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static bool fakex_bus_receive(const int fd, uint8_t *data, size_t length) {
+    while (length > 0) {
+        const ssize_t count = read(fd, data, length);
+        if (count < 0 && errno == EINTR) { continue; }
+        if (count <= 0) { return false; }
+        data   += count;
+        length -= (size_t)count;
+    }
+    return true;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_bus_parse()
+///////////////////////////////////////////////////////////////////////////////
+/** Check that a message is a well-formed method call, either `Hello` or `SetBrightness`.
+
+    The header must be little-endian, of protocol version 1, and its fields
+    properly aligned and terminated; `SetBrightness` must call logind's
+    session `auto` for the device named by SYSFS_BACKLIGHT_PATH, with a body
+    of exactly the `ssu` it announces.
+
+    @param message          the message
+    @param length           the message's length
+    @param pcall            the call's serial, and value if any, on success
+    @return                 true if well-formed, false otherwise
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static bool fakex_bus_parse(const uint8_t *message, const size_t length, struct Tfakexcall *pcall) {
+    const char *fields[FAKEX_BUS_FIELDS] = { NULL };
+    const size_t fields_end = 16 + get32(message + 12);
+    const size_t body       = (fields_end + 7) & ~(size_t)7;
+    if (message[0] != 'l' || message[1] != 1 || message[3] != 1 || (pcall->serial = get32(message + 8)) == 0 ||
+        body + get32(message + 4) != length) {
+        return false;
+    }
+    size_t offset = 16;
+    while (offset < fields_end) {
+        offset = (offset + 7) & ~(size_t)7;
+        if (offset + 4 > fields_end || message[offset + 1] != 1 || message[offset + 3] != '\0') {
+            return false;
+        }
+        const uint8_t code = message[offset];
+        const char    type = (char)message[offset + 2];
+        const char   *value;
+        offset += 4;
+        if (type == 's' || type == 'o') {
+            offset = (offset + 3) & ~(size_t)3;
+            const size_t string_length = offset + 4 <= fields_end ? get32(message + offset) : fields_end;
+            value   = (const char *)message + offset + 4;
+            offset += 4 + string_length + 1;
+        } else if (type == 'g') {
+            const size_t string_length = message[offset];
+            value   = (const char *)message + offset + 1;
+            offset += 1 + string_length + 1;
+        } else {
+            return false;
+        }
+        if (offset > fields_end || message[offset - 1] != '\0' || code >= FAKEX_BUS_FIELDS || fields[code]) {
+            return false;
+        }
+        fields[code] = value;
+    }
+    if (offset != fields_end || !fields[1] || !fields[2] || !fields[3] || !fields[6]) {
+        return false;
+    }
+    pcall->set_brightness = false;
+    if (strcmp(fields[3], "Hello") == 0) {
+        return strcmp(fields[1], "/org/freedesktop/DBus") == 0 && strcmp(fields[2], "org.freedesktop.DBus") == 0 &&
+               strcmp(fields[6], "org.freedesktop.DBus") == 0 && !fields[8] && body == length;
+    }
+    if (strcmp(fields[3], "SetBrightness") != 0 || strcmp(fields[1], "/org/freedesktop/login1/session/auto") != 0 ||
+        strcmp(fields[2], "org.freedesktop.login1.Session") != 0 || strcmp(fields[6], "org.freedesktop.login1") != 0 ||
+        !fields[8] || strcmp(fields[8], "ssu") != 0) {
+        return false;
+    }
+    // the body: the subsystem and name of SYSFS_BACKLIGHT_PATH, then the value
+    char device[] = SYSFS_BACKLIGHT_PATH;
+    size_t device_length = strlen(device);
+    while (device_length > 1 && device[device_length - 1] == '/') {
+        device[--device_length] = '\0';
+    }
+    char *name = strrchr(device, '/');
+    if (!name) {
+        return false;
+    }
+    *name++ = '\0';
+    const char *subsystem = strrchr(device, '/') ? strrchr(device, '/') + 1 : device;
+    const char *strings[2] = { subsystem, name };
+    offset = body;
+    for (uint8_t s = 0; s < 2; s++) {
+        const size_t string_length = strlen(strings[s]);
+        offset = (offset + 3) & ~(size_t)3;
+        if (offset + 4 + string_length + 1 > length || get32(message + offset) != string_length ||
+            memcmp(message + offset + 4, strings[s], string_length + 1) != 0) {
+            return false;
+        }
+        offset += 4 + string_length + 1;
+    }
+    offset = (offset + 3) & ~(size_t)3;
+    if (offset + 4 != length) {
+        return false;
+    }
+    pcall->value          = get32(message + offset);
+    pcall->set_brightness = true;
+    return true;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_bus_reply()
+///////////////////////////////////////////////////////////////////////////////
+/** Answer a call by an empty method return, or by an error.
+
+    @param fd               the server's end of the connection
+    @param serial           the serial of the call answered
+    @param error            whether to answer by an error
+    @return                 false once the client is gone
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static bool fakex_bus_reply(const int fd, const uint32_t serial, const bool error) {
+    const char error_name[] = "org.freedesktop.DBus.Error.AccessDenied";
+    uint8_t reply[32 + sizeof(error_name) + 7] = { 'l', error ? 3 : 2, 1, 1 }; // ERROR or METHOD_RETURN, NO_REPLY_EXPECTED
+    put32(reply + 8, ++gs_fakexbus.replies);
+    reply[16] = 5; // REPLY_SERIAL
+    reply[17] = 1;
+    reply[18] = 'u';
+    put32(reply + 20, serial);
+    size_t length = 24;
+    if (error) {
+        reply[24] = 4; // ERROR_NAME
+        reply[25] = 1;
+        reply[26] = 's';
+        put32(reply + 28, (uint32_t)strlen(error_name));
+        memcpy(reply + 32, error_name, sizeof(error_name));
+        length = 32 + sizeof(error_name);
+    }
+    put32(reply + 12, (uint32_t)(length - 16));
+    length = (length + 7) & ~(size_t)7;
+    return write(fd, reply, length) == (ssize_t)length;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_bus_serve()
+///////////////////////////////////////////////////////////////////////////////
+/** Serve the mock bus: authenticate, then answer every method call.
+
+    Before answering the oldest call, all calls the client has sent so far
+    are taken, i.e., those not answered yet are the calls in flight. A
+    `SetBrightness` call writes its value to the brightness file, unless it
+    is answered by an error. After FAKEX_BUS_DROP_AFTER such calls, the
+    connection is closed. With FAKEX_BUS_REORDER, the newest call is
+    answered first instead; with FAKEX_BUS_MUTE, a connection made again is
+    never authenticated.
+
+    @param arg              the server's end of the connection
+    @return                 NULL
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+static void *fakex_bus_serve(void *arg) {
+    const int fd = (int)(intptr_t)arg;
+    sigset_t signals;
+    (void)sigfillset(&signals);
+    (void)pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    const int brightness_fd = open(SYSFS_BACKLIGHT_PATH "brightness", O_WRONLY | O_CLOEXEC);
+
+    // a NUL, the AUTH line, and after the OK, the BEGIN line
+    uint8_t message[FAKEX_BUS_MESSAGE_MAX];
+    size_t length = 0;
+    while (length < 2 || memcmp(message + length - 2, "\r\n", 2) != 0) {
+        if (length == sizeof(message) || !fakex_bus_receive(fd, message + length, 1)) {
+            goto out;
+        }
+        length++;
+    }
+    // counted before the client got the connection to authenticate on
+    if (gs_fakexbus.mute && gs_fakexbus.connections > 1) {
+        while (fakex_bus_receive(fd, message, 1)) {}
+        goto out;
+    }
+    const char ok[] = "OK 0123456789abcdef0123456789abcdef\r\n";
+    if (write(fd, ok, strlen(ok)) != (ssize_t)strlen(ok) || !fakex_bus_receive(fd, message, strlen("BEGIN\r\n"))) {
+        goto out;
+    }
+
+    struct Tfakexcall queue[FAKEX_BUS_MAX_QUEUE];
+    uint32_t queued = 0;
+    uint32_t calls  = 0;
+    while (true) {
+        struct pollfd pollfd = { .fd = fd, .events = POLLIN };
+        while (queued < FAKEX_BUS_MAX_QUEUE && poll(&pollfd, 1, queued == 0 ? -1 : 0) == 1) {
+            if (!fakex_bus_receive(fd, message, 16)) {
+                goto out;
+            }
+            length = ((16 + get32(message + 12) + 7) & ~(size_t)7) + get32(message + 4);
+            if (length > sizeof(message) || !fakex_bus_receive(fd, message + 16, length - 16)) {
+                goto out;
+            }
+            struct Tfakexcall *pcall = &queue[queued++];
+            if (!fakex_bus_parse(message, length, pcall)) {
+                gs_fakexbus.malformed++;
+                pcall->set_brightness = false;
+            }
+            uint32_t inflight = 0;
+            for (uint32_t q = 0; q < queued; q++) {
+                inflight += queue[q].set_brightness;
+            }
+            if (inflight > gs_fakexbus.inflight_max) {
+                gs_fakexbus.inflight_max = inflight;
+            }
+        }
+        if (queued == 0) {
+            continue;
+        }
+        if (gs_fakexbus.latency_us > 0) {
+            const struct timespec latency = {
+                .tv_sec  = gs_fakexbus.latency_us / 1000000,
+                .tv_nsec = (long)(gs_fakexbus.latency_us % 1000000) * 1000
+            };
+            (void)nanosleep(&latency, NULL);
+        }
+        const uint32_t answered = gs_fakexbus.reorder ? queued - 1 : 0;
+        const struct Tfakexcall call = queue[answered];
+        memmove(&queue[answered], &queue[answered + 1], (--queued - answered) * sizeof(queue[0]));
+        bool error = false;
+        if (call.set_brightness) {
+            gs_fakexbus.calls++;
+            error = gs_fakexbus.error_percent > 0 && (uint32_t)rand_r(&gs_fakexbus.seed) % 100 < gs_fakexbus.error_percent;
+            if (error) {
+                gs_fakexbus.errors++;
+            } else if (brightness_fd >= 0) {
+                char value[16];
+                const int value_length = snprintf(value, sizeof(value), "%u", call.value);
+                (void)pwrite(brightness_fd, value, (size_t)value_length, 0);
+            }
+        }
+        if (!fakex_bus_reply(fd, call.serial, error)) {
+            break;
+        }
+        if (call.set_brightness && ++calls == gs_fakexbus.drop_after) {
+            gs_fakexbus.drops++;
+            break;
+        }
+    }
+out:
+    if (brightness_fd >= 0) {
+        (void)close(brightness_fd);
+    }
+    (void)close(fd);
+    return NULL;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fakex_bus()
+///////////////////////////////////////////////////////////////////////////////
+/** Start the mock system bus for logind's SetBrightness.
+
+    Called again once the client lost the connection, up to FAKEX_BUS_CONNECTIONS times.
+
+    @return                 the client's end of the connection, or -1 on error
+*/
+#ifdef USE_SYSFS_BACKLIGHT_CONTROL
+int fakex_bus(void) {
+    if (gs_fakexbus.connections == 0) {
+        gs_fakexbus.latency_us      = env_uint("FAKEX_BUS_LATENCY_US", 0);
+        gs_fakexbus.error_percent   = env_uint("FAKEX_BUS_ERROR_PERCENT", 0);
+        gs_fakexbus.drop_after      = env_uint("FAKEX_BUS_DROP_AFTER", 0);
+        gs_fakexbus.max_connections = env_uint("FAKEX_BUS_CONNECTIONS", 0);
+        gs_fakexbus.reorder         = env_uint("FAKEX_BUS_REORDER", 0);
+        gs_fakexbus.mute            = env_uint("FAKEX_BUS_MUTE", 0);
+        gs_fakexbus.seed            = 1;
+    } else if (gs_fakexbus.max_connections > 0 && gs_fakexbus.connections == gs_fakexbus.max_connections) {
+        return -1;
+    }
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        return -1;
+    }
+    if (pthread_create(&gs_fakexbus.thread, NULL, fakex_bus_serve, (void *)(intptr_t)fds[1]) != 0) {
+        (void)close(fds[0]);
+        (void)close(fds[1]);
+        return -1;
+    }
+    (void)pthread_detach(gs_fakexbus.thread);
+    gs_fakexbus.connections++;
+    return fds[0];
+}
+#endif
+
+// vim: expandtab tabstop=4 shiftwidth=4
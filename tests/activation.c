@@ -0,0 +1,227 @@
+/*
+ * Copyright © 2015 Christian Storm <Christian.Storm at tngtech dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * A minimal session manager checking socket activation and readiness notification.
+ *
+ * Binds a listening unix socket and a datagram notification socket in a
+ * temporary directory, then starts brightnessd the way systemd would: the
+ * listening socket as file descriptor 3, `LISTEN_PID` and `LISTEN_FDS=1`
+ * naming it, and `NOTIFY_SOCKET` naming the notification socket.
+ * `XDG_RUNTIME_DIR` is unset, so brightnessd has no socket of its own to fall
+ * back on. The check passes if brightnessd sends `READY=1` with its own
+ * `MAINPID`, serves the status on the passed socket, and exits cleanly on
+ * SIGTERM.
+ *
+ * usage: tests/activation BRIGHTNESSD [ARGS...]   (make fakex)
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define ACTIVATION_TIMEOUT_MS 10000
+#define ACTIVATION_FD 3
+
+static char gs_directory[] = "/tmp/brightnessd-activation.XXXXXX";
+static char gs_listen_path[sizeof(gs_directory) + 16];
+static char gs_notify_path[sizeof(gs_directory) + 16];
+static char gs_log_path[sizeof(gs_directory) + 16];
+static pid_t gs_child = -1;
+
+static void cleanup(void);
+static int bind_socket(const int type, const char *path);
+static bool receive(const int fd, char *buffer, const size_t size);
+static void fail(const char *reason);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// cleanup()
+///////////////////////////////////////////////////////////////////////////////
+/** Stop brightnessd if still running and remove the temporary directory.
+*/
+static void cleanup(void) {
+    if (gs_child > 0) {
+        (void)kill(gs_child, SIGKILL);
+        (void)waitpid(gs_child, NULL, 0);
+        gs_child = -1;
+    }
+    (void)unlink(gs_listen_path);
+    (void)unlink(gs_notify_path);
+    (void)unlink(gs_log_path);
+    (void)rmdir(gs_directory);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fail()
+///////////////////////////////////////////////////////////////////////////////
+/** Report the check as failed along with brightnessd's output and exit.
+
+    @param reason           what went wrong
+*/
+static void fail(const char *reason) {
+    (void)fprintf(stderr, "FAIL: activation: %s\n", reason);
+    FILE *log = fopen(gs_log_path, "r");
+    if (log) {
+        char line[512];
+        while (fgets(line, sizeof(line), log)) {
+            (void)fprintf(stderr, "    %s", line);
+        }
+        (void)fclose(log);
+    }
+    exit(EXIT_FAILURE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// bind_socket()
+///////////////////////////////////////////////////////////////////////////////
+/** Create a unix socket bound to a path.
+
+    @param type             SOCK_STREAM or SOCK_DGRAM
+    @param path             the path to bind to
+    @return                 the socket, or -1 on error
+*/
+static int bind_socket(const int type, const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    (void)snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, type, 0);
+    if (fd < 0 || bind(fd, (const struct sockaddr *)&address, sizeof(address)) < 0) {
+        return -1;
+    }
+    return fd;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// receive()
+///////////////////////////////////////////////////////////////////////////////
+/** Wait for and read data from a socket.
+
+    @param fd               the socket
+    @param buffer           the buffer to read into, NUL-terminated on success
+    @param size             size of `buffer`
+    @return                 true if data was read within ACTIVATION_TIMEOUT_MS, false otherwise
+*/
+static bool receive(const int fd, char *buffer, const size_t size) {
+    struct pollfd pollfd = { .fd = fd, .events = POLLIN };
+    if (poll(&pollfd, 1, ACTIVATION_TIMEOUT_MS) != 1) {
+        return false;
+    }
+    ssize_t length = recv(fd, buffer, size - 1, 0);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// main()
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        (void)fprintf(stderr, "usage: %s BRIGHTNESSD [ARGS...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!mkdtemp(gs_directory)) {
+        fail("cannot create a temporary directory");
+    }
+    (void)snprintf(gs_listen_path, sizeof(gs_listen_path), "%s/listen", gs_directory);
+    (void)snprintf(gs_notify_path, sizeof(gs_notify_path), "%s/notify", gs_directory);
+    (void)snprintf(gs_log_path, sizeof(gs_log_path), "%s/log", gs_directory);
+    atexit(cleanup);
+
+    int listen_fd = bind_socket(SOCK_STREAM, gs_listen_path);
+    int notify_fd = bind_socket(SOCK_DGRAM, gs_notify_path);
+    if (listen_fd < 0 || notify_fd < 0 || listen(listen_fd, 8) < 0) {
+        fail("cannot bind the sockets");
+    }
+
+    if ( (gs_child = fork()) < 0 ) {
+        fail("cannot fork");
+    }
+    if (gs_child == 0) {
+        char pid[16];
+        (void)snprintf(pid, sizeof(pid), "%ld", (long)getpid());
+        int log_fd = open(gs_log_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (log_fd < 0 || dup2(log_fd, STDOUT_FILENO) < 0 || dup2(log_fd, STDERR_FILENO) < 0 || dup2(listen_fd, ACTIVATION_FD) < 0) {
+            _exit(127);
+        }
+        (void)setenv("LISTEN_PID", pid, 1);
+        (void)setenv("LISTEN_FDS", "1", 1);
+        (void)setenv("NOTIFY_SOCKET", gs_notify_path, 1);
+        (void)unsetenv("XDG_RUNTIME_DIR");
+        // keep the fake X server cycling until the check is done
+        (void)setenv("FAKEX_CYCLES", "1000000", 0);
+        (void)setenv("FAKEX_PERIOD_MS", "1000", 0);
+        execv(argv[1], &argv[1]);
+        _exit(127);
+    }
+    (void)close(listen_fd);
+
+    char buffer[256];
+    char mainpid[32];
+    if (!receive(notify_fd, buffer, sizeof(buffer))) {
+        fail("no readiness notification");
+    }
+    if (strncmp(buffer, "READY=1\n", strlen("READY=1\n")) != 0) {
+        fail("the notification does not start with READY=1");
+    }
+    (void)snprintf(mainpid, sizeof(mainpid), "MAINPID=%ld\n", (long)gs_child);
+    if (!strstr(buffer, mainpid)) {
+        fail("the notification does not name brightnessd's pid as MAINPID");
+    }
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    (void)snprintf(address.sun_path, sizeof(address.sun_path), "%s", gs_listen_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (const struct sockaddr *)&address, sizeof(address)) < 0) {
+        fail("cannot connect to the passed socket");
+    }
+    if (!receive(fd, buffer, sizeof(buffer)) || strncmp(buffer, "state=", strlen("state=")) != 0) {
+        fail("no status on the passed socket");
+    }
+    (void)close(fd);
+
+    int status;
+    (void)kill(gs_child, SIGTERM);
+    if (waitpid(gs_child, &status, 0) != gs_child) {
+        fail("cannot wait for brightnessd");
+    }
+    gs_child = -1;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fail("brightnessd did not exit cleanly on SIGTERM");
+    }
+    (void)printf("PASS: activation\n");
+    return EXIT_SUCCESS;
+}
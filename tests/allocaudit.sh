@@ -0,0 +1,20 @@
+#!/bin/sh
+# Runs the allocation audit build against the fake X server for a number of
+# screensaver cycles. Any allocation of brightnessd's own while handling a
+# state it has handled before makes it exit with EX_SOFTWARE.
+#
+# usage: tests/allocaudit.sh [BRIGHTNESSD]   (make fakex_allocaudit)
+
+. "$(dirname "$0")/common.sh"
+
+CYCLES=${CHECK_CYCLES:-100}
+
+FAKEX_CYCLES=$CYCLES FAKEX_PERIOD_MS=20 "$BRIGHTNESSD" >"$LOG" 2>&1
+status=$?
+[ $status -eq 0 ] || fail "exited with $status after $(stat iterations allocations) iterations"
+
+grep -q "\[fakex\] $CYCLES cycles done" "$LOG" || fail "did not run $CYCLES cycles"
+[ -n "$(stat total allocations)" ] || fail "not an allocation audit build"
+[ "$(stat iterations allocations)" -gt "$CYCLES" ] || fail "too few audited iterations"
+
+pass
@@ -0,0 +1,27 @@
+# Helpers shared by the check scripts, sourced with the brightnessd under test as $1.
+
+BRIGHTNESSD=${1:-./brightnessd}
+NAME=$(basename "$0" .sh)
+LOG=$(mktemp "${TMPDIR:-/tmp}/brightnessd-$NAME.XXXXXX")
+trap 'rm -f "$LOG"' EXIT
+
+fail() {
+    echo "FAIL: $NAME: $*" >&2
+    sed 's/^/    /' "$LOG" >&2
+    exit 1
+}
+
+skip() {
+    echo "SKIP: $NAME: $*"
+    exit 0
+}
+
+pass() {
+    echo "PASS: $NAME"
+    exit 0
+}
+
+# value of KEY in the last "[brightnessd::STATS] LINE: ... KEY=value ..." line of the log
+stat() {
+    grep "STATS\] $2:.* $1=" "$LOG" | tail -n 1 | sed -n "s/.* $1=\([0-9]*\).*/\1/p"
+}
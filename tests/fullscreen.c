@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2015 Christian Storm <Christian.Storm at tngtech dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Marks the root window as the focused fullscreen window the way a window
+ * manager would, by _NET_WM_STATE_FULLSCREEN in its _NET_WM_STATE and by
+ * naming it in _NET_ACTIVE_WINDOW, for brightnessd's fullscreen inhibit.
+ * The properties outlive the connection.
+ *
+ * usage: DISPLAY=:N tests/fullscreen   (tests/xvfb.sh)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+
+static xcb_atom_t intern(xcb_connection_t *connection, const char *name);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// intern()
+///////////////////////////////////////////////////////////////////////////////
+/** Get an atom by name.
+
+    @param connection       the X connection
+    @param name             the atom's name
+    @return                 the atom, or XCB_ATOM_NONE on error
+*/
+static xcb_atom_t intern(xcb_connection_t *connection, const char *name) {
+    xcb_atom_t atom = XCB_ATOM_NONE;
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(connection,
+        xcb_intern_atom(connection, 0, (uint16_t)strlen(name), name), NULL);
+    if (reply) {
+        atom = reply->atom;
+        free(reply);
+    }
+    return atom;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// main()
+///////////////////////////////////////////////////////////////////////////////
+int main(void) {
+    int screen_number = 0;
+    xcb_connection_t *connection = xcb_connect(NULL, &screen_number);
+    if (xcb_connection_has_error(connection)) {
+        (void)fprintf(stderr, "fullscreen: cannot connect to the X server\n");
+        return EXIT_FAILURE;
+    }
+    xcb_screen_iterator_t iterator = xcb_setup_roots_iterator(xcb_get_setup(connection));
+    for (; iterator.rem && screen_number > 0; screen_number--) {
+        xcb_screen_next(&iterator);
+    }
+    const xcb_window_t root = iterator.data->root;
+    const xcb_atom_t   wm_state   = intern(connection, "_NET_WM_STATE");
+    const xcb_atom_t   fullscreen = intern(connection, "_NET_WM_STATE_FULLSCREEN");
+    const xcb_atom_t   active     = intern(connection, "_NET_ACTIVE_WINDOW");
+    if (wm_state == XCB_ATOM_NONE || fullscreen == XCB_ATOM_NONE || active == XCB_ATOM_NONE) {
+        (void)fprintf(stderr, "fullscreen: cannot intern the atoms\n");
+        xcb_disconnect(connection);
+        return EXIT_FAILURE;
+    }
+
+    // the state first, so that it is in place once the window becomes active
+    (void)xcb_change_property(connection, XCB_PROP_MODE_REPLACE, root, wm_state, XCB_ATOM_ATOM, 32, 1, &fullscreen);
+    xcb_generic_error_t *error = xcb_request_check(connection,
+        xcb_change_property_checked(connection, XCB_PROP_MODE_REPLACE, root, active, XCB_ATOM_WINDOW, 32, 1, &root));
+    xcb_disconnect(connection);
+    if (error) {
+        (void)fprintf(stderr, "fullscreen: cannot set the properties (error %d)\n", error->error_code);
+        free(error);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
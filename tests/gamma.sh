@@ -0,0 +1,59 @@
+#!/bin/sh
+# Runs the fake X server build with --gamma on a backlit output and outputs
+# without backlight, each crtc starting with gamma ramps of its own. The
+# screensaver has to dim every gamma-dimmed crtc, and the ramps the server is
+# left with have to be the original ones: restored on reset after each cycle,
+# and restored on exit when terminated while dimmed. Also fades the ramps
+# paced by the fake server's Present refresh, the part of tests/xvfb.sh that
+# runs without Xvfb.
+#
+# usage: tests/gamma.sh [BRIGHTNESSD]   (make fakex)
+
+. "$(dirname "$0")/common.sh"
+
+OUTPUTS=3
+GAMMA_OUTPUTS=2
+CYCLES=2
+
+# value of KEY in the gamma line fakex prints once brightnessd is gone
+gamma() {
+    sed -n "s/.*\[fakex\] gamma on exit:.* $1=\([0-9]*\).*/\1/p" "$LOG" | tail -n 1
+}
+
+# check the ramps left behind after a run dimming DIMS times
+check() {
+    grep -q "\[fakex\] gamma on exit: closed=1" "$LOG" || fail "$1: the connection was not closed on exit"
+    [ "$(gamma gamma_dimmed)" -eq "$2" ] || fail "$1: dimmed $(gamma gamma_dimmed) times for $2"
+    [ "$(gamma gamma_changed)" -eq 0 ] || fail "$1: $(gamma gamma_changed) crtcs left with other ramps than their original ones"
+}
+
+FAKEX_OUTPUTS=$OUTPUTS FAKEX_GAMMA_OUTPUTS=$GAMMA_OUTPUTS FAKEX_CYCLES=$CYCLES FAKEX_PERIOD_MS=1500 \
+    "$BRIGHTNESSD" --gamma >"$LOG" 2>&1
+status=$?
+[ $status -eq 0 ] || fail "exited with $status"
+grep -q "\[fakex\] $CYCLES cycles done" "$LOG" || fail "did not run $CYCLES cycles"
+check "cycles" $((CYCLES * GAMMA_OUTPUTS))
+
+FAKEX_OUTPUTS=$OUTPUTS FAKEX_GAMMA_OUTPUTS=$GAMMA_OUTPUTS FAKEX_CYCLES=1 FAKEX_PERIOD_MS=4000 \
+    "$BRIGHTNESSD" --gamma >"$LOG" 2>&1 &
+pid=$!
+trap 'kill $pid 2>/dev/null; rm -f "$LOG"' EXIT
+# well after the dim, and well before the screensaver turns off again
+sleep 2.5
+kill -TERM $pid
+wait $pid
+status=$?
+pid=
+[ $status -eq 0 ] || fail "exited with $status when terminated while dimmed"
+grep -q "restoring original gamma ramps" "$LOG" || fail "did not restore the ramps on exit"
+check "terminated" $GAMMA_OUTPUTS
+
+FAKEX_OUTPUTS=$OUTPUTS FAKEX_GAMMA_OUTPUTS=$GAMMA_OUTPUTS FAKEX_CYCLES=1 FAKEX_PERIOD_MS=3000 \
+    "$BRIGHTNESSD" --gamma --fade-ms 800 >"$LOG" 2>&1
+status=$?
+[ $status -eq 0 ] || fail "exited with $status when fading"
+grep -q "fades are paced by msc notifications" "$LOG" || fail "fades are not paced by Present"
+[ "$(stat written fade)" -gt 1 ] || fail "faded in $(stat written fade) present frames"
+check "fading" $GAMMA_OUTPUTS
+
+pass
@@ -0,0 +1,68 @@
+#!/bin/sh
+# Runs the fake X server build of the sysfs backend with --writer logind
+# against the fake server's mock system bus, which checks every call's
+# marshalling. With a slow logind, at most 2 calls (LOGIND_MAX_INFLIGHT) may
+# be in flight and the steps of the fades are merged; calls answered by an
+# error are counted as such; replies out of order answer their own calls; a
+# dropped connection is made again, and if that fails, brightnessd exits
+# with EX_UNAVAILABLE, also if the bus does not authenticate it again.
+#
+# usage: tests/logind.sh [BRIGHTNESSD]   (make check_logind)
+
+. "$(dirname "$0")/common.sh"
+
+# the backlight the build's SYSFS_BACKLIGHT_PATH points at
+SYSFS=$(dirname "$0")/sysfs/backlight/fakex
+CYCLES=3
+BRIGHTNESS=900
+trap 'rm -f "$LOG"; rm -rf "$(dirname "$0")/sysfs"' EXIT
+
+mkdir -p "$SYSFS" || fail "cannot create $SYSFS"
+echo 1000 >"$SYSFS/max_brightness"
+ln -sf brightness "$SYSFS/actual_brightness"
+
+# value of KEY in the fake server's final statistics
+bus() {
+    grep "\[fakex\] $CYCLES cycles done" "$LOG" | sed -n "s/.* $1=\([0-9]*\).*/\1/p"
+}
+
+# run with the mock bus configured by the arguments, expecting exit STATUS
+run() {
+    status=$1
+    shift
+    echo $BRIGHTNESS >"$SYSFS/brightness"
+    env "$@" FAKEX_CYCLES=$CYCLES FAKEX_PERIOD_MS=1000 "$BRIGHTNESSD" --writer logind --fade-ms 800 >"$LOG" 2>&1
+    result=$?
+    [ $result -eq $status ] || fail "exited with $result instead of $status with $*"
+    [ $status -ne 0 ] && return
+    grep -q "\[fakex\] $CYCLES cycles done" "$LOG" || fail "did not run $CYCLES cycles with $*"
+    [ "$(bus bus_malformed)" -eq 0 ] || fail "$(bus bus_malformed) malformed calls with $*"
+    [ "$(bus bus_inflight_max)" -le 2 ] || fail "$(bus bus_inflight_max) calls in flight with $*"
+    [ "$(bus bus_calls)" -eq "$(stat submitted logind)" ] || fail "$(stat submitted logind) calls sent, $(bus bus_calls) received with $*"
+}
+
+run 0 FAKEX_BUS_LATENCY_US=50000
+[ "$(stat superseded logind)" -gt 0 ] || fail "no fade step merged with a slow logind"
+[ "$(cat "$SYSFS/brightness")" -eq $BRIGHTNESS ] || fail "brightness $(cat "$SYSFS/brightness") left instead of $BRIGHTNESS"
+
+run 0 FAKEX_BUS_ERROR_PERCENT=30
+[ "$(bus bus_errors)" -gt 0 ] || fail "no call answered by an error"
+[ "$(stat errors logind)" -eq "$(bus bus_errors)" ] || fail "$(stat errors logind) errors counted for $(bus bus_errors) error replies"
+[ "$(stat completed logind)" -eq "$(stat submitted logind)" ] || fail "$(stat completed logind) of $(stat submitted logind) calls answered"
+
+run 0 FAKEX_BUS_REORDER=1 FAKEX_BUS_LATENCY_US=50000
+[ "$(stat completed logind)" -eq "$(stat submitted logind)" ] || fail "$(stat completed logind) of $(stat submitted logind) calls answered out of order"
+[ "$(cat "$SYSFS/brightness")" -eq $BRIGHTNESS ] || fail "brightness $(cat "$SYSFS/brightness") left instead of $BRIGHTNESS with replies out of order"
+
+run 0 FAKEX_BUS_DROP_AFTER=7
+[ "$(bus bus_drops)" -gt 0 ] || fail "the bus never dropped the connection"
+[ "$(stat reconnects logind)" -eq "$(bus bus_drops)" ] || fail "$(stat reconnects logind) reconnects for $(bus bus_drops) drops"
+[ "$(cat "$SYSFS/brightness")" -eq $BRIGHTNESS ] || fail "brightness $(cat "$SYSFS/brightness") left instead of $BRIGHTNESS after reconnecting"
+
+# EX_UNAVAILABLE
+run 69 FAKEX_BUS_DROP_AFTER=7 FAKEX_BUS_CONNECTIONS=1
+grep -q "cannot reconnect to the system bus" "$LOG" || fail "no error on the failed reconnect"
+run 69 FAKEX_BUS_DROP_AFTER=7 FAKEX_BUS_MUTE=1
+grep -q "refused to authenticate" "$LOG" || fail "no error on the unanswered authentication"
+
+pass
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Runs the fake X server build plugging and unplugging a mains adapter while
+# the screen is dimmed. With a single adapter, each unplug switches to the
+# battery's dim level at once and each plug back to the ac's; with a second
+# adapter staying plugged in, the machine never runs on battery.
+#
+# usage: tests/uevents.sh [BRIGHTNESSD]   (make fakex)
+
+. "$(dirname "$0")/common.sh"
+
+CYCLES=8
+
+# run with ADAPTERS adapters, the first toggled every other cycle
+run() {
+    FAKEX_ADAPTERS=$1 FAKEX_CYCLES=$CYCLES FAKEX_PERIOD_MS=100 FAKEX_POWER_EVERY=2 \
+        "$BRIGHTNESSD" --battery-brightness 10:5 >"$LOG" 2>&1
+    status=$?
+    [ $status -eq 0 ] || fail "exited with $status with $1 adapters"
+    grep -q "\[fakex\] $CYCLES cycles done" "$LOG" || fail "did not run $CYCLES cycles with $1 adapters"
+    # the add uevents announcing the adapters come first
+    toggles=$(($(stat uevents power) - $1))
+    [ $toggles -gt 0 ] || fail "no adapter was toggled with $1 adapters"
+}
+
+run 1
+[ "$(stat switches power)" -eq $toggles ] || fail "switched $(stat switches power) times for $toggles toggles"
+grep -q "power source changed while dimmed, 40% -> 10%" "$LOG" || fail "not dimmed to the battery's level"
+grep -q "power source changed while dimmed, 10% -> 40%" "$LOG" || fail "not dimmed back to the ac's level"
+
+run 2
+[ "$(stat switches power)" -eq 0 ] || fail "switched $(stat switches power) times with an adapter left online"
+! grep -q "power source changed" "$LOG" || fail "changed the dim level with an adapter left online"
+
+pass
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Runs the fake X server build with a long period between the screensaver
+# notifications and takes the statistics twice while brightnessd sits dimmed
+# in between. Nothing but the signals asking for the statistics may wake it
+# up in that interval: no periodic timer, no polling, no busy worker.
+#
+# usage: tests/wakeups.sh [BRIGHTNESSD]   (make fakex)
+
+. "$(dirname "$0")/common.sh"
+
+# the screensaver turns on after 1s and off PERIOD_MS later
+PERIOD_MS=${CHECK_PERIOD_MS:-4000}
+
+# value of KEY in the Nth wakeups statistics line
+wakeups() {
+    grep "STATS\] wakeups:" "$LOG" | sed -n "$2p" | sed -n "s/.* $1=\([0-9]*\).*/\1/p"
+}
+
+FAKEX_CYCLES=1 FAKEX_PERIOD_MS=$PERIOD_MS "$BRIGHTNESSD" >"$LOG" 2>&1 &
+pid=$!
+trap 'kill $pid 2>/dev/null; rm -f "$LOG"' EXIT
+
+# settled after the dim, and well before the screensaver turns off again
+sleep 1.5
+kill -USR1 $pid
+sleep $(awk -v period="$PERIOD_MS" 'BEGIN { print (period - 1000) / 1000 }')
+kill -USR1 $pid
+wait $pid
+status=$?
+[ $status -eq 0 ] || fail "exited with $status"
+grep -q "\[fakex\] 1 cycles done" "$LOG" || fail "did not run the cycle"
+[ -n "$(wakeups signal 2)" ] || fail "no statistics while dimmed"
+
+for source in x timer worker uevent hook socket timeout; do
+    [ "$(wakeups $source 1)" -eq "$(wakeups $source 2)" ] \
+        || fail "woken up by $source $(($(wakeups $source 2) - $(wakeups $source 1))) times while idle"
+done
+[ "$(wakeups signal 2)" -gt "$(wakeups signal 1)" ] || fail "the second signal was not counted"
+
+pass
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Runs the fake X server build of the sysfs backend with --writer sync and
+# with --writer uring on the same number of screensaver cycles, and prints
+# the statistics telling how long the event loop spent issuing the writes
+# of a restore and how long the writes took, one writer after the other.
+# Fails if a run fails or a write is not confirmed, skips the io_uring run
+# if io_uring is unavailable and the writer thread took over.
+#
+# usage: tests/writers.sh [BRIGHTNESSD]   (make check_writers, CYCLES=N)
+
+. "$(dirname "$0")/common.sh"
+
+# the backlight the build's SYSFS_BACKLIGHT_PATH points at
+SYSFS=$(dirname "$0")/sysfs/backlight/fakex
+CYCLES=${CYCLES:-500}
+CACHE=$(mktemp -d "${TMPDIR:-/tmp}/brightnessd-$NAME.XXXXXX")
+trap 'rm -f "$LOG"; rm -rf "$CACHE" "$(dirname "$0")/sysfs"' EXIT
+
+mkdir -p "$SYSFS" || fail "cannot create $SYSFS"
+# every level from the dim to the full brightness has four digits: the files
+# are regular ones, which unlike sysfs keep the tail of a longer value
+echo 9999 >"$SYSFS/max_brightness"
+ln -sf brightness "$SYSFS/actual_brightness"
+
+# run with WRITER and print its restore and confirm statistics, and those named STATS
+run() {
+    echo 9999 >"$SYSFS/brightness"
+    XDG_CACHE_HOME=$CACHE FAKEX_CYCLES=$CYCLES FAKEX_PERIOD_MS=5 \
+        "$BRIGHTNESSD" --writer "$1" >"$LOG" 2>&1
+    status=$?
+    [ $status -eq 0 ] || fail "--writer $1 exited with $status"
+    grep -q "\[fakex\] $CYCLES cycles done" "$LOG" || fail "--writer $1 did not run $CYCLES cycles"
+    [ "$(stat failed confirm)" -eq 0 ] || fail "--writer $1 left $(stat failed confirm) writes unconfirmed"
+    grep "STATS\] \(restore\|confirm\|$2\):" "$LOG" | sed "s/^\[brightnessd::STATS\]/$1:/"
+}
+
+run sync restore
+run uring uring
+[ "$(stat submitted uring)" -gt 0 ] || skip "io_uring is unavailable"
+
+pass
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Runs a debug build against Xvfb, i.e., a real X server without a display:
+# the screensaver dims the screen by its gamma ramps in a fade paced by
+# Present's fake 60Hz clock and restores it on reset, and a focused
+# fullscreen window inhibits the dimming. Skipped without Xvfb and xrandr;
+# tests/gamma.sh fades and restores gamma ramps paced by Present against the
+# fake server instead.
+#
+# usage: tests/xvfb.sh [BRIGHTNESSD]   (make debug tests/fullscreen)
+
+. "$(dirname "$0")/common.sh"
+
+for tool in Xvfb xset xrandr; do
+    command -v $tool >/dev/null 2>&1 || skip "$tool is not installed"
+done
+
+display=${CHECK_DISPLAY:-99}
+while [ -e /tmp/.X$display-lock ] || [ -e /tmp/.X11-unix/X$display ]; do
+    display=$((display + 1))
+done
+Xvfb :$display -screen 0 640x480x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+pid=
+trap 'kill $pid $xvfb 2>/dev/null; rm -f "$LOG"' EXIT
+export DISPLAY=:$display
+
+# until COMMAND succeeds, for at most 5 seconds
+retry() {
+    tries=0
+    until "$@"; do
+        tries=$((tries + 1))
+        [ $tries -lt 50 ] || return 1
+        sleep 0.1
+    done
+}
+
+# the brightness xrandr derives from the first crtc's gamma ramps
+brightness() {
+    xrandr --verbose 2>/dev/null | sed -n 's/^[[:space:]]*Brightness: *\([0-9.]*\).*/\1/p' | head -n 1
+}
+
+# whether the brightness compares to VALUE by OP, e.g., brightness_is '<' 0.9
+brightness_is() {
+    awk -v brightness="$(brightness)" -v value="$2" "BEGIN { exit !(brightness != \"\" && brightness $1 value) }"
+}
+
+retry xset q >/dev/null 2>&1 || fail "Xvfb did not start"
+[ -n "$(brightness)" ] || skip "Xvfb has no gamma ramps"
+
+"$BRIGHTNESSD" --gamma --fade-ms 800 >"$LOG" 2>&1 &
+pid=$!
+retry grep -q "fades are paced by msc notifications" "$LOG" || fail "fades are not paced by Present"
+
+xset s activate
+retry brightness_is '<' 0.9 || fail "not dimmed on the screensaver, brightness $(brightness)"
+xset s reset
+retry brightness_is '>' 0.99 || fail "not restored on reset, brightness $(brightness)"
+
+"$(dirname "$0")/fullscreen" || fail "cannot mark a fullscreen window"
+sleep 0.5
+xset s activate
+sleep 2
+brightness_is '>' 0.99 || fail "dimmed with a fullscreen window focused, brightness $(brightness)"
+xset s reset
+
+kill -USR1 $pid
+retry grep -q "STATS\] fade:" "$LOG" || fail "no statistics"
+[ "$(stat dims_inhibited fullscreen)" -gt 0 ] || fail "no dim inhibited"
+[ "$(stat frames fade)" -gt 0 ] || fail "no present frames"
+
+kill $pid
+wait $pid
+status=$?
+pid=
+[ $status -eq 0 ] || fail "exited with $status"
+
+pass